@@ -17,6 +17,7 @@ Feel free to copy, use and enjoy according to the license provided.
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -75,11 +76,50 @@ Feel free to copy, use and enjoy according to the license provided.
 #define DEBUG_SPINLOCK 0
 #endif
 
+/* The number of hash sharded pub/sub channel collections (a power of 2) */
+#ifndef FIO_PUBSUB_CHANNEL_SHARDS
+#define FIO_PUBSUB_CHANNEL_SHARDS 16
+#endif
+
+/* Shared memory (SPSC ring) cluster IPC transport - requires eventfd (Linux) */
+#ifndef FIO_CLUSTER_SHM
+#define FIO_CLUSTER_SHM 0
+#endif
+#if FIO_CLUSTER_SHM && !defined(__linux__)
+#undef FIO_CLUSTER_SHM
+#define FIO_CLUSTER_SHM 0
+#endif
+
+/* The byte size of each shared memory ring (a power of 2) */
+#ifndef FIO_CLUSTER_SHM_RING_SIZE
+#define FIO_CLUSTER_SHM_RING_SIZE (1UL << 20)
+#endif
+
 /* Slowloris mitigation  (must be less than 1<<16) */
 #ifndef FIO_SLOWLORIS_LIMIT
 #define FIO_SLOWLORIS_LIMIT (1 << 10)
 #endif
 
+/* Connections accepted per listening socket event (fairness between sockets) */
+#ifndef FIO_ACCEPT_BATCH
+#define FIO_ACCEPT_BATCH 16
+#endif
+
+/* Reactor metrics (counters), set to 0 to disable */
+#ifndef FIO_METRICS
+#define FIO_METRICS 1
+#endif
+
+/* The number of per thread metrics shards (a power of 2) */
+#ifndef FIO_METRICS_SHARDS
+#define FIO_METRICS_SHARDS 16
+#endif
+
+/* Milliseconds between worker metrics reports to the root process */
+#ifndef FIO_METRICS_INTERVAL
+#define FIO_METRICS_INTERVAL 1000
+#endif
+
 #if !defined(__clang__) && !defined(__GNUC__)
 #define __thread _Thread_value
 #endif
@@ -139,6 +179,7 @@ typedef void (*fio_uuid_link_fn)(void *);
 #define FIO_SET_NAME fio_uuid_links
 #define FIO_SET_OBJ_TYPE fio_uuid_link_fn
 #define FIO_SET_OBJ_COMPARE(o1, o2) 1
+#define FIO_SET_SWISS 1
 #include <fio.h>
 
 /** User-space socket buffer data */
@@ -155,6 +196,14 @@ struct fio_packet_s {
   uintptr_t length;
 };
 
+/** A task waiting for the socket's queue to drain (see `fio_defer_on_drain`) */
+typedef struct fio_drain_s fio_drain_s;
+struct fio_drain_s {
+  fio_drain_s *next;
+  size_t pending;
+  fio_defer_iotask_args_s task;
+};
+
 /** Connection data (fd_data) */
 typedef struct {
   /* current data to be send */
@@ -183,6 +232,8 @@ typedef struct {
   uint8_t open;
   /** indicated that the connection should be closed. */
   uint8_t close;
+  /** a listening socket configured by `fio_sock_options` (inherited). */
+  uint8_t sock_options;
   /** peer address length */
   uint8_t addr_len;
   /** peer address length */
@@ -193,6 +244,8 @@ typedef struct {
   void *rw_udata;
   /* Objects linked to the UUID */
   fio_uuid_links_s links;
+  /* Tasks waiting for the queue to drain */
+  fio_drain_s *drain;
 } fio_fd_data_s;
 
 typedef struct {
@@ -290,7 +343,11 @@ static inline int fio_clear_fd(intptr_t fd, uint8_t is_open) {
   fio_rw_hook_s *rw_hooks;
   void *rw_udata;
   fio_uuid_links_s links;
+  fio_drain_s *drain;
+  intptr_t uuid;
   fio_lock(&(fd_data(fd).sock_lock));
+  uuid = fd2uuid(fd);
+  drain = fd_data(fd).drain;
   links = fd_data(fd).links;
   packet = fd_data(fd).packet;
   protocol = fd_data(fd).protocol;
@@ -303,6 +360,8 @@ static inline int fio_clear_fd(intptr_t fd, uint8_t is_open) {
       .rw_hooks = (fio_rw_hook_s *)&FIO_DEFAULT_RW_HOOKS,
       .counter = fd_data(fd).counter + 1,
       .packet_last = &fd_data(fd).packet,
+      /* new connections might wait for a protocol (i.e., a TLS handshake) */
+      .active = fio_data->last_cycle.tv_sec,
   };
   if (fio_data->max_protocol_fd < fd) {
     fio_data->max_protocol_fd = fd;
@@ -326,6 +385,13 @@ static inline int fio_clear_fd(intptr_t fd, uint8_t is_open) {
     }
   }
   fio_uuid_links_free(&links);
+  while (drain) {
+    /* the old uuid is no longer valid, so the fallback will be called */
+    fio_drain_s *tmp = drain;
+    drain = drain->next;
+    fio_defer_io_task FIO_IGNORE_MACRO(uuid, tmp->task);
+    fio_free(tmp);
+  }
   if (protocol && protocol->on_close) {
     fio_defer(deferred_on_close, (void *)fd2uuid(fd), protocol);
   }
@@ -535,6 +601,81 @@ invalid:
   return -1;
 }
 
+/* *****************************************************************************
+Reactor metrics (sharded counters)
+***************************************************************************** */
+
+/*
+ * Each thread updates its own shard (shards are padded to a cache line), so
+ * the atomic operations are uncontended unless there are more threads than
+ * shards. Shards are only summed when the counters are read.
+ */
+
+typedef union {
+  fio_metrics_s metrics;
+  uint8_t padding[(sizeof(fio_metrics_s) + 63) & (~(size_t)63)];
+} fio_metrics_shard_u;
+
+static fio_metrics_shard_u fio_metrics_shards[FIO_METRICS_SHARDS]
+    __attribute__((aligned(64)));
+static size_t fio_metrics_shard_counter;
+static __thread fio_metrics_s *fio_metrics_local;
+
+/** Returns the calling thread's metrics shard. */
+static inline fio_metrics_s *fio_metrics_shard(void) {
+  if (!fio_metrics_local) {
+    const size_t i = fio_atomic_add(&fio_metrics_shard_counter, 1);
+    fio_metrics_local =
+        &fio_metrics_shards[i & (FIO_METRICS_SHARDS - 1)].metrics;
+  }
+  return fio_metrics_local;
+}
+
+#if FIO_METRICS
+#define FIO_METRICS_ADD(field, count)                                          \
+  fio_atomic_add(&fio_metrics_shard()->field, (uint64_t)(count))
+#else
+#define FIO_METRICS_ADD(field, count) ((void)(count))
+#endif
+
+/** Adds the counters in `src` to `dest`. */
+static void fio_metrics_merge(fio_metrics_s *dest, const fio_metrics_s *src) {
+  const uint64_t max = (dest->queue_latency_max_ns > src->queue_latency_max_ns
+                            ? dest->queue_latency_max_ns
+                            : src->queue_latency_max_ns);
+  uint64_t *d = (uint64_t *)dest;
+  const uint64_t *s = (const uint64_t *)src;
+  for (size_t i = 0; i < sizeof(*dest) / sizeof(uint64_t); ++i)
+    d[i] += s[i];
+  dest->queue_latency_max_ns = max;
+}
+
+/** Records a task queue latency sample (nanoseconds). */
+static inline void fio_metrics_queue_latency(uint64_t ns) {
+#if FIO_METRICS
+  fio_metrics_s *m = fio_metrics_shard();
+  fio_atomic_add(&m->queue_latency_samples, 1);
+  fio_atomic_add(&m->queue_latency_ns, ns);
+  if (m->queue_latency_max_ns < ns)
+    m->queue_latency_max_ns = ns; /* a rare write, a lost race is harmless */
+#else
+  (void)ns;
+#endif
+}
+
+/** Returns the counters of the calling process (all threads). */
+fio_metrics_s fio_metrics(void) {
+  fio_metrics_s ret = {0};
+  for (size_t i = 0; i < FIO_METRICS_SHARDS; ++i)
+    fio_metrics_merge(&ret, &fio_metrics_shards[i].metrics);
+  return ret;
+}
+
+/** A new process starts counting from zero. */
+static void fio_metrics_on_fork(void) {
+  memset(fio_metrics_shards, 0, sizeof(fio_metrics_shards));
+}
+
 /* *****************************************************************************
 Section Start Marker
 
@@ -906,6 +1047,10 @@ static inline void fio_defer_push_task_fn(fio_defer_task_s task,
     queue->writer->state = 1;
   }
   fio_unlock(&queue->lock);
+  if (queue == &task_queue_urgent)
+    FIO_METRICS_ADD(tasks_urgent_queued, 1);
+  else
+    FIO_METRICS_ADD(tasks_queued, 1);
   return;
 
 critical_error:
@@ -1001,6 +1146,10 @@ fio_defer_perform_single_task_for_queue(fio_task_queue_s *queue) {
   fio_defer_task_s task = fio_defer_pop_task(queue);
   if (!task.func)
     return -1;
+  if (queue == &task_queue_urgent)
+    FIO_METRICS_ADD(tasks_urgent_performed, 1);
+  else
+    FIO_METRICS_ADD(tasks_performed, 1);
   task.func(task.arg1, task.arg2);
   return 0;
 }
@@ -1726,8 +1875,12 @@ static size_t fio_poll(void) {
         epoll_wait(internal[j].data.fd, events, FIO_POLL_MAX_EVENTS, 0);
     if (active_count > 0) {
       for (int i = 0; i < active_count; i++) {
-        if (events[i].events & (~(EPOLLIN | EPOLLOUT))) {
+        if ((events[i].events & (~(EPOLLIN | EPOLLOUT | EPOLLRDHUP))) ||
+            (events[i].events & (EPOLLIN | EPOLLRDHUP)) == EPOLLRDHUP) {
           // errors are hendled as disconnections (on_close)
+          /* a hangup without EPOLLIN was reported by the write set, so the
+           * connection isn't waiting on reads (i.e., it's suspended) and
+           * nothing would read the EOF */
           fio_force_close_in_poll(fd2uuid(events[i].data.fd));
         } else {
           // no error, then it's an active event(s)
@@ -1735,6 +1888,8 @@ static size_t fio_poll(void) {
             fio_defer_push_urgent(deferred_on_ready,
                                   (void *)fd2uuid(events[i].data.fd), NULL);
           }
+          /* a hangup reported with EPOLLIN is readable: the data sent before
+           * the hangup is read before `fio_read` encounters the EOF */
           if (events[i].events & EPOLLIN)
             fio_defer_push_task(deferred_on_data,
                                 (void *)fd2uuid(events[i].data.fd), NULL);
@@ -1871,7 +2026,9 @@ static size_t fio_poll(void) {
         fio_defer_push_task(deferred_on_data, (void *)fd2uuid(events[i].udata),
                             NULL);
       }
-      if (events[i].flags & (EV_EOF | EV_ERROR)) {
+      /* after EV_EOF, data might still be read (`fio_read` closes on EOF) */
+      if ((events[i].flags & EV_ERROR) ||
+          ((events[i].flags & EV_EOF) && events[i].filter != EVFILT_READ)) {
         fio_force_close_in_poll(fd2uuid(events[i].udata));
       }
     }
@@ -2348,6 +2505,27 @@ static void fio_tcp_addr_cpy(int fd, int family, struct sockaddr *addrinfo) {
   }
 }
 
+/* sets TCP_NODELAY and enlarges the socket buffers */
+static void fio_sock_options(int fd) {
+  // avoid the TCP delay algorithm.
+  {
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+  }
+  // handle socket buffers.
+  {
+    int optval = 0;
+    socklen_t size = (socklen_t)sizeof(optval);
+    if (!getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &optval, &size) &&
+        optval <= 131072) {
+      optval = 131072;
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &optval, sizeof(optval));
+      optval = 131072;
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval));
+    }
+  }
+}
+
 /**
  * `fio_accept` accepts a new socket connection from a server socket - see the
  * server flag on `fio_socket`.
@@ -2373,23 +2551,12 @@ intptr_t fio_accept(intptr_t srv_uuid) {
     return -1;
   }
 #endif
-  // avoid the TCP delay algorithm.
-  {
-    int optval = 1;
-    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
-  }
-  // handle socket buffers.
-  {
-    int optval = 0;
-    socklen_t size = (socklen_t)sizeof(optval);
-    if (!getsockopt(client, SOL_SOCKET, SO_SNDBUF, &optval, &size) &&
-        optval <= 131072) {
-      optval = 131072;
-      setsockopt(client, SOL_SOCKET, SO_SNDBUF, &optval, sizeof(optval));
-      optval = 131072;
-      setsockopt(client, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval));
-    }
-  }
+#if defined(__linux__)
+  /* TCP/IP sockets inherit these options from a listener we configured */
+  if (!uuid_data(srv_uuid).sock_options ||
+      ((struct sockaddr *)addrinfo)->sa_family == AF_UNIX)
+#endif
+    fio_sock_options(client);
 
   fio_lock(&fd_data(client).protocol_lock);
   fio_clear_fd(client, 1);
@@ -2467,7 +2634,7 @@ static intptr_t fio_unix_socket(const char *address, uint8_t server) {
 
 /* Creates a TCP/IP socket - returning it's uuid (or -1) */
 static intptr_t fio_tcp_socket(const char *address, const char *port,
-                               uint8_t server) {
+                               uint8_t server, uint8_t fastopen) {
   /* TCP/IP socket */
   // setup the address
   struct addrinfo hints = {0};
@@ -2511,12 +2678,13 @@ static intptr_t fio_tcp_socket(const char *address, const char *port,
       close(fd);
       return -1;
     }
+    /* set before `listen` (window scaling), accepted sockets inherit these */
+    fio_sock_options(fd);
 #ifdef TCP_FASTOPEN
     {
       // support TCP Fast Open when available
       int optval = 128;
-      setsockopt(fd, addrinfo->ai_protocol, TCP_FASTOPEN, &optval,
-                 sizeof(optval));
+      setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &optval, sizeof(optval));
     }
 #endif
     if (listen(fd, SOMAXCONN) < 0) {
@@ -2527,6 +2695,11 @@ static intptr_t fio_tcp_socket(const char *address, const char *port,
   } else {
     int one = 1;
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef TCP_FASTOPEN_CONNECT
+    /* the SYN is sent with the first write (once a cookie is cached) */
+    if (fastopen)
+      setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one));
+#endif
     errno = 0;
     for (struct addrinfo *i = addrinfo; i; i = i->ai_next) {
       if (connect(fd, i->ai_addr, i->ai_addrlen) == 0 || errno == EINPROGRESS)
@@ -2540,13 +2713,16 @@ socket_okay:
   fio_lock(&fd_data(fd).protocol_lock);
   fio_clear_fd(fd, 1);
   fio_unlock(&fd_data(fd).protocol_lock);
+  fd_data(fd).sock_options = server;
   fio_tcp_addr_cpy(fd, addrinfo->ai_family, (void *)addrinfo);
   freeaddrinfo(addrinfo);
   return fd2uuid(fd);
 }
 
 /* PUBLIC API: opens a server or client socket */
-intptr_t fio_socket(const char *address, const char *port, uint8_t server) {
+/* creates a socket, optionally using TCP Fast Open (for clients) */
+static intptr_t fio_socket_internal(const char *address, const char *port,
+                                    uint8_t server, uint8_t fastopen) {
   intptr_t uuid;
   if (port) {
     char *pos = (char *)port;
@@ -2578,12 +2754,16 @@ intptr_t fio_socket(const char *address, const char *port, uint8_t server) {
   } else {
     do {
       errno = 0;
-      uuid = fio_tcp_socket(address, port, server);
+      uuid = fio_tcp_socket(address, port, server, fastopen);
     } while (errno == EINTR);
   }
   return uuid;
 }
 
+intptr_t fio_socket(const char *address, const char *port, uint8_t server) {
+  return fio_socket_internal(address, port, server, 0);
+}
+
 /* *****************************************************************************
 Internal socket flushing related functions
 ***************************************************************************** */
@@ -2608,6 +2788,21 @@ Internal socket flushing related functions
 
 static void fio_sock_perform_close_fd(intptr_t fd) { close(fd); }
 
+/* schedules the tasks waiting for a shorter queue (see `fio_defer_on_drain`) */
+static void fio_sock_drain_unsafe(uintptr_t fd) {
+  fio_drain_s **pos = &fd_data(fd).drain;
+  while (*pos) {
+    fio_drain_s *d = *pos;
+    if (fd_data(fd).packet_count > d->pending) {
+      pos = &d->next;
+      continue;
+    }
+    *pos = d->next;
+    fio_defer_io_task FIO_IGNORE_MACRO(fd2uuid(fd), d->task);
+    fio_free(d);
+  }
+}
+
 static inline void fio_sock_packet_rotate_unsafe(uintptr_t fd) {
   fio_packet_s *packet = fd_data(fd).packet;
   fd_data(fd).packet = packet->next;
@@ -2619,6 +2814,8 @@ static inline void fio_sock_packet_rotate_unsafe(uintptr_t fd) {
     fd_data(fd).packet_last = &fd_data(fd).packet;
   }
   fio_packet_free(packet);
+  if (fd_data(fd).drain)
+    fio_sock_drain_unsafe(fd);
 }
 
 static int fio_sock_write_buffer(int fd, fio_packet_s *packet) {
@@ -2725,6 +2922,27 @@ static int (*fio_sock_sendfile_from_fd)(int fd, fio_packet_s *packet) =
 
 #endif
 
+/* sends file data using the read/write hook's `sendfile` (i.e., kernel TLS) */
+static int fio_sock_sendfile_from_hook(int fd, fio_packet_s *packet) {
+  if (!fd_data(fd).rw_hooks->sendfile) /* the hook was replaced */
+    return fio_sock_write_from_fd(fd, packet);
+  off_t offset = (off_t)packet->offset;
+  ssize_t sent = fd_data(fd).rw_hooks->sendfile(
+      fd2uuid(fd), fd_data(fd).rw_udata, packet->data.fd, &offset,
+      packet->length);
+  if (sent < 0)
+    return -1;
+  if (sent == 0) { /* EOF (file shorter than expected) */
+    fio_sock_packet_rotate_unsafe(fd);
+    return 1;
+  }
+  packet->offset = (uintptr_t)offset;
+  packet->length -= sent;
+  if (!packet->length)
+    fio_sock_packet_rotate_unsafe(fd);
+  return sent;
+}
+
 /* *****************************************************************************
 Socket / Connection Functions
 ***************************************************************************** */
@@ -2773,6 +2991,7 @@ ssize_t fio_read(intptr_t uuid, void *buffer, size_t count) {
 retry_int:
   ret = rw_read(uuid, udata, buffer, count);
   if (ret > 0) {
+    FIO_METRICS_ADD(bytes_read, ret);
     fio_touch(uuid);
     return ret;
   }
@@ -2804,7 +3023,9 @@ ssize_t fio_write2_fn(intptr_t uuid, fio_write_args_s options) {
   if (options.is_fd) {
     packet->write_func = (uuid_data(uuid).rw_hooks == &FIO_DEFAULT_RW_HOOKS)
                              ? fio_sock_sendfile_from_fd
-                             : fio_sock_write_from_fd;
+                             : (uuid_data(uuid).rw_hooks->sendfile
+                                    ? fio_sock_sendfile_from_hook
+                                    : fio_sock_write_from_fd);
     packet->dealloc =
         (options.after.dealloc ? options.after.dealloc
                                : (void (*)(void *))fio_sock_perform_close_fd);
@@ -2956,9 +3177,17 @@ ssize_t fio_flush(intptr_t uuid) {
 
   const fio_packet_s *old_packet = uuid_data(uuid).packet;
   const size_t old_sent = uuid_data(uuid).sent;
+  const uintptr_t old_length = old_packet->length;
 
   tmp = uuid_data(uuid).packet->write_func(fio_uuid2fd(uuid),
                                            uuid_data(uuid).packet);
+  /* a packet is released (rotated) once it was fully written */
+  if (uuid_data(uuid).packet == old_packet) {
+    FIO_METRICS_ADD(bytes_written, old_length - old_packet->length);
+    FIO_METRICS_ADD(partial_writes, 1);
+  } else {
+    FIO_METRICS_ADD(bytes_written, old_length);
+  }
   if (tmp <= 0) {
     goto test_errno;
   }
@@ -2971,6 +3200,18 @@ ssize_t fio_flush(intptr_t uuid) {
     goto attacked;
   }
 
+  /* the queue drained, but the rw hook might be buffering (coalescing) data */
+  if (!uuid_data(uuid).packet) {
+    flushed = uuid_data(uuid).rw_hooks->flush(uuid, uuid_data(uuid).rw_udata);
+    if (flushed < 0)
+      goto test_errno;
+    if (flushed > 0) {
+      fio_unlock(&uuid_data(uuid).sock_lock);
+      touchfd(fio_uuid2fd(uuid));
+      return 1;
+    }
+  }
+
   /* end critical section */
   fio_unlock(&uuid_data(uuid).sock_lock);
 
@@ -2991,12 +3232,16 @@ closed:
 
 flush_rw_hook:
   flushed = uuid_data(uuid).rw_hooks->flush(uuid, uuid_data(uuid).rw_udata);
-  fio_unlock(&uuid_data(uuid).sock_lock);
-  if (!flushed)
-    return 0;
   if (flushed < 0) {
     goto test_errno;
   }
+  fio_unlock(&uuid_data(uuid).sock_lock);
+  if (!flushed) {
+    /* closure might have been delayed until the rw hook drained */
+    if (uuid_data(uuid).close)
+      goto closed;
+    return 0;
+  }
   touchfd(fio_uuid2fd(uuid));
   return 1;
 
@@ -3037,6 +3282,7 @@ invalid:
 
 attacked:
   /* don't close, just detach from facil.io and mark uuid as invalid */
+  FIO_METRICS_ADD(slowloris, 1);
   FIO_LOG_WARNING("(facil.io) possible Slowloris attack from %.*s",
                   (int)fio_peer_addr(uuid).len, fio_peer_addr(uuid).data);
   fio_unlock(&uuid_data(uuid).sock_lock);
@@ -3483,17 +3729,48 @@ void fio_defer_io_task FIO_IGNORE_MACRO(intptr_t uuid,
   fio_defer_push_task(fio_io_task_perform, (void *)uuid, cpy);
 }
 
+/**
+ * Schedules a protected connection task once no more than `pending` packets
+ * are waiting in the socket's queue.
+ *
+ * If the connection is closed before the queue drains, the `fallback` task
+ * will be called instead, allowing for resource cleanup.
+ */
+void fio_defer_on_drain FIO_IGNORE_MACRO(intptr_t uuid, size_t pending,
+                                         fio_defer_iotask_args_s args) {
+  if (!args.task || !uuid_is_valid(uuid))
+    goto schedule;
+  fio_drain_s *d = fio_malloc(sizeof(*d));
+  FIO_ASSERT_ALLOC(d);
+  *d = (fio_drain_s){.pending = pending, .task = args};
+  fio_lock(&uuid_data(uuid).sock_lock);
+  if (!uuid_is_valid(uuid) || uuid_data(uuid).packet_count <= pending) {
+    fio_unlock(&uuid_data(uuid).sock_lock);
+    fio_free(d);
+    goto schedule;
+  }
+  /* the task is scheduled by `fio_flush` (or by `fio_clear_fd`) */
+  d->next = uuid_data(uuid).drain;
+  uuid_data(uuid).drain = d;
+  fio_unlock(&uuid_data(uuid).sock_lock);
+  return;
+schedule:
+  fio_defer_io_task FIO_IGNORE_MACRO(uuid, args);
+}
+
 /* *****************************************************************************
 Initialize the library
 ***************************************************************************** */
 
 static void fio_pubsub_on_fork(void);
+static void fio_dns_on_fork(void);
 
 /* Called within a child process after it starts. */
 static void fio_on_fork(void) {
   fio_timer_lock = FIO_LOCK_INIT;
   fio_data->lock = FIO_LOCK_INIT;
   fio_defer_on_fork();
+  fio_metrics_on_fork();
   fio_malloc_after_fork();
   fio_poll_init();
   fio_state_callback_on_fork();
@@ -3511,6 +3788,7 @@ static void fio_on_fork(void) {
   }
 
   fio_pubsub_on_fork();
+  fio_dns_on_fork();
   uint16_t old_active = fio_data->active;
   fio_data->active = 0;
   fio_defer_perform();
@@ -3682,6 +3960,7 @@ static void fio_review_timeout(void *arg, void *ignr) {
     if (prt_meta(tmp).locks[FIO_PR_LOCK_TASK] ||
         prt_meta(tmp).locks[FIO_PR_LOCK_WRITE])
       goto unlock;
+    FIO_METRICS_ADD(timeouts, 1);
     fio_defer_push_task(deferred_ping, (void *)fio_fd2uuid((int)fd), NULL);
   unlock:
     protocol_unlock(tmp, FIO_PR_LOCK_STATE);
@@ -3718,6 +3997,8 @@ static void fio_cycle_schedule_events(void) {
   if (events < 0) {
     return;
   }
+  FIO_METRICS_ADD(polls, 1);
+  FIO_METRICS_ADD(poll_events, events);
   if (events > 0) {
     idle = 1;
   } else {
@@ -3745,10 +4026,32 @@ static void fio_cycle_unwind(void *ignr, void *ignr2) {
   return;
 }
 
+#if FIO_METRICS
+/* the time the reactor cycle task was queued, a queue latency sample */
+static struct timespec fio_cycle_queued;
+
+static inline void fio_cycle_latency_review(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!fio_cycle_queued.tv_sec && !fio_cycle_queued.tv_nsec)
+    return;
+  fio_metrics_queue_latency(
+      ((uint64_t)(now.tv_sec - fio_cycle_queued.tv_sec) * 1000000000ULL) +
+      (uint64_t)now.tv_nsec - (uint64_t)fio_cycle_queued.tv_nsec);
+}
+#endif
+
 /* reactor pattern cycling */
 static void fio_cycle(void *ignr, void *ignr2) {
+#if FIO_METRICS
+  fio_cycle_latency_review();
+#endif
   fio_cycle_schedule_events();
   if (fio_data->active) {
+#if FIO_METRICS
+    /* the events were just scheduled, this task waits behind them */
+    clock_gettime(CLOCK_MONOTONIC, &fio_cycle_queued);
+#endif
     fio_defer_push_task(fio_cycle, ignr, ignr2);
     return;
   }
@@ -3778,6 +4081,9 @@ static void fio_worker_startup(void) {
   fio_data->need_review = 1;
 
   /* the cycle task will loop by re-scheduling until it's time to finish */
+#if FIO_METRICS
+  fio_cycle_queued = (struct timespec){.tv_sec = 0};
+#endif
   fio_defer_push_task(fio_cycle, NULL, NULL);
 
   /* A single thread doesn't need a pool. */
@@ -4145,6 +4451,12 @@ Numbers to Strings
  * Returns the number of bytes actually written (excluding the NUL
  * terminator).
  */
+/* "00" to "99", used for writing two decimal digits at a time */
+static const char fio_decimal_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
 size_t fio_ltoa(char *dest, int64_t num, uint8_t base) {
   const char notation[] = {'0', '1', '2', '3', '4', '5', '6', '7',
                            '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
@@ -4259,24 +4571,34 @@ size_t fio_ltoa(char *dest, int64_t num, uint8_t base) {
   default:
     break;
   }
-  /* Base 10, the default base */
-
-  if (num < 0) {
-    dest[len++] = '-';
-    num = 0 - num;
-  }
-  uint64_t l = 0;
-  while (num) {
-    uint64_t t = num / 10;
-    buf[l++] = '0' + (num - (t * 10));
-    num = t;
-  }
-  while (l) {
-    --l;
-    dest[len++] = buf[l];
+  /* Base 10, the default base (two digits at a time) */
+  {
+    uint64_t n = (uint64_t)num;
+    if (num < 0) {
+      dest[len++] = '-';
+      n = 0 - n;
+    }
+    uint64_t l = 0;
+    while (n >= 100) {
+      uint64_t t = n / 100;
+      const char *d = fio_decimal_pairs + ((n - (t * 100)) << 1);
+      buf[l++] = d[1];
+      buf[l++] = d[0];
+      n = t;
+    }
+    if (n >= 10) {
+      buf[l++] = fio_decimal_pairs[(n << 1) + 1];
+      buf[l++] = fio_decimal_pairs[(n << 1)];
+    } else {
+      buf[l++] = '0' + n;
+    }
+    while (l) {
+      --l;
+      dest[len++] = buf[l];
+    }
+    dest[len] = 0;
+    return len;
   }
-  dest[len] = 0;
-  return len;
 
 zero:
   switch (base) {
@@ -4312,6 +4634,184 @@ zero:
  * Returns the number of bytes actually written (excluding the NUL
  * terminator).
  */
+/*
+Base 10 conversion uses the Grisu2 algorithm (Florian Loitsch, "Printing
+Floating-Point Numbers Quickly and Accurately with Integers", 2010), producing
+the shortest digit sequence that reads back as the same double (in almost all
+cases, otherwise a slightly longer one that still round-trips).
+
+The implementation follows Milo Yip's public domain C++ implementation (used by
+RapidJSON).
+*/
+
+/* a "do it yourself" floating point: f * 2^e */
+typedef struct {
+  uint64_t f;
+  int e;
+} fio_diy_fp_s;
+
+/* normalized powers of 10 (10^-348 to 10^340, in steps of 8) */
+static const uint64_t fio_ftoa_pow10_f[] = {
+    0xFA8FD5A0081C0288, 0xBAAEE17FA23EBF76, 0x8B16FB203055AC76,
+    0xCF42894A5DCE35EA, 0x9A6BB0AA55653B2D, 0xE61ACF033D1A45DF,
+    0xAB70FE17C79AC6CA, 0xFF77B1FCBEBCDC4F, 0xBE5691EF416BD60C,
+    0x8DD01FAD907FFC3C, 0xD3515C2831559A83, 0x9D71AC8FADA6C9B5,
+    0xEA9C227723EE8BCB, 0xAECC49914078536D, 0x823C12795DB6CE57,
+    0xC21094364DFB5637, 0x9096EA6F3848984F, 0xD77485CB25823AC7,
+    0xA086CFCD97BF97F4, 0xEF340A98172AACE5, 0xB23867FB2A35B28E,
+    0x84C8D4DFD2C63F3B, 0xC5DD44271AD3CDBA, 0x936B9FCEBB25C996,
+    0xDBAC6C247D62A584, 0xA3AB66580D5FDAF6, 0xF3E2F893DEC3F126,
+    0xB5B5ADA8AAFF80B8, 0x87625F056C7C4A8B, 0xC9BCFF6034C13053,
+    0x964E858C91BA2655, 0xDFF9772470297EBD, 0xA6DFBD9FB8E5B88F,
+    0xF8A95FCF88747D94, 0xB94470938FA89BCF, 0x8A08F0F8BF0F156B,
+    0xCDB02555653131B6, 0x993FE2C6D07B7FAC, 0xE45C10C42A2B3B06,
+    0xAA242499697392D3, 0xFD87B5F28300CA0E, 0xBCE5086492111AEB,
+    0x8CBCCC096F5088CC, 0xD1B71758E219652C, 0x9C40000000000000,
+    0xE8D4A51000000000, 0xAD78EBC5AC620000, 0x813F3978F8940984,
+    0xC097CE7BC90715B3, 0x8F7E32CE7BEA5C70, 0xD5D238A4ABE98068,
+    0x9F4F2726179A2245, 0xED63A231D4C4FB27, 0xB0DE65388CC8ADA8,
+    0x83C7088E1AAB65DB, 0xC45D1DF942711D9A, 0x924D692CA61BE758,
+    0xDA01EE641A708DEA, 0xA26DA3999AEF774A, 0xF209787BB47D6B85,
+    0xB454E4A179DD1877, 0x865B86925B9BC5C2, 0xC83553C5C8965D3D,
+    0x952AB45CFA97A0B3, 0xDE469FBD99A05FE3, 0xA59BC234DB398C25,
+    0xF6C69A72A3989F5C, 0xB7DCBF5354E9BECE, 0x88FCF317F22241E2,
+    0xCC20CE9BD35C78A5, 0x98165AF37B2153DF, 0xE2A0B5DC971F303A,
+    0xA8D9D1535CE3B396, 0xFB9B7CD9A4A7443C, 0xBB764C4CA7A44410,
+    0x8BAB8EEFB6409C1A, 0xD01FEF10A657842C, 0x9B10A4E5E9913129,
+    0xE7109BFBA19C0C9D, 0xAC2820D9623BF429, 0x80444B5E7AA7CF85,
+    0xBF21E44003ACDD2D, 0x8E679C2F5E44FF8F, 0xD433179D9C8CB841,
+    0x9E19DB92B4E31BA9, 0xEB96BF6EBADF77D9, 0xAF87023B9BF0EE6B,
+};
+static const int16_t fio_ftoa_pow10_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635,
+    -608, -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316,
+    -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56,
+    83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+    481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853,
+    880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint32_t fio_ftoa_pow10_i[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+static inline fio_diy_fp_s fio_diy_fp_mul(fio_diy_fp_s a, fio_diy_fp_s b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t p = (__uint128_t)a.f * (__uint128_t)b.f;
+  uint64_t h = (uint64_t)(p >> 64);
+  if (((uint64_t)p) & ((uint64_t)1 << 63))
+    ++h; /* round */
+  return (fio_diy_fp_s){.f = h, .e = a.e + b.e + 64};
+#else
+  const uint64_t a_hi = a.f >> 32, a_lo = a.f & 0xFFFFFFFF;
+  const uint64_t b_hi = b.f >> 32, b_lo = b.f & 0xFFFFFFFF;
+  const uint64_t hh = a_hi * b_hi, hl = a_hi * b_lo;
+  const uint64_t lh = a_lo * b_hi, ll = a_lo * b_lo;
+  uint64_t tmp = (ll >> 32) + (hl & 0xFFFFFFFF) + (lh & 0xFFFFFFFF);
+  tmp += (uint64_t)1 << 31; /* round */
+  return (fio_diy_fp_s){.f = hh + (hl >> 32) + (lh >> 32) + (tmp >> 32),
+                        .e = a.e + b.e + 64};
+#endif
+}
+
+static inline void fio_ftoa_round(char *buf, size_t len, uint64_t delta,
+                                  uint64_t rest, uint64_t ten_kappa,
+                                  uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    --buf[len - 1];
+    rest += ten_kappa;
+  }
+}
+
+/* writes the shortest digits of a positive (finite) number, sets `*k` */
+static size_t fio_ftoa_digits(char *buf, double num, int *k) {
+  union {
+    double f;
+    uint64_t i;
+  } u = {.f = num};
+  const uint64_t hidden = (uint64_t)1 << 52;
+  fio_diy_fp_s v = {.f = u.i & (hidden - 1), .e = (int)((u.i >> 52) & 0x7FF)};
+  if (v.e) {
+    v.f += hidden;
+    v.e -= 1075;
+  } else {
+    v.e = -1074;
+  }
+  /* boundaries (the halfway points to the neighboring doubles) */
+  fio_diy_fp_s plus = {.f = (v.f << 1) + 1, .e = v.e - 1};
+  while (!(plus.f & (hidden << 1))) {
+    plus.f <<= 1;
+    --plus.e;
+  }
+  plus.f <<= 10;
+  plus.e -= 10;
+  fio_diy_fp_s minus = (v.f == hidden)
+                           ? (fio_diy_fp_s){.f = (v.f << 2) - 1, .e = v.e - 2}
+                           : (fio_diy_fp_s){.f = (v.f << 1) - 1, .e = v.e - 1};
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+  {
+    int shift = __builtin_clzll(v.f);
+    v.f <<= shift;
+    v.e -= shift;
+  }
+  /* scale by a cached power of 10, so the exponent is in [-60, -32] */
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0)
+    ++ik;
+  const unsigned index = (unsigned)((ik >> 3) + 1);
+  *k = -(-348 + (int)(index << 3));
+  const fio_diy_fp_s c_mk = {.f = fio_ftoa_pow10_f[index],
+                             .e = fio_ftoa_pow10_e[index]};
+  const fio_diy_fp_s w = fio_diy_fp_mul(v, c_mk);
+  fio_diy_fp_s wp = fio_diy_fp_mul(plus, c_mk);
+  fio_diy_fp_s wm = fio_diy_fp_mul(minus, c_mk);
+  ++wm.f;
+  --wp.f;
+  /* generate digits */
+  uint64_t delta = wp.f - wm.f;
+  const fio_diy_fp_s one = {.f = (uint64_t)1 << -wp.e, .e = wp.e};
+  const uint64_t wp_w = wp.f - w.f;
+  uint32_t p1 = (uint32_t)(wp.f >> -one.e);
+  uint64_t p2 = wp.f & (one.f - 1);
+  int kappa = 1;
+  while (kappa < 10 && p1 >= fio_ftoa_pow10_i[kappa])
+    ++kappa;
+  size_t len = 0;
+  while (kappa > 0) {
+    uint32_t d = p1 / fio_ftoa_pow10_i[kappa - 1];
+    p1 -= d * fio_ftoa_pow10_i[kappa - 1];
+    if (d || len)
+      buf[len++] = '0' + (char)d;
+    --kappa;
+    uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      fio_ftoa_round(buf, len, delta, tmp,
+                     (uint64_t)fio_ftoa_pow10_i[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+  uint64_t unit = 1;
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    unit *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || len)
+      buf[len++] = '0' + d;
+    p2 &= one.f - 1;
+    --kappa;
+    if (p2 < delta) {
+      *k += kappa;
+      fio_ftoa_round(buf, len, delta, p2, one.f, wp_w * unit);
+      return len;
+    }
+  }
+}
+
 size_t fio_ftoa(char *dest, double num, uint8_t base) {
   if (base == 2 || base == 16) {
     /* handle the binary / Hex representation the same as if it were an
@@ -4321,6 +4821,68 @@ size_t fio_ftoa(char *dest, double num, uint8_t base) {
     return fio_ltoa(dest, *i, base);
   }
 
+  if (isfinite(num)) {
+    size_t len = 0;
+    if (signbit(num)) {
+      dest[len++] = '-';
+      num = -num;
+    }
+    if (num == 0) {
+      dest[len++] = '0';
+      dest[len++] = '.';
+      dest[len++] = '0';
+      dest[len] = 0;
+      return len;
+    }
+    char digits[24];
+    int k;
+    const int count = (int)fio_ftoa_digits(digits, num, &k);
+    /* the decimal exponent of the first digit, layout follows "%.17g" */
+    const int exp10 = count + k - 1;
+    if (exp10 < -4 || exp10 >= 17) {
+      dest[len++] = digits[0];
+      if (count > 1) {
+        dest[len++] = '.';
+        memcpy(dest + len, digits + 1, count - 1);
+        len += count - 1;
+      }
+      dest[len++] = 'e';
+      int e = exp10;
+      if (e < 0) {
+        dest[len++] = '-';
+        e = -e;
+      } else {
+        dest[len++] = '+';
+      }
+      if (e >= 100)
+        dest[len++] = '0' + (e / 100);
+      dest[len++] = fio_decimal_pairs[((e % 100) << 1)];
+      dest[len++] = fio_decimal_pairs[((e % 100) << 1) + 1];
+    } else if (exp10 < 0) {
+      dest[len++] = '0';
+      dest[len++] = '.';
+      for (int i = exp10 + 1; i < 0; ++i)
+        dest[len++] = '0';
+      memcpy(dest + len, digits, count);
+      len += count;
+    } else if (exp10 + 1 >= count) {
+      memcpy(dest + len, digits, count);
+      len += count;
+      for (int i = count; i <= exp10; ++i)
+        dest[len++] = '0';
+      dest[len++] = '.';
+      dest[len++] = '0';
+    } else {
+      memcpy(dest + len, digits, exp10 + 1);
+      len += exp10 + 1;
+      dest[len++] = '.';
+      memcpy(dest + len, digits + exp10 + 1, count - (exp10 + 1));
+      len += count - (exp10 + 1);
+    }
+    dest[len] = 0;
+    return len;
+  }
+
   size_t written = sprintf(dest, "%g", num);
   uint8_t need_zero = 1;
   char *start = dest;
@@ -4474,22 +5036,30 @@ Section Start Marker
 The listening protocol (use the facil.io API to make a socket and attach it)
 ***************************************************************************** */
 
-typedef struct {
+typedef struct fio_listen_protocol_s fio_listen_protocol_s;
+struct fio_listen_protocol_s {
   fio_protocol_s pr;
   intptr_t uuid;
   void *udata;
   void (*on_open)(intptr_t uuid, void *udata);
   void (*on_start)(intptr_t uuid, void *udata);
   void (*on_finish)(intptr_t uuid, void *udata);
+  /* sets up an accepted connection (TLS and / or `on_open`) */
+  void (*open)(intptr_t uuid, fio_listen_protocol_s *pr);
   char *port;
   char *addr;
   size_t port_len;
   size_t addr_len;
   void *tls;
-} fio_listen_protocol_s;
+  /* the listening socket and any pending `open` tasks (spread_accept) */
+  volatile size_t ref;
+  uint8_t spread_accept;
+};
 
 static void fio_listen_cleanup_task(void *pr_) {
   fio_listen_protocol_s *pr = pr_;
+  if (fio_atomic_sub(&pr->ref, 1))
+    return; /* the last pending `open` task will finish the cleanup */
   if (pr->tls)
     fio_tls_destroy(pr->tls);
   if (pr->on_finish) {
@@ -4522,35 +5092,77 @@ static void fio_listen_on_close(intptr_t uuid, fio_protocol_s *pr_) {
   (void)uuid;
 }
 
-static void fio_listen_on_data(intptr_t uuid, fio_protocol_s *pr_) {
-  fio_listen_protocol_s *pr = (fio_listen_protocol_s *)pr_;
-  for (int i = 0; i < 4; ++i) {
-    intptr_t client = fio_accept(uuid);
-    if (client == -1)
-      return;
-    pr->on_open(client, pr->udata);
-  }
+static void fio_listen_open(intptr_t uuid, fio_listen_protocol_s *pr) {
+  pr->on_open(uuid, pr->udata);
+}
+
+static void fio_listen_open_tls(intptr_t uuid, fio_listen_protocol_s *pr) {
+  fio_tls_accept(uuid, pr->tls, pr->udata);
+  pr->on_open(uuid, pr->udata);
+}
+
+static void fio_listen_open_tls_alpn(intptr_t uuid,
+                                     fio_listen_protocol_s *pr) {
+  fio_tls_accept(uuid, pr->tls, pr->udata);
+}
+
+static void fio_listen_open_task(void *uuid, void *pr_) {
+  fio_listen_protocol_s *pr = pr_;
+  if (uuid_is_valid((intptr_t)uuid))
+    pr->open((intptr_t)uuid, pr);
+  fio_listen_cleanup_task(pr);
 }
 
-static void fio_listen_on_data_tls(intptr_t uuid, fio_protocol_s *pr_) {
+static void fio_listen_on_data(intptr_t uuid, fio_protocol_s *pr_) {
   fio_listen_protocol_s *pr = (fio_listen_protocol_s *)pr_;
-  for (int i = 0; i < 4; ++i) {
+  /* the listening socket is polled again once the batch is done (fairness) */
+  for (size_t i = 0; i < FIO_ACCEPT_BATCH; ++i) {
     intptr_t client = fio_accept(uuid);
     if (client == -1)
       return;
-    fio_tls_accept(client, pr->tls, pr->udata);
-    pr->on_open(client, pr->udata);
+    if (pr->spread_accept) {
+      fio_atomic_add(&pr->ref, 1);
+      fio_defer_push_task(fio_listen_open_task, (void *)client, pr);
+      continue;
+    }
+    pr->open(client, pr);
   }
 }
 
-static void fio_listen_on_data_tls_alpn(intptr_t uuid, fio_protocol_s *pr_) {
-  fio_listen_protocol_s *pr = (fio_listen_protocol_s *)pr_;
-  for (int i = 0; i < 4; ++i) {
-    intptr_t client = fio_accept(uuid);
-    if (client == -1)
-      return;
-    fio_tls_accept(client, pr->tls, pr->udata);
+/* sets the TCP/IP listening socket's options (see `fio_listen_args`) */
+static void fio_listen_sock_options(int fd, struct fio_listen_args *args) {
+  int optval;
+  if (args->defer_accept) {
+#ifdef TCP_DEFER_ACCEPT
+    optval = args->defer_accept;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &optval, sizeof(optval)))
+      FIO_LOG_WARNING("(fio_listen) couldn't set TCP_DEFER_ACCEPT: %s",
+                      strerror(errno));
+#else
+    FIO_LOG_WARNING("(fio_listen) TCP_DEFER_ACCEPT isn't supported.");
+#endif
+  }
+  if (args->fastopen) {
+#ifdef TCP_FASTOPEN
+    optval = args->fastopen;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &optval, sizeof(optval)))
+      FIO_LOG_WARNING("(fio_listen) couldn't set TCP_FASTOPEN: %s",
+                      strerror(errno));
+#else
+    FIO_LOG_WARNING("(fio_listen) TCP_FASTOPEN isn't supported.");
+#endif
+  }
+  if (args->busy_poll) {
+#ifdef SO_BUSY_POLL
+    optval = args->busy_poll;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &optval, sizeof(optval)))
+      FIO_LOG_WARNING("(fio_listen) couldn't set SO_BUSY_POLL: %s",
+                      strerror(errno));
+#else
+    FIO_LOG_WARNING("(fio_listen) SO_BUSY_POLL isn't supported.");
+#endif
   }
+  (void)optval;
 }
 
 /* stub for editor - unused */
@@ -4588,6 +5200,8 @@ intptr_t fio_listen FIO_IGNORE_MACRO(struct fio_listen_args args) {
   const intptr_t uuid = fio_socket(args.address, args.port, 1);
   if (uuid == -1)
     goto error;
+  if (port_len)
+    fio_listen_sock_options(fio_uuid2fd(uuid), &args);
 
   fio_listen_protocol_s *pr = malloc(sizeof(*pr) + addr_len + port_len +
                                      ((addr_len + port_len) ? 2 : 0));
@@ -4601,17 +5215,20 @@ intptr_t fio_listen FIO_IGNORE_MACRO(struct fio_listen_args args) {
           {
               .on_close = fio_listen_on_close,
               .ping = mock_ping_eternal,
-              .on_data = (args.tls ? (fio_tls_alpn_count(args.tls)
-                                          ? fio_listen_on_data_tls_alpn
-                                          : fio_listen_on_data_tls)
-                                   : fio_listen_on_data),
+              .on_data = fio_listen_on_data,
           },
       .uuid = uuid,
       .udata = args.udata,
       .on_open = args.on_open,
       .on_start = args.on_start,
       .on_finish = args.on_finish,
+      .open = (args.tls ? (fio_tls_alpn_count(args.tls)
+                               ? fio_listen_open_tls_alpn
+                               : fio_listen_open_tls)
+                        : fio_listen_open),
       .tls = args.tls,
+      .ref = 1,
+      .spread_accept = args.spread_accept,
       .addr_len = addr_len,
       .port_len = port_len,
       .addr = (char *)(pr + 1),
@@ -4680,26 +5297,1112 @@ Section Start Marker
 ***************************************************************************** */
 
 /* *****************************************************************************
-The connection protocol (use the facil.io API to make a socket and attach it)
+Asynchronous DNS resolution
 ***************************************************************************** */
 
+#ifndef FIO_DNS_RESOLV_CONF
+/** The resolver's configuration file (name servers, search list, options). */
+#define FIO_DNS_RESOLV_CONF "/etc/resolv.conf"
+#endif
+
+#ifndef FIO_DNS_HOSTS
+/** The static host names file. */
+#define FIO_DNS_HOSTS "/etc/hosts"
+#endif
+
+#ifndef FIO_DNS_MAX_SERVERS
+/** The maximum number of name servers (as in `MAXNS`). */
+#define FIO_DNS_MAX_SERVERS 3
+#endif
+
+#ifndef FIO_DNS_MAX_TTL
+/** The maximum number of seconds a DNS answer is cached. */
+#define FIO_DNS_MAX_TTL 86400
+#endif
+
+#ifndef FIO_DNS_CACHE_LIMIT
+/** The number of cached host names that triggers an eviction of old entries. */
+#define FIO_DNS_CACHE_LIMIT 4096
+#endif
+
+#ifndef FIO_DNS_RESOLUTION_DELAY
+/** Milliseconds to wait for the AAAA answer once the A answer arrived. */
+#define FIO_DNS_RESOLUTION_DELAY 50
+#endif
+
+/* the advertised EDNS(0) UDP payload size (avoids IP fragmentation) */
+#define FIO_DNS_UDP_SIZE 1232
+
+/* a lookup waiting for a pending query */
 typedef struct {
-  fio_protocol_s pr;
-  intptr_t uuid;
+  fio_ls_embd_s node;
+  void (*on_result)(void *udata, fio_dns_result_s *result);
   void *udata;
-  void *tls;
-  void (*on_connect)(intptr_t uuid, void *udata);
-  void (*on_fail)(intptr_t uuid, void *udata);
-} fio_connect_protocol_s;
+} fio_dns_waiter_s;
 
-static void fio_connect_on_close(intptr_t uuid, fio_protocol_s *pr_) {
-  fio_connect_protocol_s *pr = (fio_connect_protocol_s *)pr_;
-  if (pr->on_fail)
-    pr->on_fail(uuid, pr->udata);
-  if (pr->tls)
-    fio_tls_destroy(pr->tls);
-  fio_free(pr);
-  (void)uuid;
+/* a cached (or pending) host name */
+typedef struct {
+  fio_ls_embd_s waiting;
+  /* the monotonic time after which the result is stale */
+  time_t expires;
+  uint8_t pending;
+  /* an `/etc/hosts` entry (never expires) */
+  uint8_t hosts;
+  fio_dns_result_s result;
+  uint64_t hash;
+  size_t len;
+  char name[];
+} fio_dns_entry_s;
+
+static inline int fio_dns_entry_cmp(fio_dns_entry_s *e1, fio_dns_entry_s *e2) {
+  return e1->len == e2->len && !memcmp(e1->name, e2->name, e1->len);
+}
+
+#define FIO_FORCE_MALLOC_TMP 1
+#define FIO_SET_NAME fio_dns_cache
+#define FIO_SET_OBJ_TYPE fio_dns_entry_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2) fio_dns_entry_cmp((o1), (o2))
+#include <fio.h>
+
+static struct {
+  fio_dns_cache_s cache;
+  struct sockaddr_storage servers[FIO_DNS_MAX_SERVERS];
+  /* the search list (NUL separated, terminated by an empty name) */
+  char *search;
+  fio_lock_i lock;
+  uint8_t loaded;
+  uint8_t at_exit;
+  /* name servers were set using `fio_dns_server_add` */
+  uint8_t custom;
+  uint8_t count;
+  uint8_t timeout;
+  uint8_t attempts;
+  uint8_t ndots;
+} fio_dns = {.cache = FIO_SET_INIT, .lock = FIO_LOCK_INIT};
+
+static inline time_t fio_dns_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec;
+}
+
+static inline uint64_t fio_dns_hash(const char *name, size_t len) {
+  return FIO_HASH_FN(name, len, 0x646e73, 0);
+}
+
+/* parses a numerical address, returns 0 on success */
+static int fio_dns_numeric(struct sockaddr_storage *dest, const char *address,
+                           uint16_t port) {
+  struct sockaddr_in *in4 = (struct sockaddr_in *)dest;
+  struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)dest;
+  memset(dest, 0, sizeof(*dest));
+  if (inet_pton(AF_INET, address, &in4->sin_addr) == 1) {
+    in4->sin_family = AF_INET;
+    in4->sin_port = htons(port);
+    return 0;
+  }
+  if (inet_pton(AF_INET6, address, &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    return 0;
+  }
+  return -1;
+}
+
+/* adds an address to a result (unless full or a duplicate) */
+static void fio_dns_result_add(fio_dns_result_s *r, int family,
+                               const void *addr) {
+  if (r->count >= FIO_DNS_MAX_ADDRESSES)
+    return;
+  struct sockaddr_storage tmp = {.ss_family = family};
+  if (family == AF_INET)
+    memcpy(&((struct sockaddr_in *)&tmp)->sin_addr, addr, 4);
+  else
+    memcpy(&((struct sockaddr_in6 *)&tmp)->sin6_addr, addr, 16);
+  for (size_t i = 0; i < r->count; ++i) {
+    if (!memcmp(r->addr + i, &tmp, sizeof(tmp)))
+      return;
+  }
+  r->addr[r->count++] = tmp;
+}
+
+/* orders the addresses, alternating families and starting with IPv6 */
+static void fio_dns_result_order(fio_dns_result_s *r) {
+  struct sockaddr_storage tmp[FIO_DNS_MAX_ADDRESSES];
+  size_t pos[2] = {0, 0}; /* IPv6, IPv4 */
+  size_t count = 0;
+  memcpy(tmp, r->addr, sizeof(*tmp) * r->count);
+  while (count < r->count) {
+    for (size_t f = 0; f < 2 && count < r->count; ++f) {
+      const int family = f ? AF_INET : AF_INET6;
+      while (pos[f] < r->count && tmp[pos[f]].ss_family != family)
+        ++pos[f];
+      if (pos[f] < r->count)
+        r->addr[count++] = tmp[pos[f]++];
+    }
+  }
+}
+
+/* removes (and frees) a settled entry (call within the lock) */
+static void fio_dns_entry_evict(fio_dns_entry_s *e) {
+  fio_dns_cache_remove(&fio_dns.cache, e->hash, e, NULL);
+  fio_free(e);
+}
+
+/* evicts expired answers, then the oldest answers (call within the lock) */
+static void fio_dns_cache_evict(void) {
+  if (fio_dns_cache_count(&fio_dns.cache) < FIO_DNS_CACHE_LIMIT)
+    return;
+  const time_t now = fio_dns_now();
+  FIO_SET_FOR_LOOP(&fio_dns.cache, pos) {
+    if (pos->hash && !pos->obj->pending && !pos->obj->hosts &&
+        pos->obj->expires <= now)
+      fio_dns_entry_evict(pos->obj);
+  }
+  /* evict a quarter of the cache at a time, so evictions are rare */
+  FIO_SET_FOR_LOOP(&fio_dns.cache, pos) {
+    if (fio_dns_cache_count(&fio_dns.cache) <
+        FIO_DNS_CACHE_LIMIT - (FIO_DNS_CACHE_LIMIT >> 2))
+      break;
+    if (pos->hash && !pos->obj->pending && !pos->obj->hosts)
+      fio_dns_entry_evict(pos->obj);
+  }
+}
+
+/* finds or creates a cache entry (call within the lock) */
+static fio_dns_entry_s *fio_dns_entry(const char *name, size_t len,
+                                      uint64_t hash) {
+  union {
+    fio_dns_entry_s e;
+    char buf[sizeof(fio_dns_entry_s) + 256];
+  } key;
+  key.e.len = len;
+  memcpy(key.e.name, name, len);
+  fio_dns_entry_s *e = fio_dns_cache_find(&fio_dns.cache, hash, &key.e);
+  if (e) {
+    if (e->pending || e->hosts || e->expires > fio_dns_now())
+      return e;
+    /* an expired (or negative) answer is replaced by a fresh entry */
+    fio_dns_entry_evict(e);
+  }
+  fio_dns_cache_evict();
+  e = fio_malloc(sizeof(*e) + len + 1);
+  FIO_ASSERT_ALLOC(e);
+  *e = (fio_dns_entry_s){.waiting = FIO_LS_INIT(e->waiting), .hash = hash,
+                         .len = len};
+  memcpy(e->name, name, len);
+  e->name[len] = 0;
+  fio_dns_cache_insert(&fio_dns.cache, hash, e);
+  return e;
+}
+
+/* lower cases a host name, returns it's length or 0 if invalid */
+static size_t fio_dns_name(char *dest, const char *name, uint8_t *absolute) {
+  size_t len = 0;
+  *absolute = 0;
+  if (!name)
+    return 0;
+  while (name[len] && len < 254) {
+    dest[len] = tolower((unsigned char)name[len]);
+    ++len;
+  }
+  if (len && dest[len - 1] == '.') {
+    *absolute = 1;
+    --len;
+  }
+  if (!len || len > 253)
+    return 0;
+  dest[len] = 0;
+  return len;
+}
+
+/* reads the `/etc/hosts` file into the cache (call within the lock) */
+static void fio_dns_load_hosts(void) {
+  char line[1024];
+  FILE *f = fopen(FIO_DNS_HOSTS, "r");
+  if (!f)
+    return;
+  while (fgets(line, sizeof(line), f)) {
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+    char *save = NULL;
+    char *tok = strtok_r(line, " \t\r\n", &save);
+    struct sockaddr_storage addr;
+    if (!tok || fio_dns_numeric(&addr, tok, 0))
+      continue;
+    while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+      char name[256];
+      uint8_t absolute;
+      size_t len = fio_dns_name(name, tok, &absolute);
+      if (!len)
+        continue;
+      fio_dns_entry_s *e = fio_dns_entry(name, len, fio_dns_hash(name, len));
+      e->hosts = 1;
+      fio_dns_result_add(
+          &e->result, addr.ss_family,
+          (addr.ss_family == AF_INET)
+              ? (void *)&((struct sockaddr_in *)&addr)->sin_addr
+              : (void *)&((struct sockaddr_in6 *)&addr)->sin6_addr);
+    }
+  }
+  fclose(f);
+  FIO_SET_FOR_LOOP(&fio_dns.cache, pos) {
+    if (pos->hash && pos->obj->hosts)
+      fio_dns_result_order(&pos->obj->result);
+  }
+}
+
+/* reads the `/etc/resolv.conf` file (call within the lock) */
+static void fio_dns_load_resolv(void) {
+  char line[1024];
+  char *search = NULL;
+  fio_dns.timeout = 5;
+  fio_dns.attempts = 2;
+  fio_dns.ndots = 1;
+  if (!fio_dns.custom)
+    fio_dns.count = 0;
+  FILE *f = fopen(FIO_DNS_RESOLV_CONF, "r");
+  while (f && fgets(line, sizeof(line), f)) {
+    char *save = NULL;
+    char *tok = strtok_r(line, " \t\r\n", &save);
+    if (!tok || *tok == '#' || *tok == ';')
+      continue;
+    if (!strcmp(tok, "nameserver")) {
+      tok = strtok_r(NULL, " \t\r\n", &save);
+      if (tok && !fio_dns.custom && fio_dns.count < FIO_DNS_MAX_SERVERS &&
+          !fio_dns_numeric(fio_dns.servers + fio_dns.count, tok, 53))
+        ++fio_dns.count;
+    } else if (!strcmp(tok, "search") || !strcmp(tok, "domain")) {
+      /* the last `search` or `domain` line wins */
+      size_t len = 0;
+      free(search);
+      search = malloc(sizeof(line) + 1);
+      FIO_ASSERT_ALLOC(search);
+      while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+        uint8_t absolute;
+        size_t l = fio_dns_name(search + len, tok, &absolute);
+        if (l)
+          len += l + 1;
+      }
+      search[len] = 0;
+    } else if (!strcmp(tok, "options")) {
+      while ((tok = strtok_r(NULL, " \t\r\n", &save))) {
+        char *value = strchr(tok, ':');
+        if (!value)
+          continue;
+        char *pos = ++value;
+        int64_t n = fio_atol(&pos);
+        if (n < 0)
+          n = 0;
+        if (n > 30)
+          n = 30;
+        if (!strncmp(tok, "ndots:", 6))
+          fio_dns.ndots = (uint8_t)n;
+        else if (!strncmp(tok, "timeout:", 8) && n)
+          fio_dns.timeout = (uint8_t)n;
+        else if (!strncmp(tok, "attempts:", 9) && n)
+          fio_dns.attempts = (uint8_t)n;
+      }
+    }
+  }
+  if (f)
+    fclose(f);
+  if (!fio_dns.count)
+    fio_dns_numeric(fio_dns.servers + fio_dns.count++, "127.0.0.1", 53);
+  free(fio_dns.search);
+  fio_dns.search = search;
+}
+
+/* frees the cache, keeping pending entries (call within the lock) */
+static void fio_dns_cache_reset(uint8_t all) {
+  fio_dns_cache_s pending = FIO_SET_INIT;
+  FIO_SET_FOR_LOOP(&fio_dns.cache, pos) {
+    if (!pos->hash)
+      continue;
+    if (pos->obj->pending && !all) {
+      pos->obj->hosts = 0;
+      fio_dns_cache_insert(&pending, pos->obj->hash, pos->obj);
+      continue;
+    }
+    while (fio_ls_embd_any(&pos->obj->waiting))
+      fio_free(FIO_LS_EMBD_OBJ(fio_dns_waiter_s, node,
+                               fio_ls_embd_pop(&pos->obj->waiting)));
+    fio_free(pos->obj);
+  }
+  fio_dns_cache_free(&fio_dns.cache);
+  fio_dns.cache = pending;
+}
+
+/* Called within a child process after it starts. */
+static void fio_dns_on_fork(void) { fio_dns.lock = FIO_LOCK_INIT; }
+
+static void fio_dns_cleanup(void *ignr_) {
+  fio_lock(&fio_dns.lock);
+  fio_dns_cache_reset(1);
+  free(fio_dns.search);
+  fio_dns.search = NULL;
+  fio_dns.loaded = 0;
+  fio_unlock(&fio_dns.lock);
+  (void)ignr_;
+}
+
+/* loads the configuration and the hosts file (call within the lock) */
+static void fio_dns_load(void) {
+  if (fio_dns.loaded)
+    return;
+  if (!fio_dns.at_exit) {
+    fio_dns.at_exit = 1;
+    fio_state_callback_add(FIO_CALL_AT_EXIT, fio_dns_cleanup, NULL);
+  }
+  fio_dns_load_resolv();
+  fio_dns_load_hosts();
+  fio_dns.loaded = 1;
+}
+
+/** Clears the DNS cache. */
+void fio_dns_clear(void) {
+  fio_lock(&fio_dns.lock);
+  fio_dns_cache_reset(0);
+  fio_dns.loaded = 0;
+  fio_unlock(&fio_dns.lock);
+}
+
+/** Adds a name server, replacing the `/etc/resolv.conf` name servers. */
+int fio_dns_server_add(const char *address, const char *port) {
+  struct sockaddr_storage addr;
+  int ret = 0;
+  if (!address) {
+    fio_lock(&fio_dns.lock);
+    fio_dns.custom = 0;
+    fio_dns.loaded = 0;
+    fio_unlock(&fio_dns.lock);
+    return 0;
+  }
+  char *pos = (char *)port;
+  int64_t n = port ? fio_atol(&pos) : 53;
+  if ((port && *pos) || n <= 0 || n > 65535 ||
+      fio_dns_numeric(&addr, address, (uint16_t)n)) {
+    errno = EINVAL;
+    return -1;
+  }
+  fio_lock(&fio_dns.lock);
+  if (!fio_dns.custom) {
+    fio_dns.custom = 1;
+    fio_dns.count = 0;
+  }
+  if (fio_dns.count < FIO_DNS_MAX_SERVERS)
+    fio_dns.servers[fio_dns.count++] = addr;
+  else
+    ret = -1;
+  fio_unlock(&fio_dns.lock);
+  return ret;
+}
+
+/* stores the result and calls the waiting lookups */
+static void fio_dns_finish(const char *name, size_t len, uint64_t hash,
+                           fio_dns_result_s *result, uint32_t ttl) {
+  fio_ls_embd_s waiting = FIO_LS_INIT(waiting);
+  fio_lock(&fio_dns.lock);
+  fio_dns_entry_s *e = fio_dns_entry(name, len, hash);
+  e->pending = 0;
+  e->result = *result;
+  e->expires = fio_dns_now() + (ttl > FIO_DNS_MAX_TTL ? FIO_DNS_MAX_TTL : ttl);
+  while (fio_ls_embd_any(&e->waiting))
+    fio_ls_embd_push(&waiting, fio_ls_embd_shift(&e->waiting));
+  fio_unlock(&fio_dns.lock);
+  while (fio_ls_embd_any(&waiting)) {
+    fio_dns_waiter_s *w =
+        FIO_LS_EMBD_OBJ(fio_dns_waiter_s, node, fio_ls_embd_shift(&waiting));
+    w->on_result(w->udata, result);
+    fio_free(w);
+  }
+}
+
+/* *****************************************************************************
+DNS messages (RFC 1035)
+***************************************************************************** */
+
+/* writes a query (with an EDNS(0) OPT record), returns it's length or 0 */
+static size_t fio_dns_message_write(uint8_t *dest, uint16_t id,
+                                    const char *name, uint16_t type) {
+  uint8_t *pos = dest + 12;
+  dest[0] = id >> 8;
+  dest[1] = id & 0xFF;
+  dest[2] = 0x01; /* RD (recursion desired) */
+  memset(dest + 3, 0, 9);
+  dest[5] = 1;  /* QDCOUNT */
+  dest[11] = 1; /* ARCOUNT */
+  while (*name) {
+    size_t len = 0;
+    while (name[len] && name[len] != '.')
+      ++len;
+    if (!len || len > 63)
+      return 0;
+    *pos++ = (uint8_t)len;
+    memcpy(pos, name, len);
+    pos += len;
+    name += len + (name[len] == '.');
+  }
+  *pos++ = 0;
+  *pos++ = type >> 8;
+  *pos++ = type & 0xFF;
+  *pos++ = 0;
+  *pos++ = 1; /* class IN */
+  /* OPT: root name, type 41, the UDP payload size, no flags or options */
+  memcpy(pos, "\x00\x00\x29\x04\xD0\x00\x00\x00\x00\x00\x00", 11);
+  pos += 11;
+  return pos - dest;
+}
+
+/* skips a (possibly compressed) name, returns -1 on error */
+static int fio_dns_message_skip(const uint8_t *msg, size_t len, size_t *pos) {
+  while (*pos < len) {
+    if ((msg[*pos] & 0xC0) == 0xC0) {
+      *pos += 2;
+      return -(*pos > len);
+    }
+    if (msg[*pos] & 0xC0)
+      return -1;
+    if (!msg[*pos]) {
+      ++*pos;
+      return 0;
+    }
+    *pos += msg[*pos] + 1;
+  }
+  return -1;
+}
+
+/* compares a (possibly compressed) name with a dotted name (case insensitive)
+ * and skips it, returns -1 if the names differ */
+static int fio_dns_message_name_eq(const uint8_t *msg, size_t len, size_t *pos,
+                                   const char *name) {
+  size_t i = *pos;
+  size_t hops = 0;
+  if (fio_dns_message_skip(msg, len, pos))
+    return -1;
+  for (;;) {
+    if (i >= len)
+      return -1;
+    if ((msg[i] & 0xC0) == 0xC0) {
+      if (i + 1 >= len || ++hops > 16)
+        return -1;
+      i = ((msg[i] & 0x3F) << 8) | msg[i + 1];
+      continue;
+    }
+    size_t l = msg[i++];
+    if (!l)
+      break;
+    if (i + l > len)
+      return -1;
+    for (size_t j = 0; j < l; ++j) {
+      if (!name[j] || tolower(msg[i + j]) != (unsigned char)name[j])
+        return -1;
+    }
+    name += l;
+    if (*name == '.')
+      ++name;
+    else if (*name)
+      return -1;
+    i += l;
+  }
+  return -(*name != 0);
+}
+
+#define fio_dns_u16(p) ((uint16_t)(((p)[0] << 8) | (p)[1]))
+#define fio_dns_u32(p)                                                         \
+  (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) |                       \
+   ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+/* the information collected from an answer */
+typedef struct {
+  uint32_t ttl;
+  uint32_t negative_ttl;
+  uint8_t rcode;
+} fio_dns_answer_s;
+
+/**
+ * Reads an answer to a query for `name` of `type` into `result`.
+ *
+ * Returns -1 if the message isn't a valid answer to the query.
+ */
+static int fio_dns_message_read(const uint8_t *msg, size_t len,
+                                const char *name, uint16_t type,
+                                fio_dns_result_s *result,
+                                fio_dns_answer_s *answer) {
+  size_t pos = 12;
+  if (len < 12 || !(msg[2] & 0x80) || fio_dns_u16(msg + 4) != 1)
+    return -1;
+  if (fio_dns_message_name_eq(msg, len, &pos, name) || pos + 4 > len ||
+      fio_dns_u16(msg + pos) != type || fio_dns_u16(msg + pos + 2) != 1)
+    return -1;
+  pos += 4;
+  answer->rcode = msg[3] & 0x0F;
+  answer->ttl = FIO_DNS_MAX_TTL;
+  answer->negative_ttl = 0;
+  const size_t answers = fio_dns_u16(msg + 6);
+  const size_t records = answers + fio_dns_u16(msg + 8);
+  for (size_t i = 0; i < records; ++i) {
+    if (fio_dns_message_skip(msg, len, &pos) || pos + 10 > len)
+      return -1;
+    const uint16_t rtype = fio_dns_u16(msg + pos);
+    const uint16_t rclass = fio_dns_u16(msg + pos + 2);
+    uint32_t ttl = fio_dns_u32(msg + pos + 4);
+    const size_t rlen = fio_dns_u16(msg + pos + 8);
+    size_t data = pos + 10;
+    pos = data + rlen;
+    if (pos > len)
+      return -1;
+    if (ttl > 0x7FFFFFFF)
+      ttl = 0;
+    if (i < answers) {
+      /* CNAME records are followed by the canonical name's addresses */
+      if (rclass != 1 || rtype != type || rlen != (type == 1 ? 4U : 16U))
+        continue;
+      fio_dns_result_add(result, (type == 1 ? AF_INET : AF_INET6),
+                         msg + data);
+      if (answer->ttl > ttl)
+        answer->ttl = ttl;
+    } else if (rtype == 6 && rclass == 1) {
+      /* SOA: negative answers are cached for the SOA's minimum (RFC 2308) */
+      if (fio_dns_message_skip(msg, len, &data) ||
+          fio_dns_message_skip(msg, len, &data) || data + 20 != pos)
+        continue;
+      uint32_t minimum = fio_dns_u32(msg + data + 16);
+      answer->negative_ttl = (minimum < ttl ? minimum : ttl);
+    }
+  }
+  return 0;
+}
+
+/* *****************************************************************************
+DNS queries (UDP sockets managed by the reactor)
+***************************************************************************** */
+
+typedef struct {
+  fio_protocol_s pr;
+  fio_dns_result_s result;
+  uint64_t hash;
+  uint32_t ttl;
+  uint32_t negative_ttl;
+  /* query IDs, for the A and the AAAA queries */
+  uint16_t id[2];
+  /* 1 for an A answer, 2 for an AAAA answer */
+  uint8_t answered;
+  uint8_t delayed;
+  uint8_t done;
+  uint8_t tries;
+  uint8_t max_tries;
+  uint8_t timeout;
+  struct sockaddr_storage server;
+  /* the current candidate name (within `names`) */
+  char *candidate;
+  /* the candidate names (search list), terminated by an empty name */
+  char *names;
+  size_t len;
+  char name[];
+} fio_dns_query_s;
+
+static void fio_dns_query_on_data(intptr_t uuid, fio_protocol_s *pr);
+static void fio_dns_query_on_close(intptr_t uuid, fio_protocol_s *pr);
+
+/* sends the unanswered queries for the current candidate, returns -1 if the
+ * name server can't be reached (i.e., ECONNREFUSED) */
+static int fio_dns_query_send(intptr_t uuid, fio_dns_query_s *q) {
+  uint8_t msg[300];
+  for (size_t i = 0; i < 2; ++i) {
+    if (q->answered & (1 << i))
+      continue;
+    size_t len =
+        fio_dns_message_write(msg, q->id[i], q->candidate, (i ? 28 : 1));
+    if (!len) {
+      /* an invalid name is answered as missing */
+      q->answered |= (1 << i);
+      continue;
+    }
+    if (send(fio_uuid2fd(uuid), msg, len, 0) == -1 && errno != EAGAIN &&
+        errno != EWOULDBLOCK && errno != ENOBUFS)
+      return -1;
+  }
+  return 0;
+}
+
+/* opens a UDP socket to the next name server, returns -1 on error */
+static int fio_dns_query_open(fio_dns_query_s *q) {
+  fio_lock(&fio_dns.lock);
+  q->server = fio_dns.servers[q->tries % fio_dns.count];
+  fio_unlock(&fio_dns.lock);
+  int fd = socket(q->server.ss_family, SOCK_DGRAM, 0);
+  if (fd == -1)
+    return -1;
+  /* connected UDP sockets only receive the name server's datagrams */
+  if (fio_set_non_block(fd) ||
+      connect(fd, (struct sockaddr *)&q->server,
+              (q->server.ss_family == AF_INET ? sizeof(struct sockaddr_in)
+                                              : sizeof(struct sockaddr_in6)))) {
+    close(fd);
+    return -1;
+  }
+  fio_lock(&fd_data(fd).protocol_lock);
+  fio_clear_fd(fd, 1);
+  fio_unlock(&fd_data(fd).protocol_lock);
+  const intptr_t uuid = fd2uuid(fd);
+  q->pr = (fio_protocol_s){
+      .on_data = fio_dns_query_on_data,
+      .on_close = fio_dns_query_on_close,
+  };
+  const int failed = fio_dns_query_send(uuid, q);
+  fio_timeout_set(uuid, q->timeout);
+  fio_attach(uuid, &q->pr);
+  if (failed)
+    fio_force_close(uuid); /* try the next name server */
+  return 0;
+}
+
+/* completes the lookup, the query is freed once the socket is closed */
+static void fio_dns_query_complete(intptr_t uuid, fio_dns_query_s *q) {
+  q->done = 1;
+  fio_dns_result_order(&q->result);
+  if (q->result.count)
+    fio_dns_finish(q->name, q->len, q->hash, &q->result, q->ttl);
+  else
+    fio_dns_finish(q->name, q->len, q->hash, &q->result, q->negative_ttl);
+  fio_force_close(uuid);
+}
+
+/* moves to the next candidate name once both queries were answered */
+static void fio_dns_query_review(intptr_t uuid, fio_dns_query_s *q) {
+  if (q->answered != 3)
+    return;
+  if (q->result.count)
+    goto complete;
+  q->candidate += strlen(q->candidate) + 1;
+  if (!*q->candidate)
+    goto complete;
+  q->answered = 0;
+  q->delayed = 0;
+  q->id[0] = (uint16_t)fio_rand64();
+  q->id[1] = q->id[0] + 1;
+  if (fio_dns_query_send(uuid, q))
+    fio_force_close(uuid); /* try the next name server */
+  return;
+complete:
+  fio_dns_query_complete(uuid, q);
+}
+
+/* the Resolution Delay (RFC 8305) expired without an AAAA answer */
+static void fio_dns_query_delay(void *uuid_) {
+  fio_dns_query_s *q = (fio_dns_query_s *)fio_protocol_try_lock(
+      (intptr_t)uuid_, FIO_PR_LOCK_TASK);
+  if (!q) {
+    if (errno == EWOULDBLOCK)
+      fio_run_every(1, 1, fio_dns_query_delay, uuid_, NULL);
+    return;
+  }
+  if (!q->done && q->delayed && q->result.count) {
+    q->answered = 3;
+    fio_dns_query_review((intptr_t)uuid_, q);
+  }
+  fio_protocol_unlock(&q->pr, FIO_PR_LOCK_TASK);
+}
+
+static void fio_dns_query_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  fio_dns_query_s *q = (fio_dns_query_s *)pr;
+  uint8_t msg[FIO_DNS_UDP_SIZE];
+  ssize_t len = 0;
+  while (!q->done && (len = recv(fio_uuid2fd(uuid), msg, sizeof(msg), 0)) > 0) {
+    if (len < 12)
+      continue;
+    const uint16_t id = fio_dns_u16(msg);
+    const size_t i = (id == q->id[1]);
+    fio_dns_answer_s answer;
+    if ((id != q->id[i]) || (q->answered & (1 << i)) ||
+        fio_dns_message_read(msg, len, q->candidate, (i ? 28 : 1), &q->result,
+                             &answer))
+      continue;
+    if (answer.rcode && answer.rcode != 3) {
+      /* SERVFAIL, REFUSED, etc': try the next name server */
+      fio_force_close(uuid);
+      return;
+    }
+    q->answered |= (1 << i);
+    if (q->result.count && q->ttl > answer.ttl)
+      q->ttl = answer.ttl;
+    if (q->negative_ttl > answer.negative_ttl)
+      q->negative_ttl = answer.negative_ttl;
+    if (q->answered == 1 && q->result.count && !q->delayed) {
+      /* wait a little for the AAAA answer before connecting over IPv4 */
+      q->delayed = 1;
+      fio_run_every(FIO_DNS_RESOLUTION_DELAY, 1, fio_dns_query_delay,
+                    (void *)uuid, NULL);
+    }
+    fio_dns_query_review(uuid, q);
+  }
+  if (!q->done && len == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+      errno != EINTR)
+    fio_force_close(uuid); /* i.e., ECONNREFUSED, try the next name server */
+}
+
+static void fio_dns_query_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  fio_dns_query_s *q = (fio_dns_query_s *)pr;
+  if (!q->done) {
+    /* a timeout or an error, retry with the next name server */
+    while (++q->tries < q->max_tries) {
+      if (!fio_dns_query_open(q))
+        return;
+    }
+    q->done = 1;
+    q->result.count = 0;
+    fio_dns_finish(q->name, q->len, q->hash, &q->result, 0);
+  }
+  free(q->names);
+  fio_free(q);
+  (void)uuid;
+}
+
+/**
+ * Returns a (malloc allocated) list of NUL terminated candidate names, ending
+ * with an empty name. See the `search` and `ndots` options in resolv.conf(5).
+ *
+ * `search` is a list of NUL terminated domains, ending with an empty domain.
+ */
+static char *fio_dns_candidates(const char *name, size_t len, uint8_t absolute,
+                                const char *search, size_t ndots) {
+  size_t dots = 0;
+  for (size_t i = 0; i < len; ++i)
+    dots += (name[i] == '.');
+  size_t search_len = 0;
+  size_t domains = 0;
+  if (!absolute && search) {
+    while (search[search_len]) {
+      search_len += strlen(search + search_len) + 1;
+      ++domains;
+    }
+  }
+  /* each candidate is the name, a dot (or NUL) and a domain (with it's NUL) */
+  char *pos = malloc(((domains + 1) * (len + 1)) + search_len + 1);
+  FIO_ASSERT_ALLOC(pos);
+  char *names = pos;
+  if (absolute || dots >= ndots) {
+    memcpy(pos, name, len + 1);
+    pos += len + 1;
+  }
+  for (size_t i = 0; i < search_len; i += strlen(search + i) + 1) {
+    size_t l = strlen(search + i);
+    if (len + l + 1 > 253)
+      continue;
+    memcpy(pos, name, len);
+    pos[len] = '.';
+    memcpy(pos + len + 1, search + i, l + 1);
+    pos += len + l + 2;
+  }
+  if (!absolute && dots < ndots) {
+    memcpy(pos, name, len + 1);
+    pos += len + 1;
+  }
+  *pos = 0;
+  return names;
+}
+
+/* starts a query, returns -1 on error */
+static int fio_dns_query_new(const char *name, size_t len, uint64_t hash,
+                             uint8_t absolute) {
+  fio_dns_query_s *q = fio_malloc(sizeof(*q) + len + 1);
+  FIO_ASSERT_ALLOC(q);
+  *q = (fio_dns_query_s){
+      .hash = hash,
+      .ttl = FIO_DNS_MAX_TTL,
+      .negative_ttl = FIO_DNS_MAX_TTL,
+      .len = len,
+  };
+  memcpy(q->name, name, len + 1);
+  q->id[0] = (uint16_t)fio_rand64();
+  q->id[1] = q->id[0] + 1;
+  fio_lock(&fio_dns.lock);
+  q->names =
+      fio_dns_candidates(name, len, absolute, fio_dns.search, fio_dns.ndots);
+  q->candidate = q->names;
+  q->max_tries = fio_dns.attempts * fio_dns.count;
+  q->timeout = fio_dns.timeout;
+  fio_unlock(&fio_dns.lock);
+  for (; q->tries < q->max_tries; ++q->tries) {
+    if (!fio_dns_query_open(q))
+      return 0;
+  }
+  free(q->names);
+  fio_free(q);
+  return -1;
+}
+
+/** Resolves a host name without blocking. */
+void fio_dns_resolve(const char *name,
+                     void (*on_result)(void *udata, fio_dns_result_s *result),
+                     void *udata) {
+  fio_dns_result_s result = {.count = 0};
+  char key[256];
+  uint8_t absolute;
+  size_t len = fio_dns_name(key, name, &absolute);
+  if (!len)
+    goto finish;
+  if (!fio_dns_numeric(result.addr, key, 0)) {
+    result.count = 1;
+    goto finish;
+  }
+  const uint64_t hash = fio_dns_hash(key, len);
+  fio_lock(&fio_dns.lock);
+  fio_dns_load();
+  fio_dns_entry_s *e = fio_dns_entry(key, len, hash);
+  if (!e->pending && (e->hosts || e->expires > fio_dns_now())) {
+    result = e->result;
+    fio_unlock(&fio_dns.lock);
+    goto finish;
+  }
+  fio_dns_waiter_s *w = fio_malloc(sizeof(*w));
+  FIO_ASSERT_ALLOC(w);
+  *w = (fio_dns_waiter_s){.on_result = on_result, .udata = udata};
+  fio_ls_embd_push(&e->waiting, &w->node);
+  if (e->pending) {
+    fio_unlock(&fio_dns.lock);
+    return;
+  }
+  e->pending = 1;
+  fio_unlock(&fio_dns.lock);
+  if (fio_dns_query_new(key, len, hash, absolute))
+    fio_dns_finish(key, len, hash, &result, 0);
+  return;
+finish:
+  on_result(udata, &result);
+}
+
+/* *****************************************************************************
+Connection racing (Happy Eyeballs, RFC 8305)
+***************************************************************************** */
+
+#ifndef FIO_CONNECT_ATTEMPT_DELAY
+/** Milliseconds between connection attempts to a host's addresses. */
+#define FIO_CONNECT_ATTEMPT_DELAY 250
+#endif
+
+/* the connection attempts for a resolved host */
+typedef struct {
+  /* the connection's reserved uuid (an unconnected socket) */
+  intptr_t uuid;
+  intptr_t attempts[FIO_DNS_MAX_ADDRESSES];
+  volatile uintptr_t ref;
+  fio_lock_i lock;
+  uint16_t port;
+  uint8_t fastopen;
+  uint8_t timeout;
+  uint8_t count;
+  uint8_t next;
+  uint8_t pending;
+  uint8_t done;
+  struct sockaddr_storage addr[FIO_DNS_MAX_ADDRESSES];
+} fio_connect_race_s;
+
+typedef struct {
+  fio_protocol_s pr;
+  fio_connect_race_s *race;
+  uint8_t won;
+} fio_connect_attempt_s;
+
+static void fio_connect_race_free(void *race_) {
+  fio_connect_race_s *race = race_;
+  if (fio_atomic_sub(&race->ref, 1))
+    return;
+  fio_free(race);
+}
+
+static void fio_connect_race_next(fio_connect_race_s *race);
+
+/* moves the winning socket to the reserved file descriptor (keeping the uuid
+ * returned by `fio_connect`) and closes the other attempts */
+static void fio_connect_race_won(fio_connect_race_s *race, intptr_t winner,
+                                 fio_connect_attempt_s *a) {
+  const int fd = fio_uuid2fd(race->uuid);
+  const int wfd = fio_uuid2fd(winner);
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  int ok;
+  a->won = 1;
+  /* the epoll registration would otherwise outlive the closed descriptor */
+  fio_poll_remove_fd(wfd);
+  fio_lock(&fd_data(fd).protocol_lock);
+  ok = uuid_is_valid(race->uuid) && dup2(wfd, fd) != -1;
+  if (ok && !getpeername(fd, (struct sockaddr *)&addr, &len))
+    fio_tcp_addr_cpy(fd, addr.ss_family, (struct sockaddr *)&addr);
+  fio_unlock(&fd_data(fd).protocol_lock);
+  fio_force_close(winner);
+  for (size_t i = 0; i < race->next; ++i) {
+    if (race->attempts[i] != winner)
+      fio_force_close(race->attempts[i]);
+  }
+  if (ok) {
+    touchfd(fd);
+    fio_poll_add(fd);
+  }
+}
+
+static void fio_connect_attempt_on_ready(intptr_t uuid, fio_protocol_s *pr) {
+  fio_connect_attempt_s *a = (fio_connect_attempt_s *)pr;
+  fio_connect_race_s *race = a->race;
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (a->pr.on_ready == mock_on_ev)
+    return;
+  a->pr.on_ready = mock_on_ev;
+  if (getsockopt(fio_uuid2fd(uuid), SOL_SOCKET, SO_ERROR, &err, &len) || err)
+    goto close;
+  fio_lock(&race->lock);
+  const uint8_t won = !race->done;
+  race->done = 1;
+  fio_unlock(&race->lock);
+  if (!won)
+    goto close;
+  fio_connect_race_won(race, uuid, a);
+  return;
+close:
+  fio_force_close(uuid);
+}
+
+static void fio_connect_attempt_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  fio_connect_attempt_s *a = (fio_connect_attempt_s *)pr;
+  fio_connect_race_s *race = a->race;
+  if (!a->won) {
+    fio_lock(&race->lock);
+    --race->pending;
+    fio_unlock(&race->lock);
+    /* a failed attempt starts the next one without waiting */
+    fio_connect_race_next(race);
+  }
+  fio_free(a);
+  fio_connect_race_free(race);
+  (void)uuid;
+}
+
+/* starts a connection attempt, returns -1 on error */
+static int fio_connect_attempt(fio_connect_race_s *race, size_t i) {
+  struct sockaddr *addr = (struct sockaddr *)(race->addr + i);
+  int fd = socket(addr->sa_family, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  int one = 1;
+  if (fio_set_non_block(fd) < 0)
+    goto error;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef TCP_FASTOPEN_CONNECT
+  if (race->fastopen)
+    setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one));
+#endif
+  if (connect(fd, addr,
+              (addr->sa_family == AF_INET ? sizeof(struct sockaddr_in)
+                                          : sizeof(struct sockaddr_in6))) ==
+          -1 &&
+      errno != EINPROGRESS)
+    goto error;
+  fio_lock(&fd_data(fd).protocol_lock);
+  fio_clear_fd(fd, 1);
+  fio_unlock(&fd_data(fd).protocol_lock);
+  fio_tcp_addr_cpy(fd, addr->sa_family, addr);
+  fio_connect_attempt_s *a = fio_malloc(sizeof(*a));
+  FIO_ASSERT_ALLOC(a);
+  *a = (fio_connect_attempt_s){
+      .pr =
+          {
+              .on_ready = fio_connect_attempt_on_ready,
+              .on_close = fio_connect_attempt_on_close,
+          },
+      .race = race,
+  };
+  fio_atomic_add(&race->ref, 1);
+  race->attempts[i] = fd2uuid(fd);
+  fio_timeout_set(fd2uuid(fd), race->timeout);
+  fio_attach(fd2uuid(fd), &a->pr);
+  return 0;
+error:
+  close(fd);
+  return -1;
+}
+
+/* starts the next attempt, failing the connection once all attempts failed */
+static void fio_connect_race_next(fio_connect_race_s *race) {
+  for (;;) {
+    fio_lock(&race->lock);
+    if (race->done || race->next >= race->count) {
+      const uint8_t failed = !race->done && !race->pending;
+      race->done |= failed;
+      fio_unlock(&race->lock);
+      if (failed)
+        fio_force_close(race->uuid); /* calls `on_fail` */
+      return;
+    }
+    const size_t i = race->next++;
+    ++race->pending;
+    fio_unlock(&race->lock);
+    if (!fio_connect_attempt(race, i))
+      return;
+    fio_lock(&race->lock);
+    --race->pending;
+    fio_unlock(&race->lock);
+  }
+}
+
+/* the Connection Attempt Delay expired */
+static void fio_connect_race_timer(void *race_) {
+  fio_connect_race_s *race = race_;
+  if (!race->done && uuid_is_valid(race->uuid))
+    fio_connect_race_next(race);
+}
+
+static void fio_connect_on_resolved(void *race_, fio_dns_result_s *result) {
+  fio_connect_race_s *race = race_;
+  for (size_t i = 0; i < FIO_DNS_MAX_ADDRESSES; ++i)
+    race->attempts[i] = -1;
+  if (!result->count || !uuid_is_valid(race->uuid)) {
+    fio_force_close(race->uuid); /* calls `on_fail` */
+    fio_connect_race_free(race);
+    return;
+  }
+  race->count = (uint8_t)result->count;
+  for (size_t i = 0; i < result->count; ++i) {
+    race->addr[i] = result->addr[i];
+    if (race->addr[i].ss_family == AF_INET)
+      ((struct sockaddr_in *)(race->addr + i))->sin_port = race->port;
+    else
+      ((struct sockaddr_in6 *)(race->addr + i))->sin6_port = race->port;
+  }
+  /* a Fast Open socket "connects" before the SYN is sent, so it can't race */
+  if (race->count > 1) {
+    race->fastopen = 0;
+    fio_atomic_add(&race->ref, 1);
+    fio_run_every(FIO_CONNECT_ATTEMPT_DELAY, race->count - 1,
+                  fio_connect_race_timer, race, fio_connect_race_free);
+  }
+  fio_connect_race_next(race);
+  fio_connect_race_free(race);
+}
+
+/* *****************************************************************************
+The connection protocol (use the facil.io API to make a socket and attach it)
+***************************************************************************** */
+
+typedef struct {
+  fio_protocol_s pr;
+  intptr_t uuid;
+  void *udata;
+  void *tls;
+  void (*on_connect)(intptr_t uuid, void *udata);
+  void (*on_fail)(intptr_t uuid, void *udata);
+} fio_connect_protocol_s;
+
+static void fio_connect_on_close(intptr_t uuid, fio_protocol_s *pr_) {
+  fio_connect_protocol_s *pr = (fio_connect_protocol_s *)pr_;
+  if (pr->on_fail)
+    pr->on_fail(uuid, pr->udata);
+  if (pr->tls)
+    fio_tls_destroy(pr->tls);
+  fio_free(pr);
+  (void)uuid;
 }
 
 static void fio_connect_on_ready(intptr_t uuid, fio_protocol_s *pr_) {
@@ -4739,13 +6442,58 @@ static void fio_connect_on_ready_tls_alpn(intptr_t uuid, fio_protocol_s *pr_) {
 /* stub for sublime text function navigation */
 intptr_t fio_connect___(struct fio_connect_args args);
 
+/* reserves a uuid for a host name, the connection is made once resolved */
+static fio_connect_race_s *fio_connect_resolve(struct fio_connect_args *args,
+                                               uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1)
+    return NULL;
+  if (fio_set_non_block(fd) < 0) {
+    close(fd);
+    return NULL;
+  }
+  fio_lock(&fd_data(fd).protocol_lock);
+  fio_clear_fd(fd, 1);
+  fio_unlock(&fd_data(fd).protocol_lock);
+  size_t len = strlen(args->address);
+  if (len < sizeof(fd_data(fd).addr)) {
+    memcpy(fd_data(fd).addr, args->address, len + 1);
+    fd_data(fd).addr_len = len;
+  }
+  fio_connect_race_s *race = fio_malloc(sizeof(*race));
+  FIO_ASSERT_ALLOC(race);
+  *race = (fio_connect_race_s){
+      .uuid = fd2uuid(fd),
+      .ref = 1,
+      .lock = FIO_LOCK_INIT,
+      .port = htons(port),
+      .fastopen = args->fastopen,
+      .timeout = args->timeout,
+  };
+  return race;
+}
+
 intptr_t fio_connect FIO_IGNORE_MACRO(struct fio_connect_args args) {
+  fio_connect_race_s *race = NULL;
+  intptr_t uuid;
   if ((!args.on_connect && (!args.tls || !fio_tls_alpn_count(args.tls))) ||
       (!args.address && !args.port)) {
     errno = EINVAL;
     goto error;
   }
-  const intptr_t uuid = fio_socket(args.address, args.port, 0);
+  {
+    struct sockaddr_storage addr;
+    char *pos = (char *)args.port;
+    int64_t port = args.port ? fio_atol(&pos) : 0;
+    if (args.address && port > 0 && port <= 65535 && !*pos &&
+        fio_dns_numeric(&addr, args.address, 0)) {
+      /* a host name, don't block the reactor while resolving it */
+      race = fio_connect_resolve(&args, (uint16_t)port);
+      uuid = race ? race->uuid : -1;
+    } else {
+      uuid = fio_socket_internal(args.address, args.port, 0, args.fastopen);
+    }
+  }
   if (uuid == -1)
     goto error;
   fio_timeout_set(uuid, args.timeout);
@@ -4771,6 +6519,17 @@ intptr_t fio_connect FIO_IGNORE_MACRO(struct fio_connect_args args) {
       .on_connect = args.on_connect,
       .on_fail = args.on_fail,
   };
+  if (race) {
+    /* the reserved socket isn't polled until a connection attempt won */
+    pr->pr.on_data = mock_on_data;
+    pr->pr.on_shutdown = mock_on_shutdown;
+    pr->pr.ping = mock_ping;
+    fio_lock(&uuid_data(uuid).protocol_lock);
+    uuid_data(uuid).protocol = &pr->pr;
+    fio_unlock(&uuid_data(uuid).protocol_lock);
+    fio_dns_resolve(args.address, fio_connect_on_resolved, race);
+    return uuid;
+  }
   fio_attach(uuid, &pr->pr);
   return uuid;
 error:
@@ -5102,6 +6861,11 @@ typedef enum fio_cluster_message_type_e {
   FIO_CLUSTER_MSG_SHUTDOWN,
   FIO_CLUSTER_MSG_ERROR,
   FIO_CLUSTER_MSG_PING,
+  FIO_CLUSTER_MSG_SHM_ATTACH,
+  FIO_CLUSTER_MSG_SHM_READY,
+  FIO_CLUSTER_MSG_SHM_PAUSE,
+  FIO_CLUSTER_MSG_SHM_RESUME,
+  FIO_CLUSTER_MSG_METRICS,
 } fio_cluster_message_type_e;
 
 typedef struct fio_collection_s fio_collection_s;
@@ -5180,6 +6944,7 @@ static int fio_channel_cmp(channel_s *ch1, channel_s *ch2) {
 #define FIO_SET_OBJ_COMPARE(o1, o2) fio_channel_cmp((o1), (o2))
 #define FIO_SET_OBJ_DESTROY(obj) fio_channel_free((obj))
 #define FIO_SET_OBJ_COPY(dest, src) ((dest) = fio_channel_copy((src)))
+#define FIO_SET_SWISS 1
 #include <fio.h>
 
 #define FIO_FORCE_MALLOC_TMP 1
@@ -5191,6 +6956,7 @@ static int fio_channel_cmp(channel_s *ch1, channel_s *ch2) {
 #define FIO_SET_NAME fio_engine_set
 #define FIO_SET_OBJ_TYPE fio_pubsub_engine_s *
 #define FIO_SET_OBJ_COMPARE(k1, k2) ((k1) == (k2))
+#define FIO_SET_SWISS 1
 #include <fio.h>
 
 struct fio_collection_s {
@@ -5201,9 +6967,16 @@ struct fio_collection_s {
 #define COLLECTION_INIT                                                        \
   { .channels = FIO_SET_INIT, .lock = FIO_LOCK_INIT }
 
+#if FIO_PUBSUB_CHANNEL_SHARDS < 1 ||                                          \
+    (FIO_PUBSUB_CHANNEL_SHARDS & (FIO_PUBSUB_CHANNEL_SHARDS - 1))
+#error FIO_PUBSUB_CHANNEL_SHARDS must be a power of 2
+#endif
+
 static struct {
   fio_collection_s filters;
-  fio_collection_s pubsub;
+  /* named channels are sharded, so publishing and (un)subscribing to different
+   * channels rarely contend for the same collection lock. */
+  fio_collection_s pubsub[FIO_PUBSUB_CHANNEL_SHARDS];
   fio_collection_s patterns;
   struct {
     fio_engine_set_s set;
@@ -5215,12 +6988,22 @@ static struct {
   } meta;
 } fio_postoffice = {
     .filters = COLLECTION_INIT,
-    .pubsub = COLLECTION_INIT,
     .patterns = COLLECTION_INIT,
     .engines.lock = FIO_LOCK_INIT,
     .meta.lock = FIO_LOCK_INIT,
 };
 
+/** Loops over every named channel collection (shard). */
+#define FIO_PUBSUB_SHARD_FOR(c)                                                \
+  for (fio_collection_s *c = fio_postoffice.pubsub;                            \
+       c < fio_postoffice.pubsub + FIO_PUBSUB_CHANNEL_SHARDS; ++c)
+
+/** Returns the named channel collection (shard) for the hashed channel name. */
+static inline fio_collection_s *fio_pubsub_shard(uint64_t hashed) {
+  return fio_postoffice.pubsub +
+         ((hashed >> 32) & (FIO_PUBSUB_CHANNEL_SHARDS - 1));
+}
+
 /** used to contain the message before it's passed to the handler */
 typedef struct {
   fio_msg_s msg;
@@ -5344,6 +7127,12 @@ static inline void fio_msg_internal_free(fio_msg_internal_s *m) {
 
 static void fio_msg_internal_free2(void *m) { fio_msg_internal_free(m); }
 
+/** Returns the cluster message type stored in the message's frame header. */
+static inline uint32_t fio_msg_internal_type(fio_msg_internal_s *m) {
+  return fio_str2u32((uint8_t *)m + sizeof(*m) +
+                     (m->meta_len * sizeof(*m->meta)) + 8);
+}
+
 /* add reference count to fio_msg_internal_s */
 static inline fio_msg_internal_s *fio_msg_internal_dup(fio_msg_internal_s *m) {
   fio_atomic_add(&m->ref, 1);
@@ -5397,16 +7186,15 @@ static channel_s *fio_filter_dup_lock(uint32_t filter) {
 
 /** Creates / finds a pubsub channel, adds a reference count and locks it. */
 static channel_s *fio_channel_dup_lock(fio_str_info_s name) {
+  uint64_t hashed_name = FIO_HASH_FN(
+      name.data, name.len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
   channel_s ch = (channel_s){
       .name = name.data,
       .name_len = name.len,
-      .parent = &fio_postoffice.pubsub,
+      .parent = fio_pubsub_shard(hashed_name),
       .ref = 8, /* avoid freeing stack memory */
   };
-  uint64_t hashed_name = FIO_HASH_FN(
-      name.data, name.len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
-  channel_s *ch_p =
-      fio_filter_dup_lock_internal(&ch, hashed_name, &fio_postoffice.pubsub);
+  channel_s *ch_p = fio_filter_dup_lock_internal(&ch, hashed_name, ch.parent);
   if (fio_ls_embd_is_empty(&ch_p->subscriptions)) {
     fio_pubsub_on_channel_create(ch_p);
   }
@@ -5615,16 +7403,18 @@ int fio_pubsub_is_attached(fio_pubsub_engine_s *engine) {
  * exclusive subscription process.
  */
 void fio_pubsub_reattach(fio_pubsub_engine_s *eng) {
-  fio_lock(&fio_postoffice.pubsub.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash)
-      continue;
-    eng->subscribe(
-        eng,
-        (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
-        NULL);
+  FIO_PUBSUB_SHARD_FOR(c) {
+    fio_lock(&c->lock);
+    FIO_SET_FOR_LOOP(&c->channels, pos) {
+      if (!pos->hash)
+        continue;
+      eng->subscribe(
+          eng,
+          (fio_str_info_s){.data = pos->obj->name, .len = pos->obj->name_len},
+          NULL);
+    }
+    fio_unlock(&c->lock);
   }
-  fio_unlock(&fio_postoffice.pubsub.lock);
   fio_lock(&fio_postoffice.patterns.lock);
   FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
     if (!pos->hash)
@@ -5696,8 +7486,8 @@ static channel_s *fio_channel_find_dup(fio_str_info_s name) {
   channel_s tmp = {.name = name.data, .name_len = name.len};
   uint64_t hashed_name = FIO_HASH_FN(
       name.data, name.len, &fio_postoffice.pubsub, &fio_postoffice.pubsub);
-  channel_s *ch =
-      fio_channel_find_dup_internal(&tmp, hashed_name, &fio_postoffice.pubsub);
+  channel_s *ch = fio_channel_find_dup_internal(&tmp, hashed_name,
+                                                fio_pubsub_shard(hashed_name));
   return ch;
 }
 
@@ -5723,6 +7513,7 @@ static void fio_perform_subscription_callback(void *s_, void *msg_) {
               .filter = msg->filter,
               .udata1 = s->udata1,
               .udata2 = s->udata2,
+              .is_json = (uint8_t)msg->is_json,
           },
       .meta_len = msg->meta_len,
       .meta = msg->meta,
@@ -5737,6 +7528,7 @@ static void fio_perform_subscription_callback(void *s_, void *msg_) {
     fio_defer_push_task(fio_perform_subscription_callback, s_, msg_);
     return;
   }
+  FIO_METRICS_ADD(pubsub_delivered, 1);
   fio_msg_internal_free(msg);
   fio_subscription_free(s);
 }
@@ -5772,6 +7564,7 @@ finish:
 
 /** Publishes the message to the current process and frees the strings. */
 static void fio_publish2process(fio_msg_internal_s *m) {
+  FIO_METRICS_ADD(pubsub_received, 1);
   fio_msg_internal_finalize(m);
   channel_s *ch;
   if (m->filter) {
@@ -5824,6 +7617,7 @@ finish:
 #define FIO_SET_KEY_COMPARE(k1, k2) fio_str_iseq(&(k1), &(k2))
 #define FIO_SET_KEY_DESTROY(key) fio_str_free(&(key))
 #define FIO_SET_OBJ_DESTROY(obj) fio_unsubscribe(obj)
+#define FIO_SET_SWISS 1
 #include <fio.h>
 
 #define FIO_CLUSTER_NAME_LIMIT 255
@@ -5842,78 +7636,520 @@ typedef struct cluster_pr_s {
   int32_t filter;
   uint32_t length;
   fio_lock_i lock;
+#if FIO_CLUSTER_SHM
+  /* the shared memory ring read by this connection (if any) */
+  void *shm;
+  /* set while the ring's producer is using the socket (see SHM_PAUSE) */
+  uint8_t shm_paused;
+#endif
+  /* the worker's latest metrics report (root) */
+  fio_metrics_s metrics;
   uint8_t buffer[CLUSTER_READ_BUFFER];
 } cluster_pr_s;
 
 static struct cluster_data_s {
   intptr_t uuid;
+  /* the root's worker connections (cluster_pr_s pointers) */
   fio_ls_s clients;
   fio_lock_i lock;
+  /* root: the metrics of workers that exited, worker: the cluster's totals */
+  fio_metrics_s metrics;
+  uint8_t metrics_ready;
   char name[FIO_CLUSTER_NAME_LIMIT + 1];
 } cluster_data = {.clients = FIO_LS_INIT(cluster_data.clients),
                   .lock = FIO_LOCK_INIT};
 
-static void fio_cluster_data_cleanup(int delete_file) {
-  if (delete_file && cluster_data.name[0]) {
-#if DEBUG
-    FIO_LOG_DEBUG("(%d) unlinking cluster's Unix socket.", (int)getpid());
-#endif
-    unlink(cluster_data.name);
+static void fio_cluster_data_cleanup(int delete_file) {
+  if (delete_file && cluster_data.name[0]) {
+#if DEBUG
+    FIO_LOG_DEBUG("(%d) unlinking cluster's Unix socket.", (int)getpid());
+#endif
+    unlink(cluster_data.name);
+  }
+  while (fio_ls_any(&cluster_data.clients)) {
+    cluster_pr_s *pr = fio_ls_pop(&cluster_data.clients);
+    if (pr->uuid > 0) {
+      fio_close(pr->uuid);
+    }
+  }
+  cluster_data.uuid = 0;
+  cluster_data.lock = FIO_LOCK_INIT;
+  cluster_data.clients = (fio_ls_s)FIO_LS_INIT(cluster_data.clients);
+}
+
+static void fio_cluster_cleanup(void *ignore) {
+  /* cleanup the cluster data */
+  fio_cluster_data_cleanup(fio_parent_pid() == getpid());
+  (void)ignore;
+}
+
+static void fio_cluster_init(void) {
+  fio_cluster_data_cleanup(0);
+  /* create a unique socket name */
+  char *tmp_folder = getenv("TMPDIR");
+  uint32_t tmp_folder_len = 0;
+  if (!tmp_folder || ((tmp_folder_len = (uint32_t)strlen(tmp_folder)) >
+                      (FIO_CLUSTER_NAME_LIMIT - 28))) {
+#ifdef P_tmpdir
+    tmp_folder = (char *)P_tmpdir;
+    if (tmp_folder)
+      tmp_folder_len = (uint32_t)strlen(tmp_folder);
+#else
+    tmp_folder = "/tmp/";
+    tmp_folder_len = 5;
+#endif
+  }
+  if (tmp_folder_len >= (FIO_CLUSTER_NAME_LIMIT - 28)) {
+    tmp_folder_len = 0;
+  }
+  if (tmp_folder_len) {
+    memcpy(cluster_data.name, tmp_folder, tmp_folder_len);
+    if (cluster_data.name[tmp_folder_len - 1] != '/')
+      cluster_data.name[tmp_folder_len++] = '/';
+  }
+  memcpy(cluster_data.name + tmp_folder_len, "facil-io-sock-", 14);
+  tmp_folder_len += 14;
+  tmp_folder_len +=
+      snprintf(cluster_data.name + tmp_folder_len,
+               FIO_CLUSTER_NAME_LIMIT - tmp_folder_len, "%d", (int)getpid());
+  cluster_data.name[tmp_folder_len] = 0;
+
+  /* remove if existing */
+  unlink(cluster_data.name);
+  /* add cleanup callback */
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio_cluster_cleanup, NULL);
+}
+
+/* *****************************************************************************
+ * Shared Memory Transport (optional, see FIO_CLUSTER_SHM)
+ *
+ * The root process creates a slot for each worker before forking. Each slot
+ * contains a single producer / single consumer ring in each direction, as well
+ * as an eventfd "doorbell" for each ring.
+ *
+ * Frames are identical to the Unix socket frames (16 byte header, channel and
+ * data), padded to 8 bytes. The doorbell is rung only when the ring was empty,
+ * so consumers handle all available messages per wakeup.
+ *
+ * The Unix socket is still used for control messages, for the initial handshake
+ * and as a fallback whenever a message doesn't fit in the ring.
+ *
+ * Messages keep their order: once a message is sent using the socket, the
+ * producer sends a PAUSE message and keeps using the socket until the consumer
+ * handled the PAUSE (draining the ring and pausing it). A RESUME message is
+ * sent before the ring is used again. Rings start paused, so messages sent
+ * before the ring was ready are handled first.
+ **************************************************************************** */
+#if FIO_CLUSTER_SHM
+#include <sys/eventfd.h>
+
+#if (FIO_CLUSTER_SHM_RING_SIZE & (FIO_CLUSTER_SHM_RING_SIZE - 1)) ||           \
+    FIO_CLUSTER_SHM_RING_SIZE < 4096
+#error FIO_CLUSTER_SHM_RING_SIZE must be a power of 2 (4096 or more)
+#endif
+
+/* marks the end of the ring as unused, the next frame starts at offset 0 */
+#define FIO_CLUSTER_SHM_WRAP ((uint32_t)0xFFFFFFFFUL)
+
+/* the length of a message frame in the ring (padded to 8 bytes) */
+#define FIO_CLUSTER_SHM_FRAME_LEN(ch_len, data_len)                            \
+  ((16 + (size_t)(ch_len) + (size_t)(data_len) + 2 + 7) & (~(size_t)7))
+
+/** A single producer, single consumer byte ring in shared memory. */
+typedef struct {
+  /** written only by the consumer. */
+  volatile size_t head;
+  /** written only by the consumer: the number of PAUSE messages handled. */
+  volatile size_t paused;
+  uint8_t pad_[64 - (sizeof(size_t) * 2)];
+  /** written only by the producer. */
+  volatile size_t tail;
+  /** written only by the producer: the number of PAUSE messages sent. */
+  size_t pauses;
+  /** producer threads (in the same process) take turns. */
+  fio_lock_i lock;
+  /** set by the producer while it's using the socket. */
+  uint8_t fallback;
+  uint8_t pad2_[64 - (sizeof(size_t) * 2) - sizeof(fio_lock_i) - 1];
+  uint8_t buffer[FIO_CLUSTER_SHM_RING_SIZE];
+} fio_cluster_ring_s;
+
+/** A worker's slot. */
+typedef struct {
+  /** the worker process that claimed the slot (0 == free). */
+  volatile pid_t pid;
+  /** worker => root doorbell (eventfd). */
+  int up_fd;
+  /** root => worker doorbell (eventfd). */
+  int down_fd;
+  /** root only: the worker's cluster connection. */
+  intptr_t uuid;
+  /** root only: the doorbell's uuid. */
+  intptr_t doorbell;
+  /** worker => root messages. */
+  fio_cluster_ring_s up;
+  /** root => worker messages. */
+  fio_cluster_ring_s down;
+} fio_cluster_shm_slot_s;
+
+static struct {
+  fio_cluster_shm_slot_s *slots;
+  size_t count;
+  /** worker only: the slot claimed by the worker. */
+  fio_cluster_shm_slot_s *own;
+  /** worker only: set once the root process is reading from the slot. */
+  volatile uint8_t ready;
+} fio_cluster_shm = {.slots = NULL};
+
+/* the doorbell protocol forwards wakeups to the cluster connection */
+typedef struct {
+  fio_protocol_s protocol;
+  intptr_t target;
+} fio_cluster_doorbell_s;
+
+static void fio_cluster_doorbell_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  uint64_t count;
+  fio_read(uuid, &count, sizeof(count));
+  fio_force_event(((fio_cluster_doorbell_s *)pr)->target, FIO_EVENT_ON_DATA);
+}
+
+static void fio_cluster_doorbell_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  free(pr);
+  (void)uuid;
+}
+
+/* attaches a copy of the eventfd to the reactor, so closing it is safe */
+static intptr_t fio_cluster_doorbell_attach(int event_fd, intptr_t target) {
+  int fd = dup(event_fd);
+  if (fd == -1)
+    return -1;
+  fio_cluster_doorbell_s *d = malloc(sizeof(*d));
+  FIO_ASSERT_ALLOC(d);
+  *d = (fio_cluster_doorbell_s){
+      .protocol =
+          {
+              .on_data = fio_cluster_doorbell_on_data,
+              .on_close = fio_cluster_doorbell_on_close,
+              .on_shutdown = mock_on_shutdown_eternal,
+              .ping = mock_ping_eternal,
+          },
+      .target = target,
+  };
+  intptr_t uuid = fio_fd2uuid(fd);
+  fio_attach(uuid, &d->protocol);
+  return uuid;
+}
+
+/**
+ * Pushes a message to the ring (the ring's lock must be held).
+ *
+ * Returns -1 if the ring is full, otherwise returns 1 if the consumer should be
+ * woken up (see `fio_cluster_ring_wake`) and 0 if it's already awake.
+ */
+static int fio_cluster_ring_push(fio_cluster_ring_s *r,
+                                 fio_msg_internal_s *m) {
+  const size_t len = FIO_CLUSTER_SHM_FRAME_LEN(m->channel.len, m->data.len);
+  if (len > (FIO_CLUSTER_SHM_RING_SIZE >> 2))
+    return -1;
+  const size_t start = r->tail;
+  size_t tail = start;
+  size_t pos = tail & (FIO_CLUSTER_SHM_RING_SIZE - 1);
+  const size_t edge = FIO_CLUSTER_SHM_RING_SIZE - pos;
+  const size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  if (FIO_CLUSTER_SHM_RING_SIZE - (tail - head) <
+      len + (edge < len ? edge : 0))
+    return -1;
+  if (edge < len) {
+    fio_u2str32(r->buffer + pos, FIO_CLUSTER_SHM_WRAP);
+    tail += edge;
+    pos = 0;
+  }
+  memcpy(r->buffer + pos,
+         (uint8_t *)m + sizeof(*m) + (m->meta_len * sizeof(*m->meta)),
+         16 + m->channel.len + m->data.len + 2);
+  __atomic_store_n(&r->tail, tail + len, __ATOMIC_SEQ_CST);
+  /* the consumer might be asleep only if it consumed everything before us */
+  return (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == start);
+}
+
+/** Rings the consumer's doorbell. */
+static void fio_cluster_ring_wake(int event_fd) {
+  uint64_t one = 1;
+  if (write(event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+    FIO_LOG_ERROR("(%d) cluster doorbell failed.", (int)getpid());
+  }
+}
+
+/** Handles all the messages in the ring using the connection's handler. */
+static void fio_cluster_ring_drain(cluster_pr_s *c, fio_cluster_ring_s *r) {
+  /* the socket's parser state might be mid-message */
+  fio_msg_internal_s *const old_msg = c->msg;
+  const uint32_t old_type = c->type;
+  const int32_t old_filter = c->filter;
+  size_t head = r->head;
+  while (head != __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST)) {
+    const size_t pos = head & (FIO_CLUSTER_SHM_RING_SIZE - 1);
+    uint8_t *frame = r->buffer + pos;
+    const uint32_t ch_len = fio_str2u32(frame);
+    if (ch_len == FIO_CLUSTER_SHM_WRAP) {
+      head += FIO_CLUSTER_SHM_RING_SIZE - pos;
+      continue;
+    }
+    const uint32_t data_len = fio_str2u32(frame + 4);
+    c->type = fio_str2u32(frame + 8);
+    c->filter = (int32_t)fio_str2u32(frame + 12);
+    c->msg = fio_msg_internal_create(
+        c->filter, c->type,
+        (fio_str_info_s){.data = (char *)frame + 16, .len = ch_len},
+        (fio_str_info_s){.data = (char *)frame + 16 + ch_len + 1,
+                         .len = data_len},
+        (int8_t)(c->type == FIO_CLUSTER_MSG_JSON ||
+                 c->type == FIO_CLUSTER_MSG_ROOT_JSON),
+        1);
+    head += FIO_CLUSTER_SHM_FRAME_LEN(ch_len, data_len);
+    /* the message was copied, release the ring space before handling it */
+    __atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+    c->handler(c);
+    fio_msg_internal_free(c->msg);
+  }
+  __atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+  c->msg = old_msg;
+  c->type = old_type;
+  c->filter = old_filter;
+}
+
+/** Tests if the message may be sent using the rings. */
+static inline int fio_cluster_shm_fits(fio_msg_internal_s *m,
+                                       uint8_t to_root) {
+  const uint32_t type = fio_msg_internal_type(m);
+  return (type == FIO_CLUSTER_MSG_FORWARD || type == FIO_CLUSTER_MSG_JSON ||
+          (to_root && (type == FIO_CLUSTER_MSG_ROOT ||
+                       type == FIO_CLUSTER_MSG_ROOT_JSON))) &&
+         FIO_CLUSTER_SHM_FRAME_LEN(m->channel.len, m->data.len) <=
+             (FIO_CLUSTER_SHM_RING_SIZE >> 2);
+}
+
+/** Sends an (empty) control message using the socket. */
+static void fio_cluster_shm_signal(intptr_t uuid, uint32_t type) {
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, type, (fio_str_info_s){.len = 0}, (fio_str_info_s){.len = 0}, 0, 1);
+  fio_msg_internal_send_dup(uuid, m);
+  fio_msg_internal_free(m);
+}
+
+/**
+ * Sends a message using the ring or, if it can't be used, the socket.
+ *
+ * Once the socket was used, messages are sent using the socket until the
+ * consumer drained the ring and paused it, so all messages are handled in order
+ * (the ring is read again after RESUME). The producer never waits.
+ */
+static void fio_cluster_shm_send(fio_cluster_ring_s *r, int event_fd,
+                                 intptr_t uuid, fio_msg_internal_s *m,
+                                 uint8_t to_root) {
+  const uint8_t fits = fio_cluster_shm_fits(m, to_root);
+  int wake = -1;
+  fio_lock(&r->lock);
+  if (r->fallback && fits &&
+      __atomic_load_n(&r->paused, __ATOMIC_ACQUIRE) == r->pauses) {
+    fio_cluster_shm_signal(uuid, FIO_CLUSTER_MSG_SHM_RESUME);
+    r->fallback = 0;
+  }
+  if (!r->fallback && fits)
+    wake = fio_cluster_ring_push(r, m);
+  if (wake == -1) {
+    if (!r->fallback) {
+      fio_cluster_shm_signal(uuid, FIO_CLUSTER_MSG_SHM_PAUSE);
+      r->fallback = 1;
+      ++r->pauses;
+    }
+    fio_msg_internal_send_dup(uuid, m);
+  }
+  fio_unlock(&r->lock);
+  if (wake == 1)
+    fio_cluster_ring_wake(event_fd);
+}
+
+/** Root: sends a message to a worker. Returns -1 if the worker has no ring. */
+static int fio_cluster_shm_send2worker(intptr_t uuid, fio_msg_internal_s *m) {
+  for (size_t i = 0; i < fio_cluster_shm.count; ++i) {
+    fio_cluster_shm_slot_s *slot = fio_cluster_shm.slots + i;
+    if (slot->uuid != uuid)
+      continue;
+    fio_cluster_shm_send(&slot->down, slot->down_fd, uuid, m, 0);
+    return 0;
+  }
+  return -1;
+}
+
+/** Worker: sends a message to the root. Returns -1 if there's no ring. */
+static int fio_cluster_shm_send2root(fio_msg_internal_s *m) {
+  fio_cluster_shm_slot_s *slot = fio_cluster_shm.own;
+  if (!slot || !fio_cluster_shm.ready)
+    return -1;
+  fio_cluster_shm_send(&slot->up, slot->up_fd, cluster_data.uuid, m, 1);
+  return 0;
+}
+
+/** Handles the ring's PAUSE / RESUME messages (received using the socket). */
+static void fio_cluster_shm_on_signal(cluster_pr_s *c) {
+  fio_cluster_ring_s *r = c->shm;
+  if (c->type == FIO_CLUSTER_MSG_SHM_RESUME)
+    c->shm_paused = 0;
+  if (!c->shm_paused) /* messages sent before the PAUSE (or after the RESUME) */
+    fio_cluster_ring_drain(c, r);
+  if (c->type == FIO_CLUSTER_MSG_SHM_PAUSE) {
+    c->shm_paused = 1;
+    /* the producer may RESUME once the ring is paused */
+    __atomic_add_fetch(&r->paused, 1, __ATOMIC_SEQ_CST);
   }
-  while (fio_ls_any(&cluster_data.clients)) {
-    intptr_t uuid = (intptr_t)fio_ls_pop(&cluster_data.clients);
-    if (uuid > 0) {
-      fio_close(uuid);
-    }
+}
+
+/** Worker: claims a free slot and asks the root to attach it. */
+static void fio_cluster_shm_claim(void) {
+  fio_cluster_shm.own = NULL;
+  fio_cluster_shm.ready = 0;
+  for (size_t i = 0; i < fio_cluster_shm.count; ++i) {
+    fio_cluster_shm_slot_s *slot = fio_cluster_shm.slots + i;
+    if (!__sync_bool_compare_and_swap(&slot->pid, 0, getpid()))
+      continue;
+    fio_cluster_shm.own = slot;
+    char buf[4];
+    fio_u2str32((uint8_t *)buf, (uint32_t)i);
+    fio_msg_internal_s *m = fio_msg_internal_create(
+        0, FIO_CLUSTER_MSG_SHM_ATTACH, (fio_str_info_s){.len = 0},
+        (fio_str_info_s){.data = buf, .len = 4}, 0, 1);
+    fio_msg_internal_send_dup(cluster_data.uuid, m);
+    fio_msg_internal_free(m);
+    return;
   }
-  cluster_data.uuid = 0;
-  cluster_data.lock = FIO_LOCK_INIT;
-  cluster_data.clients = (fio_ls_s)FIO_LS_INIT(cluster_data.clients);
+  FIO_LOG_DEBUG("(%d) no free cluster ring, using the cluster socket.",
+                (int)getpid());
 }
 
-static void fio_cluster_cleanup(void *ignore) {
-  /* cleanup the cluster data */
-  fio_cluster_data_cleanup(fio_parent_pid() == getpid());
-  (void)ignore;
+/** Worker: the root process is ready, start using the slot. */
+static void fio_cluster_shm_on_ready(cluster_pr_s *pr) {
+  fio_cluster_shm_slot_s *slot = fio_cluster_shm.own;
+  if (!slot)
+    return;
+  pr->shm = &slot->down;
+  pr->shm_paused = 1; /* until the root's RESUME */
+  fio_cluster_doorbell_attach(slot->down_fd, pr->uuid);
+  fio_cluster_shm.ready = 1;
+  fio_force_event(pr->uuid, FIO_EVENT_ON_DATA);
 }
 
-static void fio_cluster_init(void) {
-  fio_cluster_data_cleanup(0);
-  /* create a unique socket name */
-  char *tmp_folder = getenv("TMPDIR");
-  uint32_t tmp_folder_len = 0;
-  if (!tmp_folder || ((tmp_folder_len = (uint32_t)strlen(tmp_folder)) >
-                      (FIO_CLUSTER_NAME_LIMIT - 28))) {
-#ifdef P_tmpdir
-    tmp_folder = (char *)P_tmpdir;
-    if (tmp_folder)
-      tmp_folder_len = (uint32_t)strlen(tmp_folder);
-#else
-    tmp_folder = "/tmp/";
-    tmp_folder_len = 5;
-#endif
+/** Root: resets the worker's slot and starts reading from it. */
+static void fio_cluster_shm_attach(cluster_pr_s *pr) {
+  if (pr->msg->data.len != 4)
+    return;
+  uint32_t i = fio_str2u32(pr->msg->data.data);
+  if (i >= fio_cluster_shm.count)
+    return;
+  fio_cluster_shm_slot_s *slot = fio_cluster_shm.slots + i;
+  uint64_t count;
+  slot->up.head = slot->up.tail = 0;
+  slot->down.head = slot->down.tail = 0;
+  slot->up.paused = slot->up.pauses = 0;
+  slot->down.paused = slot->down.pauses = 0;
+  slot->up.lock = slot->down.lock = FIO_LOCK_INIT;
+  /* messages sent using the socket are handled before the RESUME message */
+  slot->up.fallback = slot->down.fallback = 1;
+  if (read(slot->up_fd, &count, sizeof(count)) == -1 ||
+      read(slot->down_fd, &count, sizeof(count)) == -1) {
+    /* nothing to clear */
+  }
+  slot->doorbell = fio_cluster_doorbell_attach(slot->up_fd, pr->uuid);
+  if (slot->doorbell == -1) {
+    slot->pid = 0; /* the worker keeps using the socket */
+    return;
   }
-  if (tmp_folder_len >= (FIO_CLUSTER_NAME_LIMIT - 28)) {
-    tmp_folder_len = 0;
+  pr->shm = &slot->up;
+  pr->shm_paused = 1;
+  fio_msg_internal_s *m = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_SHM_READY, (fio_str_info_s){.len = 0},
+      (fio_str_info_s){.len = 0}, 0, 1);
+  /* the senders (holding the lock) use the ring only after READY was sent */
+  fio_lock(&cluster_data.lock);
+  fio_msg_internal_send_dup(pr->uuid, m);
+  slot->uuid = pr->uuid;
+  fio_unlock(&cluster_data.lock);
+  fio_msg_internal_free(m);
+}
+
+/** Root: releases the slot used by a (lost) worker connection. */
+static void fio_cluster_shm_detach(intptr_t uuid) {
+  for (size_t i = 0; i < fio_cluster_shm.count; ++i) {
+    fio_cluster_shm_slot_s *slot = fio_cluster_shm.slots + i;
+    if (slot->uuid != uuid)
+      continue;
+    if (slot->doorbell != -1)
+      fio_force_close(slot->doorbell);
+    slot->doorbell = -1;
+    slot->uuid = -1;
+    slot->pid = 0;
+  }
+}
+
+static void fio_cluster_shm_destroy(void *ignore) {
+  for (size_t i = 0; i < fio_cluster_shm.count; ++i) {
+    if (fio_cluster_shm.slots[i].up_fd != -1)
+      close(fio_cluster_shm.slots[i].up_fd);
+    if (fio_cluster_shm.slots[i].down_fd != -1)
+      close(fio_cluster_shm.slots[i].down_fd);
+  }
+  if (fio_cluster_shm.slots)
+    munmap(fio_cluster_shm.slots,
+           sizeof(*fio_cluster_shm.slots) * fio_cluster_shm.count);
+  fio_cluster_shm.slots = NULL;
+  fio_cluster_shm.count = 0;
+  fio_cluster_shm.own = NULL;
+  fio_cluster_shm.ready = 0;
+  (void)ignore;
+}
+
+/* creates the slots before the workers are forked */
+static void fio_cluster_shm_init(void *ignore) {
+  fio_cluster_shm_destroy(NULL);
+  if (fio_data->workers <= 1)
+    return;
+  const size_t count = fio_data->workers;
+  fio_cluster_shm_slot_s *slots =
+      mmap(NULL, sizeof(*slots) * count, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (slots == MAP_FAILED) {
+    FIO_LOG_WARNING("(cluster) couldn't map shared memory rings, using the "
+                    "cluster socket.");
+    return;
   }
-  if (tmp_folder_len) {
-    memcpy(cluster_data.name, tmp_folder, tmp_folder_len);
-    if (cluster_data.name[tmp_folder_len - 1] != '/')
-      cluster_data.name[tmp_folder_len++] = '/';
+  fio_cluster_shm.slots = slots;
+  fio_cluster_shm.count = count;
+  for (size_t i = 0; i < count; ++i) {
+    slots[i].uuid = -1;
+    slots[i].doorbell = -1;
+    slots[i].up_fd = eventfd(0, EFD_NONBLOCK);
+    slots[i].down_fd = eventfd(0, EFD_NONBLOCK);
+    if (slots[i].up_fd == -1 || slots[i].down_fd == -1) {
+      FIO_LOG_WARNING("(cluster) couldn't create eventfd doorbells, using the "
+                      "cluster socket.");
+      fio_cluster_shm.count = i + 1;
+      fio_cluster_shm_destroy(NULL);
+      return;
+    }
   }
-  memcpy(cluster_data.name + tmp_folder_len, "facil-io-sock-", 14);
-  tmp_folder_len += 14;
-  tmp_folder_len +=
-      snprintf(cluster_data.name + tmp_folder_len,
-               FIO_CLUSTER_NAME_LIMIT - tmp_folder_len, "%d", (int)getpid());
-  cluster_data.name[tmp_folder_len] = 0;
-
-  /* remove if existing */
-  unlink(cluster_data.name);
-  /* add cleanup callback */
-  fio_state_callback_add(FIO_CALL_AT_EXIT, fio_cluster_cleanup, NULL);
+  (void)ignore;
 }
 
+#else
+#define fio_cluster_ring_drain(c, r)
+#define fio_cluster_shm_send2worker(uuid, m) (-1)
+#define fio_cluster_shm_send2root(m) (-1)
+#define fio_cluster_shm_claim()
+#define fio_cluster_shm_on_ready(pr)
+#define fio_cluster_shm_attach(pr)
+#define fio_cluster_shm_detach(uuid)
+#endif /* FIO_CLUSTER_SHM */
+
 /* *****************************************************************************
  * Cluster Protocol callbacks
  **************************************************************************** */
@@ -5933,6 +8169,10 @@ static uint8_t fio_cluster_on_shutdown(intptr_t uuid, fio_protocol_s *pr_) {
 
 static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_) {
   cluster_pr_s *c = (cluster_pr_s *)pr_;
+#if FIO_CLUSTER_SHM
+  if (c->shm && !c->shm_paused)
+    fio_cluster_ring_drain(c, c->shm);
+#endif
   ssize_t i =
       fio_read(uuid, c->buffer + c->length, CLUSTER_READ_BUFFER - c->length);
   if (i <= 0)
@@ -6005,6 +8245,11 @@ static void fio_cluster_on_data(intptr_t uuid, fio_protocol_s *pr_) {
       }
     }
     fio_postoffice_meta_update(c->msg);
+#if FIO_CLUSTER_SHM
+    if (c->shm && (c->type == FIO_CLUSTER_MSG_SHM_PAUSE ||
+                   c->type == FIO_CLUSTER_MSG_SHM_RESUME))
+      fio_cluster_shm_on_signal(c);
+#endif
     c->handler(c);
     fio_msg_internal_free(c->msg);
     c->msg = NULL;
@@ -6029,10 +8274,13 @@ static void fio_cluster_on_close(intptr_t uuid, fio_protocol_s *pr_) {
   cluster_pr_s *c = (cluster_pr_s *)pr_;
   if (!fio_data->is_worker) {
     /* a child was lost, respawning is handled elsewhere. */
+    fio_cluster_shm_detach(uuid);
     fio_lock(&cluster_data.lock);
     FIO_LS_FOR(&cluster_data.clients, pos) {
-      if (pos->obj == (void *)uuid) {
+      if (pos->obj == (void *)c) {
         fio_ls_remove(pos);
+        /* keep the cluster's totals from going backwards */
+        fio_metrics_merge(&cluster_data.metrics, &c->metrics);
         break;
       }
     }
@@ -6051,6 +8299,7 @@ static void fio_cluster_on_close(intptr_t uuid, fio_protocol_s *pr_) {
     fio_msg_internal_free(c->msg);
   c->msg = NULL;
   fio_sub_hash_free(&c->pubsub);
+  fio_sub_hash_free(&c->patterns);
   fio_cluster_protocol_free(c);
   (void)uuid;
 }
@@ -6083,14 +8332,51 @@ fio_cluster_protocol_alloc(intptr_t uuid,
  * Master (server) IPC Connections
  **************************************************************************** */
 
+/** Tests if a worker is subscribed to the message's channel. */
+static int fio_cluster_is_subscribed(cluster_pr_s *pr, fio_msg_internal_s *m,
+                                     uint64_t hashed) {
+  int ret = 0;
+  fio_str_s tmp =
+      FIO_STR_INIT_EXISTING(m->channel.data, m->channel.len, 0); // don't free
+  fio_lock(&pr->lock);
+  if (fio_sub_hash_find(&pr->pubsub, hashed, tmp)) {
+    ret = 1;
+    goto finish;
+  }
+  FIO_SET_FOR_LOOP(&pr->patterns, pos) {
+    if (!pos->hash || !pos->obj.obj)
+      continue;
+    /* the root's subscription uses the worker's matching function */
+    if (pos->obj.obj->parent->match(fio_str_info(&pos->obj.key), m->channel)) {
+      ret = 1;
+      goto finish;
+    }
+  }
+finish:
+  fio_unlock(&pr->lock);
+  return ret;
+}
+
 static void fio_cluster_server_sender(void *m_, intptr_t avoid_uuid) {
   fio_msg_internal_s *m = m_;
+  const uint32_t type = fio_msg_internal_type(m);
+  /* pub/sub messages are routed only to subscribed workers */
+  const uint8_t route =
+      (!m->filter &&
+       (type == FIO_CLUSTER_MSG_FORWARD || type == FIO_CLUSTER_MSG_JSON));
+  const uint64_t hashed =
+      (route ? FIO_HASH_FN(m->channel.data, m->channel.len,
+                           &fio_postoffice.pubsub, &fio_postoffice.pubsub)
+             : 0);
   fio_lock(&cluster_data.lock);
   FIO_LS_FOR(&cluster_data.clients, pos) {
-    if ((intptr_t)pos->obj != -1) {
-      if ((intptr_t)pos->obj != avoid_uuid) {
-        fio_msg_internal_send_dup((intptr_t)pos->obj, m);
-      }
+    cluster_pr_s *pr = (cluster_pr_s *)pos->obj;
+    if (pr->uuid == avoid_uuid ||
+        (route && !fio_cluster_is_subscribed(pr, m, hashed))) {
+      continue;
+    }
+    if (fio_cluster_shm_send2worker(pr->uuid, m) == -1) {
+      fio_msg_internal_send_dup(pr->uuid, m);
     }
   }
   fio_unlock(&cluster_data.lock);
@@ -6173,9 +8459,24 @@ static void fio_cluster_server_handler(struct cluster_pr_s *pr) {
     fio_publish2process(fio_msg_internal_dup(pr->msg));
     break;
 
-  case FIO_CLUSTER_MSG_SHUTDOWN: /* fallthrough */
-  case FIO_CLUSTER_MSG_ERROR:    /* fallthrough */
-  case FIO_CLUSTER_MSG_PING:     /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_ATTACH:
+    fio_cluster_shm_attach(pr);
+    break;
+
+  case FIO_CLUSTER_MSG_METRICS:
+    if (pr->msg->data.len != sizeof(pr->metrics))
+      break;
+    fio_lock(&cluster_data.lock);
+    memcpy(&pr->metrics, pr->msg->data.data, sizeof(pr->metrics));
+    fio_unlock(&cluster_data.lock);
+    break;
+
+  case FIO_CLUSTER_MSG_SHM_READY:  /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_PAUSE:  /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_RESUME: /* fallthrough */
+  case FIO_CLUSTER_MSG_SHUTDOWN:   /* fallthrough */
+  case FIO_CLUSTER_MSG_ERROR:      /* fallthrough */
+  case FIO_CLUSTER_MSG_PING:       /* fallthrough */
   default:
     break;
   }
@@ -6187,12 +8488,12 @@ static void fio_cluster_listen_accept(intptr_t uuid, fio_protocol_s *protocol) {
   /* prevent `accept` backlog in parent */
   intptr_t client;
   while ((client = fio_accept(uuid)) != -1) {
-    fio_attach(client,
-               fio_cluster_protocol_alloc(client, fio_cluster_server_handler,
-                                          fio_cluster_server_sender));
+    fio_protocol_s *pr = fio_cluster_protocol_alloc(
+        client, fio_cluster_server_handler, fio_cluster_server_sender);
     fio_lock(&cluster_data.lock);
-    fio_ls_push(&cluster_data.clients, (void *)client);
+    fio_ls_push(&cluster_data.clients, pr);
     fio_unlock(&cluster_data.lock);
+    fio_attach(client, pr);
   }
 }
 
@@ -6247,6 +8548,18 @@ static void fio_cluster_client_handler(struct cluster_pr_s *pr) {
   case FIO_CLUSTER_MSG_JSON:
     fio_publish2process(fio_msg_internal_dup(pr->msg));
     break;
+  case FIO_CLUSTER_MSG_SHM_READY:
+    fio_cluster_shm_on_ready(pr);
+    break;
+  case FIO_CLUSTER_MSG_METRICS:
+    if (pr->msg->data.len != sizeof(cluster_data.metrics))
+      break;
+    fio_lock(&cluster_data.lock);
+    memcpy(&cluster_data.metrics, pr->msg->data.data,
+           sizeof(cluster_data.metrics));
+    cluster_data.metrics_ready = 1;
+    fio_unlock(&cluster_data.lock);
+    break;
   case FIO_CLUSTER_MSG_SHUTDOWN:
     fio_stop();
   case FIO_CLUSTER_MSG_ERROR:         /* fallthrough */
@@ -6257,6 +8570,9 @@ static void fio_cluster_client_handler(struct cluster_pr_s *pr) {
   case FIO_CLUSTER_MSG_PUBSUB_UNSUB:  /* fallthrough */
   case FIO_CLUSTER_MSG_PATTERN_SUB:   /* fallthrough */
   case FIO_CLUSTER_MSG_PATTERN_UNSUB: /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_ATTACH:    /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_PAUSE:     /* fallthrough */
+  case FIO_CLUSTER_MSG_SHM_RESUME:    /* fallthrough */
 
   default:
     break;
@@ -6270,7 +8586,8 @@ static void fio_cluster_client_sender(void *m_, intptr_t ignr_) {
                         (void *)ignr_);
     return;
   }
-  fio_msg_internal_send_dup(cluster_data.uuid, m);
+  if (fio_cluster_shm_send2root(m) == -1)
+    fio_msg_internal_send_dup(cluster_data.uuid, m);
   fio_msg_internal_free(m);
 }
 
@@ -6288,14 +8605,16 @@ static void fio_cluster_on_connect(intptr_t uuid, void *udata) {
   cluster_data.uuid = uuid;
 
   /* inform root about all existing channels */
-  fio_lock(&fio_postoffice.pubsub.lock);
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash) {
-      continue;
+  FIO_PUBSUB_SHARD_FOR(c) {
+    fio_lock(&c->lock);
+    FIO_SET_FOR_LOOP(&c->channels, pos) {
+      if (!pos->hash) {
+        continue;
+      }
+      fio_cluster_inform_root_about_channel(pos->obj, 1);
     }
-    fio_cluster_inform_root_about_channel(pos->obj, 1);
+    fio_unlock(&c->lock);
   }
-  fio_unlock(&fio_postoffice.pubsub.lock);
   fio_lock(&fio_postoffice.patterns.lock);
   FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
     if (!pos->hash) {
@@ -6307,6 +8626,7 @@ static void fio_cluster_on_connect(intptr_t uuid, void *udata) {
 
   fio_attach(uuid, fio_cluster_protocol_alloc(uuid, fio_cluster_client_handler,
                                               fio_cluster_client_sender));
+  fio_cluster_shm_claim();
   (void)udata;
 }
 /**
@@ -6350,6 +8670,59 @@ static void fio_send2cluster(fio_msg_internal_s *m) {
   }
 }
 
+/* *****************************************************************************
+ * Metrics aggregation
+ **************************************************************************** */
+
+/** Root: sums the root's counters and the workers' latest reports. */
+static fio_metrics_s fio_metrics_cluster_collect(void) {
+  fio_metrics_s ret = fio_metrics();
+  fio_lock(&cluster_data.lock);
+  fio_metrics_merge(&ret, &cluster_data.metrics);
+  FIO_LS_FOR(&cluster_data.clients, pos) {
+    fio_metrics_merge(&ret, &((cluster_pr_s *)pos->obj)->metrics);
+  }
+  fio_unlock(&cluster_data.lock);
+  return ret;
+}
+
+/** Workers report to the root, the root reports the totals to the workers. */
+static void fio_metrics_cluster_report(void *ignore) {
+  if (fio_data->workers == 1 || !fio_is_running())
+    return;
+  const uint8_t is_root = fio_is_master();
+  fio_metrics_s m = (is_root ? fio_metrics_cluster_collect() : fio_metrics());
+  fio_msg_internal_s *msg = fio_msg_internal_create(
+      0, FIO_CLUSTER_MSG_METRICS, (fio_str_info_s){.len = 0},
+      (fio_str_info_s){.data = (char *)&m, .len = sizeof(m)}, 0, 1);
+  if (is_root)
+    fio_cluster_server_sender(msg, -1);
+  else
+    fio_cluster_client_sender(msg, -1);
+  (void)ignore;
+}
+
+/** Starts the reporting timer (inherited by the workers). */
+static void fio_metrics_cluster_start(void *ignore) {
+  if (FIO_METRICS && fio_data->workers > 1)
+    fio_run_every(FIO_METRICS_INTERVAL, 0, fio_metrics_cluster_report, NULL,
+                  NULL);
+  (void)ignore;
+}
+
+/** Returns the counters of all the processes (the root and all the workers). */
+fio_metrics_s fio_metrics_cluster(void) {
+  if (fio_data->workers <= 1)
+    return fio_metrics();
+  if (fio_is_master())
+    return fio_metrics_cluster_collect();
+  fio_metrics_s ret;
+  fio_lock(&cluster_data.lock);
+  ret = (cluster_data.metrics_ready ? cluster_data.metrics : fio_metrics());
+  fio_unlock(&cluster_data.lock);
+  return ret;
+}
+
 /* *****************************************************************************
  * Propegation
  **************************************************************************** */
@@ -6411,14 +8784,16 @@ static void fio_cluster_at_exit(void *ignore) {
     fio_ch_set_pop(&fio_postoffice.patterns.channels);
   }
 
-  while (fio_ch_set_count(&fio_postoffice.pubsub.channels)) {
-    channel_s *ch = fio_ch_set_last(&fio_postoffice.pubsub.channels);
-    while (fio_ls_embd_any(&ch->subscriptions)) {
-      subscription_s *sub =
-          FIO_LS_EMBD_OBJ(subscription_s, node, ch->subscriptions.next);
-      fio_unsubscribe(sub);
+  FIO_PUBSUB_SHARD_FOR(c) {
+    while (fio_ch_set_count(&c->channels)) {
+      channel_s *ch = fio_ch_set_last(&c->channels);
+      while (fio_ls_embd_any(&ch->subscriptions)) {
+        subscription_s *sub =
+            FIO_LS_EMBD_OBJ(subscription_s, node, ch->subscriptions.next);
+        fio_unsubscribe(sub);
+      }
+      fio_ch_set_pop(&c->channels);
     }
-    fio_ch_set_pop(&fio_postoffice.pubsub.channels);
   }
 
   while (fio_ch_set_count(&fio_postoffice.filters.channels)) {
@@ -6432,7 +8807,7 @@ static void fio_cluster_at_exit(void *ignore) {
   }
   fio_ch_set_free(&fio_postoffice.filters.channels);
   fio_ch_set_free(&fio_postoffice.patterns.channels);
-  fio_ch_set_free(&fio_postoffice.pubsub.channels);
+  FIO_PUBSUB_SHARD_FOR(c) { fio_ch_set_free(&c->channels); }
 
   /* clear engines */
   FIO_PUBSUB_DEFAULT = FIO_PUBSUB_CLUSTER;
@@ -6452,10 +8827,15 @@ static void fio_cluster_at_exit(void *ignore) {
 static void fio_pubsub_initialize(void) {
   fio_cluster_init();
   fio_state_callback_add(FIO_CALL_PRE_START, fio_listen2cluster, NULL);
+  fio_state_callback_add(FIO_CALL_PRE_START, fio_metrics_cluster_start, NULL);
   fio_state_callback_add(FIO_CALL_IN_MASTER, fio_accept_after_fork, NULL);
   fio_state_callback_add(FIO_CALL_IN_CHILD, fio_connect2cluster, NULL);
   fio_state_callback_add(FIO_CALL_ON_FINISH, fio_cluster_cleanup, NULL);
   fio_state_callback_add(FIO_CALL_AT_EXIT, fio_cluster_at_exit, NULL);
+#if FIO_CLUSTER_SHM
+  fio_state_callback_add(FIO_CALL_PRE_START, fio_cluster_shm_init, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio_cluster_shm_destroy, NULL);
+#endif
 }
 
 /* *****************************************************************************
@@ -6464,12 +8844,14 @@ Cluster forking handler
 
 static void fio_pubsub_on_fork(void) {
   fio_postoffice.filters.lock = FIO_LOCK_INIT;
-  fio_postoffice.pubsub.lock = FIO_LOCK_INIT;
+  FIO_PUBSUB_SHARD_FOR(c) { c->lock = FIO_LOCK_INIT; }
   fio_postoffice.patterns.lock = FIO_LOCK_INIT;
   fio_postoffice.engines.lock = FIO_LOCK_INIT;
   fio_postoffice.meta.lock = FIO_LOCK_INIT;
   cluster_data.lock = FIO_LOCK_INIT;
   cluster_data.uuid = 0;
+  cluster_data.metrics = (fio_metrics_s){0};
+  cluster_data.metrics_ready = 0;
   FIO_SET_FOR_LOOP(&fio_postoffice.filters.channels, pos) {
     if (!pos->hash)
       continue;
@@ -6478,12 +8860,14 @@ static void fio_pubsub_on_fork(void) {
       FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
     }
   }
-  FIO_SET_FOR_LOOP(&fio_postoffice.pubsub.channels, pos) {
-    if (!pos->hash)
-      continue;
-    pos->obj->lock = FIO_LOCK_INIT;
-    FIO_LS_EMBD_FOR(&pos->obj->subscriptions, n) {
-      FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
+  FIO_PUBSUB_SHARD_FOR(c) {
+    FIO_SET_FOR_LOOP(&c->channels, pos) {
+      if (!pos->hash)
+        continue;
+      pos->obj->lock = FIO_LOCK_INIT;
+      FIO_LS_EMBD_FOR(&pos->obj->subscriptions, n) {
+        FIO_LS_EMBD_OBJ(subscription_s, node, n)->lock = FIO_LOCK_INIT;
+      }
     }
   }
   FIO_SET_FOR_LOOP(&fio_postoffice.patterns.channels, pos) {
@@ -6533,6 +8917,7 @@ void fio_publish___(fio_publish_args_s args);
  * equal to 0 or missing.
  */
 void fio_publish FIO_IGNORE_MACRO(fio_publish_args_s args) {
+  FIO_METRICS_ADD(pubsub_published, 1);
   if (args.filter && !args.engine) {
     args.engine = FIO_PUBSUB_CLUSTER;
   } else if (!args.engine) {
@@ -6690,6 +9075,7 @@ fio_match_fn FIO_MATCH_GLOB = fio_glob_match;
 static void fio_pubsub_on_fork(void) {}
 static void fio_cluster_init(void) {}
 static void fio_cluster_signal_children(void) {}
+fio_metrics_s fio_metrics_cluster(void) { return fio_metrics(); }
 
 #endif /* FIO_PUBSUB_SUPPORT */
 
@@ -9536,6 +11922,134 @@ FIO_FUNC void fio_socket_test(void) {
   fprintf(stderr, "* passed.\n");
 }
 
+/* *****************************************************************************
+Testing DNS messages
+***************************************************************************** */
+
+FIO_FUNC void fio_dns_test(void) {
+  fprintf(stderr, "=== Testing DNS messages\n");
+  uint8_t msg[512];
+  fio_dns_result_s r = {.count = 0};
+  fio_dns_answer_s a;
+  size_t len = fio_dns_message_write(msg, 0x1234, "www.Example.com", 1);
+  FIO_ASSERT(len == 12 + 17 + 4 + 11, "DNS query length error (%zu)", len);
+  FIO_ASSERT(!fio_dns_message_write(msg, 1, "www..com", 1),
+             "DNS query with an empty label should fail");
+  len -= 11; /* the answer doesn't echo the OPT record */
+  msg[2] = 0x81;
+  msg[3] = 0x80;
+  msg[7] = 3;  /* ANCOUNT */
+  msg[11] = 0; /* ARCOUNT */
+  /* a CNAME (cdn.example.com, compressed) and two A records for it */
+  const uint8_t answers[] = {
+      /* www.example.com CNAME cdn.example.com (at offset 45) */
+      0xC0, 12, 0, 5, 0, 1, 0, 0, 0, 100, 0, 6, 3, 'c', 'd', 'n', 0xC0, 16,
+      /* cdn.example.com A 1.2.3.4 */
+      0xC0, 45, 0, 1, 0, 1, 0, 0, 0, 50, 0, 4, 1, 2, 3, 4,
+      /* cdn.example.com A 5.6.7.8 */
+      0xC0, 45, 0, 1, 0, 1, 0, 0, 0, 70, 0, 4, 5, 6, 7, 8,
+  };
+  memcpy(msg + len, answers, sizeof(answers));
+  len += sizeof(answers);
+  FIO_ASSERT(fio_dns_message_read(msg, len, "www.example.co", 1, &r, &a),
+             "DNS answer for the wrong name should be ignored");
+  FIO_ASSERT(fio_dns_message_read(msg, len, "www.example.com", 28, &r, &a),
+             "DNS answer for the wrong type should be ignored");
+  FIO_ASSERT(!fio_dns_message_read(msg, len, "www.example.com", 1, &r, &a),
+             "DNS answer error");
+  FIO_ASSERT(r.count == 2 && a.ttl == 50 && !a.rcode,
+             "DNS answer values error (%zu addresses, TTL %u)", r.count,
+             (unsigned)a.ttl);
+  FIO_ASSERT(!memcmp(&((struct sockaddr_in *)r.addr)->sin_addr, "\1\2\3\4", 4),
+             "DNS answer address error");
+  FIO_ASSERT(fio_dns_message_read(msg, len - 1, "www.example.com", 1, &r, &a),
+             "truncated DNS answer should fail");
+  /* a negative answer (NXDOMAIN) with an SOA record */
+  len = fio_dns_message_write(msg, 1, "missing.test", 28) - 11;
+  const uint8_t soa[] = {
+      /* test SOA ns.test . (serial, refresh, retry, expire, minimum) */
+      0xC0, 20, 0, 6, 0, 1, 0, 0, 0, 60, 0, 26, 2, 'n', 's', 0xC0, 20, 0,
+      0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0, 4, 0, 0, 0, 9,
+  };
+  memcpy(msg + len, soa, sizeof(soa));
+  len += sizeof(soa);
+  msg[2] = 0x81;
+  msg[3] = 0x83;
+  msg[9] = 1;  /* NSCOUNT */
+  msg[11] = 0; /* ARCOUNT */
+  r.count = 0;
+  FIO_ASSERT(!fio_dns_message_read(msg, len, "missing.test", 28, &r, &a) &&
+                 !r.count && a.rcode == 3 && a.negative_ttl == 9,
+             "DNS negative answer error (TTL %u)", (unsigned)a.negative_ttl);
+  /* Happy Eyeballs ordering */
+  r.count = 0;
+  fio_dns_result_add(&r, AF_INET, "\1\1\1\1");
+  fio_dns_result_add(&r, AF_INET, "\2\2\2\2");
+  fio_dns_result_add(&r, AF_INET, "\2\2\2\2");
+  fio_dns_result_add(&r, AF_INET6, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\1");
+  fio_dns_result_order(&r);
+  FIO_ASSERT(r.count == 3 && r.addr[0].ss_family == AF_INET6 &&
+                 r.addr[1].ss_family == AF_INET &&
+                 r.addr[2].ss_family == AF_INET,
+             "DNS result ordering error");
+  /* search domains: long names with many domains, too long candidates */
+  {
+    char name[201];
+    memset(name, 'a', 200);
+    name[200] = 0;
+    name[100] = '.';
+    /* the 4th domain is too long for the name (over 253 bytes) */
+    const char search[] = "a.test\0b.test\0c.test\0"
+                          "a-very-long-domain-name-that-doesnt-fit-after-"
+                          "the-host.test\0d.test\0";
+    char *names = fio_dns_candidates(name, 200, 0, search, 1);
+    size_t count = 0;
+    for (char *pos = names; *pos; pos += strlen(pos) + 1) {
+      FIO_ASSERT(!memcmp(pos, name, 200) && strlen(pos) <= 253,
+                 "DNS search candidate error (%s)", pos);
+      ++count;
+    }
+    FIO_ASSERT(count == 5, "DNS search candidate count error (%zu)", count);
+    free(names);
+    names = fio_dns_candidates(name, 200, 1, search, 1);
+    FIO_ASSERT(!strcmp(names, name) && !names[201],
+               "absolute DNS names shouldn't use search domains");
+    free(names);
+    names = fio_dns_candidates("host", 4, 0, search, 1);
+    FIO_ASSERT(!strcmp(names, "host.a.test") &&
+                   !strcmp(names + 12, "host.b.test"),
+               "DNS search candidate order error");
+    free(names);
+  }
+  /* the cache is bound: expired answers go first, then the oldest answers */
+  {
+    char name[32];
+    fio_lock(&fio_dns.lock);
+    fio_dns_cache_reset(1);
+    for (size_t i = 0; i < FIO_DNS_CACHE_LIMIT + 16; ++i) {
+      size_t len = (size_t)snprintf(name, sizeof(name), "host%zu.test", i);
+      fio_dns_entry_s *e = fio_dns_entry(name, len, fio_dns_hash(name, len));
+      e->expires = (i & 1) ? fio_dns_now() + 60 : 0;
+    }
+    FIO_ASSERT(fio_dns_cache_count(&fio_dns.cache) <= FIO_DNS_CACHE_LIMIT,
+               "DNS cache should be bound (%zu entries)",
+               fio_dns_cache_count(&fio_dns.cache));
+    size_t len = (size_t)snprintf(name, sizeof(name), "host1.test");
+    FIO_ASSERT(fio_dns_entry(name, len, fio_dns_hash(name, len))->expires,
+               "DNS cache evicted a valid answer before an expired one");
+    len = (size_t)snprintf(name, sizeof(name), "host0.test");
+    fio_dns_entry_s *e = fio_dns_entry(name, len, fio_dns_hash(name, len));
+    e->expires = 0;
+    e->result.count = 1;
+    e = fio_dns_entry(name, len, fio_dns_hash(name, len));
+    FIO_ASSERT(!e->result.count,
+               "DNS cache lookup should replace an expired answer");
+    fio_dns_cache_reset(1);
+    fio_unlock(&fio_dns.lock);
+  }
+  fprintf(stderr, "* passed.\n");
+}
+
 /* *****************************************************************************
 Testing listening socket
 ***************************************************************************** */
@@ -9646,6 +12160,38 @@ FIO_FUNC void fio_defer_test(void) {
   fprintf(stderr, "\n* passed.\n");
 }
 
+FIO_FUNC void fio_metrics_test(void) {
+#if FIO_METRICS
+  fprintf(stderr, "=== Testing reactor metrics\n");
+  uintptr_t i_count = 0;
+  const fio_metrics_s before = fio_metrics();
+  for (size_t i = 0; i < 1024; ++i) {
+    fio_defer(sample_task, &i_count, NULL);
+    fio_defer_push_urgent(sample_task, &i_count, NULL);
+  }
+  fio_defer_thread_pool_join(fio_defer_thread_pool_new(4));
+  const fio_metrics_s after = fio_metrics();
+  FIO_ASSERT(i_count == 2048, "metrics test tasks weren't performed");
+  FIO_ASSERT(after.tasks_queued - before.tasks_queued == 1024 &&
+                 after.tasks_performed - before.tasks_performed == 1024,
+             "task metrics error (%zu queued, %zu performed)",
+             (size_t)(after.tasks_queued - before.tasks_queued),
+             (size_t)(after.tasks_performed - before.tasks_performed));
+  const uint64_t urgent[2] = {
+      after.tasks_urgent_queued - before.tasks_urgent_queued,
+      after.tasks_urgent_performed - before.tasks_urgent_performed,
+  };
+  FIO_ASSERT(!FIO_USE_URGENT_QUEUE || (urgent[0] == 1024 && urgent[1] == 1024),
+             "urgent task metrics error");
+  fio_metrics_s a = {.polls = 1, .queue_latency_max_ns = 7};
+  const fio_metrics_s b = {.polls = 2, .queue_latency_max_ns = 3};
+  fio_metrics_merge(&a, &b);
+  FIO_ASSERT(a.polls == 3 && a.queue_latency_max_ns == 7,
+             "metrics merge error");
+  fprintf(stderr, "* passed.\n");
+#endif
+}
+
 /* *****************************************************************************
 Array data-structure Testing
 ***************************************************************************** */
@@ -9700,6 +12246,185 @@ Set data-structure Testing
 #define FIO_SET_OBJ_TYPE uintptr_t
 #include <fio.h>
 
+#define FIO_SET_NAME fio_swiss_test
+#define FIO_SET_OBJ_TYPE uintptr_t
+#define FIO_SET_SWISS 1
+#include <fio.h>
+
+#define FIO_SET_NAME fio_swiss_hash_test
+#define FIO_SET_KEY_TYPE uintptr_t
+#define FIO_SET_OBJ_TYPE uintptr_t
+#define FIO_SET_SWISS 1
+#define FIO_SET_ORDERED 1
+#include <fio.h>
+
+#define FIO_SET_NAME fio_swiss_attack
+#define FIO_SET_OBJ_COMPARE(a, b) ((a) == (b))
+#define FIO_SET_OBJ_TYPE uintptr_t
+#define FIO_SET_SWISS 1
+#include <fio.h>
+
+FIO_FUNC void fio_set_swiss_test(void) {
+  fio_swiss_test_s s = FIO_SET_INIT;
+  fio_swiss_hash_test_s h = FIO_SET_INIT;
+  fprintf(stderr, "=== Testing Core Swiss Set (unordered and ordered)\n");
+  FIO_ASSERT(!fio_swiss_test_count(&s) && !fio_swiss_test_capa(&s),
+             "empty Swiss set should have no objects or capacity");
+  FIO_ASSERT(!fio_swiss_test_last(&s) && !fio_swiss_hash_test_last(&h).key,
+             "empty Swiss set shouldn't have a last object");
+  FIO_ASSERT(!fio_swiss_test_find(&s, 1, 1) &&
+                 !fio_swiss_hash_test_find(&h, 1, 1),
+             "empty Swiss set shouldn't find anything");
+
+  fprintf(stderr, "* Inserting %lu items\n", FIO_SET_TEST_COUNT);
+  for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; ++i) {
+    fio_swiss_test_insert(&s, i, i);
+    fio_swiss_hash_test_insert(&h, i, i, i + 1, NULL);
+    FIO_ASSERT(i == fio_swiss_test_find(&s, i, i), "Swiss insertion != find");
+    FIO_ASSERT(i + 1 == fio_swiss_hash_test_find(&h, i, i),
+               "Swiss hash insertion != find");
+  }
+  FIO_ASSERT(fio_swiss_test_count(&s) == FIO_SET_TEST_COUNT - 1 &&
+                 fio_swiss_hash_test_count(&h) == FIO_SET_TEST_COUNT - 1,
+             "Swiss count error after insertion");
+  for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; ++i) {
+    FIO_ASSERT(i == fio_swiss_test_find(&s, i, i),
+               "Swiss insertion != find (seek)");
+    FIO_ASSERT(!fio_swiss_test_find(&s, i + FIO_SET_TEST_COUNT,
+                                    i + FIO_SET_TEST_COUNT),
+               "Swiss set found a missing object");
+  }
+  {
+    fprintf(stderr, "* Testing order for %lu items in ordered Swiss hash\n",
+            FIO_SET_TEST_COUNT);
+    uintptr_t i = 1;
+    FIO_SET_FOR_LOOP(&h, pos) {
+      FIO_ASSERT(pos->obj.obj == i + 1 && pos->obj.key == i,
+                 "Swiss object order mismatch %lu != %lu.", (unsigned long)i,
+                 (unsigned long)pos->obj.key);
+      ++i;
+    }
+    i = 0;
+    FIO_SET_FOR_LOOP(&s, pos) {
+      if (pos->hash)
+        ++i;
+    }
+    FIO_ASSERT(i == s.count, "Swiss set loop count error (%lu != %lu).",
+               (unsigned long)i, (unsigned long)s.count);
+  }
+
+  fprintf(stderr, "* Removing odd items from %lu items\n", FIO_SET_TEST_COUNT);
+  for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; i += 2) {
+    FIO_ASSERT(!fio_swiss_test_remove(&s, i, i, NULL),
+               "Swiss removal failed (object missing)");
+    FIO_ASSERT(!fio_swiss_hash_test_remove(&h, i, i, NULL),
+               "Swiss hash removal failed (object missing)");
+    FIO_ASSERT(!fio_swiss_test_find(&s, i, i) &&
+                   !fio_swiss_hash_test_find(&h, i, i),
+               "Swiss removal failed (still exists).");
+  }
+  for (uintptr_t i = 2; i < FIO_SET_TEST_COUNT; i += 2) {
+    FIO_ASSERT(i == fio_swiss_test_find(&s, i, i) &&
+                   i + 1 == fio_swiss_hash_test_find(&h, i, i),
+               "Swiss removal effected other objects");
+  }
+  {
+    uintptr_t i = 1;
+    FIO_SET_FOR_LOOP(&h, pos) {
+      if (pos->hash == 0) {
+        FIO_ASSERT((i & 1) == 1, "Swiss deleted object wasn't odd");
+      } else {
+        FIO_ASSERT(pos->obj.key == i, "Swiss hole order mismatch %lu != %lu",
+                   (unsigned long)i, (unsigned long)pos->obj.key);
+      }
+      ++i;
+    }
+  }
+  {
+    fprintf(stderr, "* Poping two elements (testing pop through holes)\n");
+    uintptr_t tmp = fio_swiss_hash_test_last(&h).key;
+    fio_swiss_hash_test_pop(&h);
+    FIO_ASSERT(fio_swiss_hash_test_last(&h).key == tmp - 2 &&
+                   !fio_swiss_hash_test_find(&h, tmp, tmp),
+               "Swiss hash pop didn't remove the last object");
+    tmp = fio_swiss_test_last(&s);
+    fio_swiss_test_pop(&s);
+    FIO_ASSERT(tmp && !fio_swiss_test_find(&s, tmp, tmp) &&
+                   fio_swiss_test_last(&s) != tmp,
+               "Swiss set pop didn't remove the `last` object");
+    fio_swiss_test_insert(&s, tmp, tmp);
+  }
+
+  fprintf(stderr, "* Churning %lu items\n", FIO_SET_TEST_COUNT);
+  {
+    const size_t capa = fio_swiss_test_capa(&s);
+    for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; i += 2) {
+      fio_swiss_test_insert(&s, i, i);
+      fio_swiss_test_remove(&s, i, i, NULL);
+    }
+    FIO_ASSERT(fio_swiss_test_capa(&s) == capa,
+               "Swiss set grew while churning (%zu != %zu)",
+               fio_swiss_test_capa(&s), capa);
+    FIO_ASSERT(fio_swiss_test_count(&s) == (FIO_SET_TEST_COUNT >> 1) - 1,
+               "Swiss set count error after churning (%zu)",
+               fio_swiss_test_count(&s));
+  }
+
+  fprintf(stderr, "* Compacting Swiss sets to %lu\n", FIO_SET_TEST_COUNT >> 1);
+  fio_swiss_test_compact(&s);
+  fio_swiss_hash_test_compact(&h);
+  FIO_ASSERT(!fio_swiss_test_is_fragmented(&s) &&
+                 !fio_swiss_hash_test_is_fragmented(&h),
+             "Swiss sets fragmented after compact");
+  {
+    uintptr_t i = 2;
+    FIO_SET_FOR_LOOP(&h, pos) {
+      FIO_ASSERT(pos->hash != 0, "Found a hole after compact.");
+      FIO_ASSERT(pos->obj.key == i, "Swiss order lost in compact");
+      i += 2;
+    }
+  }
+  for (uintptr_t i = 2; i < FIO_SET_TEST_COUNT - 2; i += 2) {
+    FIO_ASSERT(i == fio_swiss_test_find(&s, i, i) &&
+                   i + 1 == fio_swiss_hash_test_find(&h, i, i),
+               "Swiss find failed after compact");
+  }
+  fio_swiss_test_free(&s);
+  fio_swiss_hash_test_free(&h);
+  FIO_ASSERT(!s.ctrl && !s.ordered && !s.pos && !s.capa && !h.index,
+             "Swiss set not re-initialized after free.");
+
+  fio_swiss_test_capa_require(&s, FIO_SET_TEST_COUNT);
+  FIO_ASSERT(s.ctrl && s.ordered && !s.pos &&
+                 fio_swiss_test_capa(&s) >= FIO_SET_TEST_COUNT,
+             "Swiss capa_require changes state in a bad way");
+  {
+    const uintptr_t capa = s.capa;
+    for (uintptr_t i = 1; i < FIO_SET_TEST_COUNT; ++i)
+      fio_swiss_test_insert(&s, i, i);
+    FIO_ASSERT(capa == s.capa, "Swiss set grew after capa_require");
+  }
+  fio_swiss_test_free(&s);
+
+  /* full/partial collision attack against set and test response */
+  {
+    fio_swiss_attack_s as = FIO_SET_INIT;
+    for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
+      fio_swiss_attack_insert(&as, 1, i + 1);
+    }
+    FIO_ASSERT(fio_swiss_attack_count(&as) != FIO_SET_TEST_COUNT,
+               "Swiss set attack success! too many full-collisions inserts!");
+    fio_swiss_attack_free(&as);
+    for (uintptr_t i = 0; i < FIO_SET_TEST_COUNT; ++i) {
+      fio_swiss_attack_insert(&as, ((i << 20) | 1), i + 1);
+    }
+    FIO_ASSERT(fio_swiss_attack_count(&as) == FIO_SET_TEST_COUNT,
+               "Swiss partial collision resolusion failed!");
+    fio_swiss_attack_free(&as);
+  }
+  fprintf(stderr, "* passed.\n");
+}
+
 FIO_FUNC void fio_set_test(void) {
   fio_set_test_s s = FIO_SET_INIT;
   fio_hash_test_s h = FIO_SET_INIT;
@@ -10637,6 +13362,75 @@ FIO_FUNC void fio_uuid_link_test(void) {
   fprintf(stderr, "* passed.\n");
 }
 
+/* *****************************************************************************
+Test Drain Tasks
+***************************************************************************** */
+
+/* counts tasks (`udata[0]`) and fallbacks (`udata[1]`) */
+FIO_FUNC void fio_defer_on_drain_test_task(intptr_t uuid, fio_protocol_s *pr,
+                                           void *udata) {
+  fio_atomic_add((uintptr_t *)udata, 1);
+  (void)uuid;
+  (void)pr;
+}
+
+FIO_FUNC void fio_defer_on_drain_test_fallback(intptr_t uuid, void *udata) {
+  fio_atomic_add((uintptr_t *)udata + 1, 1);
+  (void)uuid;
+}
+
+FIO_FUNC void fio_defer_on_drain_test(void) {
+  fprintf(stderr, "=== Testing fio_defer_on_drain\n");
+  static fio_protocol_s pr = {.on_data = NULL};
+  uintptr_t called[2] = {0};
+  int fds[2];
+  FIO_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds),
+             "fio_defer_on_drain_test failed to create a socket pair!");
+  fio_set_non_block(fds[0]);
+  fio_set_non_block(fds[1]);
+  intptr_t uuid = fio_fd2uuid(fds[0]);
+  fio_attach(uuid, &pr);
+  char *buf = fio_malloc(1 << 16);
+  FIO_ASSERT_ALLOC(buf);
+  memset(buf, '*', 1 << 16);
+  for (size_t i = 0; i < 32; ++i)
+    fio_write(uuid, buf, 1 << 16);
+  fio_defer_on_drain(uuid, 4, .task = fio_defer_on_drain_test_task,
+                     .udata = called,
+                     .fallback = fio_defer_on_drain_test_fallback);
+  fio_defer_perform();
+  FIO_ASSERT(fio_pending(uuid) > 4 && !called[0],
+             "fio_defer_on_drain failed - task called too soon!");
+  /* the peer reads the data, draining the queue */
+  for (size_t i = 0; i < (1 << 14) && !called[0]; ++i) {
+    while (read(fds[1], buf, 1 << 16) > 0)
+      ;
+    fio_flush(uuid);
+    fio_defer_perform();
+  }
+  FIO_ASSERT(called[0] == 1 && fio_pending(uuid) <= 4,
+             "fio_defer_on_drain failed - task wasn't called!");
+  /* short queues schedule the task right away */
+  fio_defer_on_drain(uuid, 32, .task = fio_defer_on_drain_test_task,
+                     .udata = called,
+                     .fallback = fio_defer_on_drain_test_fallback);
+  fio_defer_perform();
+  FIO_ASSERT(called[0] == 2, "fio_defer_on_drain failed - short queue error!");
+  /* tasks waiting for a closed connection call the fallback */
+  for (size_t i = 0; i < 32; ++i)
+    fio_write(uuid, buf, 1 << 16);
+  fio_defer_on_drain(uuid, 0, .task = fio_defer_on_drain_test_task,
+                     .udata = called,
+                     .fallback = fio_defer_on_drain_test_fallback);
+  fio_force_close(uuid);
+  fio_defer_perform();
+  FIO_ASSERT(called[0] == 2 && called[1] == 1,
+             "fio_defer_on_drain failed - fallback wasn't called!");
+  fio_free(buf);
+  close(fds[1]);
+  fprintf(stderr, "* passed.\n");
+}
+
 /* *****************************************************************************
 Byte Order Testing
 ***************************************************************************** */
@@ -11001,6 +13795,43 @@ FIO_FUNC void fio_atof_test(void) {
               5708990770823839524233143877797980545530986496.0, 0);
   TEST_DOUBLE("5708990770823839207320493820740630171355185152001e-3",
               5708990770823839524233143877797980545530986496.0, 0);
+#undef TEST_DOUBLE
+
+  {
+    /* fio_ftoa should print the shortest String that reads back the same */
+    char buf[128];
+#define TEST_FTOA(d, s)                                                        \
+  do {                                                                         \
+    fio_ftoa(buf, (d), 10);                                                    \
+    FIO_ASSERT(!strcmp(buf, (s)), "fio_ftoa error %s != %s", buf, (s));        \
+  } while (0)
+    TEST_FTOA(0.0, "0.0");
+    TEST_FTOA(-0.0, "-0.0");
+    TEST_FTOA(1.0, "1.0");
+    TEST_FTOA(-2.2, "-2.2");
+    TEST_FTOA(0.1, "0.1");
+    TEST_FTOA(0.30000000000000004, "0.30000000000000004");
+    TEST_FTOA(1e-05, "1e-05");
+    TEST_FTOA(123456.75, "123456.75");
+    TEST_FTOA(1e16, "10000000000000000.0");
+    TEST_FTOA(1e21, "1e+21");
+    TEST_FTOA(5e-324, "5e-324");
+    TEST_FTOA(1.7976931348623157e+308, "1.7976931348623157e+308");
+#undef TEST_FTOA
+    uint64_t bits = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < 100000; ++i) {
+      bits = (bits * 6364136223846793005ULL) + 1442695040888963407ULL;
+      union {
+        uint64_t i;
+        double f;
+      } u = {.i = bits};
+      if (!isfinite(u.f))
+        continue;
+      fio_ftoa(buf, u.f, 10);
+      FIO_ASSERT(strtod(buf, NULL) == u.f, "fio_ftoa round trip error %s",
+                 buf);
+    }
+  }
   fprintf(stderr, "\n* passed.\n");
 }
 /* *****************************************************************************
@@ -11018,11 +13849,15 @@ void fio_test(void) {
   fio_llist_test();
   fio_ary_test();
   fio_set_test();
+  fio_set_swiss_test();
   fio_defer_test();
+  fio_metrics_test();
   fio_timer_test();
   fio_poll_test();
   fio_socket_test();
+  fio_dns_test();
   fio_uuid_link_test();
+  fio_defer_on_drain_test();
   fio_cycle_test();
   fio_riskyhash_test();
   fio_siphash_test();
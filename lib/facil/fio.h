@@ -238,10 +238,8 @@ Version and helper macros
 #define FIO_FUNC static __attribute__((unused))
 #endif
 
-#if defined(__FreeBSD__)
 #include <netinet/in.h>
 #include <sys/socket.h>
-#endif
 
 /* *****************************************************************************
 Patch for OSX version < 10.12 from https://stackoverflow.com/a/9781275/4025095
@@ -706,6 +704,39 @@ struct fio_listen_args {
    *
    * This will be called separately for every process. */
   void (*on_finish)(intptr_t uuid, void *udata);
+  /**
+   * Set to TRUE to spread new connections across the worker threads.
+   *
+   * By default, the thread accepting the connections also calls `on_open` (and
+   * sets up the TLS connection). When TRUE, the accepting thread only accepts
+   * connections (up to `FIO_ACCEPT_BATCH` per event), scheduling the `on_open`
+   * callbacks as tasks, so other threads can handle them concurrently.
+   */
+  uint8_t spread_accept;
+  /**
+   * TCP_DEFER_ACCEPT (Linux): connections are accepted only once data arrives
+   * (or after `defer_accept` seconds), saving a wakeup (and a failed `read`)
+   * per connection for protocols where the client speaks first (i.e., HTTP).
+   *
+   * Defaults to 0 (disabled).
+   */
+  uint8_t defer_accept;
+  /**
+   * The TCP Fast Open queue length (connections waiting for their handshake to
+   * complete after sending data along with the SYN).
+   *
+   * Defaults to 128 (where supported). Requires server support to be enabled by
+   * the system (i.e., the `net.ipv4.tcp_fastopen` sysctl on Linux).
+   */
+  uint16_t fastopen;
+  /**
+   * SO_BUSY_POLL (Linux): the number of microseconds to busy poll the network
+   * device when reading from an empty socket (accepted connections inherit the
+   * setting), trading CPU for lower latency.
+   *
+   * Defaults to 0 (the system default). Requires driver support.
+   */
+  uint16_t busy_poll;
 };
 
 /**
@@ -729,6 +760,10 @@ the protocol to the connection's uuid.
 
 The protocol's `on_close` callback is expected to handle any cleanup required.
 
+Each listening socket event accepts up to `FIO_ACCEPT_BATCH` connections before
+the listening socket is polled again, so a connection flood on one listening
+socket doesn't starve other listening sockets (or established connections).
+
 The following is an example echo server using facil.io:
 
 ```c
@@ -834,6 +869,13 @@ struct fio_connect_args {
   void *udata;
   /** A non-system timeout after which connection is assumed to have failed. */
   uint8_t timeout;
+  /**
+   * Set to TRUE to use TCP Fast Open (Linux, TCP_FASTOPEN_CONNECT).
+   *
+   * Once the server's Fast Open cookie is cached, the first data written to the
+   * connection is sent along with the SYN, saving a round trip.
+   */
+  uint8_t fastopen;
 };
 
 /**
@@ -854,11 +896,72 @@ See the `struct fio_connect_args` details for any possible named arguments.
 
 * `.on_fail` called if a connection failed to establish.
 
+Host names are resolved without blocking (see `fio_dns_resolve`) and the
+returned `uuid` is reserved until the connection is established. When a host
+has more than one address, connection attempts are raced (Happy Eyeballs, RFC
+8305), starting a new attempt every 250ms until one of them connects.
+
 (experimental: untested)
 */
 intptr_t fio_connect(struct fio_connect_args);
 #define fio_connect(...) fio_connect((struct fio_connect_args){__VA_ARGS__})
 
+/* *****************************************************************************
+Asynchronous DNS resolution
+***************************************************************************** */
+
+#ifndef FIO_DNS_MAX_ADDRESSES
+/** The maximum number of addresses reported by a DNS lookup. */
+#define FIO_DNS_MAX_ADDRESSES 8
+#endif
+
+/** The result of a DNS lookup (see `fio_dns_resolve`). */
+typedef struct {
+  /** The number of addresses found (0 on error or if the name wasn't found). */
+  size_t count;
+  /**
+   * The addresses (with a zero port), ordered for connection attempts: IPv6
+   * and IPv4 addresses alternate, starting with IPv6 (RFC 8305).
+   */
+  struct sockaddr_storage addr[FIO_DNS_MAX_ADDRESSES];
+} fio_dns_result_s;
+
+/**
+ * Resolves a host name without blocking, calling `on_result` with the result.
+ *
+ * Numerical addresses and `/etc/hosts` entries are resolved immediately. Other
+ * names are resolved by sending UDP queries (A and AAAA) to the name servers
+ * listed in `/etc/resolv.conf` (honoring it's `search`, `ndots`, `timeout` and
+ * `attempts` settings). The answers are cached for their TTL (including
+ * negative answers) and concurrent lookups for the same name share a query.
+ *
+ * The `on_result` callback might be called before `fio_dns_resolve` returns
+ * (i.e., for cached results) or later, from within a reactor task. The
+ * `result` pointer is only valid during the callback.
+ *
+ * `fio_connect` uses this resolver for host names.
+ */
+void fio_dns_resolve(const char *name,
+                     void (*on_result)(void *udata, fio_dns_result_s *result),
+                     void *udata);
+
+/**
+ * Adds a name server (a numerical IPv4 / IPv6 address), replacing the name
+ * servers listed in `/etc/resolv.conf`. The `port` defaults to "53".
+ *
+ * Up to 3 name servers are used. Call with a NULL `address` to revert to the
+ * `/etc/resolv.conf` name servers.
+ *
+ * Returns -1 on error (i.e., if the address isn't numerical) and 0 on success.
+ */
+int fio_dns_server_add(const char *address, const char *port);
+
+/**
+ * Clears the DNS cache. The `/etc/resolv.conf` and `/etc/hosts` files are read
+ * again by the next lookup.
+ */
+void fio_dns_clear(void);
+
 /* *****************************************************************************
 URL address parsing
 ***************************************************************************** */
@@ -1027,6 +1130,70 @@ struct timespec fio_last_tick(void);
  */
 char const *fio_engine(void);
 
+/* *****************************************************************************
+Reactor metrics
+***************************************************************************** */
+
+/**
+ * The reactor's counters (all values are totals since the process started).
+ *
+ * Counters are sharded per thread (see `FIO_METRICS_SHARDS` in `fio.c`) and
+ * can be disabled at compile time by defining `FIO_METRICS` as 0.
+ */
+typedef struct {
+  /** The number of times the IO polling system was reviewed. */
+  uint64_t polls;
+  /** The number of IO events returned by the polling system. */
+  uint64_t poll_events;
+  /** Tasks pushed to the (normal) task queue. */
+  uint64_t tasks_queued;
+  /** Tasks pushed to the urgent task queue (IO write / pub/sub delivery). */
+  uint64_t tasks_urgent_queued;
+  /** Tasks performed from the (normal) task queue. */
+  uint64_t tasks_performed;
+  /** Tasks performed from the urgent task queue. */
+  uint64_t tasks_urgent_performed;
+  /** The number of queue latency samples (one per reactor cycle). */
+  uint64_t queue_latency_samples;
+  /** The sum of all queue latency samples, in nanoseconds. */
+  uint64_t queue_latency_ns;
+  /** The longest queue latency sample, in nanoseconds (not a total). */
+  uint64_t queue_latency_max_ns;
+  /** Bytes read using `fio_read`. */
+  uint64_t bytes_read;
+  /** Bytes written from the outgoing buffers (`fio_write` / `fio_flush`). */
+  uint64_t bytes_written;
+  /** Writes that couldn't send all the data offered (the socket was full). */
+  uint64_t partial_writes;
+  /** Connections closed by the slowloris mitigation (see `fio_flush`). */
+  uint64_t slowloris;
+  /** Connections that timed out (their protocol's `ping` was scheduled). */
+  uint64_t timeouts;
+  /** Messages published by this process (`fio_publish`). */
+  uint64_t pubsub_published;
+  /** Messages received by this process for local delivery. */
+  uint64_t pubsub_received;
+  /** Messages delivered to subscriptions (`on_message` callbacks). */
+  uint64_t pubsub_delivered;
+} fio_metrics_s;
+
+/** Returns the counters of the calling process (all threads). */
+fio_metrics_s fio_metrics(void);
+
+/**
+ * Returns the counters of all the processes (the root and all the workers).
+ *
+ * Workers report their counters to the root process every
+ * `FIO_METRICS_INTERVAL` milliseconds (1 second by default) and the root
+ * process reports the totals back to the workers. When called by a worker,
+ * the totals might be up to two intervals old.
+ *
+ * The counters of workers that exited (or crashed) remain in the totals.
+ *
+ * In single process mode this is the same as `fio_metrics`.
+ */
+fio_metrics_s fio_metrics_cluster(void);
+
 /* *****************************************************************************
 Socket / Connection Functions
 ***************************************************************************** */
@@ -1058,6 +1225,10 @@ intptr_t fio_socket(const char *address, const char *port, uint8_t is_server);
  * Accepted connection are automatically set to non-blocking mode and the
  * O_CLOEXEC flag is set.
  *
+ * TCP/IP connections are set to TCP_NODELAY with enlarged socket buffers. On
+ * Linux, these options are inherited from the listening socket (see
+ * `fio_socket`), saving a few system calls per connection.
+ *
  * NOTE: this function does NOT attach the socket to the IO reactor - see
  * `fio_attach`.
  */
@@ -1413,6 +1584,20 @@ typedef struct fio_rw_hook_s {
    * This callback is always called, even if `fio_rw_hook_set` fails.
    * */
   void (*cleanup)(void *udata);
+  /**
+   * When implemented, this function is used to send file data (see
+   * `fio_sendfile`) without copying it to user space (i.e., kernel TLS).
+   *
+   * Should behave like the Linux `sendfile` call, updating the `offset` and
+   * returning the number of bytes sent (or -1 with errno set).
+   *
+   * When missing (NULL), file data is read and passed along to `write`.
+   *
+   * Note: facil.io library functions MUST NEVER be called by any r/w hook, or a
+   * deadlock might occur.
+   * */
+  ssize_t (*sendfile)(intptr_t uuid, void *udata, int fd, off_t *offset,
+                      size_t count);
 } fio_rw_hook_s;
 
 /** Sets a socket hook state (a pointer to the struct). */
@@ -1535,6 +1720,22 @@ void fio_defer_io_task(intptr_t uuid, fio_defer_iotask_args_s args);
 #define fio_defer_io_task(uuid, ...)                                           \
   fio_defer_io_task((uuid), (fio_defer_iotask_args_s){__VA_ARGS__})
 
+/**
+ * Schedules a protected connection task (see `fio_defer_io_task`) once no more
+ * than `pending` packets are waiting in the socket's queue (see `fio_pending`).
+ *
+ * This allows large responses to be written in chunks (without buffering the
+ * whole response in memory) while the thread is free to handle other tasks.
+ *
+ * If the queue is already short enough, the task is scheduled right away. If
+ * the connection is closed before the queue drains (i.e., the client stopped
+ * reading and the connection timed out), the `fallback` is called instead.
+ */
+void fio_defer_on_drain(intptr_t uuid, size_t pending,
+                        fio_defer_iotask_args_s args);
+#define fio_defer_on_drain(uuid, pending, ...)                                 \
+  fio_defer_on_drain((uuid), (pending), (fio_defer_iotask_args_s){__VA_ARGS__})
+
 /* *****************************************************************************
 Event / Task scheduling
 ***************************************************************************** */
@@ -2379,6 +2580,9 @@ size_t fio_ltoa(char *dest, int64_t num, uint8_t base);
  * default to base 10. Prefixes aren't added (i.e., no "0x" or "0b" at the
  * beginning of the string).
  *
+ * Base 10 output is the shortest representation that reads back as the same
+ * number, using the layout of `printf("%.17g")`.
+ *
  * Returns the number of bytes actually written (excluding the NUL
  * terminator).
  */
@@ -5501,6 +5705,26 @@ Done
  *
  * Note: Before freeing the Set, FIO_SET_OBJ_DESTROY will be automatically
  *       called for every existing object.
+ *
+ * Swiss Tables:
+ *
+ * By default, the Set keeps an `ordered` array of objects and a separate `map`
+ * of `{hash, pos}` couplets, so every lookup touches two arrays.
+ *
+ * Defining FIO_SET_SWISS as 1 selects an open addressing backend that keeps a
+ * 1 byte control tag for every slot (7 bits of the hash) and tests 16 tags at
+ * once (SSE2 / NEON, with a portable fallback). Most lookups touch a single
+ * cache line of tags and a single object.
+ *
+ * Swiss tables are unordered unless FIO_SET_ORDERED is defined as 1, in which
+ * case the objects are kept in insertion order (at the cost of an additional
+ * 4 byte index per slot). The API is the same for both backends, including
+ * FIO_SET_FOR_LOOP (which might encounter holes in both cases). In unordered
+ * Swiss tables, `last` and `pop` refer to an arbitrary object.
+ *
+ *         #define FIO_SET_NAME fio_ptr_set
+ *         #define FIO_SET_SWISS 1
+ *         #include <fio.h>
  */
 
 /* Used for naming functions and types, prefixing FIO_SET_NAME to the name */
@@ -5586,6 +5810,16 @@ Done
 #define FIO_SET_MAX_MAP_FULL_COLLISIONS (96)
 #endif
 
+/* Selects the Swiss table backend (see above) */
+#ifndef FIO_SET_SWISS
+#define FIO_SET_SWISS 0
+#endif
+
+/* Swiss tables keep the insertion order only when requested */
+#ifndef FIO_SET_ORDERED
+#define FIO_SET_ORDERED 0
+#endif
+
 /* Prime numbers are better */
 #ifndef FIO_SET_CUCKOO_STEPS
 #define FIO_SET_CUCKOO_STEPS 11
@@ -5808,6 +6042,698 @@ FIO_FUNC void FIO_NAME(rehash)(FIO_NAME(s) * set);
 #define FIO_SET_FOR_LOOP(set, pos)
 #endif
 
+#if FIO_SET_SWISS
+/* *****************************************************************************
+Swiss Table Group Probing (shared by all Swiss Set / Hash Map types)
+***************************************************************************** */
+#ifndef H_FIO_SET_SWISS_GROUP
+#define H_FIO_SET_SWISS_GROUP
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/** The number of control tags tested at once. */
+#define FIO_SET_SWISS_GROUP 16
+/** A control tag for a slot that was never used (stops seeking). */
+#define FIO_SET_SWISS_EMPTY 0x80
+/** A control tag for a removed slot (a tombstone, seeking continues). */
+#define FIO_SET_SWISS_DELETED 0xFE
+/** The number of slots used before the table grows (7/8). */
+#define FIO_SET_SWISS_LIMIT(capa) ((capa) - ((capa) >> 3))
+
+/*
+ * Group masks have a bit per control tag, except on NEON, where every tag is
+ * represented by a 4 bit nibble (only the top bit of the nibble is kept).
+ */
+#if !defined(__SSE2__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define FIO_SET_SWISS_SHIFT 2
+#else
+#define FIO_SET_SWISS_SHIFT 0
+#endif
+
+/** Returns a mask with the group's tags that are equal to `tag`. */
+FIO_FUNC inline uint64_t fio___swiss_match(const uint8_t *group,
+                                           uint8_t tag) {
+#if defined(__SSE2__)
+  __m128i g = _mm_loadu_si128((const __m128i *)group);
+  return (uint64_t)(uint16_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(g, _mm_set1_epi8((char)tag)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(tag));
+  uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+         0x8888888888888888ULL;
+#else
+  uint64_t mask = 0;
+  for (size_t i = 0; i < FIO_SET_SWISS_GROUP; ++i)
+    mask |= (uint64_t)(group[i] == tag) << i;
+  return mask;
+#endif
+}
+
+/** Returns a mask with the group's free (empty or removed) tags. */
+FIO_FUNC inline uint64_t fio___swiss_match_free(const uint8_t *group) {
+#if defined(__SSE2__)
+  return (uint64_t)(uint16_t)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i *)group));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  uint8x16_t top = vreinterpretq_u8_s8(
+      vshrq_n_s8(vreinterpretq_s8_u8(vld1q_u8(group)), 7));
+  uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(top), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+         0x8888888888888888ULL;
+#else
+  uint64_t mask = 0;
+  for (size_t i = 0; i < FIO_SET_SWISS_GROUP; ++i)
+    mask |= (uint64_t)(group[i] >> 7) << i;
+  return mask;
+#endif
+}
+
+/** Returns the offset of the first tag in a (non-zero) group mask. */
+FIO_FUNC inline uintptr_t fio___swiss_first(uint64_t mask) {
+  return (uintptr_t)__builtin_ctzll(mask) >> FIO_SET_SWISS_SHIFT;
+}
+
+/** Returns the number of tags after the last tag in a (non-zero) mask. */
+FIO_FUNC inline uintptr_t fio___swiss_leading(uint64_t mask) {
+#if FIO_SET_SWISS_SHIFT
+  return (uintptr_t)__builtin_clzll(mask) >> FIO_SET_SWISS_SHIFT;
+#else
+  return (uintptr_t)__builtin_clzll(mask) - (64 - FIO_SET_SWISS_GROUP);
+#endif
+}
+
+/**
+ * Mixes the hash value, since pointer hashes have their lower bits zeroed.
+ *
+ * The top 7 bits are used for the control tag and the lower bits for the
+ * position.
+ */
+FIO_FUNC inline uint64_t fio___swiss_mix(uint64_t hash) {
+  hash *= 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 32);
+}
+
+#endif /* H_FIO_SET_SWISS_GROUP */
+
+/* *****************************************************************************
+Set / Hash Map Internal Data Structures (Swiss table)
+***************************************************************************** */
+
+typedef struct FIO_NAME(_ordered_s_) {
+  FIO_SET_HASH_TYPE hash;
+  FIO_SET_TYPE obj;
+} FIO_NAME(_ordered_s_);
+
+/* the information in the Hash Map structure should be considered READ ONLY. */
+struct FIO_NAME(s) {
+  uintptr_t count;
+  uintptr_t capa;
+  uintptr_t pos;
+  FIO_NAME(_ordered_s_) * ordered;
+  uint8_t *ctrl;
+#if FIO_SET_ORDERED
+  uint32_t *index;
+#endif
+  uintptr_t deleted;
+  uint8_t used_bits;
+  uint8_t under_attack;
+};
+
+#undef FIO_SET_FOR_LOOP
+#define FIO_SET_FOR_LOOP(set, container)                                       \
+  for (__typeof__((set)->ordered) container = (set)->ordered;                  \
+       container && (container < ((set)->ordered + (set)->pos)); ++container)
+
+/* *****************************************************************************
+Set / Hash Map Internal Helpers (Swiss table)
+***************************************************************************** */
+
+/** The number of objects in the `ordered` array for a given capacity. */
+#if FIO_SET_ORDERED
+#define FIO_SET_SWISS_ENTRIES(capa) FIO_SET_SWISS_LIMIT((capa))
+#else
+#define FIO_SET_SWISS_ENTRIES(capa) (capa)
+#endif
+
+/** Mixes the hash value, the control tag is `mixed >> 57`. */
+FIO_FUNC inline uint64_t FIO_NAME(_swiss_hash_)(FIO_SET_HASH_TYPE hash_value) {
+  return fio___swiss_mix((uint64_t)FIO_SET_HASH2UINTPTR(hash_value, 0));
+}
+
+/** Returns the object stored for a (full) slot. */
+FIO_FUNC inline FIO_NAME(_ordered_s_) *
+    FIO_NAME(_swiss_entry_)(FIO_NAME(s) * set, uintptr_t slot) {
+#if FIO_SET_ORDERED
+  return set->ordered + set->index[slot];
+#else
+  return set->ordered + slot;
+#endif
+}
+
+/** Sets a slot's control tag, as well as it's copy past the table's end. */
+FIO_FUNC inline void FIO_NAME(_swiss_set_ctrl_)(FIO_NAME(s) * set,
+                                               uintptr_t slot, uint8_t tag) {
+  set->ctrl[slot] = tag;
+  for (slot += set->capa; slot < set->capa + FIO_SET_SWISS_GROUP - 1;
+       slot += set->capa)
+    set->ctrl[slot] = tag;
+}
+
+/** Returns the first free slot for a mixed hash value (no comparisons). */
+FIO_FUNC inline uintptr_t FIO_NAME(_swiss_free_slot_)(FIO_NAME(s) * set,
+                                                      uint64_t mixed) {
+  const uintptr_t mask = set->capa - 1;
+  uintptr_t pos = (uintptr_t)mixed & mask;
+  for (uintptr_t step = FIO_SET_SWISS_GROUP;; step += FIO_SET_SWISS_GROUP) {
+    uint64_t found = fio___swiss_match_free(set->ctrl + pos);
+    if (found)
+      return (pos + fio___swiss_first(found)) & mask;
+    pos = (pos + step) & mask;
+  }
+}
+
+/**
+ * Locates an object's slot in the Set, returning -1 if it doesn't exist.
+ *
+ * When the object wasn't found and `free_slot` isn't NULL, the first free slot
+ * in the object's probing sequence is written to `free_slot`.
+ */
+FIO_FUNC inline intptr_t FIO_NAME(_swiss_seek_)(FIO_NAME(s) * set,
+                                                FIO_SET_HASH_TYPE hash_value,
+                                                FIO_SET_TYPE obj,
+                                                uintptr_t *free_slot) {
+  if (!set->ctrl)
+    return -1;
+  if (FIO_SET_HASH_COMPARE(hash_value, FIO_SET_HASH_INVALID))
+    hash_value = FIO_SET_HASH_FORCE;
+  const uint64_t mixed = FIO_NAME(_swiss_hash_)(hash_value);
+  const uint8_t tag = (uint8_t)(mixed >> 57);
+  const uintptr_t mask = set->capa - 1;
+  uintptr_t pos = (uintptr_t)mixed & mask;
+  uintptr_t available = set->capa;
+  size_t full_collisions_counter = 0;
+  for (uintptr_t step = FIO_SET_SWISS_GROUP;; step += FIO_SET_SWISS_GROUP) {
+    const uint8_t *group = set->ctrl + pos;
+    for (uint64_t found = fio___swiss_match(group, tag); found;
+         found &= found - 1) {
+      const uintptr_t slot = (pos + fio___swiss_first(found)) & mask;
+      FIO_NAME(_ordered_s_) *entry = FIO_NAME(_swiss_entry_)(set, slot);
+      if (!FIO_SET_HASH_COMPARE(entry->hash, hash_value))
+        continue;
+      if (FIO_SET_COMPARE(entry->obj, obj))
+        return (intptr_t)slot;
+      /* full hash value collision detected */
+      if (++full_collisions_counter >= FIO_SET_MAX_MAP_FULL_COLLISIONS &&
+          !set->under_attack) {
+        /* is the hash under attack? */
+        FIO_LOG_WARNING(
+            "(fio hash map) too many full collisions - under attack?");
+        set->under_attack = 1;
+      }
+      if (set->under_attack)
+        return (intptr_t)slot;
+    }
+    if (available == set->capa) {
+      uint64_t found = fio___swiss_match_free(group);
+      if (found)
+        available = (pos + fio___swiss_first(found)) & mask;
+    }
+    /* an empty slot stops the probing sequence, as does a full cycle */
+    if (fio___swiss_match(group, FIO_SET_SWISS_EMPTY) || step >= set->capa)
+      break;
+    pos = (pos + step) & mask;
+  }
+  if (free_slot)
+    *free_slot = available;
+  return -1;
+  (void)obj; /* in cases where FIO_SET_OBJ_COMPARE does nothing */
+}
+
+/**
+ * Marks a slot as free after it's object was destroyed.
+ *
+ * A slot becomes EMPTY (rather than a tombstone) only when no probing sequence
+ * could have passed through it, i.e., when a group containing the slot always
+ * had an EMPTY tag.
+ */
+FIO_FUNC inline void FIO_NAME(_swiss_remove_slot_)(FIO_NAME(s) * set,
+                                                   uintptr_t slot) {
+  FIO_NAME(_ordered_s_) *entry = FIO_NAME(_swiss_entry_)(set, slot);
+  uint8_t tag = FIO_SET_SWISS_EMPTY;
+  if (set->capa > FIO_SET_SWISS_GROUP) {
+    const uint64_t before = fio___swiss_match(
+        set->ctrl + ((slot - FIO_SET_SWISS_GROUP) & (set->capa - 1)),
+        FIO_SET_SWISS_EMPTY);
+    const uint64_t after =
+        fio___swiss_match(set->ctrl + slot, FIO_SET_SWISS_EMPTY);
+    if (!before || !after ||
+        fio___swiss_first(after) + fio___swiss_leading(before) >=
+            FIO_SET_SWISS_GROUP) {
+      tag = FIO_SET_SWISS_DELETED;
+      ++set->deleted;
+    }
+  }
+  FIO_NAME(_swiss_set_ctrl_)(set, slot, tag);
+  entry->hash = FIO_SET_HASH_INVALID;
+  --set->count;
+  if (entry == set->ordered + set->pos - 1) {
+    /* removing the last item, no need for a "hole" */
+    do {
+      --set->pos;
+    } while (set->pos && FIO_SET_HASH_COMPARE(set->ordered[set->pos - 1].hash,
+                                              FIO_SET_HASH_INVALID));
+  }
+}
+
+/** Removes "holes" from the Set's internal Array - MUST re-hash afterwards. */
+FIO_FUNC inline void FIO_NAME(_compact_ordered_array_)(FIO_NAME(s) * set) {
+  if (set->count == set->pos)
+    return;
+  FIO_NAME(_ordered_s_) *reader = set->ordered;
+  FIO_NAME(_ordered_s_) *writer = set->ordered;
+  const FIO_NAME(_ordered_s_) *end = set->ordered + set->pos;
+  for (; reader && (reader < end); ++reader) {
+    if (FIO_SET_HASH_COMPARE(reader->hash, FIO_SET_HASH_INVALID)) {
+      continue;
+    }
+    *writer = *reader;
+    ++writer;
+  }
+  /* fix any possible counting errors as well as resetting position */
+  set->pos = set->count = (writer - set->ordered);
+}
+
+/**
+ * Inserts an object to the Set, rehashing if required, returning the new
+ * object's pointer.
+ *
+ * If the object already exists in the set, it will be destroyed and
+ * overwritten.
+ */
+FIO_FUNC inline FIO_SET_TYPE
+FIO_NAME(_insert_or_overwrite_)(FIO_NAME(s) * set, FIO_SET_HASH_TYPE hash_value,
+                                FIO_SET_TYPE obj, int overwrite,
+                                FIO_SET_OBJ_TYPE *old) {
+  if (FIO_SET_HASH_COMPARE(hash_value, FIO_SET_HASH_INVALID))
+    hash_value = FIO_SET_HASH_FORCE;
+  uintptr_t slot = 0;
+  intptr_t found = FIO_NAME(_swiss_seek_)(set, hash_value, obj, &slot);
+
+  if (found >= 0) {
+    FIO_NAME(_ordered_s_) *entry = FIO_NAME(_swiss_entry_)(set, found);
+    /* overwrite existing object */
+    if (!overwrite) {
+      FIO_SET_DESTROY(obj);
+      return entry->obj;
+    }
+#ifdef FIO_SET_KEY_TYPE
+    if (old) {
+      FIO_SET_OBJ_COPY((*old), entry->obj.obj);
+    }
+    /* no need to recreate the key object, just the value object */
+    FIO_SET_OBJ_DESTROY(entry->obj.obj);
+    FIO_SET_OBJ_COPY(entry->obj.obj, obj.obj);
+#else
+    if (old) {
+      FIO_SET_COPY((*old), entry->obj);
+    }
+    FIO_SET_DESTROY(entry->obj);
+    FIO_SET_COPY(entry->obj, obj);
+#endif
+    return entry->obj;
+  }
+
+  /* make room for a new object (tombstones can be reused) */
+  if (!set->ctrl ||
+#if FIO_SET_ORDERED
+      set->pos >= FIO_SET_SWISS_LIMIT(set->capa) ||
+#endif
+      (set->ctrl[slot] == FIO_SET_SWISS_EMPTY &&
+       set->count + set->deleted >= FIO_SET_SWISS_LIMIT(set->capa))) {
+    /* grow only if tombstones / holes aren't the issue */
+    if (set->count >= (FIO_SET_SWISS_LIMIT(set->capa) >> 1))
+      ++set->used_bits;
+    FIO_NAME(rehash)(set);
+    slot = FIO_NAME(_swiss_free_slot_)(set, FIO_NAME(_swiss_hash_)(hash_value));
+  }
+
+  FIO_NAME(_ordered_s_) * entry;
+  if (set->ctrl[slot] == FIO_SET_SWISS_DELETED)
+    --set->deleted;
+  FIO_NAME(_swiss_set_ctrl_)
+  (set, slot, (uint8_t)(FIO_NAME(_swiss_hash_)(hash_value) >> 57));
+#if FIO_SET_ORDERED
+  set->index[slot] = (uint32_t)set->pos;
+  entry = set->ordered + set->pos;
+  ++set->pos;
+#else
+  entry = set->ordered + slot;
+  if (slot >= set->pos)
+    set->pos = slot + 1;
+#endif
+  ++set->count;
+  entry->hash = hash_value;
+  FIO_SET_COPY(entry->obj, obj);
+  return entry->obj;
+}
+
+/* *****************************************************************************
+Set / Hash Map Implementation (Swiss table)
+***************************************************************************** */
+
+/** Frees all the objects in the set and deallocates any internal resources. */
+FIO_FUNC void FIO_NAME_FREE()(FIO_NAME(s) * s) {
+  /* destroy existing valid objects */
+  const FIO_NAME(_ordered_s_) *const end = s->ordered + s->pos;
+  if (s->ordered && s->ordered != end) {
+    for (FIO_NAME(_ordered_s_) *pos = s->ordered; pos < end; ++pos) {
+      if (!FIO_SET_HASH_COMPARE(FIO_SET_HASH_INVALID, pos->hash)) {
+        FIO_SET_DESTROY(pos->obj);
+      }
+    }
+  }
+  /* free ordered array and control tags */
+  if (s->ctrl) {
+    FIO_SET_FREE(s->ctrl, s->capa + FIO_SET_SWISS_GROUP);
+    FIO_SET_FREE(s->ordered,
+                 FIO_SET_SWISS_ENTRIES(s->capa) * sizeof(*s->ordered));
+#if FIO_SET_ORDERED
+    FIO_SET_FREE(s->index, s->capa * sizeof(*s->index));
+#endif
+  }
+  *s = (FIO_NAME(s)){.ctrl = NULL};
+}
+
+#ifdef FIO_SET_KEY_TYPE
+
+/* Hash Map unique implementation */
+
+/**
+ * Locates an object in the Set, if it exists.
+ *
+ * NOTE: This is the function's Hash Map variant. See FIO_SET_KEY_TYPE.
+ */
+FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
+                                         const FIO_SET_HASH_TYPE hash_value,
+                                         FIO_SET_KEY_TYPE key) {
+  intptr_t slot = FIO_NAME(_swiss_seek_)(set, hash_value,
+                                         (FIO_SET_TYPE){.key = key}, NULL);
+  if (slot < 0) {
+    FIO_SET_OBJ_TYPE empty;
+    memset(&empty, 0, sizeof(empty));
+    return empty;
+  }
+  return FIO_NAME(_swiss_entry_)(set, slot)->obj.obj;
+}
+
+/**
+ * Inserts an object to the Hash Map, rehashing if required, returning the new
+ * object's location using a pointer.
+ *
+ * If an object already exists in the Hash Map, it will be destroyed.
+ *
+ * If `old` is set, the existing object (if any) will be copied to the location
+ * pointed to by `old` before it is destroyed.
+ *
+ * NOTE: This is the function's Hash Map variant. See FIO_SET_KEY_TYPE.
+ */
+FIO_FUNC void FIO_NAME(insert)(FIO_NAME(s) * set,
+                               const FIO_SET_HASH_TYPE hash_value,
+                               FIO_SET_KEY_TYPE key, FIO_SET_OBJ_TYPE obj,
+                               FIO_SET_OBJ_TYPE *old) {
+  FIO_NAME(_insert_or_overwrite_)
+  (set, hash_value, (FIO_SET_TYPE){.key = key, .obj = obj}, 1, old);
+}
+
+/**
+ * Removes an object from the Hash Map.
+ *
+ * Returns 0 on success and -1 if the object wasn't found.
+ *
+ * If `old` is set, the existing object (if any) will be copied to the location
+ * pointed to by `old`.
+ *
+ * NOTE: This is the function's Hash Map variant. See FIO_SET_KEY_TYPE.
+ */
+FIO_FUNC inline int FIO_NAME(remove)(FIO_NAME(s) * set,
+                                     const FIO_SET_HASH_TYPE hash_value,
+                                     FIO_SET_KEY_TYPE key,
+                                     FIO_SET_OBJ_TYPE *old) {
+  intptr_t slot = FIO_NAME(_swiss_seek_)(set, hash_value,
+                                         (FIO_SET_TYPE){.key = key}, NULL);
+  if (slot < 0)
+    return -1;
+  FIO_NAME(_ordered_s_) *entry = FIO_NAME(_swiss_entry_)(set, slot);
+  if (old)
+    FIO_SET_OBJ_COPY((*old), entry->obj.obj);
+  FIO_SET_DESTROY(entry->obj);
+  FIO_NAME(_swiss_remove_slot_)(set, slot);
+  return 0;
+}
+
+#else /* FIO_SET_KEY_TYPE */
+
+/* Set unique implementation */
+
+/** Locates an object in the Set, if it exists. */
+FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(find)(FIO_NAME(s) * set,
+                                         const FIO_SET_HASH_TYPE hash_value,
+                                         FIO_SET_OBJ_TYPE obj) {
+  intptr_t slot = FIO_NAME(_swiss_seek_)(set, hash_value, obj, NULL);
+  if (slot < 0) {
+    FIO_SET_OBJ_TYPE empty;
+    memset(&empty, 0, sizeof(empty));
+    return empty;
+  }
+  return FIO_NAME(_swiss_entry_)(set, slot)->obj;
+}
+
+/**
+ * Inserts an object to the Set, rehashing if required, returning the new
+ * object's pointer.
+ *
+ * If the object already exists in the set, than the new object will be
+ * destroyed and the old object's address will be returned.
+ */
+FIO_FUNC FIO_SET_OBJ_TYPE FIO_NAME(insert)(FIO_NAME(s) * set,
+                                           const FIO_SET_HASH_TYPE hash_value,
+                                           FIO_SET_OBJ_TYPE obj) {
+  return FIO_NAME(_insert_or_overwrite_)(set, hash_value, obj, 0, NULL);
+}
+
+/**
+ * Inserts an object to the Set, rehashing if required, returning the new
+ * object's pointer.
+ *
+ * If the object already exists in the set, it will be destroyed and
+ * overwritten.
+ *
+ * When setting `old` to NULL, the function behaves the same as `overwrite`.
+ */
+FIO_FUNC FIO_SET_OBJ_TYPE
+FIO_NAME(overwrite)(FIO_NAME(s) * set, const FIO_SET_HASH_TYPE hash_value,
+                    FIO_SET_OBJ_TYPE obj, FIO_SET_OBJ_TYPE *old) {
+  return FIO_NAME(_insert_or_overwrite_)(set, hash_value, obj, 1, old);
+}
+
+/**
+ * Removes an object from the Set.
+ */
+FIO_FUNC int FIO_NAME(remove)(FIO_NAME(s) * set,
+                              const FIO_SET_HASH_TYPE hash_value,
+                              FIO_SET_OBJ_TYPE obj, FIO_SET_OBJ_TYPE *old) {
+  if (FIO_SET_HASH_COMPARE(hash_value, FIO_SET_HASH_INVALID))
+    return -1;
+  intptr_t slot = FIO_NAME(_swiss_seek_)(set, hash_value, obj, NULL);
+  if (slot < 0)
+    return -1;
+  FIO_NAME(_ordered_s_) *entry = FIO_NAME(_swiss_entry_)(set, slot);
+  if (old)
+    FIO_SET_COPY((*old), entry->obj);
+  FIO_SET_DESTROY(entry->obj);
+  FIO_NAME(_swiss_remove_slot_)(set, slot);
+  return 0;
+}
+
+#endif
+
+/**
+ * Allows a peak at the Set's last element.
+ *
+ * Remember that objects might be destroyed if the Set is altered
+ * (`FIO_SET_OBJ_DESTROY` / `FIO_SET_KEY_DESTROY`).
+ */
+FIO_FUNC inline FIO_SET_TYPE FIO_NAME(last)(FIO_NAME(s) * set) {
+  if (!set->ordered || !set->pos) {
+    FIO_SET_TYPE empty;
+    memset(&empty, 0, sizeof(empty));
+    return empty;
+  }
+  return set->ordered[set->pos - 1].obj;
+}
+
+/**
+ * Allows the Hash to be momentarily used as a stack, destroying the last
+ * object added (`FIO_SET_OBJ_DESTROY` / `FIO_SET_KEY_DESTROY`).
+ */
+FIO_FUNC void FIO_NAME(pop)(FIO_NAME(s) * set) {
+  if (!set->ordered || !set->pos)
+    return;
+#if FIO_SET_ORDERED
+  /* find the slot pointing at the last object */
+  const uint64_t mixed =
+      FIO_NAME(_swiss_hash_)(set->ordered[set->pos - 1].hash);
+  const uint8_t tag = (uint8_t)(mixed >> 57);
+  const uintptr_t mask = set->capa - 1;
+  uintptr_t pos = (uintptr_t)mixed & mask;
+  uintptr_t slot = set->capa;
+  for (uintptr_t step = FIO_SET_SWISS_GROUP; slot == set->capa;
+       step += FIO_SET_SWISS_GROUP) {
+    for (uint64_t found = fio___swiss_match(set->ctrl + pos, tag); found;
+         found &= found - 1) {
+      const uintptr_t i = (pos + fio___swiss_first(found)) & mask;
+      if (set->index[i] == set->pos - 1) {
+        slot = i;
+        break;
+      }
+    }
+    pos = (pos + step) & mask;
+  }
+#else
+  const uintptr_t slot = set->pos - 1;
+#endif
+  FIO_SET_DESTROY(set->ordered[set->pos - 1].obj);
+  FIO_NAME(_swiss_remove_slot_)(set, slot);
+}
+
+/** Returns the number of objects currently in the Set. */
+FIO_FUNC inline size_t FIO_NAME(count)(const FIO_NAME(s) * set) {
+  return (size_t)set->count;
+}
+
+/**
+ * Returns a temporary theoretical Set capacity.
+ * This could be used for testing performance and memory consumption.
+ */
+FIO_FUNC inline size_t FIO_NAME(capa)(const FIO_NAME(s) * set) {
+  return (size_t)FIO_SET_SWISS_LIMIT(set->capa);
+}
+
+/**
+ * Requires that a Set contains the minimal requested theoretical capacity.
+ *
+ * Returns the actual (temporary) theoretical capacity.
+ */
+FIO_FUNC inline size_t FIO_NAME(capa_require)(FIO_NAME(s) * set,
+                                              size_t min_capa) {
+  if (min_capa <= FIO_NAME(capa)(set))
+    return FIO_NAME(capa)(set);
+  set->used_bits = 3;
+  while (min_capa > FIO_SET_SWISS_LIMIT(1ULL << set->used_bits)) {
+    ++set->used_bits;
+  }
+  FIO_NAME(rehash)(set);
+  return FIO_NAME(capa)(set);
+}
+
+/**
+ * Returns non-zero if the Set is fragmented (more than 50% holes).
+ */
+FIO_FUNC inline size_t FIO_NAME(is_fragmented)(const FIO_NAME(s) * set) {
+#if FIO_SET_ORDERED
+  return ((set->pos - set->count) > (set->count >> 1));
+#else
+  return (set->deleted > (set->count >> 1));
+#endif
+}
+
+/**
+ * Attempts to minimize memory usage by removing empty spaces caused by deleted
+ * items and rehashing the Set.
+ *
+ * Returns the updated Set capacity.
+ */
+FIO_FUNC inline size_t FIO_NAME(compact)(FIO_NAME(s) * set) {
+  set->used_bits = 3;
+  FIO_NAME(rehash)(set);
+  return FIO_NAME(capa)(set);
+}
+
+/** Forces a rehashing of the Set (removing any tombstones and holes). */
+FIO_FUNC void FIO_NAME(rehash)(FIO_NAME(s) * set) {
+  if (set->used_bits < 3)
+    set->used_bits = 3;
+  while (set->count >= FIO_SET_SWISS_LIMIT(1ULL << set->used_bits))
+    ++set->used_bits;
+  const uintptr_t old_capa = set->capa;
+  const uintptr_t new_capa = (uintptr_t)1 << set->used_bits;
+  uint8_t *old_ctrl = set->ctrl;
+  set->ctrl = (uint8_t *)FIO_SET_REALLOC(NULL, 0,
+                                         new_capa + FIO_SET_SWISS_GROUP, 0);
+  if (!set->ctrl) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  memset(set->ctrl, FIO_SET_SWISS_EMPTY, new_capa + FIO_SET_SWISS_GROUP);
+  set->capa = new_capa;
+  set->deleted = 0;
+#if FIO_SET_ORDERED
+  FIO_NAME(_compact_ordered_array_)(set);
+  if (old_ctrl)
+    FIO_SET_FREE(set->index, old_capa * sizeof(*set->index));
+  set->index = (uint32_t *)FIO_SET_CALLOC(sizeof(*set->index), new_capa);
+  set->ordered = (FIO_NAME(_ordered_s_) *)FIO_SET_REALLOC(
+      set->ordered,
+      (old_ctrl ? FIO_SET_SWISS_ENTRIES(old_capa) : 0) * sizeof(*set->ordered),
+      FIO_SET_SWISS_ENTRIES(new_capa) * sizeof(*set->ordered),
+      set->pos * sizeof(*set->ordered));
+  if (!set->index || !set->ordered) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  for (uintptr_t i = 0; i < set->pos; ++i) {
+    const uint64_t mixed = FIO_NAME(_swiss_hash_)(set->ordered[i].hash);
+    const uintptr_t slot = FIO_NAME(_swiss_free_slot_)(set, mixed);
+    FIO_NAME(_swiss_set_ctrl_)(set, slot, (uint8_t)(mixed >> 57));
+    set->index[slot] = (uint32_t)i;
+  }
+#else
+  FIO_NAME(_ordered_s_) *old_ordered = set->ordered;
+  const uintptr_t old_pos = set->pos;
+  set->ordered = (FIO_NAME(_ordered_s_) *)FIO_SET_CALLOC(
+      sizeof(*set->ordered), FIO_SET_SWISS_ENTRIES(new_capa));
+  if (!set->ordered) {
+    perror("FATAL ERROR: couldn't allocate memory for Set data");
+    exit(errno);
+  }
+  set->pos = 0;
+  for (uintptr_t i = 0; i < old_pos; ++i) {
+    if (FIO_SET_HASH_COMPARE(old_ordered[i].hash, FIO_SET_HASH_INVALID))
+      continue;
+    const uint64_t mixed = FIO_NAME(_swiss_hash_)(old_ordered[i].hash);
+    const uintptr_t slot = FIO_NAME(_swiss_free_slot_)(set, mixed);
+    FIO_NAME(_swiss_set_ctrl_)(set, slot, (uint8_t)(mixed >> 57));
+    set->ordered[slot] = old_ordered[i];
+    if (slot >= set->pos)
+      set->pos = slot + 1;
+  }
+  if (old_ctrl)
+    FIO_SET_FREE(old_ordered,
+                 FIO_SET_SWISS_ENTRIES(old_capa) * sizeof(*old_ordered));
+#endif
+  if (old_ctrl)
+    FIO_SET_FREE(old_ctrl, old_capa + FIO_SET_SWISS_GROUP);
+  (void)old_capa; /* in cases where FIO_SET_FREE ignores the size */
+}
+
+#undef FIO_SET_SWISS_ENTRIES
+#else /* FIO_SET_SWISS */
+
 /* *****************************************************************************
 Set / Hash Map Internal Data Structures
 ***************************************************************************** */
@@ -6304,6 +7230,8 @@ restart:
   }
 }
 
+#endif /* FIO_SET_SWISS */
+
 #undef FIO_SET_OBJ_TYPE
 #undef FIO_SET_OBJ_COMPARE
 #undef FIO_SET_OBJ_COPY
@@ -6322,6 +7250,9 @@ restart:
 #undef FIO_SET_DESTROY
 #undef FIO_SET_MAX_MAP_SEEK
 #undef FIO_SET_MAX_MAP_FULL_COLLISIONS
+#undef FIO_SET_CUCKOO_STEPS
+#undef FIO_SET_SWISS
+#undef FIO_SET_ORDERED
 #undef FIO_SET_REALLOC
 #undef FIO_SET_CALLOC
 #undef FIO_SET_FREE
@@ -12,6 +12,9 @@
  *
  * The parser also extends the JSON format to allow for C and Bash style
  * comments as well as hex numerical formats.
+ *
+ * Larger inputs are parsed using a (vectorized) structural index, when
+ * supported by the CPU.
  *****************************************************************************
  */
 #define H_FIO_JSON_H
@@ -46,6 +49,28 @@ JSON API
 #define JSON_MAX_DEPTH 32
 #endif
 
+#ifndef JSON_USE_INDEX
+/**
+ * Uses a vectorized structural index (when supported by the CPU) to speed up
+ * the parsing of larger inputs.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define JSON_USE_INDEX 1
+#else
+#define JSON_USE_INDEX 0
+#endif
+#endif
+
+#ifndef JSON_INDEX_MIN_LENGTH
+/** Shorter inputs are parsed byte by byte, without a structural index. */
+#define JSON_INDEX_MIN_LENGTH 256
+#endif
+
+#ifndef JSON_INDEX_WINDOW
+/** The number of bytes indexed at a time (uses 4 bytes of stack per byte). */
+#define JSON_INDEX_WINDOW 2048
+#endif
+
 /** The JSON parser type. Memory must be initialized to 0 before first uses. */
 typedef struct {
   /** in dictionary flag. */
@@ -63,6 +88,9 @@ typedef struct {
  *
  * Unconsumed data should be resent to the parser once more data is available.
  *
+ * Note: a top level numeral that ends at `buffer[length]` is considered
+ * complete (it can't be told apart from a partial numeral).
+ *
  * For security (due to numeral parsing concerns), a NUL byte should be placed
  * at `buffer[length]`.
  */
@@ -76,6 +104,25 @@ fio_json_parse(json_parser_s *parser, const char *buffer, size_t length);
 static size_t __attribute__((unused))
 fio_json_unescape_str(void *dest, const char *source, size_t length);
 
+/** The structural index implementations (see `fio_json_set_isa`). */
+enum {
+  JSON_ISA_AUTO = -1,
+  JSON_ISA_SCALAR = 0,
+  JSON_ISA_SSE42,
+  JSON_ISA_AVX2,
+  JSON_ISA_NEON,
+};
+
+/**
+ * Selects the structural index implementation used by `fio_json_parse` (for
+ * the current translation unit), returning the selected `JSON_ISA_*` value.
+ *
+ * By default (`JSON_ISA_AUTO`), the fastest implementation supported by the
+ * CPU is selected the first time the parser is used. Unsupported values fall
+ * back to `JSON_ISA_SCALAR`, which parses the data byte by byte.
+ */
+static int __attribute__((unused)) fio_json_set_isa(int isa);
+
 /* *****************************************************************************
 JSON Callacks - these must be implemented in the C file that uses the parser
 ***************************************************************************** */
@@ -299,218 +346,569 @@ double __attribute__((weak)) fio_atof(char **pstr) {
 
 #endif
 
+/* *****************************************************************************
+JSON Structural Index (the vectorized first stage)
+***************************************************************************** */
+
+/*
+The structural index marks the beginning of every token in a window of the
+input (the `JSON_INDEX_WINDOW` bytes following the parser's position), 64 bytes
+at a time:
+
+* Unescaped quotes (both the opening and the closing quote of each String).
+* The `{`, `}`, `[`, `]`, `:` and `,` characters outside of Strings.
+* The first byte of any other token (numbers, `true`, `null`, etc').
+
+Vector instructions are used to classify the bytes, after which the escaped
+characters and String contents are masked using (64 bit) bitwise arithmetic.
+
+Windows always start at a token boundary, so no state is kept between windows.
+Windows containing comments (outside of Strings) are handed to the byte by byte
+parser.
+*/
+
+/** The value returned when the window should be parsed byte by byte. */
+#define JSON_INDEX_BYTEWISE ((size_t)-1)
+
+#if JSON_USE_INDEX
+
+/** The classification bitmaps of a 64 byte block (bit `i` == byte `i`). */
+typedef struct {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t space;
+  uint64_t op;
+  uint64_t comment;
+} json_block_s;
+
+/** Writes the index of a single window, using the `classify` function. */
+static inline __attribute__((always_inline)) size_t
+fio_json_index_window(const uint8_t *buf, size_t len, uint32_t *idx,
+                      void (*classify)(const uint8_t *, json_block_s *)) {
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  uint64_t prev_escaped = 0;
+  uint64_t prev_in_string = 0;
+  uint64_t prev_scalar = 0;
+  size_t count = 0;
+  for (size_t offset = 0; offset < len; offset += 64) {
+    json_block_s b;
+    if (len - offset >= 64) {
+      classify(buf + offset, &b);
+    } else {
+      uint8_t tail[64];
+      memset(tail, ' ', 64);
+      memcpy(tail, buf + offset, len - offset);
+      classify(tail, &b);
+    }
+    /* mark characters following an odd sequence of backslashes as escaped */
+    uint64_t backslash = b.backslash & ~prev_escaped;
+    uint64_t follows_escape = (backslash << 1) | prev_escaped;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_sequences = odd_starts + backslash;
+    prev_escaped = (even_sequences < backslash);
+    uint64_t escaped = (even_bits ^ (even_sequences << 1)) & follows_escape;
+    /* String contents (including the opening quote) using a prefix XOR */
+    uint64_t quote = b.quote & ~escaped;
+    uint64_t in_string = quote;
+    in_string ^= in_string << 1;
+    in_string ^= in_string << 2;
+    in_string ^= in_string << 4;
+    in_string ^= in_string << 8;
+    in_string ^= in_string << 16;
+    in_string ^= in_string << 32;
+    in_string ^= prev_in_string;
+    prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+    if ((b.comment & ~in_string))
+      return JSON_INDEX_BYTEWISE;
+    /* tokens: operators, quotes and the first byte of any other token */
+    uint64_t scalar = ~(b.space | b.op | quote | in_string);
+    uint64_t tokens = (b.op & ~in_string) | quote |
+                      (scalar & ~((scalar << 1) | prev_scalar));
+    prev_scalar = scalar >> 63;
+    while (tokens) {
+      idx[count++] = (uint32_t)(offset + __builtin_ctzll(tokens));
+      tokens &= tokens - 1;
+    }
+  }
+  return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*
+The x86 implementations classify bytes using two (nibble indexed) lookup tables,
+where `lo[c & 15] & hi[c >> 4]` sets a single bit for each of the marked bytes:
+
+* 1, 2, 4: `[` `]` `{` `}` / `,` / `:`
+* 8, 16: `\t` `\n` `\r` / ` `
+* 32: `"`
+* 64: `\\`
+* 128: `#` `/`
+*/
+#define JSON_CLASS_LO                                                          \
+  16, 0, 32, (char)128, 0, 0, 0, 0, 0, 8, 12, 1, 66, 9, 0, (char)128
+#define JSON_CLASS_HI 8, 0, (char)178, 4, 0, 65, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0
+
+static inline __attribute__((always_inline, target("avx2"))) void
+fio_json_classify_avx2(const uint8_t *buf, json_block_s *b) {
+  const __m256i lo_table = _mm256_setr_epi8(JSON_CLASS_LO, JSON_CLASS_LO);
+  const __m256i hi_table = _mm256_setr_epi8(JSON_CLASS_HI, JSON_CLASS_HI);
+  const __m256i nibble = _mm256_set1_epi8(15);
+  const __m256i zero = _mm256_setzero_si256();
+  *b = (json_block_s){0};
+  for (size_t i = 0; i < 64; i += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    const __m256i c = _mm256_and_si256(
+        _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble)),
+        _mm256_shuffle_epi8(
+            hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+    const uint64_t op = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_and_si256(c, _mm256_set1_epi8(7)), zero));
+    const uint64_t space = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_and_si256(c, _mm256_set1_epi8(24)), zero));
+    b->op |= (~op & 0xFFFFFFFFULL) << i;
+    b->space |= (~space & 0xFFFFFFFFULL) << i;
+    b->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                    _mm256_slli_epi16(c, 2))
+                << i;
+    b->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                        _mm256_slli_epi16(c, 1))
+                    << i;
+    b->comment |= (uint64_t)(uint32_t)_mm256_movemask_epi8(c) << i;
+  }
+}
+
+static __attribute__((target("avx2"))) size_t
+fio_json_index_avx2(const uint8_t *buf, size_t len, uint32_t *idx) {
+  return fio_json_index_window(buf, len, idx, fio_json_classify_avx2);
+}
+
+static inline __attribute__((always_inline, target("sse4.2"))) void
+fio_json_classify_sse42(const uint8_t *buf, json_block_s *b) {
+  const __m128i lo_table = _mm_setr_epi8(JSON_CLASS_LO);
+  const __m128i hi_table = _mm_setr_epi8(JSON_CLASS_HI);
+  const __m128i nibble = _mm_set1_epi8(15);
+  const __m128i zero = _mm_setzero_si128();
+  *b = (json_block_s){0};
+  for (size_t i = 0; i < 64; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    const __m128i c = _mm_and_si128(
+        _mm_shuffle_epi8(lo_table, _mm_and_si128(v, nibble)),
+        _mm_shuffle_epi8(hi_table,
+                         _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+    const uint64_t op = (uint16_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_and_si128(c, _mm_set1_epi8(7)), zero));
+    const uint64_t space = (uint16_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_and_si128(c, _mm_set1_epi8(24)), zero));
+    b->op |= (~op & 0xFFFFULL) << i;
+    b->space |= (~space & 0xFFFFULL) << i;
+    b->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_slli_epi16(c, 2))
+                << i;
+    b->backslash |=
+        (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_slli_epi16(c, 1)) << i;
+    b->comment |= (uint64_t)(uint16_t)_mm_movemask_epi8(c) << i;
+  }
+}
+
+#undef JSON_CLASS_LO
+#undef JSON_CLASS_HI
+
+static __attribute__((target("sse4.2"))) size_t
+fio_json_index_sse42(const uint8_t *buf, size_t len, uint32_t *idx) {
+  return fio_json_index_window(buf, len, idx, fio_json_classify_sse42);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/** Collects the high bits of four (16 byte) comparison results. */
+static inline __attribute__((always_inline)) uint64_t
+fio_json_neon_bits(uint8x16_t r0, uint8x16_t r1, uint8x16_t r2,
+                   uint8x16_t r3) {
+  const uint8x16_t bit_mask = {0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80,
+                               0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80};
+  uint8x16_t sum0 = vpaddq_u8(vandq_u8(r0, bit_mask), vandq_u8(r1, bit_mask));
+  uint8x16_t sum1 = vpaddq_u8(vandq_u8(r2, bit_mask), vandq_u8(r3, bit_mask));
+  sum0 = vpaddq_u8(sum0, sum1);
+  sum0 = vpaddq_u8(sum0, sum0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+#define JSON_NEON_EQ(v, c) vceqq_u8((v), vdupq_n_u8(c))
+#define JSON_NEON_BITS(test)                                                   \
+  fio_json_neon_bits(test(v[0]), test(v[1]), test(v[2]), test(v[3]))
+#define JSON_NEON_QUOTE(x) JSON_NEON_EQ(x, '"')
+#define JSON_NEON_BACKSLASH(x) JSON_NEON_EQ(x, '\\')
+#define JSON_NEON_SPACE(x)                                                     \
+  vorrq_u8(vorrq_u8(JSON_NEON_EQ(x, ' '), JSON_NEON_EQ(x, '\t')),              \
+           vorrq_u8(JSON_NEON_EQ(x, '\n'), JSON_NEON_EQ(x, '\r')))
+#define JSON_NEON_OP(x)                                                        \
+  vorrq_u8(vorrq_u8(JSON_NEON_EQ(vorrq_u8(x, vdupq_n_u8(0x20)), '{'),          \
+                    JSON_NEON_EQ(vorrq_u8(x, vdupq_n_u8(0x20)), '}')),         \
+           vorrq_u8(JSON_NEON_EQ(x, ':'), JSON_NEON_EQ(x, ',')))
+#define JSON_NEON_COMMENT(x)                                                   \
+  vorrq_u8(JSON_NEON_EQ(x, '/'), JSON_NEON_EQ(x, '#'))
+
+static inline __attribute__((always_inline)) void
+fio_json_classify_neon(const uint8_t *buf, json_block_s *b) {
+  const uint8x16_t v[4] = {vld1q_u8(buf), vld1q_u8(buf + 16),
+                           vld1q_u8(buf + 32), vld1q_u8(buf + 48)};
+  b->quote = JSON_NEON_BITS(JSON_NEON_QUOTE);
+  b->backslash = JSON_NEON_BITS(JSON_NEON_BACKSLASH);
+  b->space = JSON_NEON_BITS(JSON_NEON_SPACE);
+  b->op = JSON_NEON_BITS(JSON_NEON_OP);
+  b->comment = JSON_NEON_BITS(JSON_NEON_COMMENT);
+}
+
+#undef JSON_NEON_EQ
+#undef JSON_NEON_BITS
+#undef JSON_NEON_QUOTE
+#undef JSON_NEON_BACKSLASH
+#undef JSON_NEON_SPACE
+#undef JSON_NEON_OP
+#undef JSON_NEON_COMMENT
+
+static size_t fio_json_index_neon(const uint8_t *buf, size_t len,
+                                  uint32_t *idx) {
+  return fio_json_index_window(buf, len, idx, fio_json_classify_neon);
+}
+
+#endif /* ISA */
+#endif /* JSON_USE_INDEX */
+
+/** The byte by byte implementation (no index). */
+static size_t fio_json_index_none(const uint8_t *buf, size_t len,
+                                  uint32_t *idx) {
+  return JSON_INDEX_BYTEWISE;
+  (void)buf;
+  (void)len;
+  (void)idx;
+}
+
+/** The structural index implementation used by this translation unit. */
+static size_t (*fio_json_index_fn)(const uint8_t *, size_t, uint32_t *);
+/** The implementation's `JSON_ISA_*` value. */
+static int fio_json_index_isa = JSON_ISA_SCALAR;
+
+static int __attribute__((unused)) fio_json_set_isa(int isa) {
+#if JSON_USE_INDEX && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if ((isa == JSON_ISA_AUTO || isa == JSON_ISA_AVX2) &&
+      __builtin_cpu_supports("avx2")) {
+    fio_json_index_fn = fio_json_index_avx2;
+    return (fio_json_index_isa = JSON_ISA_AVX2);
+  }
+  if ((isa == JSON_ISA_AUTO || isa == JSON_ISA_SSE42) &&
+      __builtin_cpu_supports("sse4.2")) {
+    fio_json_index_fn = fio_json_index_sse42;
+    return (fio_json_index_isa = JSON_ISA_SSE42);
+  }
+#elif JSON_USE_INDEX && defined(__aarch64__) && defined(__ARM_NEON)
+  if (isa == JSON_ISA_AUTO || isa == JSON_ISA_NEON) {
+    fio_json_index_fn = fio_json_index_neon;
+    return (fio_json_index_isa = JSON_ISA_NEON);
+  }
+#endif
+  fio_json_index_fn = fio_json_index_none;
+  return (fio_json_index_isa = JSON_ISA_SCALAR);
+}
+
 /* *****************************************************************************
 JSON Consumption (astract parsing)
 ***************************************************************************** */
 
 /**
- * Returns the number of bytes consumed. Stops as close as possible to the end
- * of the buffer or once an object parsing was completed.
+ * Consumes a single token at `*pos`, returning 0 (continue), 1 (stop) or -1
+ * (error).
+ *
+ * If the token is a String and its end is already known, `eos` should point to
+ * the closing quote (otherwise `eos` should be NULL).
  */
-static size_t __attribute__((unused))
-fio_json_parse(json_parser_s *parser, const char *buffer, size_t length) {
-  if (!length || !buffer)
-    return 0;
-  uint8_t *pos = (uint8_t *)buffer;
-  const uint8_t *limit = pos + length;
-  do {
-    while (pos < limit && JSON_SEPERATOR[*pos])
-      ++pos;
-    if (pos == limit)
-      goto stop;
-    switch (*pos) {
-    case '"': {
-      uint8_t *tmp = pos + 1;
+static inline __attribute__((always_inline)) int
+fio_json_consume(json_parser_s *parser, uint8_t **ppos, const uint8_t *limit,
+                 uint8_t *eos) {
+  uint8_t *pos = *ppos;
+  switch (*pos) {
+  case '"': {
+    uint8_t *tmp = eos;
+    if (!tmp) {
+      tmp = pos + 1;
       if (seek2eos(&tmp, limit) == 0)
         goto stop;
-      if (parser->key) {
-        uint8_t *key = tmp + 1;
-        while (key < limit && JSON_SEPERATOR[*key])
-          ++key;
-        if (key >= limit)
-          goto stop;
-        if (*key != ':')
-          goto error;
-        ++pos;
-        fio_json_on_string(parser, pos, (uintptr_t)(tmp - pos));
-        pos = key + 1;
-        parser->key = 0;
-        continue; /* skip tests */
-      } else {
-        ++pos;
-        fio_json_on_string(parser, pos, (uintptr_t)(tmp - pos));
-        pos = tmp + 1;
-      }
-      break;
     }
-    case '{':
-      if (parser->key) {
-#if DEBUG
-        fprintf(stderr, "ERROR: JSON key can't be a Hash.\n");
-#endif
-        goto error;
-      }
-      ++parser->depth;
-      if (parser->depth >= JSON_MAX_DEPTH)
+    if (parser->key) {
+      uint8_t *key = tmp + 1;
+      while (key < limit && JSON_SEPERATOR[*key])
+        ++key;
+      if (key >= limit)
+        goto stop;
+      if (*key != ':')
         goto error;
-      parser->dict = (parser->dict << 1) | 1;
       ++pos;
-      if (fio_json_on_start_object(parser))
-        goto error;
-      break;
-    case '}':
-      if ((parser->dict & 1) == 0) {
+      fio_json_on_string(parser, pos, (uintptr_t)(tmp - pos));
+      *ppos = key + 1;
+      parser->key = 0;
+      return 0; /* skip tests */
+    } else {
+      ++pos;
+      fio_json_on_string(parser, pos, (uintptr_t)(tmp - pos));
+      pos = tmp + 1;
+    }
+    break;
+  }
+  case '{':
+    if (parser->key) {
 #if DEBUG
-        fprintf(stderr, "ERROR: JSON dictionary closure error.\n");
+      fprintf(stderr, "ERROR: JSON key can't be a Hash.\n");
 #endif
-        goto error;
-      }
-      if (!parser->key) {
+      goto error;
+    }
+    ++parser->depth;
+    if (parser->depth >= JSON_MAX_DEPTH)
+      goto error;
+    parser->dict = (parser->dict << 1) | 1;
+    ++pos;
+    if (fio_json_on_start_object(parser))
+      goto error;
+    break;
+  case '}':
+    if ((parser->dict & 1) == 0) {
 #if DEBUG
-        fprintf(stderr, "ERROR: JSON dictionary closure missing key value.\n");
-        goto error;
+      fprintf(stderr, "ERROR: JSON dictionary closure error.\n");
 #endif
-        fio_json_on_null(parser); /* append NULL and recuperate from error. */
-      }
-      --parser->depth;
-      ++pos;
-      parser->dict = (parser->dict >> 1);
-      fio_json_on_end_object(parser);
-      break;
-    case '[':
-      if (parser->key) {
+      goto error;
+    }
+    if (!parser->key) {
 #if DEBUG
-        fprintf(stderr, "ERROR: JSON key can't be an array.\n");
+      fprintf(stderr, "ERROR: JSON dictionary closure missing key value.\n");
+      goto error;
 #endif
-        goto error;
-      }
-      ++parser->depth;
-      if (parser->depth >= JSON_MAX_DEPTH)
-        goto error;
-      ++pos;
-      parser->dict = (parser->dict << 1);
-      if (fio_json_on_start_array(parser))
-        goto error;
-      break;
-    case ']':
-      if ((parser->dict & 1))
-        goto error;
-      --parser->depth;
-      ++pos;
-      parser->dict = (parser->dict >> 1);
-      fio_json_on_end_array(parser);
-      break;
-    case 't':
-      if (pos + 3 >= limit)
-        goto stop;
-      if (pos[1] == 'r' && pos[2] == 'u' && pos[3] == 'e')
-        fio_json_on_true(parser);
-      else
-        goto error;
-      pos += 4;
-      break;
-    case 'N': /* overflow */
-    case 'n':
-      if (pos + 2 <= limit && (pos[1] | 32) == 'a' && (pos[2] | 32) == 'n')
-        goto numeral;
-      if (pos + 3 >= limit)
-        goto stop;
-      if (pos[1] == 'u' && pos[2] == 'l' && pos[3] == 'l')
-        fio_json_on_null(parser);
-      else
-        goto error;
-      pos += 4;
-      break;
-    case 'f':
-      if (pos + 4 >= limit)
-        goto stop;
-      if (pos + 4 < limit && pos[1] == 'a' && pos[2] == 'l' && pos[3] == 's' &&
-          pos[4] == 'e')
-        fio_json_on_false(parser);
-      else
-        goto error;
-      pos += 5;
-      break;
-    case '-': /* overflow */
-    case '0': /* overflow */
-    case '1': /* overflow */
-    case '2': /* overflow */
-    case '3': /* overflow */
-    case '4': /* overflow */
-    case '5': /* overflow */
-    case '6': /* overflow */
-    case '7': /* overflow */
-    case '8': /* overflow */
-    case '9': /* overflow */
-    case '.': /* overflow */
-    case 'e': /* overflow */
-    case 'E': /* overflow */
-    case 'x': /* overflow */
-    case 'i': /* overflow */
-    case 'I': /* overflow */
-    numeral : {
-      uint8_t *tmp = pos;
-      long long i = fio_atol((char **)&tmp);
-      if (tmp > limit)
+      fio_json_on_null(parser); /* append NULL and recuperate from error. */
+    }
+    --parser->depth;
+    ++pos;
+    parser->dict = (parser->dict >> 1);
+    fio_json_on_end_object(parser);
+    break;
+  case '[':
+    if (parser->key) {
+#if DEBUG
+      fprintf(stderr, "ERROR: JSON key can't be an array.\n");
+#endif
+      goto error;
+    }
+    ++parser->depth;
+    if (parser->depth >= JSON_MAX_DEPTH)
+      goto error;
+    ++pos;
+    parser->dict = (parser->dict << 1);
+    if (fio_json_on_start_array(parser))
+      goto error;
+    break;
+  case ']':
+    if ((parser->dict & 1))
+      goto error;
+    --parser->depth;
+    ++pos;
+    parser->dict = (parser->dict >> 1);
+    fio_json_on_end_array(parser);
+    break;
+  case 't':
+    if (pos + 3 >= limit)
+      goto stop;
+    if (pos[1] == 'r' && pos[2] == 'u' && pos[3] == 'e')
+      fio_json_on_true(parser);
+    else
+      goto error;
+    pos += 4;
+    break;
+  case 'N': /* overflow */
+  case 'n':
+    if (pos + 2 <= limit && (pos[1] | 32) == 'a' && (pos[2] | 32) == 'n')
+      goto numeral;
+    if (pos + 3 >= limit)
+      goto stop;
+    if (pos[1] == 'u' && pos[2] == 'l' && pos[3] == 'l')
+      fio_json_on_null(parser);
+    else
+      goto error;
+    pos += 4;
+    break;
+  case 'f':
+    if (pos + 4 >= limit)
+      goto stop;
+    if (pos + 4 < limit && pos[1] == 'a' && pos[2] == 'l' && pos[3] == 's' &&
+        pos[4] == 'e')
+      fio_json_on_false(parser);
+    else
+      goto error;
+    pos += 5;
+    break;
+  case '-': /* overflow */
+  case '0': /* overflow */
+  case '1': /* overflow */
+  case '2': /* overflow */
+  case '3': /* overflow */
+  case '4': /* overflow */
+  case '5': /* overflow */
+  case '6': /* overflow */
+  case '7': /* overflow */
+  case '8': /* overflow */
+  case '9': /* overflow */
+  case '.': /* overflow */
+  case 'e': /* overflow */
+  case 'E': /* overflow */
+  case 'x': /* overflow */
+  case 'i': /* overflow */
+  case 'I': /* overflow */
+  numeral : {
+    /* within a container, a numeral that reaches `limit` might continue */
+    uint8_t *tmp = pos;
+    long long i = fio_atol((char **)&tmp);
+    if (tmp > limit || (tmp == limit && parser->depth))
+      goto stop;
+    if (!tmp || tmp == pos || JSON_NUMERAL[*tmp]) {
+      tmp = pos;
+      double f = fio_atof((char **)&tmp);
+      if (tmp > limit || (tmp == limit && parser->depth))
         goto stop;
       if (!tmp || tmp == pos || JSON_NUMERAL[*tmp]) {
+        /* an incomplete numeral (i.e., "-" or "1e") */
         tmp = pos;
-        double f = fio_atof((char **)&tmp);
-        if (tmp > limit)
+        while (tmp < limit && JSON_NUMERAL[*tmp])
+          ++tmp;
+        if (tmp == limit)
           goto stop;
-        if (!tmp || tmp == pos || JSON_NUMERAL[*tmp])
-          goto error;
-        fio_json_on_float(parser, f);
-        pos = tmp;
-      } else {
-        fio_json_on_number(parser, i);
-        pos = tmp;
+        goto error;
       }
-      break;
+      fio_json_on_float(parser, f);
+      pos = tmp;
+    } else {
+      fio_json_on_number(parser, i);
+      pos = tmp;
     }
-    case '#': /* Ruby style comment */
-    {
+    break;
+  }
+  case '#': /* Ruby style comment */
+  {
+    uint8_t *tmp = memchr(pos, '\n', (uintptr_t)(limit - pos));
+    if (!tmp)
+      goto stop;
+    *ppos = tmp + 1;
+    return 0; /* skip tests */
+  }
+  case '/': /* C style / Javascript style comment */
+    if (pos + 1 >= limit)
+      goto stop;
+    if (pos[1] == '*') {
+      if (pos + 4 > limit)
+        goto stop;
+      uint8_t *tmp = pos + 3; /* avoid this: /*/
+      do {
+        tmp = memchr(tmp, '/', (uintptr_t)(limit - tmp));
+      } while (tmp && tmp[-1] != '*');
+      if (!tmp)
+        goto stop;
+      *ppos = tmp + 1;
+    } else if (pos[1] == '/') {
       uint8_t *tmp = memchr(pos, '\n', (uintptr_t)(limit - pos));
       if (!tmp)
         goto stop;
-      pos = tmp + 1;
-      continue; /* skip tests */
-      ;
-    }
-    case '/': /* C style / Javascript style comment */
-      if (pos[1] == '*') {
-        if (pos + 4 > limit)
-          goto stop;
-        uint8_t *tmp = pos + 3; /* avoid this: /*/
-        do {
-          tmp = memchr(tmp, '/', (uintptr_t)(limit - tmp));
-        } while (tmp && tmp[-1] != '*');
-        if (!tmp)
-          goto stop;
-        pos = tmp + 1;
-      } else if (pos[1] == '/') {
-        uint8_t *tmp = memchr(pos, '\n', (uintptr_t)(limit - pos));
-        if (!tmp)
-          goto stop;
-        pos = tmp + 1;
-      } else
-        goto error;
-      continue; /* skip tests */
-      ;
-    default:
+      *ppos = tmp + 1;
+    } else
       goto error;
-    }
-    if (parser->depth == 0) {
-      fio_json_on_json(parser);
-      goto stop;
-    }
-    parser->key = (parser->dict & 1);
-  } while (pos < limit);
+    return 0; /* skip tests */
+  default:
+    goto error;
+  }
+  *ppos = pos;
+  if (parser->depth == 0) {
+    parser->key = 0; /* the next top level value (if any) isn't a key */
+    fio_json_on_json(parser);
+    return 1;
+  }
+  parser->key = (parser->dict & 1);
+  return 0;
 stop:
-  return (size_t)((uintptr_t)pos - (uintptr_t)buffer);
+  *ppos = pos;
+  return 1;
 error:
-  fio_json_on_error(parser);
-  return 0;
+  return -1;
+}
+
+/**
+ * Walks the structural index one window at a time (the second stage).
+ *
+ * Returns 0 when the rest of the data should be parsed byte by byte, 1 (stop)
+ * or -1 (error).
+ */
+static inline int fio_json_parse_indexed(json_parser_s *parser, uint8_t **ppos,
+                                         const uint8_t *limit) {
+  uint32_t idx[JSON_INDEX_WINDOW];
+  uint8_t *pos = *ppos;
+  int state = 0;
+  while (pos < limit) {
+    uint8_t *window = pos;
+    size_t len = (size_t)(limit - window);
+    if (len > JSON_INDEX_WINDOW)
+      len = JSON_INDEX_WINDOW;
+    size_t count = fio_json_index_fn(window, len, idx);
+    if (count == JSON_INDEX_BYTEWISE)
+      break;
+    for (size_t i = 0; i < count;) {
+      uint8_t *token = window + idx[i];
+      if (token < pos || *token == ',') {
+        ++i;
+        continue;
+      }
+      uint8_t *eos = NULL;
+      if (token > pos && !JSON_SEPERATOR[*pos])
+        token = pos; /* unindexed data following a token, i.e.: `nullx` */
+      else if (*token == '"' && i + 1 < count)
+        eos = window + idx[i + 1];
+      pos = token;
+      state = fio_json_consume(parser, &pos, limit, eos);
+      if (state)
+        goto finish;
+    }
+    /* the rest of the window contains only white space and commas */
+    if (pos < window + len)
+      pos = window + len;
+  }
+finish:
+  *ppos = pos;
+  return state;
+}
+
+/**
+ * Returns the number of bytes consumed. Stops as close as possible to the end
+ * of the buffer or once an object parsing was completed.
+ */
+static size_t __attribute__((unused))
+fio_json_parse(json_parser_s *parser, const char *buffer, size_t length) {
+  if (!length || !buffer)
+    return 0;
+  uint8_t *pos = (uint8_t *)buffer;
+  const uint8_t *limit = pos + length;
+  int state = 0;
+  if (length >= JSON_INDEX_MIN_LENGTH) {
+    if (!fio_json_index_fn)
+      fio_json_set_isa(JSON_ISA_AUTO);
+    state = fio_json_parse_indexed(parser, &pos, limit);
+  }
+  while (!state && pos < limit) {
+    while (pos < limit && JSON_SEPERATOR[*pos])
+      ++pos;
+    if (pos == limit)
+      break;
+    state = fio_json_consume(parser, &pos, limit, NULL);
+  }
+  if (state < 0) {
+    fio_json_on_error(parser);
+    return 0;
+  }
+  return (size_t)((uintptr_t)pos - (uintptr_t)buffer);
 }
 
 /* *****************************************************************************
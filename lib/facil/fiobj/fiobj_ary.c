@@ -32,7 +32,7 @@ VTable
 static void fiobj_ary_dealloc(FIOBJ o, void (*task)(FIOBJ, void *), void *arg) {
   FIO_ARY_FOR((&obj2ary(o)->ary), i) { task(*i, arg); }
   fio_ary___free(&obj2ary(o)->ary);
-  fio_free(FIOBJ2PTR(o));
+  fiobject___pool_free(FIOBJ2PTR(o), sizeof(fiobj_ary_s));
 }
 
 static size_t fiobj_ary_each1(FIOBJ o, size_t start_at,
@@ -79,7 +79,7 @@ Allocation
 ***************************************************************************** */
 
 static inline FIOBJ fiobj_ary_alloc(size_t capa) {
-  fiobj_ary_s *ary = fio_malloc(sizeof(*ary));
+  fiobj_ary_s *ary = fiobject___pool_alloc(sizeof(*ary));
   if (!ary) {
     perror("ERROR: fiobj array couldn't allocate memory");
     exit(errno);
@@ -89,6 +89,7 @@ static inline FIOBJ fiobj_ary_alloc(size_t capa) {
           {
               .ref = 1,
               .type = FIOBJ_T_ARRAY,
+              .arena = fiobject___pool_arena(),
           },
   };
   if (capa)
@@ -31,6 +31,9 @@ License: MIT
     fiobj_free((obj));                                                         \
     (obj) = FIOBJ_INVALID;                                                     \
   } while (0)
+/* Hash objects are ordered (see `fiobj_hash_each`) */
+#define FIO_SET_SWISS 1
+#define FIO_SET_ORDERED 1
 
 #include <fio.h>
 
@@ -66,7 +69,7 @@ static void fiobj_hash_dealloc(FIOBJ o, void (*task)(FIOBJ, void *),
   }
   obj2hash(o)->hash.count = 0;
   fio_hash___free(&obj2hash(o)->hash);
-  fio_free(FIOBJ2PTR(o));
+  fiobject___pool_free(FIOBJ2PTR(o), sizeof(fiobj_hash_s));
 }
 
 static __thread FIOBJ each_at_key = FIOBJ_INVALID;
@@ -158,9 +161,11 @@ Hash API
  * retain order of object insertion.
  */
 FIOBJ fiobj_hash_new(void) {
-  fiobj_hash_s *h = fio_malloc(sizeof(*h));
+  fiobj_hash_s *h = fiobject___pool_alloc(sizeof(*h));
   FIO_ASSERT_ALLOC(h);
-  *h = (fiobj_hash_s){.head = {.ref = 1, .type = FIOBJ_T_HASH},
+  *h = (fiobj_hash_s){.head = {.ref = 1,
+                               .type = FIOBJ_T_HASH,
+                               .arena = fiobject___pool_arena()},
                       .hash = FIO_SET_INIT};
   return (FIOBJ)h | FIOBJECT_HASH_FLAG;
 }
@@ -173,9 +178,11 @@ FIOBJ fiobj_hash_new(void) {
  * retain order of object insertion.
  */
 FIOBJ fiobj_hash_new2(size_t capa) {
-  fiobj_hash_s *h = fio_malloc(sizeof(*h));
+  fiobj_hash_s *h = fiobject___pool_alloc(sizeof(*h));
   FIO_ASSERT_ALLOC(h);
-  *h = (fiobj_hash_s){.head = {.ref = 1, .type = FIOBJ_T_HASH},
+  *h = (fiobj_hash_s){.head = {.ref = 1,
+                               .type = FIOBJ_T_HASH,
+                               .arena = fiobject___pool_arena()},
                       .hash = FIO_SET_INIT};
   fio_hash___capa_require(&h->hash, capa);
   return (FIOBJ)h | FIOBJECT_HASH_FLAG;
@@ -9,6 +9,12 @@ License: MIT
 
 #include <fio_json_parser.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
@@ -29,6 +35,46 @@ size_t fiobj_json2obj(FIOBJ *pobj, const void *data, size_t len);
 /* Formats an object into a JSON string. Remember to `fiobj_free`. */
 FIOBJ fiobj_obj2json(FIOBJ, uint8_t);
 
+/* *****************************************************************************
+JSON View Types
+***************************************************************************** */
+
+/* a value in the view's index (containers are followed by their members) */
+typedef struct {
+  union {
+    int64_t i;
+    double f;
+    /* String data position (in the JSON text or the unescaped Strings) */
+    struct {
+      uint32_t pos;
+      uint32_t len;
+    } str;
+    /* Array / Hash: the index following the container and the member count */
+    struct {
+      uint32_t end;
+      uint32_t count;
+    } c;
+  } data;
+  fiobj_type_enum type;
+  /* String data is in the view's `strings` buffer */
+  uint8_t unescaped;
+} fiobj_json_node_s;
+
+typedef struct {
+  fiobj_object_header_s head;
+  fiobj_json_node_s *nodes;
+  size_t count;
+  size_t capa;
+  /* unescaped copies of Strings that contain escape sequences */
+  char *strings;
+  size_t strings_len;
+  size_t strings_capa;
+  size_t len;
+  char text[];
+} fiobj_json_view_s;
+
+#define obj2view(o) ((fiobj_json_view_s *)FIOBJ2PTR(o))
+
 /* *****************************************************************************
 FIOBJ Parser
 ***************************************************************************** */
@@ -40,8 +86,78 @@ typedef struct {
   FIOBJ target;
   fio_json_stack_s stack;
   uint8_t is_hash;
+  /* set on errors and (in view mode) for non-String keys */
+  uint8_t invalid;
+  /* view mode (see `fiobj_json2view`) - no objects are created */
+  fiobj_json_view_s *view;
+  const char *base;
+  uint32_t open[JSON_MAX_DEPTH];
 } fiobj_json_parser_s;
 
+/* *****************************************************************************
+View Callbacks
+***************************************************************************** */
+
+/* adds a value to the view, `depth` is the depth of the value's container */
+static inline fiobj_json_node_s *
+fiobj_json_view_add(fiobj_json_parser_s *p, fiobj_type_enum type,
+                    uint8_t depth) {
+  fiobj_json_view_s *v = p->view;
+  if (v->count == v->capa) {
+    v->capa <<= 1;
+    v->nodes = fio_realloc2(v->nodes, v->capa * sizeof(*v->nodes),
+                            v->count * sizeof(*v->nodes));
+    FIO_ASSERT_ALLOC(v->nodes);
+  }
+  if (depth && !p->p.key)
+    ++v->nodes[p->open[depth]].data.c.count;
+  fiobj_json_node_s *n = v->nodes + v->count++;
+  *n = (fiobj_json_node_s){.type = type};
+  return n;
+}
+
+/* adds a scalar, Hash keys must be Strings */
+static inline fiobj_json_node_s *
+fiobj_json_view_add_scalar(fiobj_json_parser_s *p, fiobj_type_enum type) {
+  if (p->p.key)
+    p->invalid = 1;
+  return fiobj_json_view_add(p, type, p->p.depth);
+}
+
+static inline void fiobj_json_view_add_str(fiobj_json_parser_s *p,
+                                           const char *start, size_t length) {
+  fiobj_json_view_s *v = p->view;
+  fiobj_json_node_s *n = fiobj_json_view_add(p, FIOBJ_T_STRING, p->p.depth);
+  n->data.str.len = (uint32_t)length;
+  if (!memchr(start, '\\', length)) {
+    n->data.str.pos = (uint32_t)(start - p->base);
+    return;
+  }
+  if (v->strings_len + length + 1 > v->strings_capa) {
+    size_t capa = (v->strings_len + length + 1) << 1;
+    v->strings = fio_realloc2(v->strings, capa, v->strings_len);
+    FIO_ASSERT_ALLOC(v->strings);
+    v->strings_capa = capa;
+  }
+  length = fio_json_unescape_str(v->strings + v->strings_len, start, length);
+  v->strings[v->strings_len + length] = 0;
+  n->data.str.pos = (uint32_t)v->strings_len;
+  n->data.str.len = (uint32_t)length;
+  n->unescaped = 1;
+  v->strings_len += length + 1;
+}
+
+static inline void fiobj_json_view_open(fiobj_json_parser_s *p,
+                                        fiobj_type_enum type) {
+  fiobj_json_view_add(p, type, p->p.depth - 1);
+  p->open[p->p.depth] = (uint32_t)(p->view->count - 1);
+}
+
+static inline void fiobj_json_view_close(fiobj_json_parser_s *p) {
+  p->view->nodes[p->open[p->p.depth + 1]].data.c.end =
+      (uint32_t)p->view->count;
+}
+
 /* *****************************************************************************
 FIOBJ Callacks
 ***************************************************************************** */
@@ -66,26 +182,52 @@ static inline void fiobj_json_add2parser(fiobj_json_parser_s *p, FIOBJ o) {
 
 /** a NULL object was detected */
 static void fio_json_on_null(json_parser_s *p) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_scalar((fiobj_json_parser_s *)p, FIOBJ_T_NULL);
+    return;
+  }
   fiobj_json_add2parser((fiobj_json_parser_s *)p, fiobj_null());
 }
 /** a TRUE object was detected */
 static void fio_json_on_true(json_parser_s *p) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_scalar((fiobj_json_parser_s *)p, FIOBJ_T_TRUE);
+    return;
+  }
   fiobj_json_add2parser((fiobj_json_parser_s *)p, fiobj_true());
 }
 /** a FALSE object was detected */
 static void fio_json_on_false(json_parser_s *p) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_scalar((fiobj_json_parser_s *)p, FIOBJ_T_FALSE);
+    return;
+  }
   fiobj_json_add2parser((fiobj_json_parser_s *)p, fiobj_false());
 }
 /** a Numberl was detected (long long). */
 static void fio_json_on_number(json_parser_s *p, long long i) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_scalar((fiobj_json_parser_s *)p, FIOBJ_T_NUMBER)
+        ->data.i = i;
+    return;
+  }
   fiobj_json_add2parser((fiobj_json_parser_s *)p, fiobj_num_new(i));
 }
 /** a Float was detected (double). */
 static void fio_json_on_float(json_parser_s *p, double f) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_scalar((fiobj_json_parser_s *)p, FIOBJ_T_FLOAT)
+        ->data.f = f;
+    return;
+  }
   fiobj_json_add2parser((fiobj_json_parser_s *)p, fiobj_float_new(f));
 }
 /** a String was detected (int / float). update `pos` to point at ending */
 static void fio_json_on_string(json_parser_s *p, void *start, size_t length) {
+  if (((fiobj_json_parser_s *)p)->view) {
+    fiobj_json_view_add_str((fiobj_json_parser_s *)p, start, length);
+    return;
+  }
   FIOBJ str = fiobj_str_buf(length);
   fiobj_str_resize(
       str, fio_json_unescape_str(fiobj_obj2cstr(str).data, start, length));
@@ -94,6 +236,10 @@ static void fio_json_on_string(json_parser_s *p, void *start, size_t length) {
 /** a dictionary object was detected */
 static int fio_json_on_start_object(json_parser_s *p) {
   fiobj_json_parser_s *pr = (fiobj_json_parser_s *)p;
+  if (pr->view) {
+    fiobj_json_view_open(pr, FIOBJ_T_HASH);
+    return 0;
+  }
   if (pr->target) {
     /* push NULL, don't free the objects */
     fio_json_stack_push(&pr->stack, pr->top);
@@ -111,6 +257,10 @@ static int fio_json_on_start_object(json_parser_s *p) {
 /** a dictionary object closure detected */
 static void fio_json_on_end_object(json_parser_s *p) {
   fiobj_json_parser_s *pr = (fiobj_json_parser_s *)p;
+  if (pr->view) {
+    fiobj_json_view_close(pr);
+    return;
+  }
   if (pr->key) {
     FIO_LOG_WARNING("(JSON parsing) malformed JSON, "
                     "ignoring dangling Hash key.");
@@ -124,6 +274,10 @@ static void fio_json_on_end_object(json_parser_s *p) {
 /** an array object was detected */
 static int fio_json_on_start_array(json_parser_s *p) {
   fiobj_json_parser_s *pr = (fiobj_json_parser_s *)p;
+  if (pr->view) {
+    fiobj_json_view_open(pr, FIOBJ_T_ARRAY);
+    return 0;
+  }
   if (pr->target)
     return -1;
   FIOBJ ary = fiobj_ary_new();
@@ -136,6 +290,10 @@ static int fio_json_on_start_array(json_parser_s *p) {
 /** an array closure was detected */
 static void fio_json_on_end_array(json_parser_s *p) {
   fiobj_json_parser_s *pr = (fiobj_json_parser_s *)p;
+  if (pr->view) {
+    fiobj_json_view_close(pr);
+    return;
+  }
   pr->top = FIOBJ_INVALID;
   fio_json_stack_pop(&pr->stack, &pr->top);
   pr->is_hash = FIOBJ_TYPE_IS(pr->top, FIOBJ_T_HASH);
@@ -156,108 +314,142 @@ static void fio_json_on_error(json_parser_s *p) {
   fiobj_free((FIOBJ)fio_json_stack_get(&pr->stack, 0));
   fiobj_free(pr->key);
   fio_json_stack_free(&pr->stack);
-  *pr = (fiobj_json_parser_s){.top = FIOBJ_INVALID};
+  *pr = (fiobj_json_parser_s){.top = FIOBJ_INVALID, .invalid = 1};
 }
 
 /* *****************************************************************************
 JSON formatting
 ***************************************************************************** */
 
+/**
+ * Makes sure `dest` has room for `len` more bytes, growing the String
+ * geometrically (so a long JSON String isn't reallocated for every value).
+ */
+static inline fio_str_info_s fiobj_json_reserve(FIOBJ dest, size_t len) {
+  fio_str_info_s t = fiobj_obj2cstr(dest);
+  if (t.capa >= t.len + len)
+    return t;
+  fiobj_str_capa_assert(dest, (t.capa << 1) > (t.len + len) ? (t.capa << 1)
+                                                             : (t.len + len));
+  return fiobj_obj2cstr(dest);
+}
+
+/** Returns the number of bytes (from `src`) that don't need escaping. */
+static inline size_t fiobj_json_safe_len(const uint8_t *src, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(31);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+    int bits = _mm_movemask_epi8(m);
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8(src + i);
+    uint8x16_t m = vorrq_u8(
+        vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))),
+        vcleq_u8(v, vdupq_n_u8(31)));
+    if (vmaxvq_u8(m))
+      break;
+  }
+#endif
+  while (i < len && src[i] > 31 && src[i] != '"' && src[i] != '\\')
+    ++i;
+  return i;
+}
+
 /** Writes a JSON friendly version of the src String */
 static void write_safe_str(FIOBJ dest, const FIOBJ str) {
   fio_str_info_s s = fiobj_obj2cstr(str);
-  fio_str_info_s t = fiobj_obj2cstr(dest);
-  t.data[t.len] = '"';
-  t.len++;
-  fiobj_str_resize(dest, t.len);
-  t = fiobj_obj2cstr(dest);
+  fio_str_info_s t = fiobj_json_reserve(dest, s.len + 2);
   const uint8_t *restrict src = (const uint8_t *)s.data;
   size_t len = s.len;
-  uint64_t end = t.len;
-  /* make sure we have some room */
-  size_t added = 0;
-  size_t capa = fiobj_str_capa(dest);
-  if (capa <= end + s.len + 64) {
-    if (0) {
-      capa = (((capa >> 12) + 1) << 12) - 1;
-      capa = fiobj_str_capa_assert(dest, capa);
-    } else {
-      capa = fiobj_str_capa_assert(dest, (end + s.len + 64));
-    }
-    fio_str_info_s tmp = fiobj_obj2cstr(dest);
-    t = tmp;
-  }
-  while (len) {
-    char *restrict writer = (char *)t.data;
-    while (len && src[0] > 32 && src[0] != '"' && src[0] != '\\') {
-      len--;
-      writer[end++] = *(src++);
-    }
+  size_t end = t.len;
+  t.data[end++] = '"';
+  for (;;) {
+    /* copy the bytes that don't require escaping */
+    size_t safe = fiobj_json_safe_len(src, len);
+    memcpy(t.data + end, src, safe);
+    end += safe;
+    src += safe;
+    len -= safe;
     if (!len)
       break;
+    /* escape sequences use up to 6 bytes */
+    if (t.capa < end + len + 7) {
+      fiobj_str_resize(dest, end);
+      t = fiobj_json_reserve(dest, len + 7);
+    }
+    char *restrict writer = t.data;
     switch (src[0]) {
     case '\b':
       writer[end++] = '\\';
       writer[end++] = 'b';
-      added++;
       break; /* from switch */
     case '\f':
       writer[end++] = '\\';
       writer[end++] = 'f';
-      added++;
       break; /* from switch */
     case '\n':
       writer[end++] = '\\';
       writer[end++] = 'n';
-      added++;
       break; /* from switch */
     case '\r':
       writer[end++] = '\\';
       writer[end++] = 'r';
-      added++;
       break; /* from switch */
     case '\t':
       writer[end++] = '\\';
       writer[end++] = 't';
-      added++;
       break; /* from switch */
     case '"':
     case '\\':
-    case '/':
       writer[end++] = '\\';
       writer[end++] = src[0];
-      added++;
       break; /* from switch */
     default:
-      if (src[0] <= 31) {
-        /* MUST escape all control values less than 32 */
-        writer[end++] = '\\';
-        writer[end++] = 'u';
-        writer[end++] = '0';
-        writer[end++] = '0';
-        writer[end++] = hex_chars[src[0] >> 4];
-        writer[end++] = hex_chars[src[0] & 15];
-        added += 4;
-      } else
-        writer[end++] = src[0];
+      /* MUST escape all control values less than 32 */
+      writer[end++] = '\\';
+      writer[end++] = 'u';
+      writer[end++] = '0';
+      writer[end++] = '0';
+      writer[end++] = hex_chars[src[0] >> 4];
+      writer[end++] = hex_chars[src[0] & 15];
       break; /* from switch */
     }
-    src++;
-    len--;
-    if (added >= 48 && capa <= end + len + 64) {
-      writer[end] = 0;
-      fiobj_str_resize(dest, end);
-      fiobj_str_capa_assert(dest, (end + len + 64));
-      t = fiobj_obj2cstr(dest);
-      writer = (char *)t.data;
-      capa = t.capa;
-      added = 0;
-    }
+    ++src;
+    --len;
   }
   t.data[end++] = '"';
   fiobj_str_resize(dest, end);
 }
 
+/** Writes a Number or a Float directly to the `dest` String */
+static inline void write_number(FIOBJ dest, FIOBJ o) {
+  fio_str_info_s t;
+  if (FIOBJ_TYPE_IS(o, FIOBJ_T_NUMBER)) {
+    t = fiobj_json_reserve(dest, 24);
+    t.len += fio_ltoa(t.data + t.len, fiobj_obj2num(o), 10);
+  } else {
+    double f = fiobj_obj2float(o);
+    if (!isfinite(f)) {
+      /* NaN and Infinity aren't JSON, keep their String representation */
+      fiobj_str_join(dest, o);
+      return;
+    }
+    t = fiobj_json_reserve(dest, 32);
+    t.len += fio_ftoa(t.data + t.len, f, 10);
+  }
+  fiobj_str_resize(dest, t.len);
+}
+
 typedef struct {
   FIOBJ dest;
   FIOBJ parent;
@@ -275,11 +467,20 @@ static int fiobj_obj2json_task(FIOBJ o, void *data_) {
   }
   switch (FIOBJ_TYPE(o)) {
   case FIOBJ_T_NUMBER:
+  case FIOBJ_T_FLOAT:
+    write_number(data->dest, o);
+    --data->count;
+    break;
   case FIOBJ_T_NULL:
+    fiobj_str_write(data->dest, "null", 4);
+    --data->count;
+    break;
   case FIOBJ_T_TRUE:
+    fiobj_str_write(data->dest, "true", 4);
+    --data->count;
+    break;
   case FIOBJ_T_FALSE:
-  case FIOBJ_T_FLOAT:
-    fiobj_str_join(data->dest, o);
+    fiobj_str_write(data->dest, "false", 5);
     --data->count;
     break;
 
@@ -290,6 +491,12 @@ static int fiobj_obj2json_task(FIOBJ o, void *data_) {
     --data->count;
     break;
 
+  case FIOBJ_T_JSON:
+    /* views are valid JSON, pass through */
+    fiobj_str_write(data->dest, obj2view(o)->text, obj2view(o)->len);
+    --data->count;
+    break;
+
   case FIOBJ_T_ARRAY:
     --data->count;
     fio_json_stack_push(data->stack, data->parent);
@@ -311,9 +518,7 @@ static int fiobj_obj2json_task(FIOBJ o, void *data_) {
     break;
   }
   if (data->pretty) {
-    fiobj_str_capa_assert(data->dest,
-                          fiobj_obj2cstr(data->dest).len +
-                              (fio_json_stack_count(data->stack) * 5));
+    fiobj_json_reserve(data->dest, fio_json_stack_count(data->stack) * 5);
     while (!data->count && data->parent) {
       if (FIOBJ_TYPE_IS(data->parent, FIOBJ_T_HASH)) {
         fiobj_str_write(data->dest, "}", 1);
@@ -330,9 +535,7 @@ static int fiobj_obj2json_task(FIOBJ o, void *data_) {
     if (add_seperator && data->parent) {
       fiobj_str_write(data->dest, ",\n", 2);
       uintptr_t indent = fio_json_stack_count(data->stack) - 1;
-      fiobj_str_capa_assert(data->dest,
-                            fiobj_obj2cstr(data->dest).len + (indent * 2));
-      fio_str_info_s buf = fiobj_obj2cstr(data->dest);
+      fio_str_info_s buf = fiobj_json_reserve(data->dest, indent * 2);
       while (indent--) {
         buf.data[buf.len++] = ' ';
         buf.data[buf.len++] = ' ';
@@ -340,9 +543,7 @@ static int fiobj_obj2json_task(FIOBJ o, void *data_) {
       fiobj_str_resize(data->dest, buf.len);
     }
   } else {
-    fiobj_str_capa_assert(data->dest,
-                          fiobj_obj2cstr(data->dest).len +
-                              (fio_json_stack_count(data->stack) << 1));
+    fiobj_json_reserve(data->dest, fio_json_stack_count(data->stack) << 1);
     while (!data->count && data->parent) {
       if (FIOBJ_TYPE_IS(data->parent, FIOBJ_T_HASH)) {
         fiobj_str_write(data->dest, "}", 1);
@@ -442,11 +643,436 @@ FIOBJ fiobj_obj2json(FIOBJ obj, uint8_t pretty) {
   return fiobj_obj2json2(fiobj_str_buf(128), obj, pretty);
 }
 
+/* *****************************************************************************
+JSON Streams
+***************************************************************************** */
+
+struct fiobj_json_stream_s {
+  fiobj_json_parser_s p;
+  /* unconsumed data (an incomplete token), always NUL terminated */
+  FIOBJ buffer;
+  void (*on_value)(FIOBJ value, void *udata);
+  void *udata;
+  uint8_t error;
+};
+
+/** Creates a push style JSON parser. */
+fiobj_json_stream_s *
+fiobj_json_stream_new(void (*on_value)(FIOBJ value, void *udata),
+                      void *udata) {
+  fiobj_json_stream_s *s = fio_malloc(sizeof(*s));
+  FIO_ASSERT_ALLOC(s);
+  *s = (fiobj_json_stream_s){
+      .p = {.top = FIOBJ_INVALID},
+      .buffer = fiobj_str_buf(0),
+      .on_value = on_value,
+      .udata = udata,
+  };
+  return s;
+}
+
+/* frees any incomplete value and resets the parser */
+static void fiobj_json_stream_reset(fiobj_json_stream_s *s) {
+  if (s->p.p.depth)
+    fiobj_free(fio_json_stack_get(&s->p.stack, 0));
+  fiobj_free(s->p.key);
+  fio_json_stack_free(&s->p.stack);
+  s->p = (fiobj_json_parser_s){.top = FIOBJ_INVALID};
+  fiobj_str_resize(s->buffer, 0);
+  s->error = 0;
+}
+
+/* parses the buffered data, keeping any incomplete token in the buffer */
+static int fiobj_json_stream_parse(fiobj_json_stream_s *s, uint8_t final) {
+  fio_str_info_s b = fiobj_obj2cstr(s->buffer);
+  size_t pos = 0;
+  for (;;) {
+    if (!s->p.p.depth) {
+      /* between values, skip white space (and commas) */
+      while (pos < b.len && JSON_SEPERATOR[(uint8_t)b.data[pos]])
+        ++pos;
+      if (pos == b.len)
+        break;
+      if (!final) {
+        /* a top level Number might continue in the next chunk */
+        size_t end = pos;
+        while (end < b.len && JSON_NUMERAL[(uint8_t)b.data[end]])
+          ++end;
+        if (end == b.len)
+          break;
+      }
+    }
+    size_t consumed = fio_json_parse(&s->p.p, b.data + pos, b.len - pos);
+    if (s->p.invalid) {
+      s->p.invalid = 0;
+      s->error = 1;
+      fiobj_str_resize(s->buffer, 0);
+      return -1;
+    }
+    pos += consumed;
+    if (!s->p.p.depth && s->p.top) {
+      FIOBJ value = s->p.top;
+      s->p.top = FIOBJ_INVALID;
+      s->p.is_hash = 0;
+      s->on_value(value, s->udata);
+      fiobj_free(value);
+      continue;
+    }
+    if (!consumed)
+      break;
+  }
+  if (pos) {
+    memmove(b.data, b.data + pos, b.len - pos);
+    fiobj_str_resize(s->buffer, b.len - pos);
+  }
+  return 0;
+}
+
+/** Parses a chunk of JSON data, calling `on_value` for every complete value. */
+int fiobj_json_stream_push(fiobj_json_stream_s *s, const void *data,
+                           size_t len) {
+  if (!s || s->error)
+    return -1;
+  if (!len)
+    return 0;
+  fiobj_str_write(s->buffer, data, len);
+  return fiobj_json_stream_parse(s, 0);
+}
+
+/** Marks the end of the stream, parsing any remaining data. */
+int fiobj_json_stream_finish(fiobj_json_stream_s *s) {
+  if (!s)
+    return -1;
+  int ret = -1;
+  if (!s->error && !fiobj_json_stream_parse(s, 1) && !s->p.p.depth &&
+      !fiobj_obj2cstr(s->buffer).len)
+    ret = 0;
+  fiobj_json_stream_reset(s);
+  return ret;
+}
+
+/** Frees the stream parser (and any incomplete value). */
+void fiobj_json_stream_free(fiobj_json_stream_s *s) {
+  if (!s)
+    return;
+  fiobj_json_stream_reset(s);
+  fiobj_free(s->buffer);
+  fio_free(s);
+}
+
+/* *****************************************************************************
+JSON View API
+***************************************************************************** */
+
+/**
+ * Parses JSON into a read only view (a `FIOBJ_T_JSON` object), setting `pview`
+ * to point to the new view.
+ *
+ * Returns the number of bytes consumed. On Error, 0 is returned and no data is
+ * consumed.
+ */
+size_t fiobj_json2view(FIOBJ *pview, const void *data, size_t len) {
+  *pview = FIOBJ_INVALID;
+  if (!data || !len || len >= UINT32_MAX)
+    return 0;
+  /* the index is collected before the view (and the text) are allocated */
+  fiobj_json_view_s tmp = {.capa = (len >> 4) + 16};
+  tmp.nodes = fio_malloc(tmp.capa * sizeof(*tmp.nodes));
+  FIO_ASSERT_ALLOC(tmp.nodes);
+  fiobj_json_parser_s p = {.top = FIOBJ_INVALID, .view = &tmp, .base = data};
+  size_t consumed = fio_json_parse(&p.p, data, len);
+  if (!consumed || p.p.depth || p.invalid || !tmp.count) {
+    fio_free(tmp.nodes);
+    fio_free(tmp.strings);
+    return 0;
+  }
+  fiobj_json_view_s *view = fio_malloc(sizeof(*view) + consumed + 1);
+  FIO_ASSERT_ALLOC(view);
+  *view = tmp;
+  view->head = (fiobj_object_header_s){.type = FIOBJ_T_JSON, .ref = 1};
+  view->len = consumed;
+  memcpy(view->text, data, consumed);
+  view->text[consumed] = 0;
+  *pview = (FIOBJ)view;
+  return consumed;
+}
+
+/* returns the referenced node, or NULL for missing values */
+static inline fiobj_json_node_s *fiobj_json_ref2node(fiobj_json_ref_s ref) {
+  if (!FIOBJ_TYPE_IS(ref.view, FIOBJ_T_JSON) ||
+      ref.pos >= obj2view(ref.view)->count)
+    return NULL;
+  return obj2view(ref.view)->nodes + ref.pos;
+}
+
+/* returns the position of the value following the value at `pos` */
+static inline uintptr_t fiobj_json_view_next(fiobj_json_view_s *v,
+                                             uintptr_t pos) {
+  if (v->nodes[pos].type == FIOBJ_T_ARRAY || v->nodes[pos].type == FIOBJ_T_HASH)
+    return v->nodes[pos].data.c.end;
+  return pos + 1;
+}
+
+static inline fio_str_info_s fiobj_json_view_str(fiobj_json_view_s *v,
+                                                 fiobj_json_node_s *n) {
+  return (fio_str_info_s){
+      .data = (n->unescaped ? v->strings : v->text) + n->data.str.pos,
+      .len = n->data.str.len,
+  };
+}
+
+/** Returns a reference to the view's top level value. */
+fiobj_json_ref_s fiobj_json_root(FIOBJ view) {
+  if (!FIOBJ_TYPE_IS(view, FIOBJ_T_JSON))
+    return (fiobj_json_ref_s){.view = FIOBJ_INVALID};
+  return (fiobj_json_ref_s){.view = view, .pos = 0};
+}
+
+/** Returns the type of a referenced value. */
+fiobj_type_enum fiobj_json_type(fiobj_json_ref_s ref) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n)
+    return FIOBJ_T_UNKNOWN;
+  return n->type;
+}
+
+/** Returns the number of members in a referenced Array or Hash. */
+size_t fiobj_json_count(fiobj_json_ref_s ref) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n || (n->type != FIOBJ_T_ARRAY && n->type != FIOBJ_T_HASH))
+    return 0;
+  return n->data.c.count;
+}
+
+/** Returns a reference to the value stored in a referenced Hash. */
+fiobj_json_ref_s fiobj_json_get(fiobj_json_ref_s hash, const char *key,
+                                size_t key_len) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(hash);
+  if (!n || n->type != FIOBJ_T_HASH)
+    return (fiobj_json_ref_s){.view = FIOBJ_INVALID};
+  fiobj_json_view_s *v = obj2view(hash.view);
+  uintptr_t pos = hash.pos + 1;
+  while (pos < n->data.c.end) {
+    fio_str_info_s k = fiobj_json_view_str(v, v->nodes + pos);
+    if (k.len == key_len && !memcmp(k.data, key, key_len))
+      return (fiobj_json_ref_s){.view = hash.view, .pos = pos + 1};
+    pos = fiobj_json_view_next(v, pos + 1);
+  }
+  return (fiobj_json_ref_s){.view = FIOBJ_INVALID};
+}
+
+/** Returns a reference to the value at `index` in a referenced Array. */
+fiobj_json_ref_s fiobj_json_index(fiobj_json_ref_s ary, int64_t index) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ary);
+  if (!n || n->type != FIOBJ_T_ARRAY)
+    return (fiobj_json_ref_s){.view = FIOBJ_INVALID};
+  if (index < 0)
+    index += n->data.c.count;
+  if (index < 0 || index >= (int64_t)n->data.c.count)
+    return (fiobj_json_ref_s){.view = FIOBJ_INVALID};
+  fiobj_json_view_s *v = obj2view(ary.view);
+  uintptr_t pos = ary.pos + 1;
+  while (index--)
+    pos = fiobj_json_view_next(v, pos);
+  return (fiobj_json_ref_s){.view = ary.view, .pos = pos};
+}
+
+/** Iterates through the members of a referenced Array or Hash. */
+size_t fiobj_json_each(fiobj_json_ref_s ref, size_t start_at,
+                       int (*task)(fiobj_json_ref_s key, fiobj_json_ref_s value,
+                                   void *arg),
+                       void *arg) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n || (n->type != FIOBJ_T_ARRAY && n->type != FIOBJ_T_HASH))
+    return 0;
+  fiobj_json_view_s *v = obj2view(ref.view);
+  const uint8_t is_hash = (n->type == FIOBJ_T_HASH);
+  fiobj_json_ref_s key = {.view = FIOBJ_INVALID};
+  fiobj_json_ref_s value = {.view = ref.view};
+  uintptr_t pos = ref.pos + 1;
+  size_t i = 0;
+  while (pos < n->data.c.end) {
+    if (is_hash) {
+      key = (fiobj_json_ref_s){.view = ref.view, .pos = pos};
+      ++pos;
+    }
+    value.pos = pos;
+    pos = fiobj_json_view_next(v, pos);
+    if (i++ < start_at)
+      continue;
+    if (task(key, value, arg) == -1)
+      return i;
+  }
+  return i;
+}
+
+/** Returns a referenced String's (unescaped) content without copying. */
+fio_str_info_s fiobj_json2cstr(fiobj_json_ref_s ref) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n || n->type != FIOBJ_T_STRING)
+    return (fio_str_info_s){.data = NULL, .len = 0};
+  return fiobj_json_view_str(obj2view(ref.view), n);
+}
+
+/** Returns a referenced value's numerical value. */
+intptr_t fiobj_json2num(fiobj_json_ref_s ref) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n)
+    return 0;
+  switch (n->type) {
+  case FIOBJ_T_NUMBER:
+    return (intptr_t)n->data.i;
+  case FIOBJ_T_FLOAT:
+    return (intptr_t)floorl(n->data.f);
+  case FIOBJ_T_TRUE:
+    return 1;
+  case FIOBJ_T_STRING: {
+    char *pos = fiobj_json_view_str(obj2view(ref.view), n).data;
+    return (intptr_t)fio_atol(&pos);
+  }
+  case FIOBJ_T_ARRAY:
+  case FIOBJ_T_HASH:
+    return (intptr_t)n->data.c.count;
+  default:
+    return 0;
+  }
+}
+
+/** Returns a referenced value's floating point value. */
+double fiobj_json2float(fiobj_json_ref_s ref) {
+  fiobj_json_node_s *n = fiobj_json_ref2node(ref);
+  if (!n)
+    return 0;
+  switch (n->type) {
+  case FIOBJ_T_FLOAT:
+    return n->data.f;
+  case FIOBJ_T_STRING: {
+    char *pos = fiobj_json_view_str(obj2view(ref.view), n).data;
+    return fio_atof(&pos);
+  }
+  default:
+    return (double)fiobj_json2num(ref);
+  }
+}
+
+/* nesting is limited by JSON_MAX_DEPTH, so recursion is safe */
+static FIOBJ fiobj_json_view2obj(fiobj_json_view_s *v, uintptr_t pos) {
+  fiobj_json_node_s *n = v->nodes + pos;
+  switch (n->type) {
+  case FIOBJ_T_NUMBER:
+    return fiobj_num_new(n->data.i);
+  case FIOBJ_T_FLOAT:
+    return fiobj_float_new(n->data.f);
+  case FIOBJ_T_TRUE:
+    return fiobj_true();
+  case FIOBJ_T_FALSE:
+    return fiobj_false();
+  case FIOBJ_T_STRING: {
+    fio_str_info_s s = fiobj_json_view_str(v, n);
+    return fiobj_str_new(s.data, s.len);
+  }
+  case FIOBJ_T_ARRAY: {
+    FIOBJ ary = fiobj_ary_new2(n->data.c.count);
+    for (pos = pos + 1; pos < n->data.c.end; pos = fiobj_json_view_next(v, pos))
+      fiobj_ary_push(ary, fiobj_json_view2obj(v, pos));
+    return ary;
+  }
+  case FIOBJ_T_HASH: {
+    FIOBJ hash = fiobj_hash_new2(n->data.c.count);
+    for (pos = pos + 1; pos < n->data.c.end;
+         pos = fiobj_json_view_next(v, pos + 1)) {
+      FIOBJ key = fiobj_json_view2obj(v, pos);
+      fiobj_hash_set(hash, key, fiobj_json_view2obj(v, pos + 1));
+      fiobj_free(key);
+    }
+    return hash;
+  }
+  default:
+    return fiobj_null();
+  }
+}
+
+/** Creates a FIOBJ object from a referenced value (and any nested values). */
+FIOBJ fiobj_json_ref2obj(fiobj_json_ref_s ref) {
+  if (!fiobj_json_ref2node(ref))
+    return FIOBJ_INVALID;
+  return fiobj_json_view2obj(obj2view(ref.view), ref.pos);
+}
+
+/* *****************************************************************************
+JSON View VTable
+***************************************************************************** */
+
+static void fiobj_json_view_dealloc(FIOBJ o, void (*task)(FIOBJ, void *),
+                                    void *arg) {
+  fio_free(obj2view(o)->nodes);
+  fio_free(obj2view(o)->strings);
+  fio_free(obj2view(o));
+  (void)task;
+  (void)arg;
+}
+
+static size_t fiobj_json_view_is_true(const FIOBJ o) {
+  fiobj_json_ref_s root = {.view = o};
+  switch (fiobj_json_type(root)) {
+  case FIOBJ_T_STRING:
+    return fiobj_json2cstr(root).len > 0;
+  case FIOBJ_T_FLOAT:
+    return fiobj_json2float(root) != 0;
+  default:
+    return fiobj_json2num(root) != 0;
+  }
+}
+
+static size_t fiobj_json_view_is_eq(const FIOBJ o1, const FIOBJ o2) {
+  return obj2view(o1)->len == obj2view(o2)->len &&
+         !memcmp(obj2view(o1)->text, obj2view(o2)->text, obj2view(o1)->len);
+}
+
+static fio_str_info_s fiobj_json_view2str(const FIOBJ o) {
+  return (fio_str_info_s){.data = obj2view(o)->text, .len = obj2view(o)->len};
+}
+
+static intptr_t fiobj_json_view2i(const FIOBJ o) {
+  return fiobj_json2num((fiobj_json_ref_s){.view = o});
+}
+
+static double fiobj_json_view2f(const FIOBJ o) {
+  return fiobj_json2float((fiobj_json_ref_s){.view = o});
+}
+
+uintptr_t fiobject___noop_count(const FIOBJ o);
+
+const fiobj_object_vtable_s FIOBJECT_VTABLE_JSON = {
+    .class_name = "JSON",
+    .dealloc = fiobj_json_view_dealloc,
+    .is_true = fiobj_json_view_is_true,
+    .is_eq = fiobj_json_view_is_eq,
+    .to_str = fiobj_json_view2str,
+    .to_i = fiobj_json_view2i,
+    .to_f = fiobj_json_view2f,
+    .count = fiobject___noop_count,
+    .each = NULL,
+};
+
 /* *****************************************************************************
 Test
 ***************************************************************************** */
 
 #if DEBUG
+static int fiobj_test_json_view_task(fiobj_json_ref_s key,
+                                     fiobj_json_ref_s value, void *arg) {
+  uintptr_t *counter = arg;
+  ++counter[0];
+  if (fiobj_json_type(value) == FIOBJ_T_HASH && !key.view)
+    ++counter[1];
+  return 0;
+}
+
+static void fiobj_test_json_stream_task(FIOBJ value, void *values) {
+  fiobj_ary_push((FIOBJ)values, fiobj_dup(value));
+}
+
 void fiobj_test_json(void) {
   fprintf(stderr, "=== Testing JSON parser (simple test)\n");
 #define TEST_ASSERT(cond, ...)                                                 \
@@ -617,6 +1243,139 @@ void fiobj_test_json(void) {
   fiobj_free(o);
   fiobj_free(tmp);
   fprintf(stderr, "* passed.\n");
+
+  fprintf(stderr, "=== Testing JSON structural index (vs. byte by byte)\n");
+  tmp = fiobj_str_buf(JSON_INDEX_WINDOW * 4);
+  fiobj_str_write(tmp, "{\"messy\":", 9);
+  fiobj_str_write(tmp, json_str2, sizeof(json_str2) - 1);
+  fiobj_str_write(tmp, ",\"long\":\"", 9);
+  for (size_t i = 0; i < JSON_INDEX_WINDOW; ++i)
+    fiobj_str_write(tmp, (i & 7) ? "x" : "\\\\\\\"", (i & 7) ? 1 : 4);
+  fiobj_str_write(tmp, "\",\n\"list\":[", 11);
+  for (size_t i = 0; i < 512; ++i) {
+    fiobj_str_printf(tmp, "{\"id\":%lu,\"ok\":true,\"s\":\"\\\\%lu\\\"\"},\n",
+                     (unsigned long)i, (unsigned long)i);
+  }
+  fiobj_str_write(tmp, "null] # a comment\n, \"end\": -1.5}", 32);
+  {
+    fio_str_info_s data = fiobj_obj2cstr(tmp);
+    FIOBJ expected = FIOBJ_INVALID;
+    fio_json_set_isa(JSON_ISA_SCALAR);
+    TEST_ASSERT(fiobj_json2obj(&expected, data.data, data.len) == data.len,
+                "JSON (byte by byte) failed to parse the test data!\n");
+    for (int isa = JSON_ISA_SSE42; isa <= JSON_ISA_NEON; ++isa) {
+      if (fio_json_set_isa(isa) != isa)
+        continue;
+      consumed = fiobj_json2obj(&o, data.data, data.len);
+      TEST_ASSERT(consumed == data.len, "JSON index (%d) stopped early!\n",
+                  isa);
+      TEST_ASSERT(fiobj_iseq(o, expected), "JSON index (%d) result error!\n",
+                  isa);
+      fiobj_free(o);
+      fprintf(stderr, "* passed (JSON_ISA %d).\n", isa);
+    }
+    fio_json_set_isa(JSON_ISA_AUTO);
+
+    fprintf(stderr, "=== Testing JSON views\n");
+    FIOBJ view;
+    TEST_ASSERT(fiobj_json2view(&view, data.data, data.len) == data.len,
+                "JSON view failed to parse the test data!\n");
+    TEST_ASSERT(FIOBJ_TYPE_IS(view, FIOBJ_T_JSON), "JSON view type error!\n");
+    fiobj_json_ref_s root = fiobj_json_root(view);
+    o = fiobj_json_ref2obj(root);
+    TEST_ASSERT(fiobj_iseq(o, expected), "JSON view materialization error!\n");
+    fiobj_free(o);
+    TEST_ASSERT(fiobj_json_count(root) == 4, "JSON view count error!\n");
+    fiobj_json_ref_s list = fiobj_json_get(root, "list", 4);
+    TEST_ASSERT(fiobj_json_type(list) == FIOBJ_T_ARRAY &&
+                    fiobj_json_count(list) == 513,
+                "JSON view Array lookup error!\n");
+    TEST_ASSERT(fiobj_json_type(fiobj_json_index(list, -1)) == FIOBJ_T_NULL &&
+                    fiobj_json_type(fiobj_json_index(list, 513)) ==
+                        FIOBJ_T_UNKNOWN,
+                "JSON view Array index error!\n");
+    fiobj_json_ref_s item = fiobj_json_index(list, 200);
+    TEST_ASSERT(fiobj_json2num(fiobj_json_get(item, "id", 2)) == 200,
+                "JSON view Number lookup error!\n");
+    fio_str_info_s str = fiobj_json2cstr(fiobj_json_get(item, "s", 1));
+    TEST_ASSERT(str.len == 5 && !memcmp(str.data, "\\200\"", 5),
+                "JSON view String unescaping error!\n");
+    TEST_ASSERT(fiobj_json2float(fiobj_json_get(root, "end", 3)) == -1.5,
+                "JSON view Float lookup error!\n");
+    TEST_ASSERT(fiobj_json_type(fiobj_json_get(root, "nothing", 7)) ==
+                    FIOBJ_T_UNKNOWN,
+                "JSON view missing key error!\n");
+    uintptr_t counter[2] = {0};
+    TEST_ASSERT(fiobj_json_each(list, 10, fiobj_test_json_view_task,
+                                counter) == 513 &&
+                    counter[0] == 503 && counter[1] == 502,
+                "JSON view iteration error!\n");
+    counter[0] = counter[1] = 0;
+    TEST_ASSERT(fiobj_json_each(item, 0, fiobj_test_json_view_task,
+                                counter) == 3 &&
+                    counter[0] == 3 && counter[1] == 0,
+                "JSON view Hash iteration error!\n");
+    o = fiobj_ary_new2(1);
+    fiobj_ary_push(o, view);
+    FIOBJ json = fiobj_obj2json(o, 0);
+    fio_str_info_s result = fiobj_obj2cstr(json);
+    TEST_ASSERT(result.len == data.len + 2 &&
+                    !memcmp(result.data + 1, data.data, data.len),
+                "JSON view pass through error!\n");
+    fiobj_free(json);
+    fiobj_free(o); /* frees the view */
+    TEST_ASSERT(!fiobj_json2view(&view, "{1:2}", 5) && !view,
+                "JSON view should require String keys!\n");
+    fprintf(stderr, "* passed.\n");
+
+    fprintf(stderr, "=== Testing JSON streams\n");
+    FIOBJ values = fiobj_ary_new();
+    fiobj_json_stream_s *stream =
+        fiobj_json_stream_new(fiobj_test_json_stream_task, (void *)values);
+    for (size_t i = 0, chunk = 1; i < data.len; i += chunk, chunk += 7) {
+      if (i + chunk > data.len)
+        chunk = data.len - i;
+      TEST_ASSERT(!fiobj_json_stream_push(stream, data.data + i, chunk),
+                  "JSON stream push error!\n");
+    }
+    TEST_ASSERT(!fiobj_json_stream_finish(stream), "JSON stream error!\n");
+    TEST_ASSERT(fiobj_ary_count(values) == 1 &&
+                    fiobj_iseq(fiobj_ary_index(values, 0), expected),
+                "JSON stream result error!\n");
+    fiobj_free(values);
+    fiobj_json_stream_free(stream);
+    /* NDJSON, byte by byte */
+    values = fiobj_ary_new();
+    stream = fiobj_json_stream_new(fiobj_test_json_stream_task, (void *)values);
+    {
+      const char ndjson[] = "1\n{\"a\":[1,-20e1,\"b\\\"\"]}\n\"str\"\n-3.5\r\n"
+                            "true\n[]\n-42";
+      const char ary[] = "[1,{\"a\":[1,-20e1,\"b\\\"\"]},\"str\",-3.5,"
+                         "true,[],-42]";
+      for (size_t i = 0; i < sizeof(ndjson) - 1; ++i)
+        TEST_ASSERT(!fiobj_json_stream_push(stream, ndjson + i, 1),
+                    "NDJSON stream push error!\n");
+      TEST_ASSERT(fiobj_ary_count(values) == 6,
+                  "NDJSON stream should wait for the last Number!\n");
+      TEST_ASSERT(!fiobj_json_stream_finish(stream), "NDJSON stream error!\n");
+      o = FIOBJ_INVALID;
+      fiobj_json2obj(&o, ary, sizeof(ary) - 1);
+      TEST_ASSERT(fiobj_iseq(o, values), "NDJSON stream result error!\n");
+      fiobj_free(o);
+    }
+    TEST_ASSERT(fiobj_json_stream_push(stream, "[1}", 3) == -1 &&
+                    fiobj_json_stream_push(stream, "1 ", 2) == -1 &&
+                    fiobj_json_stream_finish(stream) == -1,
+                "JSON stream should report errors!\n");
+    TEST_ASSERT(!fiobj_json_stream_push(stream, "[{\"a\":", 6) &&
+                    fiobj_json_stream_finish(stream) == -1,
+                "JSON stream should report incomplete values!\n");
+    fiobj_json_stream_free(stream);
+    fiobj_free(values);
+    fprintf(stderr, "* passed.\n");
+    fiobj_free(expected);
+  }
+  fiobj_free(tmp);
 }
 
 #endif
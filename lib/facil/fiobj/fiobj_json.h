@@ -57,6 +57,171 @@ FIOBJ fiobj_obj2json(FIOBJ, uint8_t pretty);
  */
 FIOBJ fiobj_obj2json2(FIOBJ dest, FIOBJ object, uint8_t pretty);
 
+/* *****************************************************************************
+JSON Streams (push parsing)
+***************************************************************************** */
+
+/** A JSON stream parser (see `fiobj_json_stream_new`). */
+typedef struct fiobj_json_stream_s fiobj_json_stream_s;
+
+/**
+ * Creates a push style JSON parser, for JSON data that arrives in chunks
+ * (i.e., large uploads, newline delimited JSON or WebSocket messages).
+ *
+ * Data is pushed using `fiobj_json_stream_push`, in chunks of any size. The
+ * `on_value` callback is called for every complete top level value, so a
+ * stream of values (i.e., NDJSON) is parsed one value at a time.
+ *
+ * The value is freed once the callback returns (use `fiobj_dup` to keep it).
+ *
+ * Only the value being parsed and any incomplete token are kept in memory.
+ */
+fiobj_json_stream_s *
+fiobj_json_stream_new(void (*on_value)(FIOBJ value, void *udata),
+                      void *udata);
+
+/**
+ * Parses a chunk of JSON data, calling `on_value` for every complete value.
+ *
+ * Returns -1 on error or 0 on success. Once an error occurred, any data pushed
+ * is ignored until `fiobj_json_stream_finish` is called.
+ */
+int fiobj_json_stream_push(fiobj_json_stream_s *stream, const void *data,
+                           size_t len);
+
+/**
+ * Marks the end of the stream, parsing any remaining data (i.e., a top level
+ * Number that might have continued in the next chunk).
+ *
+ * The stream is reset and could be reused.
+ *
+ * Returns -1 if the stream ended with an incomplete value (or after an error)
+ * or 0 on success.
+ */
+int fiobj_json_stream_finish(fiobj_json_stream_s *stream);
+
+/** Frees the stream parser (and any incomplete value). */
+void fiobj_json_stream_free(fiobj_json_stream_s *stream);
+
+/* *****************************************************************************
+JSON Views (read only, lazy access)
+***************************************************************************** */
+
+/**
+ * A reference to a value within a JSON view (see `fiobj_json2view`).
+ *
+ * References don't hold a reference to the view, they are only valid while
+ * the view exists.
+ *
+ * Missing values are represented by a reference to `FIOBJ_INVALID`.
+ */
+typedef struct {
+  FIOBJ view;
+  uintptr_t pos;
+} fiobj_json_ref_s;
+
+/**
+ * Parses JSON into a read only view (a `FIOBJ_T_JSON` object), setting `pview`
+ * to point to the new view.
+ *
+ * A view keeps a copy of the JSON text and a compact index of the values in
+ * the text. No other objects are created unless requested (see
+ * `fiobj_json_ref2obj`), so views require only a few allocations and far less
+ * memory than `fiobj_json2obj`.
+ *
+ * `fiobj_obj2cstr` returns the view's JSON text and `fiobj_obj2json` copies the
+ * text as is (the `pretty` flag is ignored), allowing JSON to be forwarded
+ * without formatting it again.
+ *
+ * Non-String Hash keys (which `fiobj_json2obj` tolerates) are considered
+ * errors.
+ *
+ * Returns the number of bytes consumed. On Error, 0 is returned and no data is
+ * consumed.
+ */
+size_t fiobj_json2view(FIOBJ *pview, const void *data, size_t len);
+
+/** Returns a reference to the view's top level value. */
+fiobj_json_ref_s fiobj_json_root(FIOBJ view);
+
+/**
+ * Returns the type of a referenced value (`FIOBJ_T_NUMBER`, `FIOBJ_T_FLOAT`,
+ * `FIOBJ_T_STRING`, `FIOBJ_T_ARRAY`, `FIOBJ_T_HASH` or a primitive type).
+ *
+ * Returns `FIOBJ_T_UNKNOWN` for missing values.
+ */
+fiobj_type_enum fiobj_json_type(fiobj_json_ref_s ref);
+
+/** Returns the number of members in a referenced Array or Hash. */
+size_t fiobj_json_count(fiobj_json_ref_s ref);
+
+/**
+ * Returns a reference to the value stored in a referenced Hash under `key`.
+ *
+ * If the key is repeated, the first occurrence is returned.
+ */
+fiobj_json_ref_s fiobj_json_get(fiobj_json_ref_s hash, const char *key,
+                                size_t key_len);
+
+/**
+ * Returns a reference to the value at `index` in a referenced Array.
+ *
+ * Negative values are retrieved from the end of the Array (i.e., -1 is the
+ * last item).
+ *
+ * Note: Arrays are walked from the start, so iteration (`fiobj_json_each`) is
+ * faster than indexing through the whole Array.
+ */
+fiobj_json_ref_s fiobj_json_index(fiobj_json_ref_s ary, int64_t index);
+
+/**
+ * Iterates through the members of a referenced Array or Hash, starting at the
+ * `start_at` member.
+ *
+ * The callback receives a reference to the Hash member's key (for Arrays the
+ * key is missing) and a reference to the value.
+ *
+ * If the callback returns -1, the loop is broken. Any other value is ignored.
+ *
+ * Returns the "stop" position, i.e., the number of items processed + the
+ * starting point.
+ */
+size_t fiobj_json_each(fiobj_json_ref_s ref, size_t start_at,
+                       int (*task)(fiobj_json_ref_s key, fiobj_json_ref_s value,
+                                   void *arg),
+                       void *arg);
+
+/**
+ * Returns a referenced String's (unescaped) content without copying the data.
+ *
+ * The String isn't always NUL terminated, use the `len` field.
+ *
+ * Non-String values return an empty String (see `fiobj_json2num` and
+ * `fiobj_json2float`).
+ */
+fio_str_info_s fiobj_json2cstr(fiobj_json_ref_s ref);
+
+/**
+ * Returns a referenced value's numerical value, following the same rules as
+ * `fiobj_obj2num` (Strings are parsed, Arrays and Hashes return their count).
+ */
+intptr_t fiobj_json2num(fiobj_json_ref_s ref);
+
+/**
+ * Returns a referenced value's floating point value, following the same rules
+ * as `fiobj_obj2float`.
+ */
+double fiobj_json2float(fiobj_json_ref_s ref);
+
+/**
+ * Creates a FIOBJ object from a referenced value (and any nested values).
+ *
+ * Remember to `fiobj_free`.
+ *
+ * Returns `FIOBJ_INVALID` for missing values.
+ */
+FIOBJ fiobj_json_ref2obj(fiobj_json_ref_s ref);
+
 #if DEBUG
 void fiobj_test_json(void);
 #endif
@@ -2,13 +2,17 @@
 Copyright: Boaz Segev, 2018-2019
 License: MIT
 */
+#include <fiobj_ary.h>
+#include <fiobj_hash.h>
+#include <fiobj_str.h>
+
+/* names are pre-hashed using the same hash function as FIOBJ String keys */
+#define MUSTACHE_NAME_HASH(name, len) fiobj_hash_string((name), (len))
 #define INCLUDE_MUSTACHE_IMPLEMENTATION 1
 #include <mustache_parser.h>
 
-#include <fiobj_ary.h>
-#include <fiobj_hash.h>
+#include <fiobj4fio.h>
 #include <fiobj_mustache.h>
-#include <fiobj_str.h>
 
 #ifndef FIO_IGNORE_MACRO
 /**
@@ -49,6 +53,41 @@ mustache_s *fiobj_mustache_new FIO_IGNORE_MACRO(mustache_load_args_s args) {
 /** Free the mustache template */
 void fiobj_mustache_free(mustache_s *mustache) { mustache_free(mustache); }
 
+/* *****************************************************************************
+Rendering
+***************************************************************************** */
+
+#ifndef FIOBJ_MUSTACHE_CHUNK_SIZE
+/** The size of the chunks written by `fiobj_mustache_stream`. */
+#define FIOBJ_MUSTACHE_CHUNK_SIZE (1 << 14)
+#endif
+
+#ifndef FIOBJ_MUSTACHE_PENDING_LIMIT
+/** The number of chunks `fiobj_mustache_write` allows in a socket's queue. */
+#define FIOBJ_MUSTACHE_PENDING_LIMIT 4
+#endif
+
+/* the rendering target (the template's `udata1`) */
+typedef struct {
+  FIOBJ dest;
+  int (*write)(FIOBJ chunk, void *udata);
+  void *udata;
+} fiobj_mustache_output_s;
+
+/* passes the rendered chunk to the `write` callback, starting a new chunk */
+static int fiobj_mustache_output_flush(fiobj_mustache_output_s *out,
+                                       mustache_section_s *section) {
+  FIOBJ chunk = out->dest;
+  out->dest = FIOBJ_INVALID;
+  int ret = out->write(chunk, out->udata);
+  if (ret == -1)
+    return -1;
+  out->dest = fiobj_str_buf(FIOBJ_MUSTACHE_CHUNK_SIZE);
+  if (ret == 1)
+    mustache_build_pause(section);
+  return 0;
+}
+
 /**
  * Renders a template into an existing FIOBJ String (`dest`'s end), using the
  * information in the `data` object.
@@ -56,7 +95,22 @@ void fiobj_mustache_free(mustache_s *mustache) { mustache_free(mustache); }
  * Returns FIOBJ_INVALID if an error occured and a FIOBJ String on success.
  */
 FIOBJ fiobj_mustache_build2(FIOBJ dest, mustache_s *mustache, FIOBJ data) {
-  mustache_build(mustache, .udata1 = (void *)dest, .udata2 = (void *)data);
+  if (!mustache)
+    return dest;
+  const size_t org_len = fiobj_obj2cstr(dest).len;
+  if (mustache->estimate)
+    fiobj_str_capa_assert(dest, org_len + mustache->estimate);
+  fiobj_mustache_output_s out = {.dest = dest};
+  mustache_build(mustache, .udata1 = (void *)&out, .udata2 = (void *)data);
+  /* update the running estimate: grow at once, shrink slowly (the estimate is
+   * only a hint, so concurrent renders may safely lose an update) */
+  const uint64_t len = fiobj_obj2cstr(dest).len - org_len;
+  uint64_t estimate = mustache->estimate;
+  if (len > estimate)
+    estimate = len;
+  else
+    estimate -= (estimate - len) >> 3;
+  mustache->estimate = estimate;
   return dest;
 }
 
@@ -69,8 +123,143 @@ FIOBJ fiobj_mustache_build2(FIOBJ dest, mustache_s *mustache, FIOBJ data) {
 FIOBJ fiobj_mustache_build(mustache_s *mustache, FIOBJ data) {
   if (!mustache)
     return FIOBJ_INVALID;
-  return fiobj_mustache_build2(fiobj_str_buf(mustache->u.read_only.data_length),
-                               mustache, data);
+  return fiobj_mustache_build2(
+      fiobj_str_buf(mustache->estimate ? mustache->estimate
+                                       : mustache->u.read_only.data_length),
+      mustache, data);
+}
+
+/**
+ * Renders a template in chunks, passing each chunk to the `write` callback as
+ * soon as it's rendered.
+ */
+int fiobj_mustache_stream(mustache_s *mustache, FIOBJ data,
+                          int (*write)(FIOBJ chunk, void *udata),
+                          void *udata) {
+  if (!mustache || !write)
+    return -1;
+  fiobj_mustache_output_s out = {
+      .dest = fiobj_str_buf(FIOBJ_MUSTACHE_CHUNK_SIZE),
+      .write = write,
+      .udata = udata,
+  };
+  int ret = mustache_build(mustache, .udata1 = (void *)&out,
+                           .udata2 = (void *)data);
+  if (ret != -1 && fiobj_obj2cstr(out.dest).len)
+    ret = fiobj_mustache_output_flush(&out, NULL);
+  fiobj_free(out.dest);
+  return ret == -1 ? -1 : 0;
+}
+
+/* a render that can be paused (see `fiobj_mustache_stream_new`) */
+struct fiobj_mustache_stream_s {
+  fiobj_mustache_output_s out;
+  mustache_builder_s *builder;
+  FIOBJ data;
+};
+
+/**
+ * Creates a template render that writes its output in chunks (see
+ * `fiobj_mustache_stream`) and pauses whenever the `write` callback returns 1.
+ */
+fiobj_mustache_stream_s *fiobj_mustache_stream_new(
+    mustache_s *mustache, FIOBJ data, int (*write)(FIOBJ chunk, void *udata),
+    void *udata) {
+  if (!mustache || !write)
+    return NULL;
+  fiobj_mustache_stream_s *s = fio_malloc(sizeof(*s));
+  FIO_ASSERT_ALLOC(s);
+  *s = (fiobj_mustache_stream_s){
+      .out =
+          {
+              .dest = fiobj_str_buf(FIOBJ_MUSTACHE_CHUNK_SIZE),
+              .write = write,
+              .udata = udata,
+          },
+      /* the render might outlive the caller's reference */
+      .data = fiobj_dup(data),
+  };
+  s->builder = mustache_builder_new(mustache, .udata1 = (void *)&s->out,
+                                    .udata2 = (void *)s->data);
+  return s;
+}
+
+/**
+ * Renders the template until it's complete or the `write` callback returned 1.
+ *
+ * Returns -1 on error, 0 once the render is complete and 1 if it was paused.
+ */
+int fiobj_mustache_stream_run(fiobj_mustache_stream_s *s) {
+  if (!s)
+    return -1;
+  int ret = mustache_builder_run(s->builder);
+  if (ret == 0 && fiobj_obj2cstr(s->out.dest).len)
+    ret = fiobj_mustache_output_flush(&s->out, NULL);
+  return ret;
+}
+
+/** Frees a render created by `fiobj_mustache_stream_new`. */
+void fiobj_mustache_stream_free(fiobj_mustache_stream_s *s) {
+  if (!s)
+    return;
+  mustache_builder_free(s->builder);
+  fiobj_free(s->out.dest);
+  fiobj_free(s->data);
+  fio_free(s);
+}
+
+/* writes a rendered chunk to a connection (see `fiobj_mustache_write`) */
+static int fiobj_mustache_write_chunk(FIOBJ chunk, void *uuid_) {
+  intptr_t uuid = (intptr_t)uuid_;
+  if (fiobj_send_free(uuid, chunk) == -1)
+    return -1;
+  /* pause while the client is falling behind */
+  return fio_pending(uuid) > FIOBJ_MUSTACHE_PENDING_LIMIT;
+}
+
+static void fiobj_mustache_write_resume(intptr_t uuid, fio_protocol_s *pr,
+                                        void *s);
+
+/* the connection was lost while the render was paused */
+static void fiobj_mustache_write_fallback(intptr_t uuid, void *s) {
+  fiobj_mustache_stream_free(s);
+  (void)uuid;
+}
+
+/* renders until complete, or until the connection's queue is long enough */
+static int fiobj_mustache_write_run(intptr_t uuid,
+                                    fiobj_mustache_stream_s *s) {
+  int ret = fiobj_mustache_stream_run(s);
+  if (ret == 1) {
+    fio_defer_on_drain(uuid, FIOBJ_MUSTACHE_PENDING_LIMIT,
+                       .type = FIO_PR_LOCK_WRITE,
+                       .task = fiobj_mustache_write_resume, .udata = s,
+                       .fallback = fiobj_mustache_write_fallback);
+    return 0;
+  }
+  fiobj_mustache_stream_free(s);
+  return ret;
+}
+
+/* the client read enough of the data, continue rendering */
+static void fiobj_mustache_write_resume(intptr_t uuid, fio_protocol_s *pr,
+                                        void *s) {
+  /* the output was cut short, don't let the client assume it's complete */
+  if (fiobj_mustache_write_run(uuid, s) == -1)
+    fio_close(uuid);
+  (void)pr;
+}
+
+/**
+ * Renders a template directly to a connection, writing the output in chunks
+ * as it's rendered.
+ */
+int fiobj_mustache_write(intptr_t uuid, mustache_s *mustache, FIOBJ data) {
+  fiobj_mustache_stream_s *s = fiobj_mustache_stream_new(
+      mustache, data, fiobj_mustache_write_chunk, (void *)uuid);
+  if (!s)
+    return -1;
+  return fiobj_mustache_write_run(uuid, s);
 }
 
 /* *****************************************************************************
@@ -99,9 +288,44 @@ static inline FIOBJ fiobj_mustache_find_obj_tree(mustache_section_s *section,
   return FIOBJ_INVALID;
 }
 
+/* seeks a compiled name, using it's pre-hashed keys (no key Strings) */
+static inline FIOBJ
+fiobj_mustache_find_obj_keys(mustache_section_s *section,
+                             const mustache_name_keys_s *keys) {
+  mustache_section_s *sec = section;
+  FIOBJ tmp = FIOBJ_INVALID;
+  do {
+    if (FIOBJ_TYPE_IS((FIOBJ)sec->udata2, FIOBJ_T_HASH) &&
+        (tmp = fiobj_hash_get2((FIOBJ)sec->udata2, keys->hash[0])))
+      return tmp;
+  } while ((sec = mustache_section_parent(sec)));
+  if (keys->count == 1)
+    return FIOBJ_INVALID;
+  /* interpolate sections... (the first segment is sought in the tree) */
+  const uint64_t *segments = keys->hash + keys->count;
+  sec = section;
+  do {
+    if (FIOBJ_TYPE_IS((FIOBJ)sec->udata2, FIOBJ_T_HASH) &&
+        (tmp = fiobj_hash_get2((FIOBJ)sec->udata2, segments[0])))
+      break;
+  } while ((sec = mustache_section_parent(sec)));
+  for (uint64_t i = 1; tmp; ++i) {
+    if (!FIOBJ_TYPE_IS(tmp, FIOBJ_T_HASH))
+      return FIOBJ_INVALID;
+    FIOBJ obj = fiobj_hash_get2(tmp, keys->hash[i]);
+    if (obj != FIOBJ_INVALID || i + 1 == keys->count)
+      return obj;
+    tmp = fiobj_hash_get2(tmp, segments[i]);
+  }
+  return FIOBJ_INVALID;
+}
+
 static inline FIOBJ fiobj_mustache_find_obj(mustache_section_s *section,
                                             const char *name,
                                             uint32_t name_len) {
+  const mustache_name_keys_s *keys = mustache_section_keys(section);
+  if (keys)
+    return fiobj_mustache_find_obj_keys(section, keys);
   FIOBJ tmp = fiobj_mustache_find_obj_tree(section, name, name_len);
   if (tmp != FIOBJ_INVALID)
     return tmp;
@@ -169,8 +393,11 @@ static int mustache_on_arg(mustache_section_s *section, const char *name,
  */
 static int mustache_on_text(mustache_section_s *section, const char *data,
                             uint32_t data_len) {
-  FIOBJ dest = (FIOBJ)section->udata1;
-  fiobj_str_write(dest, data, data_len);
+  fiobj_mustache_output_s *out = (fiobj_mustache_output_s *)section->udata1;
+  fiobj_str_write(out->dest, data, data_len);
+  if (out->write &&
+      fiobj_obj2cstr(out->dest).len >= FIOBJ_MUSTACHE_CHUNK_SIZE)
+    return fiobj_mustache_output_flush(out, section);
   return 0;
 }
 
@@ -253,6 +480,20 @@ static inline void mustache_save2file(char const *filename, char const *data,
   close(fd);
 }
 
+static int fiobj_mustache_test_chunk(FIOBJ chunk, void *dest) {
+  int ret = (fiobj_obj2cstr(chunk).len > (FIOBJ_MUSTACHE_CHUNK_SIZE << 1));
+  fiobj_str_concat((FIOBJ)dest, chunk);
+  fiobj_free(chunk);
+  return 0 - ret;
+}
+
+/* pauses the render after every chunk */
+static int fiobj_mustache_test_pause(FIOBJ chunk, void *dest) {
+  fiobj_str_concat((FIOBJ)dest, chunk);
+  fiobj_free(chunk);
+  return 1;
+}
+
 void fiobj_mustache_test(void) {
 #define TEST_ASSERT(cond, ...)                                                 \
   if (!(cond)) {                                                               \
@@ -298,11 +539,96 @@ void fiobj_mustache_test(void) {
   fiobj_hash_set(ary, key, fiobj_str_new("dot notation success", 20));
   fiobj_free(key);
   key = fiobj_mustache_build(m, data);
-  fiobj_free(data);
   TEST_ASSERT(key, "fiobj_mustache_build failed!\n");
   fprintf(stderr, "%s\n", fiobj_obj2cstr(key).data);
+  {
+    char const expected[] =
+        "* Users:\r\n0. User 0 (User&#32;0)\r\n1. User 1 (User&#32;1)\r\n"
+        "2. User 2 (User&#32;2)\r\n3. User 3 (User&#32;3)\r\n"
+        "Nested: dot notation success.";
+    TEST_ASSERT(fiobj_obj2cstr(key).len == sizeof(expected) - 1 &&
+                    !memcmp(fiobj_obj2cstr(key).data, expected,
+                            sizeof(expected) - 1),
+                "fiobj_mustache_build output error!\n");
+  }
   fiobj_free(key);
   fiobj_mustache_free(m);
+  /* compiled templates: merged text (around comments) and dotted names */
+  {
+    char const compiled[] = "Line 1\nLine {{! 2 }}2\n{{&nested.item}} "
+                            "{{nested.item.none}}{{#users}}{{&nested.item}}:"
+                            "{{id}} {{/users}}{{missing.item}}.";
+    char const expected[] = "Line 1\nLine 2\ndot notation success "
+                            "dot notation success:0 dot notation success:1 "
+                            "dot notation success:2 dot notation success:3 .";
+    m = fiobj_mustache_new(.data = compiled, .data_len = sizeof(compiled) - 1);
+    TEST_ASSERT(m, "fiobj_mustache_new failed.\n");
+    mustache__instruction_s *inst = (mustache__instruction_s *)(m + 1);
+    TEST_ASSERT(inst[1].instruction == MUSTACHE_WRITE_TEXT &&
+                    inst[2].instruction == MUSTACHE_WRITE_ARG_UNESCAPED,
+                "Mustache text instructions should be merged!\n");
+    for (int i = 0; i < 2; ++i) {
+      key = fiobj_mustache_build(m, data);
+      TEST_ASSERT(fiobj_obj2cstr(key).len == sizeof(expected) - 1 &&
+                      !memcmp(fiobj_obj2cstr(key).data, expected,
+                              sizeof(expected) - 1),
+                  "compiled template output error:\n%s\n",
+                  fiobj_obj2cstr(key).data);
+      fiobj_free(key);
+    }
+    TEST_ASSERT(m->estimate == sizeof(expected) - 1,
+                "Mustache output estimate error (%zu)\n",
+                (size_t)m->estimate);
+    fiobj_mustache_free(m);
+  }
+  /* streaming: the chunks should add up to the rendered String */
+  {
+    char const streamed[] =
+        "{{#users}}<p>{{id}}: {{name}} &lt;{{nested.item}}&gt;</p>\n"
+        "{{/users}}";
+    FIOBJ users = fiobj_hash_get2(data, fiobj_hash_string("users", 5));
+    for (int i = 4; i < 2048; ++i) {
+      FIOBJ usr = fiobj_hash_new2(2);
+      key = fiobj_str_new("id", 2);
+      fiobj_hash_set(usr, key, fiobj_num_new(i));
+      fiobj_free(key);
+      key = fiobj_str_new("name", 4);
+      fiobj_hash_set(usr, key, fiobj_str_new("<\"User\"> & Co.", 15));
+      fiobj_free(key);
+      fiobj_ary_push(users, usr);
+    }
+    m = fiobj_mustache_new(.data = streamed, .data_len = sizeof(streamed) - 1);
+    TEST_ASSERT(m, "fiobj_mustache_new failed.\n");
+    FIOBJ expected = fiobj_mustache_build(m, data);
+    key = fiobj_str_buf(1);
+    TEST_ASSERT(!fiobj_mustache_stream(m, data, fiobj_mustache_test_chunk,
+                                       (void *)key),
+                "fiobj_mustache_stream failed!\n");
+    TEST_ASSERT(fiobj_iseq(key, expected),
+                "fiobj_mustache_stream output error!\n");
+    TEST_ASSERT(fiobj_obj2cstr(expected).len > (FIOBJ_MUSTACHE_CHUNK_SIZE << 2),
+                "streaming test output should span a number of chunks!\n");
+    /* pausing: the render is resumed after the template was freed */
+    fiobj_str_resize(key, 0);
+    fiobj_mustache_stream_s *stream = fiobj_mustache_stream_new(
+        m, data, fiobj_mustache_test_pause, (void *)key);
+    TEST_ASSERT(stream, "fiobj_mustache_stream_new failed!\n");
+    TEST_ASSERT(fiobj_mustache_stream_run(stream) == 1,
+                "fiobj_mustache_stream_run should pause!\n");
+    fiobj_mustache_free(m);
+    size_t pauses = 1;
+    int ret;
+    while ((ret = fiobj_mustache_stream_run(stream)) == 1)
+      ++pauses;
+    fiobj_mustache_stream_free(stream);
+    TEST_ASSERT(!ret, "fiobj_mustache_stream_run failed!\n");
+    TEST_ASSERT(pauses >= 4, "fiobj_mustache_stream_run pause error!\n");
+    TEST_ASSERT(fiobj_iseq(key, expected),
+                "fiobj_mustache_stream_run output error!\n");
+    fiobj_free(key);
+    fiobj_free(expected);
+  }
+  fiobj_free(data);
 }
 
 #endif
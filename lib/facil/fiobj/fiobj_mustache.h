@@ -55,6 +55,71 @@ FIOBJ fiobj_mustache_build(mustache_s *mustache, FIOBJ data);
  */
 FIOBJ fiobj_mustache_build2(FIOBJ dest, mustache_s *mustache, FIOBJ data);
 
+/**
+ * Renders a template in chunks, using the information in the `data` object.
+ *
+ * Every chunk (a FIOBJ String of about 16Kb) is passed to the `write` callback
+ * as soon as it's rendered, so the whole output is never kept in memory. The
+ * callback owns the chunk and should free it (i.e., using `fiobj_send_free`).
+ *
+ * If the callback returns -1, rendering stops. Any other value is ignored (see
+ * `fiobj_mustache_stream_new` for renders that can be paused).
+ *
+ * Returns -1 if an error occurred and 0 on success.
+ */
+int fiobj_mustache_stream(mustache_s *mustache, FIOBJ data,
+                          int (*write)(FIOBJ chunk, void *udata),
+                          void *udata);
+
+/** A template render that can be paused (see `fiobj_mustache_stream_new`). */
+typedef struct fiobj_mustache_stream_s fiobj_mustache_stream_s;
+
+/**
+ * Creates a template render that passes its output to the `write` callback in
+ * chunks (see `fiobj_mustache_stream`).
+ *
+ * If the callback returns 1, the render is paused once the current tag was
+ * rendered, so the writer can wait (i.e., for a slow client) without blocking
+ * the thread.
+ *
+ * The render keeps a reference to `data` and a copy of the template (once
+ * paused), so both may be freed by the caller.
+ *
+ * Returns NULL on error.
+ */
+fiobj_mustache_stream_s *fiobj_mustache_stream_new(
+    mustache_s *mustache, FIOBJ data, int (*write)(FIOBJ chunk, void *udata),
+    void *udata);
+
+/**
+ * Renders the template until it's complete or paused (see
+ * `fiobj_mustache_stream_new`).
+ *
+ * Returns -1 if an error occurred, 0 once the render is complete and 1 if the
+ * render was paused (call `fiobj_mustache_stream_run` again to resume).
+ */
+int fiobj_mustache_stream_run(fiobj_mustache_stream_s *s);
+
+/** Frees a render created by `fiobj_mustache_stream_new`. */
+void fiobj_mustache_stream_free(fiobj_mustache_stream_s *s);
+
+/**
+ * Renders a template directly to a connection (see `fio_write2`), writing the
+ * output in chunks as it's rendered.
+ *
+ * Once a few chunks are waiting in the connection's queue, the render is paused
+ * and resumed once the client read the data (see `fio_defer_on_drain`), so slow
+ * clients don't cause the whole output to be buffered. A paused render is
+ * completed in the background, after this function returned, so nothing else
+ * should be written to the connection.
+ *
+ * If the render fails after it was paused, the connection is closed.
+ *
+ * Returns -1 if an error occurred (or the connection was lost) and 0 on
+ * success.
+ */
+int fiobj_mustache_write(intptr_t uuid, mustache_s *mustache, FIOBJ data);
+
 #if DEBUG
 void fiobj_mustache_test(void);
 #endif
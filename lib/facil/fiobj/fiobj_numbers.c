@@ -73,7 +73,20 @@ static size_t fiobj_f_is_eq(const FIOBJ self, const FIOBJ other) {
   return obj2float(self)->f == obj2float(other)->f;
 }
 
-void fiobject___simple_dealloc(FIOBJ o, void (*task)(FIOBJ, void *), void *arg);
+static void fiobj_num_dealloc(FIOBJ o, void (*task)(FIOBJ, void *),
+                              void *arg) {
+  fiobject___pool_free(FIOBJ2PTR(o), sizeof(fiobj_num_s));
+  (void)task;
+  (void)arg;
+}
+
+static void fiobj_float_dealloc(FIOBJ o, void (*task)(FIOBJ, void *),
+                                void *arg) {
+  fiobject___pool_free(FIOBJ2PTR(o), sizeof(fiobj_float_s));
+  (void)task;
+  (void)arg;
+}
+
 uintptr_t fiobject___noop_count(FIOBJ o);
 
 const fiobj_object_vtable_s FIOBJECT_VTABLE_NUMBER = {
@@ -84,7 +97,7 @@ const fiobj_object_vtable_s FIOBJECT_VTABLE_NUMBER = {
     .is_true = fio_itrue,
     .is_eq = fiobj_i_is_eq,
     .count = fiobject___noop_count,
-    .dealloc = fiobject___simple_dealloc,
+    .dealloc = fiobj_num_dealloc,
 };
 
 const fiobj_object_vtable_s FIOBJECT_VTABLE_FLOAT = {
@@ -95,7 +108,7 @@ const fiobj_object_vtable_s FIOBJECT_VTABLE_FLOAT = {
     .to_str = fio_f2str,
     .is_eq = fiobj_f_is_eq,
     .count = fiobject___noop_count,
-    .dealloc = fiobject___simple_dealloc,
+    .dealloc = fiobj_float_dealloc,
 };
 
 /* *****************************************************************************
@@ -104,7 +117,7 @@ Number API
 
 /** Creates a Number object. Remember to use `fiobj_free`. */
 FIOBJ fiobj_num_new_bignum(intptr_t num) {
-  fiobj_num_s *o = fio_malloc(sizeof(*o));
+  fiobj_num_s *o = fiobject___pool_alloc(sizeof(*o));
   if (!o) {
     perror("ERROR: fiobj number couldn't allocate memory");
     exit(errno);
@@ -114,6 +127,7 @@ FIOBJ fiobj_num_new_bignum(intptr_t num) {
           {
               .type = FIOBJ_T_NUMBER,
               .ref = 1,
+              .arena = fiobject___pool_arena(),
           },
       .i = num,
   };
@@ -142,7 +156,7 @@ Float API
 
 /** Creates a Float object. Remember to use `fiobj_free`.  */
 FIOBJ fiobj_float_new(double num) {
-  fiobj_float_s *o = fio_malloc(sizeof(*o));
+  fiobj_float_s *o = fiobject___pool_alloc(sizeof(*o));
   if (!o) {
     perror("ERROR: fiobj float couldn't allocate memory");
     exit(errno);
@@ -152,6 +166,7 @@ FIOBJ fiobj_float_new(double num) {
           {
               .type = FIOBJ_T_FLOAT,
               .ref = 1,
+              .arena = fiobject___pool_arena(),
           },
       .f = num,
   };
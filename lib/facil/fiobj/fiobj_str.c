@@ -63,7 +63,7 @@ static fio_str_info_s fio_str2str(const FIOBJ o) {
 
 static void fiobj_str_dealloc(FIOBJ o, void (*task)(FIOBJ, void *), void *arg) {
   fio_str_free(&obj2str(o)->str);
-  fio_free(FIOBJ2PTR(o));
+  fiobject___pool_free(FIOBJ2PTR(o), sizeof(fiobj_str_s));
   (void)task;
   (void)arg;
 }
@@ -109,7 +109,7 @@ FIOBJ fiobj_str_buf(size_t capa) {
   else
     capa = PAGE_SIZE;
 
-  fiobj_str_s *s = fio_malloc(sizeof(*s));
+  fiobj_str_s *s = fiobject___pool_alloc(sizeof(*s));
   if (!s) {
     perror("ERROR: fiobj string couldn't allocate memory");
     exit(errno);
@@ -119,6 +119,7 @@ FIOBJ fiobj_str_buf(size_t capa) {
           {
               .ref = 1,
               .type = FIOBJ_T_STRING,
+              .arena = fiobject___pool_arena(),
           },
       .str = FIO_STR_INIT,
   };
@@ -130,7 +131,7 @@ FIOBJ fiobj_str_buf(size_t capa) {
 
 /** Creates a String object. Remember to use `fiobj_free`. */
 FIOBJ fiobj_str_new(const char *str, size_t len) {
-  fiobj_str_s *s = fio_malloc(sizeof(*s));
+  fiobj_str_s *s = fiobject___pool_alloc(sizeof(*s));
   if (!s) {
     perror("ERROR: fiobj string couldn't allocate memory");
     exit(errno);
@@ -140,6 +141,7 @@ FIOBJ fiobj_str_new(const char *str, size_t len) {
           {
               .ref = 1,
               .type = FIOBJ_T_STRING,
+              .arena = fiobject___pool_arena(),
           },
       .str = FIO_STR_INIT,
   };
@@ -160,7 +162,7 @@ FIOBJ fiobj_str_new(const char *str, size_t len) {
  * zero.
  */
 FIOBJ fiobj_str_move(char *str, size_t len, size_t capacity) {
-  fiobj_str_s *s = fio_malloc(sizeof(*s));
+  fiobj_str_s *s = fiobject___pool_alloc(sizeof(*s));
   if (!s) {
     perror("ERROR: fiobj string couldn't allocate memory");
     exit(errno);
@@ -170,6 +172,7 @@ FIOBJ fiobj_str_move(char *str, size_t len, size_t capacity) {
           {
               .ref = 1,
               .type = FIOBJ_T_STRING,
+              .arena = fiobject___pool_arena(),
           },
       .str = FIO_STR_INIT_EXISTING(str, len, capacity),
   };
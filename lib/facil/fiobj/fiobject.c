@@ -289,7 +289,250 @@ size_t __attribute__((weak)) fio_ftoa(char *dest, double num, uint8_t base) {
   return written;
 }
 
+/* outside of facil.io, object pools aren't released when the program exits */
+#pragma weak fio_state_callback_add
+void __attribute__((weak))
+fio_state_callback_add(callback_type_e e, void (*func)(void *), void *arg) {
+  (void)e;
+  (void)func;
+  (void)arg;
+}
+
+#endif
+
+/* *****************************************************************************
+Object Arenas (bump allocation for short lived object headers)
+***************************************************************************** */
+
+#ifndef FIOBJ_ARENA_BLOCK_SIZE
+/** The size of the memory blocks allocated by object arenas. */
+#define FIOBJ_ARENA_BLOCK_SIZE 4096
 #endif
+
+/* the arena's reference count starts here, so it can't reach zero while used */
+#define FIOBJ_ARENA_BIAS ((intptr_t)1 << ((sizeof(intptr_t) << 3) - 2))
+
+typedef struct fiobj_arena_block_s {
+  struct fiobj_arena_block_s *next;
+  uintptr_t capa;
+} fiobj_arena_block_s;
+
+struct fiobj_arena_s {
+  /* the current memory block, linked to the previous blocks */
+  fiobj_arena_block_s *block;
+  /* the position within the current memory block */
+  uintptr_t pos;
+  /* objects allocated since the arena was reset (owner thread only) */
+  intptr_t count;
+  /* thread local objects released since the arena was reset (owner only) */
+  intptr_t freed;
+  /* FIOBJ_ARENA_BIAS minus the number of (other) objects released */
+  volatile intptr_t ref;
+  /* set once the arena was replaced while objects were still alive */
+  uint8_t detached;
+};
+
+static __thread fiobj_arena_s *fiobj_arena_current;
+
+static void fiobj_arena_destroy(fiobj_arena_s *a) {
+  while (a->block) {
+    fiobj_arena_block_s *tmp = a->block;
+    a->block = tmp->next;
+    fio_free(tmp);
+  }
+  fio_free(a);
+}
+
+/** Creates a new object arena. Memory is allocated only when required. */
+fiobj_arena_s *fiobj_arena_new(void) {
+  fiobj_arena_s *a = fio_malloc(sizeof(*a));
+  FIO_ASSERT_ALLOC(a);
+  *a = (fiobj_arena_s){.ref = FIOBJ_ARENA_BIAS};
+  return a;
+}
+
+/**
+ * Sets the arena used for objects created by the calling thread (or NULL, for
+ * the default allocator), returning the previous arena.
+ */
+fiobj_arena_s *fiobj_arena_use(fiobj_arena_s *arena) {
+  fiobj_arena_s *old = fiobj_arena_current;
+  fiobj_arena_current = arena;
+  return old;
+}
+
+/** Marks the end of the arena's use, returning an arena ready for reuse. */
+fiobj_arena_s *fiobj_arena_reset(fiobj_arena_s *a) {
+  if (!a || !a->count)
+    return a;
+  a->detached = 1;
+  if (fio_atomic_add(&a->ref, (a->count - a->freed) - FIOBJ_ARENA_BIAS)) {
+    /* objects escaped, the last one to be freed will release the arena */
+    return fiobj_arena_new();
+  }
+  /* keep the newest memory block, so the arena doesn't allocate memory */
+  fiobj_arena_block_s *older = a->block->next;
+  a->block->next = NULL;
+  while (older) {
+    fiobj_arena_block_s *tmp = older;
+    older = older->next;
+    fio_free(tmp);
+  }
+  a->pos = 0;
+  a->count = 0;
+  a->freed = 0;
+  a->ref = FIOBJ_ARENA_BIAS;
+  a->detached = 0;
+  return a;
+}
+
+/** Frees the arena (remaining objects keep the arena's memory alive). */
+void fiobj_arena_free(fiobj_arena_s *a) {
+  if (!a)
+    return;
+  a->detached = 1;
+  if (!fio_atomic_add(&a->ref, (a->count - a->freed) - FIOBJ_ARENA_BIAS))
+    fiobj_arena_destroy(a);
+}
+
+/* objects are prefixed with a pointer to their arena */
+static void *fiobj_arena_alloc(fiobj_arena_s *a, size_t size) {
+  size = (size + sizeof(void *) + 7) & (~(size_t)7);
+  if (!a->block || a->pos + size > a->block->capa) {
+    uintptr_t capa = FIOBJ_ARENA_BLOCK_SIZE - sizeof(fiobj_arena_block_s);
+    if (capa < size)
+      capa = size;
+    fiobj_arena_block_s *b = fio_malloc(sizeof(*b) + capa);
+    if (!b)
+      return NULL;
+    *b = (fiobj_arena_block_s){.next = a->block, .capa = capa};
+    a->block = b;
+    a->pos = 0;
+  }
+  void **o = (void **)((uintptr_t)(a->block + 1) + a->pos);
+  a->pos += size;
+  ++a->count;
+  o[0] = (void *)a;
+  return (void *)(o + 1);
+}
+
+static inline void fiobj_arena_release(void *ptr) {
+  fiobj_arena_s *a = ((fiobj_arena_s **)ptr)[-1];
+  /* thread local objects belong to the thread using the arena */
+  if (((fiobj_object_header_s *)ptr)->local && !a->detached) {
+    ++a->freed;
+    return;
+  }
+  if (!fio_atomic_sub(&a->ref, 1))
+    fiobj_arena_destroy(a);
+}
+
+/* *****************************************************************************
+Object Pools (per-thread free lists for fixed size object headers)
+***************************************************************************** */
+
+#ifndef FIOBJ_POOL_LIMIT
+/**
+ * The number of object headers each thread keeps (per size class) for reuse,
+ * instead of returning them to the allocator. Set to 0 to disable pooling.
+ */
+#define FIOBJ_POOL_LIMIT 256
+#endif
+
+/* size classes: 16, 32, 48 and 64 bytes */
+#define FIOBJ_POOL_CLASSES 4
+
+typedef struct fiobj_pool_s {
+  struct fiobj_pool_s *next;
+  void *list[FIOBJ_POOL_CLASSES];
+  uint16_t count[FIOBJ_POOL_CLASSES];
+} fiobj_pool_s;
+
+static __thread fiobj_pool_s *fiobj_pool_thread;
+/* all the pools, so they could be released when the program exits */
+static fiobj_pool_s *fiobj_pool_all;
+static fio_lock_i fiobj_pool_lock = FIO_LOCK_INIT;
+static volatile uint8_t fiobj_pool_closed;
+
+static void fiobj_pool_destroy(void *ignr_) {
+  fiobj_pool_closed = 1;
+  fio_lock(&fiobj_pool_lock);
+  fiobj_pool_s *p = fiobj_pool_all;
+  fiobj_pool_all = NULL;
+  fio_unlock(&fiobj_pool_lock);
+  while (p) {
+    fiobj_pool_s *next = p->next;
+    for (size_t i = 0; i < FIOBJ_POOL_CLASSES; ++i) {
+      while (p->list[i]) {
+        void *o = p->list[i];
+        p->list[i] = *(void **)o;
+        fio_free(o);
+      }
+    }
+    free(p);
+    p = next;
+  }
+  (void)ignr_;
+}
+
+static __attribute__((constructor)) void fiobj_pool_constructor(void) {
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fiobj_pool_destroy, NULL);
+}
+
+static fiobj_pool_s *fiobj_pool_get(void) {
+  if (fiobj_pool_thread)
+    return fiobj_pool_thread;
+  /* the pool is allocated using the system allocator, it outlives threads */
+  fiobj_pool_s *p = calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+  fio_lock(&fiobj_pool_lock);
+  p->next = fiobj_pool_all;
+  fiobj_pool_all = p;
+  fio_unlock(&fiobj_pool_lock);
+  fiobj_pool_thread = p;
+  return p;
+}
+
+/** used internally to allocate object headers (see `FIOBJ_POOL_LIMIT`). */
+void *fiobject___pool_alloc(size_t size) {
+  if (fiobj_arena_current)
+    return fiobj_arena_alloc(fiobj_arena_current, size);
+  const size_t c = (size + 15) >> 4;
+  if (c > FIOBJ_POOL_CLASSES)
+    return fio_malloc(size);
+  fiobj_pool_s *p = fiobj_pool_thread;
+  if (!fiobj_pool_closed && p && p->list[c - 1]) {
+    void *o = p->list[c - 1];
+    p->list[c - 1] = *(void **)o;
+    --p->count[c - 1];
+    return o;
+  }
+  /* allocate the whole size class, so the memory could be reused */
+  return fio_malloc(c << 4);
+}
+
+/** used internally to mark object headers allocated from an arena. */
+uint8_t fiobject___pool_arena(void) { return fiobj_arena_current != NULL; }
+
+/** used internally to free object headers (see `FIOBJ_POOL_LIMIT`). */
+void fiobject___pool_free(void *ptr, size_t size) {
+  if (((fiobj_object_header_s *)ptr)->arena) {
+    fiobj_arena_release(ptr);
+    return;
+  }
+  const size_t c = (size + 15) >> 4;
+  fiobj_pool_s *p;
+  if (FIOBJ_POOL_LIMIT && c <= FIOBJ_POOL_CLASSES && !fiobj_pool_closed &&
+      (p = fiobj_pool_get()) && p->count[c - 1] < FIOBJ_POOL_LIMIT) {
+    *(void **)ptr = p->list[c - 1];
+    p->list[c - 1] = ptr;
+    ++p->count[c - 1];
+    return;
+  }
+  fio_free(ptr);
+}
+
 /* *****************************************************************************
 the `fiobj_each2` function
 ***************************************************************************** */
@@ -416,10 +659,83 @@ void fiobj_free_complex_object(FIOBJ o) {
 }
 
 /* *****************************************************************************
-Is Equal?
+Thread Local Objects
 ***************************************************************************** */
 #include <fiobj_hash.h>
 
+struct fiobj_local_s {
+  fiobj_stack_s *stack;
+  FIOBJ container;
+  uint8_t local;
+};
+
+static inline void fiobj_local_mark(FIOBJ o, struct fiobj_local_s *l) {
+  if (!FIOBJ_IS_ALLOCATED(o) || FIOBJECT2HEAD(o)->local == l->local ||
+      FIOBJECT2HEAD(o)->local == FIOBJ_LOCAL_IMMORTAL)
+    return;
+  /* only objects owned by the (thread local) container are marked */
+  if (l->local && FIOBJECT2HEAD(o)->ref != 1)
+    return;
+  FIOBJECT2HEAD(o)->local = l->local;
+  if (FIOBJECT2VTBL(o)->each && FIOBJECT2VTBL(o)->count(o))
+    fiobj_stack_push(l->stack, o);
+}
+
+static int fiobj_local_task(FIOBJ o, void *l_) {
+  struct fiobj_local_s *l = l_;
+  if (FIOBJ_TYPE_IS(l->container, FIOBJ_T_HASH))
+    fiobj_local_mark(fiobj_hash_key_in_loop(), l);
+  fiobj_local_mark(o, l);
+  return 0;
+}
+
+static FIOBJ fiobj_local_set(FIOBJ o, uint8_t local) {
+  fiobj_stack_s stack = FIO_ARY_INIT;
+  struct fiobj_local_s l = {.stack = &stack, .local = local};
+  fiobj_local_mark(o, &l);
+  while (!fiobj_stack_pop(&stack, &l.container))
+    FIOBJECT2VTBL(l.container)->each(l.container, 0, fiobj_local_task, &l);
+  fiobj_stack_free(&stack);
+  return o;
+}
+
+/**
+ * Marks an object (and any nested objects it owns) as thread local, so their
+ * reference counting uses plain (non-atomic) increments and decrements.
+ */
+FIOBJ fiobj_local(FIOBJ o) { return fiobj_local_set(o, 1); }
+
+/**
+ * Promotes a thread local object (and any nested objects) to atomic reference
+ * counting, allowing the objects to be shared with other threads.
+ */
+FIOBJ fiobj_share(FIOBJ o) { return fiobj_local_set(o, 0); }
+
+/**
+ * Marks an object as immortal, so `fiobj_dup` and `fiobj_free` skip reference
+ * counting altogether and the object is never freed.
+ */
+FIOBJ fiobj_immortal(FIOBJ o) {
+  if (!FIOBJ_IS_ALLOCATED(o))
+    return o;
+  fiobj_share(o);
+  FIOBJECT2HEAD(o)->local = FIOBJ_LOCAL_IMMORTAL;
+  return o;
+}
+
+/** Releases an immortal object (see `fiobj_immortal`). */
+void fiobj_immortal_free(FIOBJ o) {
+  if (!FIOBJ_IS_ALLOCATED(o) ||
+      FIOBJECT2HEAD(o)->local != FIOBJ_LOCAL_IMMORTAL)
+    return;
+  FIOBJECT2HEAD(o)->local = 0;
+  fiobj_free(o);
+}
+
+/* *****************************************************************************
+Is Equal?
+***************************************************************************** */
+
 static inline int fiobj_iseq_simple(const FIOBJ o, const FIOBJ o2) {
   if (o == o2)
     return 1;
@@ -615,6 +931,95 @@ void fiobj_test_core(void) {
   TEST_ASSERT(!fiobj_iseq(fiobj_null(), fiobj_true()),
               "fiobj_null eqal to fiobj_true!");
   fprintf(stderr, "* passed.\n");
+  fprintf(stderr, "=== Testing thread local objects and object pools\n");
+  FIOBJ shared = fiobj_str_new("shared", 6);
+  o = fiobj_hash_new();
+  tmp = fiobj_ary_new();
+  fiobj_ary_push(tmp, fiobj_str_new("owned", 5));
+  fiobj_ary_push(tmp, fiobj_dup(shared));
+  key = fiobj_str_new("list", 4);
+  fiobj_hash_set(o, key, tmp);
+  fiobj_local(o);
+  TEST_ASSERT(FIOBJECT2HEAD(o)->local && FIOBJECT2HEAD(tmp)->local &&
+                  FIOBJECT2HEAD(fiobj_ary_index(tmp, 0))->local,
+              "fiobj_local didn't mark the nested objects!\n");
+  TEST_ASSERT(!FIOBJECT2HEAD(shared)->local,
+              "fiobj_local marked an object referenced elsewhere!\n");
+  TEST_ASSERT(!FIOBJECT2HEAD(key)->local,
+              "fiobj_local marked a Hash key referenced elsewhere!\n");
+  fiobj_free(fiobj_dup(o));
+  TEST_ASSERT(!FIOBJECT2HEAD(o)->local && !FIOBJECT2HEAD(tmp)->local,
+              "fiobj_dup didn't promote the thread local objects!\n");
+  fiobj_local(o);
+  TEST_ASSERT(FIOBJECT2HEAD(o)->local, "fiobj_local failed to re-mark!\n");
+  fiobj_share(o);
+  TEST_ASSERT(!FIOBJECT2HEAD(o)->local && !FIOBJECT2HEAD(tmp)->local,
+              "fiobj_share didn't promote the thread local objects!\n");
+  fiobj_local(o);
+  fiobj_free(o);
+  fiobj_free(key);
+  TEST_ASSERT(FIOBJECT2HEAD(shared)->ref == 1,
+              "thread local reference counting error (%u)!\n",
+              (unsigned int)FIOBJECT2HEAD(shared)->ref);
+  fiobj_free(shared);
+  shared = fiobj_immortal(fiobj_str_new("immortal", 8));
+  o = fiobj_hash_new();
+  fiobj_hash_set(o, shared, fiobj_dup(shared));
+  fiobj_local(o);
+  TEST_ASSERT(FIOBJECT2HEAD(shared)->local == FIOBJ_LOCAL_IMMORTAL &&
+                  FIOBJECT2HEAD(shared)->ref == 1,
+              "immortal object reference counting error (%u)!\n",
+              (unsigned int)FIOBJECT2HEAD(shared)->ref);
+  fiobj_share(o);
+  fiobj_free(o);
+  fiobj_free(shared);
+  TEST_ASSERT(FIOBJECT2HEAD(shared)->local == FIOBJ_LOCAL_IMMORTAL &&
+                  FIOBJECT2HEAD(shared)->ref == 1,
+              "immortal object was demoted or released!\n");
+  fiobj_immortal_free(shared);
+#if FIOBJ_POOL_LIMIT
+  o = fiobj_float_new(1.5);
+  void *header = FIOBJ2PTR(o);
+  fiobj_free(o);
+  o = fiobj_num_new(((intptr_t)1) << 62);
+  TEST_ASSERT(FIOBJ2PTR(o) == header, "object headers aren't reused!\n");
+  TEST_ASSERT(fiobj_obj2num(o) == ((intptr_t)1) << 62,
+              "reused object header error!\n");
+  fiobj_free(o);
+#endif
+  fprintf(stderr, "* passed.\n");
+  fprintf(stderr, "=== Testing object arenas\n");
+  {
+    fiobj_arena_s *arena = fiobj_arena_new();
+    fiobj_arena_s *old = fiobj_arena_use(arena);
+    o = fiobj_hash_new();
+    for (size_t i = 0; i < 256; ++i) {
+      key = fiobj_str_buf(8);
+      fiobj_str_printf(key, "%zu", i);
+      fiobj_hash_set(o, key, fiobj_float_new((double)i));
+      fiobj_free(key);
+    }
+    tmp = fiobj_str_new("escaped", 7);
+    fiobj_arena_use(old);
+    TEST_ASSERT(FIOBJECT2HEAD(o)->arena && FIOBJECT2HEAD(tmp)->arena,
+                "objects weren't allocated from the arena!\n");
+    fiobj_free(o);
+    fiobj_free(tmp);
+    TEST_ASSERT(fiobj_arena_reset(arena) == arena,
+                "arena wasn't recycled after all objects were freed!\n");
+    old = fiobj_arena_use(arena);
+    tmp = fiobj_str_new("escaped", 7);
+    fiobj_arena_use(old);
+    fiobj_arena_s *tmp_arena = fiobj_arena_reset(arena);
+    TEST_ASSERT(tmp_arena != arena,
+                "arena was recycled while an object was alive!\n");
+    TEST_ASSERT(fiobj_obj2cstr(tmp).len == 7 &&
+                    !memcmp(fiobj_obj2cstr(tmp).data, "escaped", 7),
+                "escaped object was corrupted!\n");
+    fiobj_free(tmp); /* releases the original arena */
+    fiobj_arena_free(tmp_arena);
+  }
+  fprintf(stderr, "* passed.\n");
 }
 
 #endif
@@ -57,7 +57,8 @@ typedef enum __attribute__((packed)) {
   FIOBJ_T_ARRAY,
   FIOBJ_T_HASH,
   FIOBJ_T_DATA,
-  FIOBJ_T_UNKNOWN
+  FIOBJ_T_UNKNOWN,
+  FIOBJ_T_JSON
 } fiobj_type_enum;
 
 typedef uintptr_t FIOBJ;
@@ -220,6 +221,101 @@ size_t fiobj_each2(FIOBJ, int (*task)(FIOBJ obj, void *arg), void *arg);
  */
 FIO_INLINE int fiobj_iseq(const FIOBJ obj1, const FIOBJ obj2);
 
+/* *****************************************************************************
+Thread Local Objects
+***************************************************************************** */
+
+/**
+ * Marks an object (and any nested objects it owns) as thread local, so their
+ * reference counting uses plain (non-atomic) increments and decrements.
+ *
+ * Only objects with a single reference are marked (objects referenced by
+ * other collections or threads, such as shared constants, remain atomic).
+ *
+ * A thread local object is promoted (see `fiobj_share`) when `fiobj_dup` is
+ * called, so it's safe to store a copy in a shared collection. However, thread
+ * local objects MUST NOT be placed in shared collections without calling
+ * `fiobj_dup` (or `fiobj_share`) first.
+ *
+ * Always returns the value passed along.
+ */
+FIOBJ fiobj_local(FIOBJ o);
+
+/**
+ * Promotes a thread local object (and any nested objects) to atomic reference
+ * counting, allowing the objects to be shared with other threads (i.e., using
+ * `fio_defer`).
+ *
+ * Always returns the value passed along.
+ */
+FIOBJ fiobj_share(FIOBJ o);
+
+/**
+ * Marks an object as immortal, so `fiobj_dup` and `fiobj_free` skip reference
+ * counting altogether and the object is never freed.
+ *
+ * Immortal objects can be shared between threads without any atomic operations
+ * (no cache line "ping-pong"), which makes them ideal for long lived constants,
+ * such as common HTTP header names. Immortal objects MUST NOT be edited (i.e.,
+ * Strings should be frozen before they are marked).
+ *
+ * Nested objects aren't marked, but they are never released while the
+ * container is immortal.
+ *
+ * Always returns the value passed along.
+ */
+FIOBJ fiobj_immortal(FIOBJ o);
+
+/**
+ * Releases an immortal object (see `fiobj_immortal`), i.e., during cleanup.
+ *
+ * The object is freed once all the references that were taken before it was
+ * marked as immortal are released.
+ */
+void fiobj_immortal_free(FIOBJ o);
+
+/* *****************************************************************************
+Object Arenas
+***************************************************************************** */
+
+/** An object arena (see `fiobj_arena_use`). */
+typedef struct fiobj_arena_s fiobj_arena_s;
+
+/** Creates a new object arena. Memory is allocated only when required. */
+fiobj_arena_s *fiobj_arena_new(void);
+
+/**
+ * Sets the arena used for objects created by the calling thread (or NULL, for
+ * the default allocator), returning the previous arena.
+ *
+ * The fixed size part of Numbers, Floats, Strings, Arrays and Hashes (but not
+ * their dynamic data, i.e., long Strings) is bump allocated from the arena and
+ * freeing these objects doesn't return memory to the allocator.
+ *
+ * The arena's memory is recycled by `fiobj_arena_reset` once all the objects
+ * allocated from the arena were freed. Objects that outlive the arena's use
+ * (i.e., were stored elsewhere using `fiobj_dup`) keep the arena's memory
+ * alive until they are freed.
+ *
+ * An arena MUST NOT be used by more than a single thread at a time.
+ */
+fiobj_arena_s *fiobj_arena_use(fiobj_arena_s *arena);
+
+/**
+ * Marks the end of the arena's use (i.e., a request's lifetime).
+ *
+ * If all the objects allocated from the arena were freed, the arena is reset
+ * for reuse and returned. Otherwise, the arena is released once the remaining
+ * objects are freed and a new arena is returned.
+ */
+fiobj_arena_s *fiobj_arena_reset(fiobj_arena_s *arena);
+
+/**
+ * Frees the arena (any remaining objects keep the arena's memory alive until
+ * they are freed).
+ */
+void fiobj_arena_free(fiobj_arena_s *arena);
+
 /* *****************************************************************************
 Object Type Identification
 ***************************************************************************** */
@@ -291,6 +387,7 @@ FIO_INLINE size_t fiobj_type_is(FIOBJ o, fiobj_type_enum type) {
   case FIOBJ_T_FLOAT:
   case FIOBJ_T_ARRAY:
   case FIOBJ_T_DATA:
+  case FIOBJ_T_JSON:
   case FIOBJ_T_UNKNOWN:
     return FIOBJ_IS_ALLOCATED(o) &&
            ((fiobj_type_enum *)FIOBJ2PTR(o))[0] == type;
@@ -327,6 +424,10 @@ typedef struct {
 typedef struct {
   /* must be first */
   fiobj_type_enum type;
+  /* thread local objects use non-atomic reference counting (2 == immortal) */
+  uint8_t local;
+  /* objects allocated from an arena (see `fiobj_arena_use`) */
+  uint8_t arena;
   /* reference counter */
   uint32_t ref;
 } fiobj_object_header_s;
@@ -337,6 +438,7 @@ extern const fiobj_object_vtable_s FIOBJECT_VTABLE_STRING;
 extern const fiobj_object_vtable_s FIOBJECT_VTABLE_ARRAY;
 extern const fiobj_object_vtable_s FIOBJECT_VTABLE_HASH;
 extern const fiobj_object_vtable_s FIOBJECT_VTABLE_DATA;
+extern const fiobj_object_vtable_s FIOBJECT_VTABLE_JSON;
 
 #define FIOBJECT2VTBL(o) fiobj_type_vtable(o)
 #define FIOBJECT2HEAD(o) (((fiobj_object_header_s *)FIOBJ2PTR((o))))
@@ -355,6 +457,8 @@ FIO_INLINE const fiobj_object_vtable_s *fiobj_type_vtable(FIOBJ o) {
     return &FIOBJECT_VTABLE_HASH;
   case FIOBJ_T_DATA:
     return &FIOBJECT_VTABLE_DATA;
+  case FIOBJ_T_JSON:
+    return &FIOBJECT_VTABLE_JSON;
   case FIOBJ_T_NULL:
   case FIOBJ_T_TRUE:
   case FIOBJ_T_FALSE:
@@ -400,8 +504,21 @@ Atomic reference counting
 #error missing required atomic options.
 #endif
 
-#define OBJREF_ADD(o) fiobj_ref_inc(o)
-#define OBJREF_REM(o) fiobj_ref_dec(o)
+/** The `local` marker for immortal objects (see `fiobj_immortal`). */
+#define FIOBJ_LOCAL_IMMORTAL 2
+
+#define OBJREF_ADD(o)                                                          \
+  (!FIOBJECT2HEAD(o)->local                                                    \
+       ? fiobj_ref_inc(o)                                                      \
+       : FIOBJECT2HEAD(o)->local == FIOBJ_LOCAL_IMMORTAL                       \
+             ? FIOBJECT2HEAD(o)->ref                                           \
+             : ++FIOBJECT2HEAD(o)->ref)
+#define OBJREF_REM(o)                                                          \
+  (!FIOBJECT2HEAD(o)->local                                                    \
+       ? fiobj_ref_dec(o)                                                      \
+       : FIOBJECT2HEAD(o)->local == FIOBJ_LOCAL_IMMORTAL                       \
+             ? FIOBJECT2HEAD(o)->ref                                           \
+             : --FIOBJECT2HEAD(o)->ref)
 
 /* *****************************************************************************
 Inlined Functions
@@ -421,6 +538,15 @@ FIO_INLINE const char *fiobj_type_name(const FIOBJ o) {
 /** used internally to free objects with nested objects. */
 void fiobj_free_complex_object(FIOBJ o);
 
+/** used internally to allocate object headers from a per-thread pool. */
+void *fiobject___pool_alloc(size_t size);
+
+/** used internally to return object headers to the per-thread pool. */
+void fiobject___pool_free(void *ptr, size_t size);
+
+/** used internally to mark object headers allocated from an arena. */
+uint8_t fiobject___pool_arena(void);
+
 /**
  * Copy by reference(!) - increases an object's (and any nested object's)
  * reference count.
@@ -428,8 +554,14 @@ void fiobj_free_complex_object(FIOBJ o);
  * Always returns the value passed along.
  */
 FIO_INLINE FIOBJ fiobj_dup(FIOBJ o) {
-  if (FIOBJ_IS_ALLOCATED(o))
-    OBJREF_ADD(o);
+  if (FIOBJ_IS_ALLOCATED(o)) {
+    if (FIOBJECT2HEAD(o)->local) {
+      if (FIOBJECT2HEAD(o)->local == FIOBJ_LOCAL_IMMORTAL)
+        return o;
+      fiobj_share(o); /* a copy might be shared */
+    }
+    fiobj_ref_inc(o);
+  }
   return o;
 }
 
@@ -446,7 +578,7 @@ FIO_INLINE FIOBJ fiobj_dup(FIOBJ o) {
 FIO_INLINE void fiobj_free(FIOBJ o) {
   if (!FIOBJ_IS_ALLOCATED(o))
     return;
-  if (fiobj_ref_dec(o))
+  if (OBJREF_REM(o))
     return;
   if (FIOBJECT2VTBL(o)->each && FIOBJECT2VTBL(o)->count(o))
     fiobj_free_complex_object(o);
@@ -59,6 +59,22 @@ Compile Time Behavior Flags
 #define MUSTACHE_NESTING_LIMIT 82
 #endif
 
+/**
+ * When set (the default), loaded templates are compiled - adjacent text
+ * instructions are merged into a single text span and padding instructions are
+ * removed when the template has no padded partials.
+ */
+#ifndef MUSTACHE_COMPILE_TEMPLATES
+#define MUSTACHE_COMPILE_TEMPLATES 1
+#endif
+
+/*
+ * If the implementation file defines `MUSTACHE_NAME_HASH(name, len)` (returning
+ * a `uint64_t`), compiled templates will store the hash values for every
+ * argument / section name and it's dot separated segments, so these could be
+ * used for lookup (see `mustache_section_keys`).
+ */
+
 /* *****************************************************************************
 Mustache API Argument types
 ***************************************************************************** */
@@ -145,6 +161,39 @@ MUSTACHE_FUNC int mustache_build(mustache_build_args_s args);
   mustache_build(                                                              \
       (mustache_build_args_s){.mustache = (mustache_s_ptr), __VA_ARGS__})
 
+/** A template render that can be paused (see `mustache_build_pause`). */
+typedef struct mustache_builder_s mustache_builder_s;
+
+/**
+ * Starts a template render that can be paused by the callbacks (see
+ * `mustache_build_pause`) and resumed later. Accepts the same arguments as
+ * `mustache_build`.
+ *
+ * The render is performed by `mustache_builder_run`.
+ *
+ * Returns NULL on error.
+ */
+MUSTACHE_FUNC mustache_builder_s *
+mustache_builder_new(mustache_build_args_s args);
+
+#define mustache_builder_new(mustache_s_ptr, ...)                              \
+  mustache_builder_new(                                                        \
+      (mustache_build_args_s){.mustache = (mustache_s_ptr), __VA_ARGS__})
+
+/**
+ * Renders the template until it's complete or paused.
+ *
+ * Once paused, the builder keeps its own copy of the template, so the template
+ * may be freed before the render is complete.
+ *
+ * Returns -1 on error, 0 once the render is complete and 1 if the render was
+ * paused (call `mustache_builder_run` again to resume).
+ */
+MUSTACHE_FUNC int mustache_builder_run(mustache_builder_s *builder);
+
+/** Frees a builder (the render may be complete or paused). */
+MUSTACHE_FUNC void mustache_builder_free(mustache_builder_s *builder);
+
 /* *****************************************************************************
 Callbacks Types - types used by the template builder callbacks
 ***************************************************************************** */
@@ -168,6 +217,21 @@ typedef struct mustache_section_s {
   void *udata2;
 } mustache_section_s;
 
+/**
+ * A name's pre-hashed keys (see `MUSTACHE_NAME_HASH`).
+ *
+ * For names containing dots (i.e., `user.name`), the `hash` array contains
+ * `count` hash values for the name's tail, starting at each segment (the first
+ * value is the hash of the whole name), followed by `count - 1` hash values,
+ * one for each of the segments (excluding the last segment).
+ */
+typedef struct {
+  /** The number of (dot separated) segments in the name. */
+  uint64_t count;
+  /** The hash values (see above). */
+  uint64_t hash[];
+} mustache_name_keys_s;
+
 /* *****************************************************************************
 Callbacks Helpers - These functions can be called from within callbacks
 ***************************************************************************** */
@@ -206,6 +270,25 @@ static inline int mustache_write_text(mustache_section_s *section, char *text,
 static inline const char *mustache_section_text(mustache_section_s *section,
                                                 size_t *p_len);
 
+/**
+ * Returns the pre-hashed keys for the argument / section name being processed
+ * (the `name` passed to the callback), or NULL if the template wasn't compiled
+ * with `MUSTACHE_NAME_HASH`.
+ *
+ * Only valid within the `mustache_on_arg`, `mustache_on_section_test` and
+ * `mustache_on_section_start` callbacks.
+ */
+static inline const mustache_name_keys_s *
+mustache_section_keys(mustache_section_s *section);
+
+/**
+ * Pauses a render started by `mustache_builder_new` once the current
+ * instruction was performed (`mustache_builder_run` will return 1).
+ *
+ * Renders performed by `mustache_build` ignore this request.
+ */
+static inline void mustache_build_pause(mustache_section_s *section);
+
 /* *****************************************************************************
 Client Callbacks - MUST be implemented by the including file
 ***************************************************************************** */
@@ -314,6 +397,8 @@ struct mustache_s {
       uint32_t data_length;
     } read_only;
   } u;
+  /* the expected length of a rendered template (maintained by the client) */
+  uint64_t estimate;
 };
 
 typedef struct mustache__instruction_s {
@@ -341,6 +426,8 @@ typedef struct mustache__instruction_s {
     uint16_t name_len;
     /** The offset between the name and the content (left / right by type). */
     uint16_t offset;
+    /** The offset of the name's keys (`mustache_name_keys_s`), if any. */
+    uint32_t keys;
   } data;
 } mustache__instruction_s;
 
@@ -362,9 +449,20 @@ typedef struct {
   uint32_t pos;     /* the instruction postision index */
   uint32_t padding; /* padding instruction position */
   uint16_t index;   /* the stack postision index */
+  uint8_t pause;    /* set by `mustache_build_pause` */
   mustache__section_stack_frame_s stack[MUSTACHE_NESTING_LIMIT];
 } mustache__builder_stack_s;
 
+/* a render that can be paused and resumed (see `mustache_builder_new`) */
+struct mustache_builder_s {
+  mustache__builder_stack_s s;
+  mustache_s *copy; /* the builder's copy of the template (once paused) */
+  mustache_error_en *err;
+  void *udata1;
+  void *udata2;
+  mustache_error_en err_if_missing;
+};
+
 #define MUSTACHE_DELIMITER_LENGTH_LIMIT 5
 
 /*
@@ -478,6 +576,33 @@ error:
   return NULL;
 }
 
+/**
+ * Returns the pre-hashed keys for the argument / section name being processed
+ * (the `name` passed to the callback), or NULL if the template wasn't compiled
+ * with `MUSTACHE_NAME_HASH`.
+ */
+static inline const mustache_name_keys_s *
+mustache_section_keys(mustache_section_s *section) {
+  if (!section)
+    return NULL;
+  mustache__builder_stack_s *s = mustache___section2stack(section);
+  mustache__instruction_s *inst = MUSTACH2INSTRUCTIONS(s->data) + s->pos;
+  if (!inst->data.keys)
+    return NULL;
+  return (const mustache_name_keys_s *)(MUSTACH2DATA(s->data) +
+                                        inst->data.keys);
+}
+
+/**
+ * Pauses a render started by `mustache_builder_new` once the current
+ * instruction was performed.
+ */
+static inline void mustache_build_pause(mustache_section_s *section) {
+  if (!section)
+    return;
+  mustache___section2stack(section)->pause = 1;
+}
+
 /**
  * used internally to write escaped text rather than clear text.
  */
@@ -567,6 +692,31 @@ static int mustache__write_escaped(mustache__builder_stack_s *s, char *text,
   size_t pos = 0;
   const char *end = text + len;
   while (text < end) {
+    /* copy spans of bytes that don't require escaping in bulk */
+    const char *span = text;
+    while (text < end && html_escape_len[(uint8_t)text[0]] == 1)
+      ++text;
+    if (text > span) {
+      size_t span_len = text - span;
+      if (pos + span_len >= (MUSTACHE_ESCAPE_BUFFER_SIZE - 6)) {
+        if (pos) {
+          buffer[pos] = 0;
+          if (mustache_on_text(&s->stack[s->index].sec, buffer, pos) == -1)
+            return -1;
+          pos = 0;
+        }
+        if (span_len >= (MUSTACHE_ESCAPE_BUFFER_SIZE >> 2)) {
+          /* long spans are written as is, without copying */
+          if (mustache_on_text(&s->stack[s->index].sec, span, span_len) == -1)
+            return -1;
+          span_len = 0;
+        }
+      }
+      memcpy(buffer + pos, span, span_len);
+      pos += span_len;
+      if (text == end)
+        break;
+    }
     if (MUSTACHE_USE_DYNAMIC_PADDING && *text == '\n' && s->padding) {
       buffer[pos++] = '\n';
       buffer[pos] = 0;
@@ -991,6 +1141,166 @@ unknown_error:
   return -1;
 }
 
+/* *****************************************************************************
+Compiling the instruction list (after the template was loaded)
+***************************************************************************** */
+
+/* appends data to the data segment, returning the data's position */
+static inline uint32_t mustache__data_append(mustache__loader_stack_s *s,
+                                             const void *data, size_t len,
+                                             size_t alignment) {
+  size_t pos = (s->data_len + (alignment - 1)) & (~(alignment - 1));
+  if (pos + len >= UINT32_MAX)
+    return 0;
+  s->data = realloc(s->data, pos + len + 1);
+  MUSTACHE_ASSERT(s->data, "failed to allocate memory for mustache data");
+  memset(s->data + s->data_len, 0, pos - s->data_len);
+  if (data)
+    memcpy(s->data + pos, data, len);
+  s->data_len = pos + len;
+  s->data[s->data_len] = 0;
+  s->m->u.read_only.data_length = s->data_len;
+  return (uint32_t)pos;
+}
+
+/* merges a text instruction into the previous text instruction (`prev`) */
+static inline int mustache__merge_text(mustache__loader_stack_s *s,
+                                       mustache__instruction_s *prev,
+                                       mustache__instruction_s *text) {
+  if ((uint32_t)prev->data.name_len + text->data.name_len > UINT16_MAX)
+    return -1;
+  if (prev->data.name_pos + prev->data.name_len != text->data.name_pos) {
+    /* the text isn't continuous (i.e., a comment), copy to the data's end */
+    if (prev->data.name_pos + prev->data.name_len != s->data_len) {
+      const uint32_t len = prev->data.name_len;
+      const uint32_t pos = mustache__data_append(s, NULL, len, 1);
+      if (!pos)
+        return -1;
+      memcpy(s->data + pos, s->data + prev->data.name_pos, len);
+      prev->data.name_pos = pos;
+    }
+    const uint32_t len = text->data.name_len;
+    const uint32_t pos = mustache__data_append(s, NULL, len, 1);
+    if (!pos)
+      return -1;
+    memcpy(s->data + pos, s->data + text->data.name_pos, len);
+  }
+  prev->data.name_len += text->data.name_len;
+  return 0;
+}
+
+#ifdef MUSTACHE_NAME_HASH
+/* returns the position of a name's keys, adding the keys if missing */
+static inline uint32_t mustache__name_keys(mustache__loader_stack_s *s,
+                                           uint32_t name_pos, uint16_t name_len,
+                                           uint32_t keys_start) {
+  const char *name = s->data + name_pos;
+  uint64_t count = 1;
+  for (uint16_t i = 0; i < name_len; ++i)
+    count += (name[i] == '.');
+  const uint64_t hash = MUSTACHE_NAME_HASH(name, name_len);
+  /* names are interned, seek a previous copy of the keys */
+  for (size_t pos = keys_start; pos < s->data_len;) {
+    mustache_name_keys_s *k = (mustache_name_keys_s *)(s->data + pos);
+    if (k->count == count && k->hash[0] == hash)
+      return (uint32_t)pos;
+    pos += sizeof(uint64_t) * (k->count << 1);
+  }
+  uint64_t *keys = malloc(sizeof(*keys) * (count << 1));
+  MUSTACHE_ASSERT(keys, "failed to allocate memory for mustache compilation");
+  keys[0] = count;
+  keys[1] = hash;
+  /* tails (starting after each dot) and segments (up to each dot) */
+  uint64_t segment = 0;
+  uint16_t start = 0;
+  for (uint16_t i = 0; i < name_len; ++i) {
+    if (name[i] != '.')
+      continue;
+    keys[count + 1 + segment] = MUSTACHE_NAME_HASH(name + start, i - start);
+    ++segment;
+    start = i + 1;
+    keys[1 + segment] = MUSTACHE_NAME_HASH(name + start, name_len - start);
+  }
+  const uint32_t pos = mustache__data_append(
+      s, keys, sizeof(*keys) * (count << 1), sizeof(*keys));
+  free(keys);
+  return pos;
+}
+#endif
+
+/*
+ * Compiles the instruction array, merging adjacent text instructions,
+ * removing padding instructions that can't be used and (if
+ * `MUSTACHE_NAME_HASH` is defined) adding pre-hashed keys for every name.
+ */
+static inline void mustache__compile(mustache__loader_stack_s *s) {
+  mustache__instruction_s *const i = s->i;
+  const uint32_t count = s->m->u.read_only.intruction_count;
+  if (!count)
+    return;
+  uint8_t padding = 0;
+  for (uint32_t r = 0; r < count; ++r)
+    padding |= (i[r].instruction == MUSTACHE_PADDING_PUSH);
+  /* compact the instruction array, mapping old positions to new positions */
+  uint32_t *map = malloc(sizeof(*map) * count);
+  MUSTACHE_ASSERT(map, "failed to allocate memory for mustache compilation");
+  uint32_t w = 0;
+  for (uint32_t r = 0; r < count; ++r) {
+    map[r] = w;
+    switch (i[r].instruction) {
+    case MUSTACHE_PADDING_WRITE:
+      /* without padded partials, padding is always empty */
+      if (!padding)
+        continue;
+      break;
+    case MUSTACHE_WRITE_TEXT:
+      /* text instructions are never a jump target, so merging is safe */
+      if (w && i[w - 1].instruction == MUSTACHE_WRITE_TEXT &&
+          !mustache__merge_text(s, i + (w - 1), i + r))
+        continue;
+      break;
+    default:
+      break;
+    }
+    i[w++] = i[r];
+  }
+  for (uint32_t r = 0; r < w; ++r) {
+    switch (i[r].instruction) {
+    case MUSTACHE_SECTION_START:     /* fallthrough */
+    case MUSTACHE_SECTION_START_INV: /* fallthrough */
+    case MUSTACHE_SECTION_END:       /* fallthrough */
+    case MUSTACHE_PADDING_PUSH:
+      i[r].data.end = map[i[r].data.end];
+      break;
+    case MUSTACHE_SECTION_GOTO:
+      i[r].data.end = map[i[r].data.end];
+      i[r].data.len = map[i[r].data.len];
+      break;
+    default:
+      break;
+    }
+  }
+  free(map);
+  s->m->u.read_only.intruction_count = w;
+#ifdef MUSTACHE_NAME_HASH
+  const uint32_t keys_start = mustache__data_append(s, NULL, 0, 8);
+  for (uint32_t r = 0; r < w; ++r) {
+    switch (i[r].instruction) {
+    case MUSTACHE_WRITE_ARG:           /* fallthrough */
+    case MUSTACHE_WRITE_ARG_UNESCAPED: /* fallthrough */
+    case MUSTACHE_SECTION_START:       /* fallthrough */
+    case MUSTACHE_SECTION_START_INV:
+      if (i[r].data.name_pos)
+        i[r].data.keys = mustache__name_keys(s, i[r].data.name_pos,
+                                             i[r].data.name_len, keys_start);
+      break;
+    default:
+      break;
+    }
+  }
+#endif
+}
+
 /* *****************************************************************************
 Calling the instrustion list (using the template engine)
 ***************************************************************************** */
@@ -1011,52 +1321,30 @@ Calling the instrustion list (using the template engine)
  * function keeps a stack of sorts. This allows the code to avoid recursion and
  * minimize any risk of stack overflow caused by recursive templates.
  */
-MUSTACHE_FUNC int(mustache_build)(mustache_build_args_s args) {
-  mustache_error_en err_if_missing;
-  if (!args.err)
-    args.err = &err_if_missing;
-  if (!args.mustache) {
-    goto user_error;
-  }
+static int mustache__build(mustache__builder_stack_s *s,
+                           mustache_error_en *err) {
   /* extract the instruction array and data segment from the mustache_s */
-  mustache__instruction_s *instructions = MUSTACH2INSTRUCTIONS(args.mustache);
-  char *const data = MUSTACH2DATA(args.mustache);
-  mustache__builder_stack_s s;
-  s.data = args.mustache;
-  s.pos = 0;
-  s.index = 0;
-  s.padding = 0;
-  s.stack[0] = (mustache__section_stack_frame_s){
-      .sec =
-          {
-              .udata1 = args.udata1,
-              .udata2 = args.udata2,
-          },
-      .start = 0,
-      .end = instructions[0].data.end,
-      .index = 0,
-      .count = 0,
-      .frame = 0,
-  };
-  while ((uintptr_t)(instructions + s.pos) < (uintptr_t)data) {
-    switch (instructions[s.pos].instruction) {
+  mustache__instruction_s *instructions = MUSTACH2INSTRUCTIONS(s->data);
+  char *const data = MUSTACH2DATA(s->data);
+  while ((uintptr_t)(instructions + s->pos) < (uintptr_t)data) {
+    switch (instructions[s->pos].instruction) {
     case MUSTACHE_WRITE_TEXT:
-      if (mustache_on_text(&s.stack[s.index].sec,
-                           data + instructions[s.pos].data.name_pos,
-                           instructions[s.pos].data.name_len))
+      if (mustache_on_text(&s->stack[s->index].sec,
+                           data + instructions[s->pos].data.name_pos,
+                           instructions[s->pos].data.name_len))
         goto user_error;
       break;
       /* fallthrough */
     case MUSTACHE_WRITE_ARG:
-      if (mustache_on_arg(&s.stack[s.index].sec,
-                          data + instructions[s.pos].data.name_pos,
-                          instructions[s.pos].data.name_len, 1))
+      if (mustache_on_arg(&s->stack[s->index].sec,
+                          data + instructions[s->pos].data.name_pos,
+                          instructions[s->pos].data.name_len, 1))
         goto user_error;
       break;
     case MUSTACHE_WRITE_ARG_UNESCAPED:
-      if (mustache_on_arg(&s.stack[s.index].sec,
-                          data + instructions[s.pos].data.name_pos,
-                          instructions[s.pos].data.name_len, 0))
+      if (mustache_on_arg(&s->stack[s->index].sec,
+                          data + instructions[s->pos].data.name_pos,
+                          instructions[s->pos].data.name_len, 0))
         goto user_error;
       break;
       /* fallthrough */
@@ -1065,70 +1353,69 @@ MUSTACHE_FUNC int(mustache_build)(mustache_build_args_s args) {
     case MUSTACHE_SECTION_START:
     case MUSTACHE_SECTION_START_INV:
       /* advance stack*/
-      if (s.index + 1 >= MUSTACHE_NESTING_LIMIT) {
-        if (args.err)
-          *args.err = MUSTACHE_ERR_TOO_DEEP;
-        goto error;
+      if (s->index + 1 >= MUSTACHE_NESTING_LIMIT) {
+        *err = MUSTACHE_ERR_TOO_DEEP;
+        return -1;
       }
-      s.stack[s.index + 1].sec = s.stack[s.index].sec;
-      ++s.index;
-      s.stack[s.index].start =
-          (instructions[s.pos].instruction == MUSTACHE_SECTION_GOTO
-               ? instructions[s.pos].data.len
-               : s.pos);
-      s.stack[s.index].end = instructions[s.pos].data.end;
-      s.stack[s.index].frame = s.index;
-      s.stack[s.index].index = 0;
-      s.stack[s.index].count = 1;
+      s->stack[s->index + 1].sec = s->stack[s->index].sec;
+      ++s->index;
+      s->stack[s->index].start =
+          (instructions[s->pos].instruction == MUSTACHE_SECTION_GOTO
+               ? instructions[s->pos].data.len
+               : s->pos);
+      s->stack[s->index].end = instructions[s->pos].data.end;
+      s->stack[s->index].frame = s->index;
+      s->stack[s->index].index = 0;
+      s->stack[s->index].count = 1;
 
       /* test section count */
-      if (instructions[s.pos].data.name_pos) {
+      if (instructions[s->pos].data.name_pos) {
         /* this is a named section, it should be tested against user data */
         int32_t val = mustache_on_section_test(
-            &s.stack[s.index].sec, data + instructions[s.pos].data.name_pos,
-            instructions[s.pos].data.name_len,
-            instructions[s.pos].instruction == MUSTACHE_SECTION_START);
+            &s->stack[s->index].sec, data + instructions[s->pos].data.name_pos,
+            instructions[s->pos].data.name_len,
+            instructions[s->pos].instruction == MUSTACHE_SECTION_START);
         if (val == -1) {
           goto user_error;
         }
-        if (instructions[s.pos].instruction == MUSTACHE_SECTION_START_INV) {
+        if (instructions[s->pos].instruction == MUSTACHE_SECTION_START_INV) {
           /* invert test */
           val = (val == 0);
         }
-        s.stack[s.index].count = (uint32_t)val;
+        s->stack[s->index].count = (uint32_t)val;
       }
       /* fallthrough  */
     case MUSTACHE_SECTION_END:
       /* loop section or continue */
-      if (s.stack[s.index].index < s.stack[s.index].count) {
+      if (s->stack[s->index].index < s->stack[s->index].count) {
         /* repeat / start section */
-        s.pos = s.stack[s.index].start;
-        s.stack[s.index].sec = s.stack[s.index - 1].sec;
+        s->pos = s->stack[s->index].start;
+        s->stack[s->index].sec = s->stack[s->index - 1].sec;
         /* review user callback (if it's a named section) */
-        if (instructions[s.pos].data.name_pos &&
-            mustache_on_section_start(&s.stack[s.index].sec,
-                                      data + instructions[s.pos].data.name_pos,
-                                      instructions[s.pos].data.name_len,
-                                      s.stack[s.index].index) == -1)
+        if (instructions[s->pos].data.name_pos &&
+            mustache_on_section_start(&s->stack[s->index].sec,
+                                      data + instructions[s->pos].data.name_pos,
+                                      instructions[s->pos].data.name_len,
+                                      s->stack[s->index].index) == -1)
           goto user_error;
         /* skip padding instructions in GOTO tags (recursive partials) */
-        if (instructions[s.pos].instruction == MUSTACHE_SECTION_GOTO)
-          ++s.pos;
-        ++s.stack[s.index].index;
+        if (instructions[s->pos].instruction == MUSTACHE_SECTION_GOTO)
+          ++s->pos;
+        ++s->stack[s->index].index;
         break;
       }
-      s.pos = s.stack[s.index].end;
-      --s.index;
+      s->pos = s->stack[s->index].end;
+      --s->index;
       break;
     case MUSTACHE_PADDING_PUSH:
-      s.padding = s.pos;
+      s->padding = s->pos;
       break;
     case MUSTACHE_PADDING_POP:
-      s.padding = instructions[s.padding].data.end;
+      s->padding = instructions[s->padding].data.end;
       break;
     case MUSTACHE_PADDING_WRITE:
-      for (uint32_t i = s.padding; i; i = instructions[i].data.end) {
-        if (mustache_on_text(&s.stack[s.index].sec,
+      for (uint32_t i = s->padding; i; i = instructions[i].data.end) {
+        if (mustache_on_text(&s->stack[s->index].sec,
                              data + instructions[i].data.name_pos,
                              instructions[i].data.name_len))
           goto user_error;
@@ -1138,22 +1425,118 @@ MUSTACHE_FUNC int(mustache_build)(mustache_build_args_s args) {
       /* not a valid engine */
       fprintf(stderr, "ERROR: invalid mustache instruction set detected (wrong "
                       "`mustache_s`?)\n");
-      if (args.err) {
-        *args.err = MUSTACHE_ERR_UNKNOWN;
-      }
-      goto error;
+      *err = MUSTACHE_ERR_UNKNOWN;
+      return -1;
+    }
+    ++s->pos;
+    if (s->pause) {
+      s->pause = 0;
+      return 1;
     }
-    ++s.pos;
   }
-  *args.err = MUSTACHE_OK;
+  *err = MUSTACHE_OK;
   return 0;
 user_error:
-  *args.err = MUSTACHE_ERR_USER_ERROR;
+  *err = MUSTACHE_ERR_USER_ERROR;
+  return -1;
+}
+
+/* initializes the builder's stack (the root section) */
+static void mustache__build_init(mustache__builder_stack_s *s,
+                                 mustache_build_args_s args) {
+  s->data = args.mustache;
+  s->pos = 0;
+  s->index = 0;
+  s->padding = 0;
+  s->pause = 0;
+  s->stack[0] = (mustache__section_stack_frame_s){
+      .sec =
+          {
+              .udata1 = args.udata1,
+              .udata2 = args.udata2,
+          },
+      .start = 0,
+      .end = MUSTACH2INSTRUCTIONS(args.mustache)[0].data.end,
+      .index = 0,
+      .count = 0,
+      .frame = 0,
+  };
+}
+
+MUSTACHE_FUNC int(mustache_build)(mustache_build_args_s args) {
+  mustache_error_en err_if_missing;
+  if (!args.err)
+    args.err = &err_if_missing;
+  if (!args.mustache) {
+    *args.err = MUSTACHE_ERR_USER_ERROR;
+    goto error;
+  }
+  mustache__builder_stack_s s;
+  mustache__build_init(&s, args);
+  int ret;
+  /* pausing is only supported by `mustache_builder_run` */
+  while ((ret = mustache__build(&s, args.err)) == 1)
+    ;
+  if (ret == -1)
+    goto error;
+  return 0;
 error:
   mustache_on_formatting_error(args.udata1, args.udata2);
   return -1;
 }
 
+/* *****************************************************************************
+Pausing and resuming renders
+***************************************************************************** */
+
+MUSTACHE_FUNC mustache_builder_s *(mustache_builder_new)(
+    mustache_build_args_s args) {
+  mustache_builder_s *b;
+  if (!args.mustache) {
+    if (args.err)
+      *args.err = MUSTACHE_ERR_USER_ERROR;
+    return NULL;
+  }
+  b = malloc(sizeof(*b));
+  MUSTACHE_ASSERT(b, "failed to allocate memory for mustache builder");
+  mustache__build_init(&b->s, args);
+  b->copy = NULL;
+  b->err = args.err ? args.err : &b->err_if_missing;
+  b->udata1 = args.udata1;
+  b->udata2 = args.udata2;
+  return b;
+}
+
+MUSTACHE_FUNC int mustache_builder_run(mustache_builder_s *b) {
+  if (!b)
+    return -1;
+  int ret = mustache__build(&b->s, b->err);
+  if (ret == -1) {
+    mustache_on_formatting_error(b->udata1, b->udata2);
+    return -1;
+  }
+  if (ret == 1 && !b->copy) {
+    /* the template might be freed before the render is resumed */
+    const size_t len =
+        sizeof(*b->copy) +
+        (sizeof(mustache__instruction_s) *
+         b->s.data->u.read_only.intruction_count) +
+        b->s.data->u.read_only.data_length;
+    b->copy = malloc(len);
+    MUSTACHE_ASSERT(b->copy, "failed to allocate memory for mustache copy");
+    memcpy(b->copy, b->s.data, len);
+    b->s.data = b->copy;
+  }
+  return ret;
+}
+
+MUSTACHE_FUNC void mustache_builder_free(mustache_builder_s *b) {
+  if (!b)
+    return;
+  free(b->copy);
+  free(b);
+}
+
 /* *****************************************************************************
 Building the instrustion list (parsing the template)
 ***************************************************************************** */
@@ -1178,6 +1561,7 @@ MUSTACHE_FUNC mustache_s *(mustache_load)(mustache_load_args_s args) {
   MUSTACHE_ASSERT(s.m, "failed to allocate memory for mustache data");
   s.m->u.read_only_pt = 0;
   s.m->u.read_only.data_length = 0;
+  s.m->estimate = 0;
   s.m->u.read_only.intruction_count = 0;
   s.i = MUSTACH2INSTRUCTIONS(s.m);
   s.err = args.err;
@@ -1512,6 +1896,9 @@ MUSTACHE_FUNC mustache_s *(mustache_load)(mustache_load_args_s args) {
     --s.index;
   }
 
+#if MUSTACHE_COMPILE_TEMPLATES
+  mustache__compile(&s);
+#endif
   s.m = realloc(s.m, sizeof(*s.m) +
                          (sizeof(*s.i) * s.m->u.read_only.intruction_count) +
                          s.data_len);
@@ -57,6 +57,10 @@ fio_tls_alpn_add(void *tls, const char *protocol_name,
 }
 #pragma weak fio_tls_alpn_add
 
+/* TLS object reference counting (used by the client's connection pool). */
+void fio_tls_dup(void *tls);
+void fio_tls_destroy(void *tls);
+
 /* *****************************************************************************
 Small Helpers
 ***************************************************************************** */
@@ -357,6 +361,114 @@ int http_sendfile(http_s *r, int fd, uintptr_t length, uintptr_t offset) {
       ->http_sendfile(r, fd, length, offset);
 }
 
+/**
+ * Sends the response headers (on the first call) and a chunk of the response's
+ * body, allowing the body to be sent in chunks as it's produced.
+ *
+ * Returns -1 on error and 0 on success.
+ */
+int http_stream(http_s *r, void *data, uintptr_t length) {
+  if (HTTP_INVALID_HANDLE(r))
+    return -1;
+  if (!length || !data)
+    return 0; /* an empty chunk would terminate a chunked body */
+  add_date(r);
+  return ((http_vtable_s *)r->private_data.vtbl)->http_stream(r, data, length);
+}
+
+/* streams a rendered chunk (see `http_send_mustache`) */
+static int http_send_mustache_chunk(FIOBJ chunk, void *h_) {
+  http_s *h = h_;
+  fio_str_info_s s = fiobj_obj2cstr(chunk);
+  int ret = http_stream(h, s.data, s.len);
+  fiobj_free(chunk);
+  /* 1 pauses the render until the client reads the data */
+  return ret;
+}
+
+/* a Mustache response, paused while the client is falling behind */
+typedef struct {
+  fiobj_mustache_stream_s *stream;
+  http_pause_handle_s *paused;
+  void *udata; /* the handle's `udata`, restored when resumed */
+  intptr_t uuid;
+} http_mustache_s;
+
+static int http_send_mustache_run(http_s *h, http_mustache_s *m);
+
+static void http_send_mustache_free(void *m_) {
+  http_mustache_s *m = m_;
+  fiobj_mustache_stream_free(m->stream);
+  fio_free(m);
+}
+
+static void http_send_mustache_resume(http_s *h) {
+  http_mustache_s *m = h->udata;
+  h->udata = m->udata;
+  http_send_mustache_run(h, m);
+}
+
+/* the client read enough of the data (or the connection was lost) */
+static void http_send_mustache_on_drain(intptr_t uuid, fio_protocol_s *pr,
+                                        void *m_) {
+  http_mustache_s *m = m_;
+  http_resume(m->paused, http_send_mustache_resume, http_send_mustache_free);
+  (void)uuid;
+  (void)pr;
+}
+
+static void http_send_mustache_on_drain_fallback(intptr_t uuid, void *m_) {
+  /* the connection was lost, `http_resume` will call the fallback */
+  http_send_mustache_on_drain(uuid, NULL, m_);
+}
+
+static void http_send_mustache_pause(http_pause_handle_s *http) {
+  http_mustache_s *m = http_paused_udata_get(http);
+  m->paused = http;
+  fio_defer_on_drain(m->uuid, HTTP_STREAM_PENDING_LIMIT,
+                     .task = http_send_mustache_on_drain, .udata = m,
+                     .fallback = http_send_mustache_on_drain_fallback);
+}
+
+/* renders until complete, pausing the handle while the client is behind */
+static int http_send_mustache_run(http_s *h, http_mustache_s *m) {
+  int ret = fiobj_mustache_stream_run(m->stream);
+  if (ret == 1) {
+    m->udata = h->udata;
+    h->udata = m;
+    http_pause(h, http_send_mustache_pause);
+    return 0;
+  }
+  http_send_mustache_free(m);
+  http_finish(h);
+  return ret;
+}
+
+/**
+ * Renders a Mustache template, streaming the rendered output as the response's
+ * body and completing the response.
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_mustache(http_s *h, mustache_s *mustache, FIOBJ data) {
+  if (HTTP_INVALID_HANDLE(h))
+    return -1;
+  if (!mustache) {
+    http_send_error(h, 500);
+    return -1;
+  }
+  http_mustache_s *m = fio_malloc(sizeof(*m));
+  FIO_ASSERT_ALLOC(m);
+  *m = (http_mustache_s){
+      .stream = fiobj_mustache_stream_new(mustache, data,
+                                          http_send_mustache_chunk, h),
+      .uuid = ((http_fio_protocol_s *)h->private_data.flag)->uuid,
+  };
+  return http_send_mustache_run(h, m);
+}
+
 static inline int http_test_encoded_path(const char *mem, size_t len) {
   const char *pos = NULL;
   const char *end = mem + len;
@@ -644,6 +756,115 @@ int http_send_error(http_s *r, size_t error) {
   return 0;
 }
 
+/**
+ * Sends the reactor metrics (`fio_metrics_cluster`) using the Prometheus text
+ * format.
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_metrics(http_s *r) {
+  if (!r || !r->private_data.out_headers) {
+    return -1;
+  }
+  const fio_metrics_s m = fio_metrics_cluster();
+  /* a metric family (HELP and TYPE lines) is followed by it's samples */
+  const struct {
+    const char *family;
+    const char *type;
+    const char *help;
+    const char *sample;
+    uint64_t value;
+    uint8_t is_ns;
+  } list[] = {
+      {"fio_polls_total", "counter", "IO polling system reviews.",
+       "fio_polls_total", m.polls, 0},
+      {"fio_poll_events_total", "counter",
+       "IO events returned by the polling system.", "fio_poll_events_total",
+       m.poll_events, 0},
+      {"fio_tasks_queued_total", "counter", "Tasks pushed to the task queues.",
+       "fio_tasks_queued_total{queue=\"normal\"}", m.tasks_queued, 0},
+      {NULL, NULL, NULL, "fio_tasks_queued_total{queue=\"urgent\"}",
+       m.tasks_urgent_queued, 0},
+      {"fio_tasks_performed_total", "counter",
+       "Tasks performed from the task queues.",
+       "fio_tasks_performed_total{queue=\"normal\"}", m.tasks_performed, 0},
+      {NULL, NULL, NULL, "fio_tasks_performed_total{queue=\"urgent\"}",
+       m.tasks_urgent_performed, 0},
+      {"fio_queue_latency_seconds", "summary",
+       "The time a task waits in the queue (sampled once per reactor cycle).",
+       "fio_queue_latency_seconds_sum", m.queue_latency_ns, 1},
+      {NULL, NULL, NULL, "fio_queue_latency_seconds_count",
+       m.queue_latency_samples, 0},
+      {"fio_queue_latency_max_seconds", "gauge",
+       "The longest queue latency sample.", "fio_queue_latency_max_seconds",
+       m.queue_latency_max_ns, 1},
+      {"fio_read_bytes_total", "counter", "Bytes read from connections.",
+       "fio_read_bytes_total", m.bytes_read, 0},
+      {"fio_written_bytes_total", "counter", "Bytes written to connections.",
+       "fio_written_bytes_total", m.bytes_written, 0},
+      {"fio_partial_writes_total", "counter",
+       "Writes that couldn't send all the data (the socket was full).",
+       "fio_partial_writes_total", m.partial_writes, 0},
+      {"fio_slowloris_total", "counter",
+       "Connections closed by the slowloris mitigation.",
+       "fio_slowloris_total", m.slowloris, 0},
+      {"fio_timeouts_total", "counter", "Connections that timed out.",
+       "fio_timeouts_total", m.timeouts, 0},
+      {"fio_pubsub_published_total", "counter", "Pub/Sub messages published.",
+       "fio_pubsub_published_total", m.pubsub_published, 0},
+      {"fio_pubsub_received_total", "counter",
+       "Pub/Sub messages received for local delivery.",
+       "fio_pubsub_received_total", m.pubsub_received, 0},
+      {"fio_pubsub_delivered_total", "counter",
+       "Pub/Sub messages delivered to subscriptions.",
+       "fio_pubsub_delivered_total", m.pubsub_delivered, 0},
+  };
+  FIOBJ body = fiobj_str_buf(2048);
+  for (size_t i = 0; i < sizeof(list) / sizeof(list[0]); ++i) {
+    if (list[i].family)
+      fiobj_str_printf(body, "# HELP %s %s\n# TYPE %s %s\n", list[i].family,
+                       list[i].help, list[i].family, list[i].type);
+    if (list[i].is_ns)
+      fiobj_str_printf(body, "%s %.9f\n", list[i].sample,
+                       (double)list[i].value / 1000000000.0);
+    else
+      fiobj_str_printf(body, "%s %llu\n", list[i].sample,
+                       (unsigned long long)list[i].value);
+  }
+  /* request latencies are collected by this process only */
+  fiobj_str_printf(body, "# HELP %s %s\n# TYPE %s summary\n",
+                   "http_request_duration_seconds",
+                   "Request latency by status class (this process).",
+                   "http_request_duration_seconds");
+  for (uint8_t c = 1; c < 6; ++c) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    http_latency_s l = {0};
+    http_latency_collect(&l, c);
+    if (!l.count)
+      continue;
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+      fiobj_str_printf(
+          body, "http_request_duration_seconds{class=\"%dxx\",quantile=\"%g\"} "
+                "%.6f\n",
+          (int)c, quantiles[i],
+          (double)http_latency_percentile(&l, quantiles[i]) / 1000000.0);
+    fiobj_str_printf(body,
+                     "http_request_duration_seconds_sum{class=\"%dxx\"} %.6f\n"
+                     "http_request_duration_seconds_count{class=\"%dxx\"} "
+                     "%llu\n",
+                     (int)c, (double)l.sum_us / 1000000.0, (int)c,
+                     (unsigned long long)l.count);
+  }
+  http_set_header(r, HTTP_HEADER_CONTENT_TYPE,
+                  fiobj_str_new("text/plain; version=0.0.4", 25));
+  fio_str_info_s t = fiobj_obj2cstr(body);
+  int ret = http_send_body(r, t.data, t.len);
+  fiobj_free(body);
+  return ret;
+}
+
 /**
  * Sends the response headers for a header only response.
  *
@@ -769,6 +990,13 @@ void http_pause(http_s *h, void (*task)(http_pause_handle_s *http)) {
       .h = h,
       .udata = h->udata,
   };
+  /* the request might be handled by a different thread */
+  fiobj_share(h->headers);
+  fiobj_share(h->private_data.out_headers);
+  fiobj_share(h->method);
+  fiobj_share(h->path);
+  fiobj_share(h->query);
+  fiobj_share(h->version);
   vtbl->http_on_pause(h, p);
   fio_defer(http_pause_wrapper, http, (void *)((uintptr_t)task));
 }
@@ -930,7 +1158,11 @@ intptr_t http_listen(const char *port, const char *binding,
 
   return fio_listen(.port = port, .address = binding, .tls = arg_settings.tls,
                     .on_finish = http_on_finish, .on_open = http_on_open,
-                    .udata = settings);
+                    .udata = settings,
+                    .spread_accept = arg_settings.spread_accept,
+                    .defer_accept = arg_settings.defer_accept,
+                    .fastopen = arg_settings.fastopen,
+                    .busy_poll = arg_settings.busy_poll);
 }
 /** Listens to HTTP connections at the specified `port` and `binding`. */
 #define http_listen(port, binding, ...)                                        \
@@ -970,6 +1202,7 @@ static void http_on_close_client(intptr_t uuid, fio_protocol_s *protocol) {
 
 static void http_on_open_client_perform(http_settings_s *set) {
   http_s *h = set->udata;
+  set->udata = h->udata; /* the response's `udata` */
   set->on_response(h);
 }
 static void http_on_open_client_http1(intptr_t uuid, void *set_,
@@ -1010,6 +1243,417 @@ static void http_on_client_failed(intptr_t uuid, void *set_) {
   (void)uuid;
 }
 
+/* *****************************************************************************
+HTTP client connection pool
+
+Pooled requests are queued by host (address, port and TLS object). Each
+connection keeps a list of the requests sent, in the order they were sent, so
+responses (pipelined or not) are routed to the right request.
+
+Requests are sent within the connection's lock, adding the request to the `sent`
+list right before it's sent, so the list's order is the order of the requests.
+The protocol's `settings` always point to the first request waiting for a
+response (or the connection's `idle` settings) and the settings of every pooled
+connection and request point (at `settings + 1`) to the connection.
+***************************************************************************** */
+
+typedef struct {
+  fio_lock_i lock;
+  uint16_t limit;        /* the maximum number of connections */
+  uint8_t pipeline;      /* the maximum number of requests per connection */
+  uint8_t timeout;       /* idle connection timeout */
+  size_t count;          /* connections (connecting, busy or idle) */
+  fio_ls_embd_s idle;    /* idle connections (most recently used last) */
+  fio_ls_embd_s busy;    /* connecting or busy connections */
+  fio_ls_embd_s waiting; /* requests waiting for a connection */
+  void *tls;
+  char *address;
+  char *port; /* NULL for Unix sockets */
+} http_pool_s;
+
+typedef struct http_pool_req_s {
+  fio_ls_embd_s node; /* in the pool's `waiting` or connection's `sent` list */
+  http_pool_s *pool;
+  http_settings_s *settings;
+  http_s *h;                      /* the request, until it's sent */
+  void (*on_response)(http_s *h); /* the user's callback */
+} http_pool_req_s;
+
+typedef struct {
+  fio_ls_embd_s node; /* in the pool's `idle` or `busy` list */
+  fio_ls_embd_s sent; /* requests waiting for a response, in order */
+  http_pool_s *pool;
+  http_settings_s *idle;  /* the protocol's settings while idle */
+  http_pool_req_s *first; /* the first request (while connecting) */
+  void (*on_close)(intptr_t, fio_protocol_s *); /* the protocol's on_close */
+  intptr_t uuid;
+  size_t assigned; /* requests sent or scheduled to be sent */
+  uint8_t ready;   /* set once connected */
+  uint8_t reuse;   /* cleared if the server closes the connection */
+} http_pool_conn_s;
+
+#define http_pool_conn(settings) (((http_pool_conn_s **)((settings) + 1))[0])
+
+static int http_pool_cmp(http_pool_s *p1, http_pool_s *p2) {
+  return p1->tls == p2->tls && !strcmp(p1->address, p2->address) &&
+         (p1->port == p2->port ||
+          (p1->port && p2->port && !strcmp(p1->port, p2->port)));
+}
+
+static void http_pool_free(http_pool_s *pool);
+
+#define FIO_FORCE_MALLOC_TMP 1 /* pools live until the application exits */
+#define FIO_SET_NAME http_pool_set
+#define FIO_SET_OBJ_TYPE http_pool_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2) http_pool_cmp((o1), (o2))
+#define FIO_SET_OBJ_DESTROY(o) http_pool_free((o))
+#include <fio.h>
+
+static http_pool_set_s http_pools = FIO_SET_INIT;
+static fio_lock_i http_pools_lock = FIO_LOCK_INIT;
+
+static char *http_pool_strdup(const char *str) {
+  size_t len = strlen(str);
+  char *dup = malloc(len + 1);
+  FIO_ASSERT_ALLOC(dup);
+  memcpy(dup, str, len + 1);
+  return dup;
+}
+
+/* finishes a request, calling `on_finish` (with or without a response) */
+static void http_pool_req_finish(http_pool_req_s *r) {
+  if (r->h) {
+    http_s_destroy(r->h, 0);
+    fio_free(r->h);
+  }
+  if (r->settings->on_finish)
+    r->settings->on_finish(r->settings);
+  http_settings_free(r->settings);
+  fio_free(r);
+}
+
+static void http_pool_free(http_pool_s *pool) {
+  while (fio_ls_embd_any(&pool->waiting))
+    http_pool_req_finish(FIO_LS_EMBD_OBJ(http_pool_req_s, node,
+                                         fio_ls_embd_shift(&pool->waiting)));
+  if (pool->tls)
+    fio_tls_destroy(pool->tls);
+  free(pool->address);
+  free(pool->port);
+  free(pool);
+}
+
+/* frees the host pools (and any requests still waiting) */
+void http_client_pool_clear(void) {
+  fio_lock(&http_pools_lock);
+  http_pool_set_free(&http_pools);
+  fio_unlock(&http_pools_lock);
+}
+
+static http_pool_s *http_pool_get(void *tls, char *address, char *port) {
+  http_pool_s tmp = {.tls = tls, .address = address, .port = port};
+  uint64_t hash = FIO_HASH_FN(address, strlen(address), (uintptr_t)tls,
+                              (port ? fio_atol(&port) : 0)); /* moves `port` */
+  fio_lock(&http_pools_lock);
+  http_pool_s *pool = http_pool_set_find(&http_pools, hash, &tmp);
+  if (!pool) {
+    pool = malloc(sizeof(*pool));
+    FIO_ASSERT_ALLOC(pool);
+    *pool = (http_pool_s){
+        .idle = FIO_LS_INIT(pool->idle),
+        .busy = FIO_LS_INIT(pool->busy),
+        .waiting = FIO_LS_INIT(pool->waiting),
+        .tls = tls,
+        .address = http_pool_strdup(address),
+        .port = (tmp.port ? http_pool_strdup(tmp.port) : NULL),
+    };
+    if (tls)
+      fio_tls_dup(tls);
+    http_pool_set_insert(&http_pools, hash, pool);
+  }
+  fio_unlock(&http_pools_lock);
+  return pool;
+}
+
+static void http_pool_on_response(http_s *h);
+static void http_pool_on_upgrade(http_s *h, char *proto, size_t len);
+static void http_pool_on_close(intptr_t uuid, fio_protocol_s *pr);
+static intptr_t http_pool_dispatch(http_pool_req_s *r);
+
+/* creates a connection for the request (call with the pool's lock) */
+static http_pool_conn_s *http_pool_conn_new(http_pool_s *pool,
+                                            http_pool_req_s *r) {
+  http_settings_s idle = *r->settings;
+  idle.on_finish = NULL;
+  idle.udata = NULL;
+  idle.public_folder = NULL;
+  http_pool_conn_s *c = fio_malloc(sizeof(*c));
+  FIO_ASSERT_ALLOC(c);
+  *c = (http_pool_conn_s){
+      .sent = FIO_LS_INIT(c->sent),
+      .pool = pool,
+      .idle = http_settings_new(idle),
+      .first = r,
+      .assigned = 1,
+      .reuse = 1,
+  };
+  c->idle->is_client = 1;
+  http_pool_conn(c->idle) = c;
+  fio_ls_embd_push(&pool->busy, &c->node);
+  ++pool->count;
+  return c;
+}
+
+/* a connection for the next waiting request, if any (call with the lock) */
+static http_pool_conn_s *http_pool_conn_next(http_pool_s *pool) {
+  if (pool->count >= pool->limit || fio_ls_embd_is_empty(&pool->waiting))
+    return NULL;
+  return http_pool_conn_new(
+      pool, FIO_LS_EMBD_OBJ(http_pool_req_s, node,
+                            fio_ls_embd_shift(&pool->waiting)));
+}
+
+/* moves waiting requests to the connection (call with the pool's lock) */
+static void http_pool_fill(http_pool_s *pool, http_pool_conn_s *c,
+                           fio_ls_embd_s *tasks) {
+  while (c->assigned < pool->pipeline && fio_ls_embd_any(&pool->waiting)) {
+    fio_ls_embd_push(tasks, fio_ls_embd_shift(&pool->waiting));
+    ++c->assigned;
+  }
+}
+
+/* sends a request (runs within the connection's lock) */
+static void http_pool_send(intptr_t uuid, fio_protocol_s *pr_, void *r_) {
+  http_pool_req_s *r = r_;
+  http_fio_protocol_s *pr = (http_fio_protocol_s *)pr_;
+  if (pr_->on_close != http_pool_on_close) {
+    /* the connection was hijacked, use another connection */
+    http_pool_dispatch(r);
+    return;
+  }
+  http_pool_conn_s *c = http_pool_conn(pr->settings);
+  http_s *h = r->h;
+  r->h = NULL;
+  http_pool_conn(r->settings) = c;
+  if (fio_ls_embd_is_empty(&c->sent)) {
+    pr->settings = r->settings;
+    fio_timeout_set(uuid, r->settings->timeout);
+  }
+  fio_ls_embd_push(&c->sent, &r->node);
+  h->private_data.flag = (uintptr_t)pr;
+  r->on_response(h);
+}
+
+/* the connection was lost before the request was sent, try another */
+static void http_pool_resend(intptr_t uuid, void *r) {
+  http_pool_dispatch(r);
+  (void)uuid;
+}
+
+static void http_pool_schedule(intptr_t uuid, fio_ls_embd_s *tasks) {
+  while (fio_ls_embd_any(tasks)) {
+    fio_defer_io_task(uuid, .task = http_pool_send,
+                      .udata = FIO_LS_EMBD_OBJ(http_pool_req_s, node,
+                                               fio_ls_embd_shift(tasks)),
+                      .fallback = http_pool_resend);
+  }
+}
+
+static void http_pool_on_connect(intptr_t uuid, void *c_);
+static void http_pool_on_fail(intptr_t uuid, void *c_);
+
+static intptr_t http_pool_connect(http_pool_conn_s *c) {
+  return fio_connect(.address = c->pool->address, .port = c->pool->port,
+                     .on_connect = http_pool_on_connect,
+                     .on_fail = http_pool_on_fail, .udata = c,
+                     .tls = c->pool->tls,
+                     .fastopen = (c->first->settings->fastopen != 0));
+}
+
+static void http_pool_connect_task(void *c, void *ignr_) {
+  http_pool_connect(c);
+  (void)ignr_;
+}
+
+static void http_pool_on_connect(intptr_t uuid, void *c_) {
+  http_pool_conn_s *c = c_;
+  fio_protocol_s *pr = http1_new(uuid, c->idle, NULL, 0);
+  if (!pr) {
+    fio_close(uuid);
+    http_pool_on_fail(uuid, c);
+    return;
+  }
+  c->on_close = pr->on_close;
+  pr->on_close = http_pool_on_close;
+  fio_ls_embd_s tasks = FIO_LS_INIT(tasks);
+  fio_lock(&c->pool->lock);
+  c->uuid = uuid;
+  c->ready = 1;
+  fio_ls_embd_push(&tasks, &c->first->node);
+  c->first = NULL;
+  http_pool_fill(c->pool, c, &tasks);
+  fio_unlock(&c->pool->lock);
+  http_pool_schedule(uuid, &tasks);
+}
+
+static void http_pool_on_fail(intptr_t uuid, void *c_) {
+  http_pool_conn_s *c = c_;
+  http_pool_s *pool = c->pool;
+  fio_lock(&pool->lock);
+  fio_ls_embd_remove(&c->node);
+  --pool->count;
+  http_pool_conn_s *next = http_pool_conn_next(pool);
+  fio_unlock(&pool->lock);
+  http_pool_req_finish(c->first);
+  http_settings_free(c->idle);
+  fio_free(c);
+  /* deferred, since a failing host might fail synchronously (recursion) */
+  if (next)
+    fio_defer(http_pool_connect_task, next, NULL);
+  (void)uuid;
+}
+
+static void http_pool_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  http_pool_conn_s *c = http_pool_conn(((http_fio_protocol_s *)pr)->settings);
+  http_pool_s *pool = c->pool;
+  c->on_close(uuid, pr);
+  fio_lock(&pool->lock);
+  fio_ls_embd_remove(&c->node);
+  --pool->count;
+  http_pool_conn_s *next = http_pool_conn_next(pool);
+  fio_unlock(&pool->lock);
+  /* requests that were sent but weren't answered */
+  while (fio_ls_embd_any(&c->sent))
+    http_pool_req_finish(
+        FIO_LS_EMBD_OBJ(http_pool_req_s, node, fio_ls_embd_shift(&c->sent)));
+  http_settings_free(c->idle);
+  fio_free(c);
+  if (next)
+    http_pool_connect(next);
+}
+
+/* tests if the server will keep the connection alive */
+static uint8_t http_pool_keep_alive(http_s *h) {
+  FIOBJ tmp = fiobj_hash_get(h->headers, HTTP_HEADER_CONNECTION);
+  fio_str_info_s t;
+  if (tmp) {
+    if (!FIOBJ_TYPE_IS(tmp, FIOBJ_T_STRING))
+      return 0;
+    t = fiobj_obj2cstr(tmp);
+    return (t.len && (t.data[0] | 32) == 'k');
+  }
+  t = fiobj_obj2cstr(h->version);
+  return (t.len > 7 && t.data[5] == '1' && t.data[6] == '.' &&
+          t.data[7] == '1');
+}
+
+static void http_pool_on_response2(http_s *h, uint8_t reuse) {
+  http_fio_protocol_s *pr = http2protocol(h);
+  http_pool_conn_s *c = http_pool_conn(pr->settings);
+  http_pool_s *pool = c->pool;
+  if (fio_ls_embd_is_empty(&c->sent)) {
+    /* a response without a request (the connection is idle) */
+    fio_close(pr->uuid);
+    return;
+  }
+  http_pool_req_s *r =
+      FIO_LS_EMBD_OBJ(http_pool_req_s, node, fio_ls_embd_shift(&c->sent));
+  r->on_response(h);
+  /* the next response belongs to the next request (if any) */
+  if (fio_ls_embd_any(&c->sent)) {
+    pr->settings =
+        FIO_LS_EMBD_OBJ(http_pool_req_s, node, c->sent.next)->settings;
+    fio_timeout_set(pr->uuid, pr->settings->timeout);
+  } else {
+    pr->settings = c->idle;
+  }
+  http_pool_req_finish(r);
+
+  fio_ls_embd_s tasks = FIO_LS_INIT(tasks);
+  fio_lock(&pool->lock);
+  --c->assigned;
+  c->reuse &= reuse;
+  if (c->reuse) {
+    http_pool_fill(pool, c, &tasks);
+    if (!c->assigned) {
+      fio_ls_embd_remove(&c->node);
+      fio_ls_embd_push(&pool->idle, &c->node);
+      fio_timeout_set(pr->uuid, pool->timeout);
+    }
+  }
+  uint8_t close = !c->reuse && !c->assigned;
+  fio_unlock(&pool->lock);
+  http_pool_schedule(pr->uuid, &tasks);
+  if (close)
+    fio_close(pr->uuid);
+}
+
+static void http_pool_on_response(http_s *h) {
+  http_pool_on_response2(h, http_pool_keep_alive(h));
+}
+
+/* pooled connections aren't upgraded, this is the final response */
+static void http_pool_on_upgrade(http_s *h, char *proto, size_t len) {
+  http_pool_on_response2(h, 0);
+  (void)proto;
+  (void)len;
+}
+
+/* assigns the request to a connection, returns the connection's uuid */
+static intptr_t http_pool_dispatch(http_pool_req_s *r) {
+  http_pool_s *pool = r->pool;
+  http_pool_conn_s *c = NULL;
+  fio_lock(&pool->lock);
+  if (fio_ls_embd_any(&pool->idle)) {
+    c = FIO_LS_EMBD_OBJ(http_pool_conn_s, node, fio_ls_embd_pop(&pool->idle));
+    fio_ls_embd_push(&pool->busy, &c->node);
+  } else if (pool->count < pool->limit) {
+    c = http_pool_conn_new(pool, r);
+    fio_unlock(&pool->lock);
+    return http_pool_connect(c);
+  } else if (pool->pipeline > 1) {
+    /* pipeline the request on the least busy connection */
+    FIO_LS_EMBD_FOR(&pool->busy, pos) {
+      http_pool_conn_s *tmp = FIO_LS_EMBD_OBJ(http_pool_conn_s, node, pos);
+      if (tmp->ready && tmp->reuse && tmp->assigned < pool->pipeline &&
+          (!c || tmp->assigned < c->assigned))
+        c = tmp;
+    }
+  }
+  if (!c) {
+    fio_ls_embd_push(&pool->waiting, &r->node);
+    fio_unlock(&pool->lock);
+    return 0;
+  }
+  ++c->assigned;
+  intptr_t uuid = c->uuid;
+  fio_unlock(&pool->lock);
+  fio_defer_io_task(uuid, .task = http_pool_send, .udata = r,
+                    .fallback = http_pool_resend);
+  return uuid;
+}
+
+static intptr_t http_pool_request(char *address, char *port,
+                                  http_settings_s *settings, http_s *h) {
+  http_pool_req_s *r = fio_malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  *r = (http_pool_req_s){
+      .pool = http_pool_get(settings->tls, address, port),
+      .settings = settings,
+      .h = h,
+      .on_response = settings->on_response,
+  };
+  settings->on_response = http_pool_on_response;
+  settings->on_upgrade = http_pool_on_upgrade;
+  settings->udata = h->udata;
+  fio_lock(&r->pool->lock);
+  r->pool->limit = settings->pool_limit;
+  r->pool->pipeline = settings->pool_pipeline;
+  r->pool->timeout = settings->pool_timeout;
+  fio_unlock(&r->pool->lock);
+  return http_pool_dispatch(r);
+}
+
 intptr_t http_connect__(void); /* sublime text marker */
 /**
  * Connects to an HTTP server as a client.
@@ -1131,17 +1775,25 @@ intptr_t http_connect FIO_IGNORE_MACRO(const char *url,
     http_set_header2(h, (fio_str_info_s){.data = (char *)"host", .len = 4},
                      (fio_str_info_s){.data = host, .len = h_len});
   intptr_t ret;
-  if (is_websocket) {
+  if (settings->pool_limit && !is_websocket) {
+    if (!settings->pool_pipeline)
+      settings->pool_pipeline = 1;
+    if (!settings->pool_timeout)
+      settings->pool_timeout = 4;
+    ret = http_pool_request(a, p, settings, h);
+  } else if (is_websocket) {
     /* force HTTP/1.1 */
     ret = fio_connect(.address = a, .port = p, .on_fail = http_on_client_failed,
                       .on_connect = http_on_open_client, .udata = settings,
-                      .tls = arg_settings.tls);
+                      .tls = arg_settings.tls,
+                      .fastopen = (arg_settings.fastopen != 0));
     (void)0;
   } else {
     /* Allow for any HTTP version */
     ret = fio_connect(.address = a, .port = p, .on_fail = http_on_client_failed,
                       .on_connect = http_on_open_client, .udata = settings,
-                      .tls = arg_settings.tls);
+                      .tls = arg_settings.tls,
+                      .fastopen = (arg_settings.fastopen != 0));
     (void)0;
   }
   if (a != unix_address)
@@ -1458,6 +2110,7 @@ static inline FIOBJ http_str2fiobj(char *s, size_t len, uint8_t encoded) {
 void http_parse_query(http_s *h) {
   if (!h->query)
     return;
+  fiobj_arena_s *old_arena = fiobj_arena_use(http_arena(h));
   if (!h->params)
     h->params = fiobj_hash_new();
   fio_str_info_s q = fiobj_obj2cstr(h->query);
@@ -1481,6 +2134,7 @@ void http_parse_query(http_s *h) {
     q.len -= (uintptr_t)(cut - q.data);
     q.data = cut;
   } while (q.len);
+  fiobj_arena_use(old_arena);
 }
 
 static inline void http_parse_cookies_cookie_str(FIOBJ dest, FIOBJ str,
@@ -1536,6 +2190,7 @@ void http_parse_cookies(http_s *h, uint8_t is_url_encoded) {
   static uint64_t setcookie_header_hash;
   if (!setcookie_header_hash)
     setcookie_header_hash = fiobj_obj2hash(HTTP_HEADER_SET_COOKIE);
+  fiobj_arena_s *old_arena = fiobj_arena_use(http_arena(h));
   FIOBJ c = fiobj_hash_get2(h->headers, fiobj_obj2hash(HTTP_HEADER_COOKIE));
   if (c) {
     if (!h->cookies)
@@ -1568,6 +2223,7 @@ void http_parse_cookies(http_s *h, uint8_t is_url_encoded) {
       http_parse_cookies_setcookie_str(h->cookies, c, is_url_encoded);
     }
   }
+  fiobj_arena_use(old_arena);
 }
 
 /**
@@ -1908,15 +2564,7 @@ static inline size_t http_mime_decode_url(char *dest, const char *encoded,
   return http_decode_url(dest, encoded, length);
 }
 
-/**
- * Attempts to decode the request's body.
- *
- * Supported Types include:
- * * application/x-www-form-urlencoded
- * * application/json
- * * multipart/form-data
- */
-int http_parse_body(http_s *h) {
+static int http_parse_body_task(http_s *h) {
   static uint64_t content_type_hash;
   if (!h->body)
     return -1;
@@ -1970,6 +2618,21 @@ int http_parse_body(http_s *h) {
   return 0;
 }
 
+/**
+ * Attempts to decode the request's body.
+ *
+ * Supported Types include:
+ * * application/x-www-form-urlencoded
+ * * application/json
+ * * multipart/form-data
+ */
+int http_parse_body(http_s *h) {
+  fiobj_arena_s *old_arena = fiobj_arena_use(http_arena(h));
+  int ret = http_parse_body_task(h);
+  fiobj_arena_use(old_arena);
+  return ret;
+}
+
 /* *****************************************************************************
 HTTP Helper functions that could be used globally
 ***************************************************************************** */
@@ -2023,63 +2686,321 @@ FIOBJ http_req2str(http_s *h) {
   return w.dest;
 }
 
+/* *****************************************************************************
+Asynchronous logging (a lock free ring buffer)
+***************************************************************************** */
+
+/*
+ * Request threads copy log lines to the ring buffer's slots and a deferred task
+ * writes them to `stderr` in batches, so request threads never wait for
+ * `stderr`.
+ *
+ * A slot's `lap` is even when the slot is free for the writer of that lap and
+ * odd when it holds a line for the reader of that lap, so the zeroed ring is
+ * ready for use.
+ */
+
+#define HTTP_LOG_LINE_MAX (512 - (2 * sizeof(size_t)))
+
+typedef struct {
+  volatile size_t lap;
+  size_t len;
+  char line[HTTP_LOG_LINE_MAX];
+} http_log_slot_s;
+
+static struct {
+  http_log_slot_s slots[HTTP_LOG_RING_SLOTS];
+  volatile size_t head; /* the next slot to write to */
+  size_t tail;          /* the next slot to read from (protected by `lock`) */
+  volatile size_t dropped;
+  volatile uint8_t scheduled;
+  fio_lock_i lock;
+} http_log_ring;
+
+static void http_log_flush_task(void *ignr1_, void *ignr2_) {
+  http_log_flush______internal(NULL);
+  (void)ignr1_;
+  (void)ignr2_;
+}
+
+/** Writes the pending log lines to `stderr`. */
+void http_log_flush______internal(void *ignr_) {
+  char buf[8192];
+  size_t len = 0;
+again:
+  /* a busy writer checks `scheduled` once it's done, so we leave it set */
+  if (fio_trylock(&http_log_ring.lock))
+    return;
+  fio_atomic_xchange(&http_log_ring.scheduled, 0);
+  for (;;) {
+    const size_t pos = http_log_ring.tail;
+    http_log_slot_s *slot =
+        http_log_ring.slots + (pos & (HTTP_LOG_RING_SLOTS - 1));
+    const size_t lap = (pos / HTTP_LOG_RING_SLOTS) * 2;
+    if (__atomic_load_n(&slot->lap, __ATOMIC_ACQUIRE) != lap + 1)
+      break;
+    if (len + slot->len > sizeof(buf)) {
+      fwrite(buf, 1, len, stderr);
+      len = 0;
+    }
+    memcpy(buf + len, slot->line, slot->len);
+    len += slot->len;
+    __atomic_store_n(&slot->lap, lap + 2, __ATOMIC_RELEASE);
+    http_log_ring.tail = pos + 1;
+  }
+  if (len)
+    fwrite(buf, 1, len, stderr);
+  len = 0;
+  size_t dropped = fio_atomic_xchange(&http_log_ring.dropped, 0);
+  if (dropped)
+    FIO_LOG_WARNING("%zu HTTP log lines were dropped (the log buffer was full)",
+                    dropped);
+  fio_unlock(&http_log_ring.lock);
+  /* lines pushed while we were writing might have missed the lock */
+  if (__atomic_load_n(&http_log_ring.scheduled, __ATOMIC_SEQ_CST))
+    goto again;
+  (void)ignr_;
+}
+
+/** Pushes a log line to the ring buffer (long lines are truncated). */
+static void http_log_push(const char *line, size_t len) {
+  size_t pos = http_log_ring.head;
+  http_log_slot_s *slot;
+  for (;;) {
+    slot = http_log_ring.slots + (pos & (HTTP_LOG_RING_SLOTS - 1));
+    const size_t lap = (pos / HTTP_LOG_RING_SLOTS) * 2;
+    const size_t slot_lap = __atomic_load_n(&slot->lap, __ATOMIC_ACQUIRE);
+    if (slot_lap == lap) {
+      if (__sync_bool_compare_and_swap(&http_log_ring.head, pos, pos + 1))
+        break;
+    } else if (slot_lap < lap) {
+      /* the slot wasn't read since the previous lap, the ring is full */
+      fio_atomic_add(&http_log_ring.dropped, 1);
+      goto schedule;
+    }
+    pos = http_log_ring.head;
+  }
+  if (len > HTTP_LOG_LINE_MAX) {
+    len = HTTP_LOG_LINE_MAX;
+    memcpy(slot->line + len - 5, "...\r\n", 5);
+    memcpy(slot->line, line, len - 5);
+  } else {
+    memcpy(slot->line, line, len);
+  }
+  slot->len = len;
+  __atomic_store_n(&slot->lap, ((pos / HTTP_LOG_RING_SLOTS) * 2) + 1,
+                   __ATOMIC_RELEASE);
+schedule:
+  if (fio_atomic_xchange(&http_log_ring.scheduled, 1))
+    return;
+  if (fio_is_running())
+    fio_defer(http_log_flush_task, NULL, NULL);
+  else
+    http_log_flush______internal(NULL);
+}
+
+/** Appends up to `len` bytes to the log line buffer. */
+static inline void http_log_write(char *dest, size_t *pos, size_t limit,
+                                  const char *src, size_t len) {
+  if (*pos + len > limit)
+    len = limit - *pos;
+  memcpy(dest + *pos, src, len);
+  *pos += len;
+}
+
+static inline void http_log_write_obj(char *dest, size_t *pos, size_t limit,
+                                      FIOBJ o) {
+  fio_str_info_s s = fiobj_obj2cstr(o);
+  http_log_write(dest, pos, limit, s.data, s.len);
+}
+
 void http_write_log(http_s *h) {
-  FIOBJ l = fiobj_str_buf(128);
+  char line[HTTP_LOG_LINE_MAX];
+  const size_t limit = sizeof(line) - 64; /* room for status, size and time */
+  size_t len = 0;
 
   intptr_t bytes_sent = fiobj_obj2num(fiobj_hash_get2(
       h->private_data.out_headers, fiobj_obj2hash(HTTP_HEADER_CONTENT_LENGTH)));
-
-  struct timespec start, end;
-  clock_gettime(CLOCK_REALTIME, &end);
-  start = h->received_at;
+  /* the elapsed time is recorded when the response is written */
+  uint32_t elapsed = http2protocol(h)->marks[HTTP_MARK_FLUSHED];
+  if (!elapsed)
+    elapsed = http_elapsed_us(h);
 
   {
     // TODO Guess IP address from headers (forwarded) where possible
     fio_str_info_s peer = fio_peer_addr(http2protocol(h)->uuid);
-    fiobj_str_write(l, peer.data, peer.len);
+    if (peer.len)
+      http_log_write(line, &len, limit, peer.data, peer.len);
+    else
+      http_log_write(line, &len, limit, "[unknown]", 9);
+  }
+  http_log_write(line, &len, limit, " - - [", 6);
+  len += http_time2str(line + len, fio_last_tick().tv_sec);
+  http_log_write(line, &len, limit, "] \"", 3);
+  http_log_write_obj(line, &len, limit, h->method);
+  http_log_write(line, &len, limit, " ", 1);
+  http_log_write_obj(line, &len, limit, h->path);
+  http_log_write(line, &len, limit, " ", 1);
+  http_log_write_obj(line, &len, limit, h->version);
+  http_log_write(line, &len, limit, "\" ", 2);
+  len += fio_ltoa(line + len, h->status, 10);
+  if (bytes_sent > 0) {
+    line[len++] = ' ';
+    len += fio_ltoa(line + len, bytes_sent, 10);
+    line[len++] = 'b';
+    line[len++] = ' ';
+  } else {
+    memcpy(line + len, " -- ", 4);
+    len += 4;
   }
-  fio_str_info_s buff = fiobj_obj2cstr(l);
+  len += fio_ltoa(line + len, elapsed / 1000, 10);
+  memcpy(line + len, "ms\r\n", 4);
+  len += 4;
+  http_log_push(line, len);
+}
+
+/* *****************************************************************************
+Request latency histograms and slow request tracing
+***************************************************************************** */
 
-  if (buff.len == 0) {
-    memcpy(buff.data, "[unknown]", 9);
-    buff.len = 9;
+#ifndef HTTP_LATENCY_SHARDS
+/** The number of histogram sets (threads share a set when there are more). */
+#define HTTP_LATENCY_SHARDS 8
+#endif
+
+/* status classes 1xx-5xx, other status codes are counted at index 0 */
+#define HTTP_LATENCY_CLASSES 6
+
+/*
+ * Each thread records requests to its own set of histograms, so the atomic
+ * operations are uncontended unless there are more threads than sets.
+ */
+static http_latency_s http_latency_shards[HTTP_LATENCY_SHARDS]
+                                         [HTTP_LATENCY_CLASSES]
+    __attribute__((aligned(64)));
+static size_t http_latency_shard_counter;
+static __thread http_latency_s *http_latency_local;
+
+/** Returns a latency's bucket index. */
+static inline size_t http_latency_bucket(uint32_t us) {
+  if (us < 8)
+    return us;
+  const size_t e = 31 - __builtin_clz(us); /* us >= 2^e */
+  return ((e - 2) << 3) + ((us >> (e - 3)) & 7);
+}
+
+/** Returns the largest latency (microseconds) counted by the bucket. */
+uint64_t http_latency_bucket_limit(size_t index) {
+  if (index < 8)
+    return index;
+  if (index >= HTTP_LATENCY_BUCKETS)
+    return 0xFFFFFFFF;
+  const size_t shift = (index >> 3) - 1; /* e - 3 */
+  return (((uint64_t)8 + (index & 7) + 1) << shift) - 1;
+}
+
+/** Records a request's latency. */
+static void http_latency_record(uintptr_t status, uint32_t us) {
+  if (!http_latency_local) {
+    const size_t i = fio_atomic_add(&http_latency_shard_counter, 1);
+    http_latency_local = http_latency_shards[i & (HTTP_LATENCY_SHARDS - 1)];
+  }
+  http_latency_s *l = http_latency_local + (status < 600 ? (status / 100) : 0);
+  fio_atomic_add(&l->count, 1);
+  fio_atomic_add(&l->sum_us, us);
+  fio_atomic_add(&l->buckets[http_latency_bucket(us)], 1);
+  if (l->max_us < us)
+    l->max_us = us; /* a rare write, a lost race is harmless */
+}
+
+void http_latency_collect(http_latency_s *dest, uint8_t status_class) {
+  if (!dest || status_class >= HTTP_LATENCY_CLASSES)
+    return;
+  for (size_t i = 0; i < HTTP_LATENCY_SHARDS; ++i) {
+    for (size_t c = 0; c < HTTP_LATENCY_CLASSES; ++c) {
+      if (status_class && c != status_class)
+        continue;
+      const http_latency_s *src = &http_latency_shards[i][c];
+      dest->count += src->count;
+      dest->sum_us += src->sum_us;
+      if (dest->max_us < src->max_us)
+        dest->max_us = src->max_us;
+      for (size_t b = 0; b < HTTP_LATENCY_BUCKETS; ++b)
+        dest->buckets[b] += src->buckets[b];
+    }
   }
-  memcpy(buff.data + buff.len, " - - [", 6);
-  buff.len += 6;
-  fiobj_str_resize(l, buff.len);
-  {
-    FIOBJ date;
-    fio_lock(&date_lock);
-    date = fiobj_dup(current_date);
-    fio_unlock(&date_lock);
-    fiobj_str_join(l, current_date);
-    fiobj_free(date);
-  }
-  fiobj_str_write(l, "] \"", 3);
-  fiobj_str_join(l, h->method);
-  fiobj_str_write(l, " ", 1);
-  fiobj_str_join(l, h->path);
-  fiobj_str_write(l, " ", 1);
-  fiobj_str_join(l, h->version);
-  fiobj_str_write(l, "\" ", 2);
-  if (bytes_sent > 0) {
-    fiobj_str_write_i(l, h->status);
-    fiobj_str_write(l, " ", 1);
-    fiobj_str_write_i(l, bytes_sent);
-    fiobj_str_write(l, "b ", 2);
-  } else {
-    fiobj_str_join(l, fiobj_num_tmp(h->status));
-    fiobj_str_write(l, " -- ", 4);
+}
+
+uint64_t http_latency_percentile(const http_latency_s *h, double fraction) {
+  if (!h || !h->count)
+    return 0;
+  uint64_t rank = (uint64_t)(fraction * (double)h->count + 0.5);
+  if (!rank)
+    rank = 1;
+  uint64_t seen = 0;
+  for (size_t b = 0; b < HTTP_LATENCY_BUCKETS; ++b) {
+    seen += h->buckets[b];
+    if (seen >= rank) {
+      const uint64_t limit = http_latency_bucket_limit(b);
+      return (limit < h->max_us ? limit : h->max_us);
+    }
   }
+  return h->max_us;
+}
+
+/* slow request reports are rate limited (per second) */
+static time_t http_slow_window;
+static size_t http_slow_count;
+static size_t http_slow_suppressed;
 
-  bytes_sent = ((end.tv_sec - start.tv_sec) * 1000) +
-               ((end.tv_nsec - start.tv_nsec) / 1000000);
-  fiobj_str_write_i(l, bytes_sent);
-  fiobj_str_write(l, "ms\r\n", 4);
+static void http_slow_request_log(http_s *h, uint32_t elapsed) {
+  const time_t now = fio_last_tick().tv_sec;
+  if (http_slow_window != now) {
+    http_slow_window = now;
+    http_slow_count = 0; /* a lost race allows a few more reports */
+  }
+  if (fio_atomic_add(&http_slow_count, 1) > HTTP_SLOW_REQUEST_LOG_LIMIT) {
+    fio_atomic_add(&http_slow_suppressed, 1);
+    return;
+  }
+  char marks[4][16];
+  for (size_t i = 0; i < 4; ++i) {
+    if (http2protocol(h)->marks[i])
+      snprintf(marks[i], sizeof(marks[i]), "%.3fms",
+               (double)http2protocol(h)->marks[i] / 1000.0);
+    else
+      memcpy(marks[i], "-", 2);
+  }
+  fio_str_info_s method = fiobj_obj2cstr(h->method);
+  fio_str_info_s path = fiobj_obj2cstr(h->path);
+  char line[HTTP_LOG_LINE_MAX];
+  int len = snprintf(line, sizeof(line),
+                     "SLOW REQUEST: %.*s %.*s %d %.3fms (parsed %s, handled %s"
+                     ", headers %s, flushed %s, %zu packets queued",
+                     (int)method.len, method.data, (int)path.len, path.data,
+                     (int)h->status, (double)elapsed / 1000.0, marks[0],
+                     marks[1], marks[2], marks[3],
+                     fio_pending(http2protocol(h)->uuid));
+  size_t suppressed = fio_atomic_xchange(&http_slow_suppressed, 0);
+  if (suppressed && len > 0 && (size_t)len < sizeof(line))
+    len += snprintf(line + len, sizeof(line) - len, ", %zu more suppressed",
+                    suppressed);
+  if (len < 0)
+    return;
+  if ((size_t)len > sizeof(line) - 4)
+    len = sizeof(line) - 4;
+  memcpy(line + len, ")\r\n", 3);
+  http_log_push(line, len + 3);
+}
 
-  buff = fiobj_obj2cstr(l);
-  fwrite(buff.data, 1, buff.len, stderr);
-  fiobj_free(l);
+void http_on_finish______internal(http_s *h, http_settings_s *settings) {
+  if (!h->status || h->status_str || !h->method)
+    return;
+  const uint32_t elapsed = http_elapsed_us(h);
+  http2protocol(h)->marks[HTTP_MARK_FLUSHED] = elapsed;
+  http_latency_record(h->status, elapsed);
+  if (settings->slow_request && elapsed >= settings->slow_request * 1000ULL)
+    http_slow_request_log(h, elapsed);
 }
 
 /**
@@ -2472,6 +3393,7 @@ Lookup Tables / functions
 #define FIO_SET_OBJ_COMPARE(o1, o2) (1)
 #define FIO_SET_OBJ_COPY(dest, o) (dest) = fiobj_dup((o))
 #define FIO_SET_OBJ_DESTROY(o) fiobj_free((o))
+#define FIO_SET_SWISS 1
 
 #include <fio.h>
 
@@ -2690,5 +3612,12 @@ void http_tests(void) {
   FIO_ASSERT(html_mime,
              "HTML mime-type not found! Mime-Type registry invalid!\n");
   fiobj_free(html_mime);
+  FIO_ASSERT(http_header_name_find("content-type", 12) ==
+                     HTTP_HEADER_CONTENT_TYPE &&
+                 http_header_name_find("te", 2) &&
+                 http_header_name_find("x-requested-with", 16) &&
+                 !http_header_name_find("content-typo", 12) &&
+                 !http_header_name_find("x-custom", 8),
+             "interned header name lookup error!\n");
 }
 #endif
@@ -42,6 +42,14 @@ Compile Time Settings
 #define HTTP_MAX_HEADER_LENGTH 8192
 #endif
 
+#ifndef HTTP_STREAM_PENDING_LIMIT
+/**
+ * The number of chunks `http_stream` allows in the connection's queue before
+ * asking the caller to wait for the client to read the data.
+ */
+#define HTTP_STREAM_PENDING_LIMIT 8
+#endif
+
 #ifndef FIO_HTTP_EXACT_LOGGING
 /**
  * By default, facil.io logs the HTTP request cycle using a fuzzy starting point
@@ -58,6 +66,21 @@ Compile Time Settings
 #define FIO_HTTP_EXACT_LOGGING 0
 #endif
 
+#ifndef HTTP_LOG_RING_SLOTS
+/**
+ * The number of log lines the logging ring buffer holds (a power of 2).
+ *
+ * Log lines are written to `stderr` by a deferred task. Lines are dropped (and
+ * the number of dropped lines is reported) while the ring buffer is full.
+ */
+#define HTTP_LOG_RING_SLOTS 512
+#endif
+
+#ifndef HTTP_SLOW_REQUEST_LOG_LIMIT
+/** The maximum number of slow request reports logged per second. */
+#define HTTP_SLOW_REQUEST_LOG_LIMIT 16
+#endif
+
 /** the `http_listen settings, see details in the struct definition. */
 typedef struct http_settings_s http_settings_s;
 
@@ -207,6 +230,45 @@ int http_send_body(http_s *h, void *data, uintptr_t length);
  */
 int http_sendfile(http_s *h, int fd, uintptr_t length, uintptr_t offset);
 
+/**
+ * Sends the response headers (on the first call) and a chunk of the response's
+ * body, allowing the body to be sent in chunks as it's produced.
+ *
+ * HTTP/1.1 responses use chunked encoding (any `content-length` header is
+ * removed), older clients are sent the body until the connection is closed.
+ *
+ * This function never waits for the client. Once a few chunks are waiting in
+ * the connection's queue (see `HTTP_STREAM_PENDING_LIMIT`), it returns 1, so
+ * the caller can stop producing data until the client reads the data (i.e.,
+ * using `http_pause` and `fio_defer_on_drain`) and slow clients don't cause the
+ * whole body to be buffered.
+ *
+ * **Note**: The data is *copied* to the HTTP stream and it's memory should be
+ * freed by the calling function.
+ *
+ * The response MUST be completed using `http_finish` (or `http_send_body`),
+ * even if an error occurred.
+ *
+ * Returns -1 on error (i.e., the connection was lost), 1 if the client is
+ * falling behind and 0 otherwise.
+ */
+int http_stream(http_s *h, void *data, uintptr_t length);
+
+/**
+ * Renders a Mustache template (see `fiobj_mustache_new`) using the information
+ * in the `data` object, streaming the rendered output as the response's body
+ * (see `http_stream`) and completing the response.
+ *
+ * While the client is falling behind, the handle is paused (see `http_pause`)
+ * and the render is resumed once the client read the data, so the thread isn't
+ * blocked. The template may be freed once this function returns.
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_mustache(http_s *h, mustache_s *mustache, FIOBJ data);
+
 /**
  * Sends the response headers and the specified file (the response's body).
  *
@@ -236,6 +298,25 @@ int http_sendfile2(http_s *h, const char *prefix, size_t prefix_len,
  */
 int http_send_error(http_s *h, size_t error_code);
 
+/**
+ * Sends the reactor metrics of all the processes (see `fio_metrics_cluster`)
+ * using the Prometheus text format, i.e.:
+ *
+ *      fio_str_info_s path = fiobj_obj2cstr(h->path);
+ *      if (path.len == 8 && !memcmp(path.data, "/metrics", 8)) {
+ *        http_send_metrics(h);
+ *        return;
+ *      }
+ *
+ * The metrics are followed by a summary of the request latencies recorded by
+ * the responding process (see `http_latency_collect`).
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_metrics(http_s *h);
+
 /**
  * Sends the response headers for a header only response.
  *
@@ -403,6 +484,66 @@ struct http_settings_s {
   uint8_t log;
   /** a read only flag set automatically to indicate the protocol's mode. */
   uint8_t is_client;
+  /**
+   * Set to TRUE to spread new connections across the worker threads (see
+   * `fio_listen`'s `spread_accept`).
+   */
+  uint8_t spread_accept;
+  /**
+   * TCP_DEFER_ACCEPT (Linux): accept connections only once the request arrives
+   * or after `defer_accept` seconds (see `fio_listen`). Defaults to 0 (off).
+   */
+  uint8_t defer_accept;
+  /**
+   * `http_listen`: the TCP Fast Open queue length (defaults to 128).
+   *
+   * `http_connect`: set to TRUE to use TCP Fast Open (Linux), sending the
+   * request along with the SYN once the server's cookie is cached.
+   */
+  uint16_t fastopen;
+  /**
+   * SO_BUSY_POLL (Linux): microseconds to busy poll the network device when
+   * reading from an empty socket (see `fio_listen`). Defaults to 0.
+   */
+  uint16_t busy_poll;
+  /**
+   * `http_connect`: the maximum number of connections per host kept by the
+   * client's connection pool.
+   *
+   * Pooled connections are kept alive once a response was handled and reused
+   * by later `http_connect` calls to the same host (and `tls` object).
+   * Requests wait for a connection when all of the host's connections are busy.
+   *
+   * Defaults to 0 (a new connection per `http_connect` call).
+   */
+  uint16_t pool_limit;
+  /**
+   * `http_connect`: the number of requests that might be pipelined on a pooled
+   * connection (when all of the host's connections are busy).
+   *
+   * Pipelined requests must be sent (`http_finish`) before the first
+   * `on_response` call returns.
+   *
+   * Defaults to 1 (no pipelining).
+   */
+  uint8_t pool_pipeline;
+  /**
+   * `http_connect`: the number of seconds an idle pooled connection is kept
+   * alive. Defaults to 4 seconds (shorter than common server timeouts).
+   */
+  uint8_t pool_timeout;
+  /**
+   * The slow request threshold in milliseconds. Defaults to 0 (off).
+   *
+   * When set, the request cycle's timing is traced and requests that took
+   * longer than the threshold are logged (even if `log` is off), detailing
+   * when the request was parsed, when the response was handed to the HTTP
+   * layer, when the response headers were serialized and when the response
+   * was written to the connection's queue.
+   *
+   * Up to `HTTP_SLOW_REQUEST_LOG_LIMIT` slow requests are logged per second.
+   */
+  uint32_t slow_request;
 };
 
 /**
@@ -443,7 +584,13 @@ intptr_t http_listen(const char *port, const char *binding,
  * signature. However, it would be better to use the `websocket_connect`
  * function instead.
  *
- * Returns -1 on error and the socket's uuid on success.
+ * When `pool_limit` is set, the connection is returned to the host's pool
+ * once the response was handled (unless the server asked to close it) and the
+ * `on_finish` callback is called. Pooled responses must be handled within the
+ * `on_response` callback (no `http_pause` or `http_hijack`).
+ *
+ * Returns -1 on error and the socket's uuid on success (0 if a pooled request
+ * is waiting for a connection).
  *
  * The `on_finish` callback is always called.
  */
@@ -874,6 +1021,7 @@ extern FIOBJ HTTP_HEADER_HOST;
 extern FIOBJ HTTP_HEADER_LAST_MODIFIED;
 extern FIOBJ HTTP_HEADER_ORIGIN;
 extern FIOBJ HTTP_HEADER_SET_COOKIE;
+extern FIOBJ HTTP_HEADER_TRANSFER_ENCODING;
 extern FIOBJ HTTP_HEADER_UPGRADE;
 
 /* *****************************************************************************
@@ -892,6 +1040,57 @@ FIOBJ http_req2str(http_s *h);
  * This function is called automatically if the `.log` setting is enabled.
  */
 void http_write_log(http_s *h);
+
+/* *****************************************************************************
+HTTP request latency histograms
+***************************************************************************** */
+
+/**
+ * The number of buckets in a latency histogram.
+ *
+ * Latencies are measured in microseconds. Buckets 0-7 count exact values, then
+ * every power of 2 is split into 8 buckets (a ~12.5% resolution) up to 2^32
+ * microseconds (~71 minutes).
+ */
+#define HTTP_LATENCY_BUCKETS 240
+
+/** A request latency histogram (see `http_latency_collect`). */
+typedef struct {
+  /** The number of requests. */
+  uint64_t count;
+  /** The sum of the request latencies (microseconds). */
+  uint64_t sum_us;
+  /** The longest request latency (microseconds). */
+  uint64_t max_us;
+  /** Request counts (see `http_latency_bucket_limit`). */
+  uint64_t buckets[HTTP_LATENCY_BUCKETS];
+} http_latency_s;
+
+/**
+ * Adds the request latencies recorded by the calling process (all threads) to
+ * `dest`.
+ *
+ * The latency is the time between the request's first line and the response
+ * being written to the connection's queue.
+ *
+ * `status_class` selects the response status class (1 for 1xx ... 5 for 5xx).
+ * 0 collects all requests.
+ *
+ * Each thread records requests to its own histograms, so recording a request
+ * is lock free. Histograms are only merged when collected.
+ */
+void http_latency_collect(http_latency_s *dest, uint8_t status_class);
+
+/**
+ * Returns the latency (microseconds) below which the requested fraction of the
+ * requests fall (i.e., 0.99 for the 99th percentile).
+ *
+ * The result is the upper limit of the bucket the percentile falls in.
+ */
+uint64_t http_latency_percentile(const http_latency_s *h, double fraction);
+
+/** Returns the largest latency (microseconds) counted by the bucket. */
+uint64_t http_latency_bucket_limit(size_t index);
 /* *****************************************************************************
 HTTP Time related helper functions that could be used globally
 ***************************************************************************** */
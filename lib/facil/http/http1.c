@@ -28,6 +28,7 @@ typedef struct http1pr_s {
   uint8_t close;
   uint8_t is_client;
   uint8_t stop;
+  uint8_t stream;
   uint8_t buf[];
 } http1pr_s;
 
@@ -51,6 +52,9 @@ static fio_str_info_s http1pr_status2str(uintptr_t status);
 static inline void http1_after_finish(http_s *h) {
   http1pr_s *p = handle2pr(h);
   p->stop = p->stop & (~1UL);
+  p->stream = 0;
+  if (!p->is_client)
+    http_on_finish______internal(h, p->p.settings);
   if (h != &p->request) {
     http_s_destroy(h, 0);
     fio_free(h);
@@ -103,6 +107,7 @@ static FIOBJ headers2str(http_s *h, uintptr_t padding) {
   if (!connection_hash)
     connection_hash = fiobj_hash_string("connection", 10);
 
+  http_mark(h, HTTP_MARK_HANDLED);
   struct header_writer_s w;
   {
     const uintptr_t header_length_guess =
@@ -170,12 +175,21 @@ static FIOBJ headers2str(http_s *h, uintptr_t padding) {
 
   fiobj_each1(h->private_data.out_headers, 0, write_header, &w);
   fiobj_str_write(w.dest, "\r\n", 2);
+  http_mark(h, HTTP_MARK_HEADERS);
   return w.dest;
 }
 
+static int http1_stream(http_s *h, void *data, uintptr_t length);
+static void htt1p_finish(http_s *h);
+
 /** Should send existing headers and data */
 static int http1_send_body(http_s *h, void *data, uintptr_t length) {
-
+  if (handle2pr(h)->stream) {
+    /* the response is being streamed, send the data as the last chunk */
+    int ret = http1_stream(h, data, length);
+    htt1p_finish(h);
+    return ret == -1 ? -1 : 0;
+  }
   FIOBJ packet = headers2str(h, length);
   if (!packet) {
     http1_after_finish(h);
@@ -219,8 +233,63 @@ static int http1_sendfile(http_s *h, int fd, uintptr_t length,
   return 0;
 }
 
+/** Should send existing headers and data and prepare for streaming */
+static int http1_stream(http_s *h, void *data, uintptr_t length) {
+  http1pr_s *p = handle2pr(h);
+  FIOBJ packet;
+  if (!p->stream) {
+    if (p->is_client)
+      return -1;
+    /* HTTP/1.1 clients get chunked encoding, others read until EOF */
+    fiobj_hash_delete(h->private_data.out_headers, HTTP_HEADER_CONTENT_LENGTH);
+    fio_str_info_s t = fiobj_obj2cstr(h->version);
+    if (t.len > 7 && t.data && t.data[5] == '1' && t.data[6] == '.' &&
+        t.data[7] == '1') {
+      fiobj_hash_set(h->private_data.out_headers,
+                     HTTP_HEADER_TRANSFER_ENCODING,
+                     fiobj_dup(HTTP_HVALUE_CHUNKED));
+      p->stream = 1;
+    } else {
+      fiobj_hash_set(h->private_data.out_headers, HTTP_HEADER_CONNECTION,
+                     fiobj_dup(HTTP_HVALUE_CLOSE));
+      p->stream = 2;
+    }
+    packet = headers2str(h, length + 24);
+    if (!packet) {
+      p->stream = 0;
+      return -1;
+    }
+  } else {
+    packet = fiobj_str_buf(length + 24);
+  }
+  if (p->stream == 1) {
+    char hex[24];
+    /* `fio_ltoa` prefixes hex with "0x", which chunk sizes don't allow */
+    size_t hex_len = fio_ltoa(hex, (int64_t)length, 16);
+    hex[hex_len++] = '\r';
+    hex[hex_len++] = '\n';
+    fiobj_str_write(packet, hex + 2, hex_len - 2);
+    fiobj_str_write(packet, data, length);
+    fiobj_str_write(packet, "\r\n", 2);
+  } else {
+    fiobj_str_write(packet, data, length);
+  }
+  if (fiobj_send_free(p->p.uuid, packet) == -1)
+    return -1;
+  /* let the caller know the client is falling behind */
+  return fio_pending(p->p.uuid) > HTTP_STREAM_PENDING_LIMIT;
+}
+
 /** Should send existing headers or complete streaming */
 static void htt1p_finish(http_s *h) {
+  http1pr_s *p = handle2pr(h);
+  if (p->stream) {
+    /* the headers were sent, terminate the chunked body */
+    if (p->stream == 1)
+      fio_write(p->p.uuid, "0\r\n\r\n", 5);
+    http1_after_finish(h);
+    return;
+  }
   FIOBJ packet = headers2str(h, 0);
   if (packet)
     fiobj_send_free((handle2pr(h)->p.uuid), packet);
@@ -529,6 +598,7 @@ Virtual Table Decleration
 struct http_vtable_s HTTP1_VTABLE = {
     .http_send_body = http1_send_body,
     .http_sendfile = http1_sendfile,
+    .http_stream = http1_stream,
     .http_finish = htt1p_finish,
     .http_push_data = http1_push_data,
     .http_push_file = http1_push_file,
@@ -550,18 +620,25 @@ Parser Callbacks
 /** called when a request was received. */
 static int http1_on_request(http1_parser_s *parser) {
   http1pr_s *p = parser2http(parser);
+  /* objects created by the handler aren't allocated from the request arena */
+  fiobj_arena_use(NULL);
+  http_mark(&http1_pr2handle(p), HTTP_MARK_PARSED);
   http_on_request_handler______internal(&http1_pr2handle(p), p->p.settings);
   if (p->request.method && !p->stop)
     http_finish(&p->request);
+  /* `http_finish` might have replaced the arena */
+  fiobj_arena_use(p->p.arena);
   h1_reset(p);
   return fio_is_closed(p->p.uuid);
 }
 /** called when a response was received. */
 static int http1_on_response(http1_parser_s *parser) {
   http1pr_s *p = parser2http(parser);
+  fiobj_arena_use(NULL);
   http_on_response_handler______internal(&http1_pr2handle(p), p->p.settings);
   if (p->request.status_str && !p->stop)
     http_finish(&p->request);
+  fiobj_arena_use(p->p.arena);
   h1_reset(p);
   return fio_is_closed(p->p.uuid);
 }
@@ -635,7 +712,10 @@ static int http1_on_header(http1_parser_s *parser, char *name, size_t name_len,
     http_send_error(&http1_pr2handle(parser2http(parser)), 413);
     return -1;
   }
-  sym = fiobj_str_new(name, name_len);
+  /* common header names are interned (no allocation, no hashing) */
+  sym = http_header_name_find(name, name_len);
+  if (!sym)
+    sym = fiobj_str_new(name, name_len);
   obj = fiobj_str_new(data, data_len);
   set_header_add(http1_pr2handle(parser2http(parser)).headers, sym, obj);
   fiobj_free(sym);
@@ -685,11 +765,14 @@ static inline void http1_consume_data(intptr_t uuid, http1pr_s *p) {
   int pipeline_limit = 8;
   if (!p->buf_len)
     return;
+  /* the parsed request data is allocated from the request's arena */
+  fiobj_arena_s *old_arena = fiobj_arena_use(p->p.arena);
   do {
     i = http1_parse(&p->parser, p->buf + (org_len - p->buf_len), p->buf_len);
     p->buf_len -= i;
     --pipeline_limit;
   } while (i && p->buf_len && pipeline_limit && !p->stop);
+  fiobj_arena_use(old_arena);
 
   if (p->buf_len && org_len != p->buf_len) {
     memmove(p->buf, p->buf + (org_len - p->buf_len), p->buf_len);
@@ -801,6 +884,7 @@ fio_protocol_s *http1_new(uintptr_t uuid, http_settings_s *settings,
       .is_client = settings->is_client,
   };
   http_s_new(&p->request, &p->p, &HTTP1_VTABLE);
+  p->p.arena = fiobj_arena_new();
   if (unread_data && unread_length <= HTTP_MAX_HEADER_LENGTH) {
     memcpy(p->buf, unread_data, unread_length);
     p->buf_len = unread_length;
@@ -817,6 +901,7 @@ void http1_destroy(fio_protocol_s *pr) {
   http1pr_s *p = (http1pr_s *)pr;
   http1_pr2handle(p).status = 0;
   http_s_destroy(&http1_pr2handle(p), 0);
+  fiobj_arena_free(p->p.arena);
   fio_free(p);
   // FIO_LOG_DEBUG("Deallocated HTTP/1.1 protocol at. %p", (void *)p);
 }
@@ -19,6 +19,13 @@ void http_on_request_handler______internal(http_s *h,
   if (!http_upgrade_hash)
     http_upgrade_hash = fiobj_hash_string("upgrade", 7);
   h->udata = settings->udata;
+  /* request objects are owned by this thread (see `http_pause`) */
+  fiobj_local(h->headers);
+  fiobj_local(h->private_data.out_headers);
+  fiobj_local(h->method);
+  fiobj_local(h->path);
+  fiobj_local(h->query);
+  fiobj_local(h->version);
 
   static uint64_t host_hash = 0;
   if (!host_hash)
@@ -105,6 +112,151 @@ int http_send_error2(size_t error, intptr_t uuid, http_settings_s *settings) {
   return ret;
 }
 
+/* *****************************************************************************
+Interned header names
+***************************************************************************** */
+
+/* common header names, including every name in the HPACK static table */
+static const char *http___header_names[] = {
+    "accept",
+    "accept-charset",
+    "accept-encoding",
+    "accept-language",
+    "accept-ranges",
+    "access-control-allow-credentials",
+    "access-control-allow-headers",
+    "access-control-allow-methods",
+    "access-control-allow-origin",
+    "access-control-request-headers",
+    "access-control-request-method",
+    "age",
+    "allow",
+    "authorization",
+    "cache-control",
+    "connection",
+    "content-disposition",
+    "content-encoding",
+    "content-language",
+    "content-length",
+    "content-location",
+    "content-range",
+    "content-type",
+    "cookie",
+    "date",
+    "dnt",
+    "etag",
+    "expect",
+    "expires",
+    "forwarded",
+    "from",
+    "host",
+    "if-match",
+    "if-modified-since",
+    "if-none-match",
+    "if-range",
+    "if-unmodified-since",
+    "keep-alive",
+    "last-modified",
+    "link",
+    "location",
+    "max-forwards",
+    "origin",
+    "pragma",
+    "proxy-authenticate",
+    "proxy-authorization",
+    "range",
+    "referer",
+    "refresh",
+    "retry-after",
+    "sec-fetch-dest",
+    "sec-fetch-mode",
+    "sec-fetch-site",
+    "sec-fetch-user",
+    "sec-websocket-accept",
+    "sec-websocket-extensions",
+    "sec-websocket-key",
+    "sec-websocket-protocol",
+    "sec-websocket-version",
+    "server",
+    "set-cookie",
+    "strict-transport-security",
+    "te",
+    "transfer-encoding",
+    "upgrade",
+    "upgrade-insecure-requests",
+    "user-agent",
+    "vary",
+    "via",
+    "www-authenticate",
+    "x-forwarded-for",
+    "x-forwarded-host",
+    "x-forwarded-proto",
+    "x-real-ip",
+    "x-requested-with",
+};
+
+#define HTTP___HEADER_NAMES_COUNT                                              \
+  (sizeof(http___header_names) / sizeof(http___header_names[0]))
+#define HTTP___HEADER_NAMES_MAX_LEN 32
+
+/* the interned names, ordered by length */
+static struct {
+  const char *name;
+  FIOBJ obj;
+} http___header_interned[HTTP___HEADER_NAMES_COUNT];
+/* the index of the first interned name for each length */
+static uint8_t http___header_by_len[HTTP___HEADER_NAMES_MAX_LEN + 2];
+
+static void http___header_names_init(void) {
+  /* counting sort by name length */
+  for (size_t i = 0; i < HTTP___HEADER_NAMES_COUNT; ++i) {
+    size_t len = strlen(http___header_names[i]);
+    FIO_ASSERT(len <= HTTP___HEADER_NAMES_MAX_LEN,
+               "interned header name too long: %s", http___header_names[i]);
+    ++http___header_by_len[len + 1];
+  }
+  for (size_t i = 1; i < HTTP___HEADER_NAMES_MAX_LEN + 2; ++i)
+    http___header_by_len[i] += http___header_by_len[i - 1];
+  uint8_t pos[HTTP___HEADER_NAMES_MAX_LEN + 1];
+  memcpy(pos, http___header_by_len, sizeof(pos));
+  for (size_t i = 0; i < HTTP___HEADER_NAMES_COUNT; ++i) {
+    size_t len = strlen(http___header_names[i]);
+    FIOBJ o = fiobj_str_new(http___header_names[i], len);
+    fiobj_obj2hash(o); /* cache the hash value before freezing */
+    fiobj_str_freeze(o);
+    http___header_interned[pos[len]].name = http___header_names[i];
+    http___header_interned[pos[len]].obj = fiobj_immortal(o);
+    ++pos[len];
+  }
+}
+
+static void http___header_names_clear(void) {
+  for (size_t i = 0; i < HTTP___HEADER_NAMES_COUNT; ++i) {
+    fiobj_immortal_free(http___header_interned[i].obj);
+    http___header_interned[i].obj = FIOBJ_INVALID;
+  }
+  memset(http___header_by_len, 0, sizeof(http___header_by_len));
+}
+
+/**
+ * Returns the interned (immortal) String for a common lower case header name,
+ * or FIOBJ_INVALID if the name isn't interned.
+ */
+FIOBJ http_header_name_find(const char *name, size_t len) {
+  if (len > HTTP___HEADER_NAMES_MAX_LEN)
+    return FIOBJ_INVALID;
+  for (size_t i = http___header_by_len[len]; i < http___header_by_len[len + 1];
+       ++i) {
+    if (http___header_interned[i].name[0] == name[0] &&
+        !memcmp(http___header_interned[i].name, name, len))
+      return http___header_interned[i].obj;
+  }
+  return FIOBJ_INVALID;
+}
+
+#define HTTP___HEADER_NAME(name)                                               \
+  http_header_name_find((name), sizeof(name) - 1)
+
 /* *****************************************************************************
 Library initialization
 ***************************************************************************** */
@@ -124,10 +276,12 @@ FIOBJ HTTP_HEADER_HOST;
 FIOBJ HTTP_HEADER_LAST_MODIFIED;
 FIOBJ HTTP_HEADER_ORIGIN;
 FIOBJ HTTP_HEADER_SET_COOKIE;
+FIOBJ HTTP_HEADER_TRANSFER_ENCODING;
 FIOBJ HTTP_HEADER_UPGRADE;
 FIOBJ HTTP_HEADER_WS_SEC_CLIENT_KEY;
 FIOBJ HTTP_HEADER_WS_SEC_KEY;
 FIOBJ HTTP_HVALUE_BYTES;
+FIOBJ HTTP_HVALUE_CHUNKED;
 FIOBJ HTTP_HVALUE_CLOSE;
 FIOBJ HTTP_HVALUE_CONTENT_TYPE_DEFAULT;
 FIOBJ HTTP_HVALUE_GZIP;
@@ -145,6 +299,10 @@ static void http_lib_cleanup(void *ignr_);
 static __attribute__((constructor)) void http_lib_constructor(void) {
   fio_state_callback_add(FIO_CALL_ON_INITIALIZE, http_lib_init, NULL);
   fio_state_callback_add(FIO_CALL_AT_EXIT, http_lib_cleanup, NULL);
+  /* pending log lines shouldn't be lost (or inherited by child processes) */
+  fio_state_callback_add(FIO_CALL_BEFORE_FORK, http_log_flush______internal,
+                         NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, http_log_flush______internal, NULL);
 }
 
 void http_mimetype_stats(void);
@@ -152,6 +310,7 @@ void http_mimetype_stats(void);
 static void http_lib_cleanup(void *ignr_) {
   (void)ignr_;
   http_mimetype_clear();
+  http_client_pool_clear();
 #define HTTPLIB_RESET(x)                                                       \
   fiobj_free(x);                                                               \
   x = FIOBJ_INVALID;
@@ -170,10 +329,12 @@ static void http_lib_cleanup(void *ignr_) {
   HTTPLIB_RESET(HTTP_HEADER_LAST_MODIFIED);
   HTTPLIB_RESET(HTTP_HEADER_ORIGIN);
   HTTPLIB_RESET(HTTP_HEADER_SET_COOKIE);
+  HTTPLIB_RESET(HTTP_HEADER_TRANSFER_ENCODING);
   HTTPLIB_RESET(HTTP_HEADER_UPGRADE);
   HTTPLIB_RESET(HTTP_HEADER_WS_SEC_CLIENT_KEY);
   HTTPLIB_RESET(HTTP_HEADER_WS_SEC_KEY);
   HTTPLIB_RESET(HTTP_HVALUE_BYTES);
+  HTTPLIB_RESET(HTTP_HVALUE_CHUNKED);
   HTTPLIB_RESET(HTTP_HVALUE_CLOSE);
   HTTPLIB_RESET(HTTP_HVALUE_CONTENT_TYPE_DEFAULT);
   HTTPLIB_RESET(HTTP_HVALUE_GZIP);
@@ -187,6 +348,7 @@ static void http_lib_cleanup(void *ignr_) {
   HTTPLIB_RESET(HTTP_HVALUE_WS_VERSION);
 
 #undef HTTPLIB_RESET
+  http___header_names_clear();
   http_mimetype_stats();
 }
 
@@ -196,25 +358,29 @@ static void http_lib_init(void *ignr_) {
   (void)ignr_;
   if (HTTP_HEADER_ACCEPT_RANGES)
     return;
-  HTTP_HEADER_ACCEPT = fiobj_str_new("accept", 6);
-  HTTP_HEADER_ACCEPT_RANGES = fiobj_str_new("accept-ranges", 13);
-  HTTP_HEADER_CACHE_CONTROL = fiobj_str_new("cache-control", 13);
-  HTTP_HEADER_CONNECTION = fiobj_str_new("connection", 10);
-  HTTP_HEADER_CONTENT_ENCODING = fiobj_str_new("content-encoding", 16);
-  HTTP_HEADER_CONTENT_LENGTH = fiobj_str_new("content-length", 14);
-  HTTP_HEADER_CONTENT_RANGE = fiobj_str_new("content-range", 13);
-  HTTP_HEADER_CONTENT_TYPE = fiobj_str_new("content-type", 12);
-  HTTP_HEADER_COOKIE = fiobj_str_new("cookie", 6);
-  HTTP_HEADER_DATE = fiobj_str_new("date", 4);
-  HTTP_HEADER_ETAG = fiobj_str_new("etag", 4);
-  HTTP_HEADER_HOST = fiobj_str_new("host", 4);
-  HTTP_HEADER_LAST_MODIFIED = fiobj_str_new("last-modified", 13);
-  HTTP_HEADER_ORIGIN = fiobj_str_new("origin", 6);
-  HTTP_HEADER_SET_COOKIE = fiobj_str_new("set-cookie", 10);
-  HTTP_HEADER_UPGRADE = fiobj_str_new("upgrade", 7);
-  HTTP_HEADER_WS_SEC_CLIENT_KEY = fiobj_str_new("sec-websocket-key", 17);
-  HTTP_HEADER_WS_SEC_KEY = fiobj_str_new("sec-websocket-accept", 20);
+  /* header names point to the (immortal) interned names */
+  http___header_names_init();
+  HTTP_HEADER_ACCEPT = HTTP___HEADER_NAME("accept");
+  HTTP_HEADER_ACCEPT_RANGES = HTTP___HEADER_NAME("accept-ranges");
+  HTTP_HEADER_CACHE_CONTROL = HTTP___HEADER_NAME("cache-control");
+  HTTP_HEADER_CONNECTION = HTTP___HEADER_NAME("connection");
+  HTTP_HEADER_CONTENT_ENCODING = HTTP___HEADER_NAME("content-encoding");
+  HTTP_HEADER_CONTENT_LENGTH = HTTP___HEADER_NAME("content-length");
+  HTTP_HEADER_CONTENT_RANGE = HTTP___HEADER_NAME("content-range");
+  HTTP_HEADER_CONTENT_TYPE = HTTP___HEADER_NAME("content-type");
+  HTTP_HEADER_COOKIE = HTTP___HEADER_NAME("cookie");
+  HTTP_HEADER_DATE = HTTP___HEADER_NAME("date");
+  HTTP_HEADER_ETAG = HTTP___HEADER_NAME("etag");
+  HTTP_HEADER_HOST = HTTP___HEADER_NAME("host");
+  HTTP_HEADER_LAST_MODIFIED = HTTP___HEADER_NAME("last-modified");
+  HTTP_HEADER_ORIGIN = HTTP___HEADER_NAME("origin");
+  HTTP_HEADER_SET_COOKIE = HTTP___HEADER_NAME("set-cookie");
+  HTTP_HEADER_TRANSFER_ENCODING = HTTP___HEADER_NAME("transfer-encoding");
+  HTTP_HEADER_UPGRADE = HTTP___HEADER_NAME("upgrade");
+  HTTP_HEADER_WS_SEC_CLIENT_KEY = HTTP___HEADER_NAME("sec-websocket-key");
+  HTTP_HEADER_WS_SEC_KEY = HTTP___HEADER_NAME("sec-websocket-accept");
   HTTP_HVALUE_BYTES = fiobj_str_new("bytes", 5);
+  HTTP_HVALUE_CHUNKED = fiobj_str_new("chunked", 7);
   HTTP_HVALUE_CLOSE = fiobj_str_new("close", 5);
   HTTP_HVALUE_CONTENT_TYPE_DEFAULT =
       fiobj_str_new("application/octet-stream", 24);
@@ -228,24 +394,8 @@ static void http_lib_init(void *ignr_) {
   HTTP_HVALUE_WS_UPGRADE = fiobj_str_new("Upgrade", 7);
   HTTP_HVALUE_WS_VERSION = fiobj_str_new("13", 2);
 
-  fiobj_obj2hash(HTTP_HEADER_ACCEPT_RANGES);
-  fiobj_obj2hash(HTTP_HEADER_CACHE_CONTROL);
-  fiobj_obj2hash(HTTP_HEADER_CONNECTION);
-  fiobj_obj2hash(HTTP_HEADER_CONTENT_ENCODING);
-  fiobj_obj2hash(HTTP_HEADER_CONTENT_LENGTH);
-  fiobj_obj2hash(HTTP_HEADER_CONTENT_RANGE);
-  fiobj_obj2hash(HTTP_HEADER_CONTENT_TYPE);
-  fiobj_obj2hash(HTTP_HEADER_COOKIE);
-  fiobj_obj2hash(HTTP_HEADER_DATE);
-  fiobj_obj2hash(HTTP_HEADER_ETAG);
-  fiobj_obj2hash(HTTP_HEADER_HOST);
-  fiobj_obj2hash(HTTP_HEADER_LAST_MODIFIED);
-  fiobj_obj2hash(HTTP_HEADER_ORIGIN);
-  fiobj_obj2hash(HTTP_HEADER_SET_COOKIE);
-  fiobj_obj2hash(HTTP_HEADER_UPGRADE);
-  fiobj_obj2hash(HTTP_HEADER_WS_SEC_CLIENT_KEY);
-  fiobj_obj2hash(HTTP_HEADER_WS_SEC_KEY);
   fiobj_obj2hash(HTTP_HVALUE_BYTES);
+  fiobj_obj2hash(HTTP_HVALUE_CHUNKED);
   fiobj_obj2hash(HTTP_HVALUE_CLOSE);
   fiobj_obj2hash(HTTP_HVALUE_CONTENT_TYPE_DEFAULT);
   fiobj_obj2hash(HTTP_HVALUE_GZIP);
@@ -62,10 +62,17 @@ struct http_fio_protocol_s {
   fio_protocol_s protocol;   /* facil.io protocol */
   intptr_t uuid;             /* socket uuid */
   http_settings_s *settings; /* pointer to HTTP settings */
+  fiobj_arena_s *arena;      /* the request's object arena (if any) */
+  uint32_t marks[4];         /* request cycle timing marks (`slow_request`) */
 };
 
 #define http2protocol(h) ((http_fio_protocol_s *)h->private_data.flag)
 
+/** Returns the object arena used for the handle's data (if any). */
+static inline fiobj_arena_s *http_arena(http_s *h) {
+  return h->private_data.flag ? http2protocol(h)->arena : NULL;
+}
+
 /* *****************************************************************************
 Constants that shouldn't be accessed by the users (`fiobj_dup` required).
 ***************************************************************************** */
@@ -74,6 +81,7 @@ extern FIOBJ HTTP_HEADER_ACCEPT_RANGES;
 extern FIOBJ HTTP_HEADER_WS_SEC_CLIENT_KEY;
 extern FIOBJ HTTP_HEADER_WS_SEC_KEY;
 extern FIOBJ HTTP_HVALUE_BYTES;
+extern FIOBJ HTTP_HVALUE_CHUNKED;
 extern FIOBJ HTTP_HVALUE_CLOSE;
 extern FIOBJ HTTP_HVALUE_CONTENT_TYPE_DEFAULT;
 extern FIOBJ HTTP_HVALUE_GZIP;
@@ -105,6 +113,57 @@ static inline void http_s_new(http_s *h, http_fio_protocol_s *owner,
   };
 }
 
+/* *****************************************************************************
+Request cycle timing
+***************************************************************************** */
+
+/** Timing marks stored in the protocol's `marks` (see `slow_request`). */
+enum {
+  HTTP_MARK_PARSED,  /* the request was parsed, the handler is called */
+  HTTP_MARK_HANDLED, /* the response was handed to the HTTP layer */
+  HTTP_MARK_HEADERS, /* the response headers were serialized */
+  HTTP_MARK_FLUSHED, /* the response was written to the connection's queue */
+};
+
+/** Returns the microseconds since `received_at` (at least 1). */
+static inline uint32_t http_elapsed_us(http_s *h) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int64_t us = ((int64_t)(now.tv_sec - h->received_at.tv_sec) * 1000000) +
+               ((now.tv_nsec - h->received_at.tv_nsec) / 1000);
+  if (us < 1)
+    return 1;
+  if (us > (int64_t)0xFFFFFFFF)
+    return 0xFFFFFFFF;
+  return (uint32_t)us;
+}
+
+/** Sets a timing mark when slow requests are traced. */
+static inline void http_mark(http_s *h, size_t mark) {
+  http_fio_protocol_s *pr = http2protocol(h);
+  if (!pr->settings->slow_request || pr->marks[mark])
+    return;
+  pr->marks[mark] = http_elapsed_us(h);
+}
+
+/**
+ * Called by the protocol before a response object is cleared or destroyed.
+ *
+ * Records the request's latency and reports slow requests.
+ */
+void http_on_finish______internal(http_s *h, http_settings_s *settings);
+
+/** Writes the pending log lines to `stderr`. */
+void http_log_flush______internal(void *ignr_);
+
+/**
+ * Returns the interned (immortal) String for a common lower case header name,
+ * or FIOBJ_INVALID if the name isn't interned.
+ *
+ * Interned names have a cached hash value and require no reference counting.
+ */
+FIOBJ http_header_name_find(const char *name, size_t len);
+
 static inline void http_s_destroy(http_s *h, uint8_t log) {
   if (log && h->status && !h->status_str) {
     http_write_log(h);
@@ -127,9 +186,14 @@ static inline void http_s_destroy(http_s *h, uint8_t log) {
 }
 
 static inline void http_s_clear(http_s *h, uint8_t log) {
+  http_fio_protocol_s *pr = http2protocol(h);
   http_s_destroy(h, log);
-  http_s_new(h, (http_fio_protocol_s *)h->private_data.flag,
-             h->private_data.vtbl);
+  /* recycle the request's object arena (unless objects escaped) */
+  pr->arena = fiobj_arena_reset(pr->arena);
+  memset(pr->marks, 0, sizeof(pr->marks));
+  fiobj_arena_s *old = fiobj_arena_use(pr->arena);
+  http_s_new(h, pr, h->private_data.vtbl);
+  fiobj_arena_use(old);
 }
 
 /** tests handle validity */
@@ -148,6 +212,9 @@ void http_on_response_handler______internal(http_s *h,
                                             http_settings_s *settings);
 int http_send_error2(size_t error, intptr_t uuid, http_settings_s *settings);
 
+/** Frees the HTTP client's connection pools (see `http_connect`). */
+void http_client_pool_clear(void);
+
 /* *****************************************************************************
 EventSource Support (SSE)
 ***************************************************************************** */
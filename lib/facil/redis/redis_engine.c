@@ -16,23 +16,65 @@ Feel free to copy, use and enjoy according to the license provided.
 #include <resp_parser.h>
 
 #define REDIS_READ_BUFFER 8192
+
+#ifndef REDIS_PIPELINE_LIMIT
+/**
+ * The default number of commands that might be "in flight" (sent, but not yet
+ * answered) on each publishing connection. A value of 1 disables pipelining.
+ */
+#define REDIS_PIPELINE_LIMIT 64
+#endif
+
+#ifndef REDIS_WRITE_BATCH
+/** Pipelined commands are coalesced into a single write up to this size. */
+#define REDIS_WRITE_BATCH 16384
+#endif
+
+#ifndef REDIS_POOL_LIMIT
+/** The maximum number of publishing connections per engine. */
+#define REDIS_POOL_LIMIT 16
+#endif
+
 /* *****************************************************************************
 The Redis Engine and Callbacks Object
 ***************************************************************************** */
 
+typedef struct redis_engine_s redis_engine_s;
+
+struct redis_engine_internal_s {
+  fio_protocol_s protocol;
+  intptr_t uuid;
+  resp_parser_s parser;
+  void (*on_message)(struct redis_engine_internal_s *parser, FIOBJ msg);
+  redis_engine_s *r;
+  uint8_t *buf;
+  FIOBJ str;
+  FIOBJ ary;
+  uint32_t ary_count;
+  uint16_t buf_pos;
+  uint16_t nesting;
+};
+
+/** A publishing (command) connection and its command queue. */
 typedef struct {
+  struct redis_engine_internal_s data;
+  /* commands are answered in the order they are queued */
+  fio_ls_embd_s queue;
+  /* the last command written to the connection (or the queue's head) */
+  fio_ls_embd_s *sent;
+  fio_lock_i lock;
+  /* the number of commands written that are waiting for a reply */
+  volatile uint16_t pending;
+  /* set when a (coalescing) write task was scheduled */
+  volatile uint8_t scheduled;
+  /* set once the connection was established (commands can be written) */
+  volatile uint8_t ready;
+} redis_pub_conn_s;
+
+struct redis_engine_s {
   fio_pubsub_engine_s en;
-  struct redis_engine_internal_s {
-    fio_protocol_s protocol;
-    intptr_t uuid;
-    resp_parser_s parser;
-    void (*on_message)(struct redis_engine_internal_s *parser, FIOBJ msg);
-    FIOBJ str;
-    FIOBJ ary;
-    uint32_t ary_count;
-    uint16_t buf_pos;
-    uint16_t nesting;
-  } pub_data, sub_data;
+  struct redis_engine_internal_s sub_data;
+  redis_pub_conn_s *pub;
   subscription_s *publication_forwarder;
   subscription_s *cmd_forwarder;
   subscription_s *cmd_reply;
@@ -42,25 +84,25 @@ typedef struct {
   FIOBJ last_ch;
   size_t auth_len;
   size_t ref;
-  fio_ls_embd_s queue;
-  fio_lock_i lock;
   fio_lock_i lock_connection;
+  uint16_t pipeline;
+  uint8_t pool;
   uint8_t ping_int;
-  volatile uint8_t pub_sent;
   volatile uint8_t flag;
-  uint8_t buf[];
-} redis_engine_s;
+};
 
 typedef struct {
   fio_ls_embd_s node;
   void (*callback)(fio_pubsub_engine_s *e, FIOBJ reply, void *udata);
+  /* if set, the reply is handled in place (see `redis_engine_send_view`) */
+  void (*on_view)(fio_pubsub_engine_s *e, fio_str_info_s reply, void *udata);
   void *udata;
   size_t cmd_len;
   uint8_t cmd[];
 } redis_commands_s;
 
-/** converts from a publishing protocol to an `redis_engine_s`. */
-#define pub2redis(pr) FIO_LS_EMBD_OBJ(redis_engine_s, pub_data, (pr))
+/** converts from a publishing protocol to a `redis_pub_conn_s`. */
+#define pub2conn(pr) FIO_LS_EMBD_OBJ(redis_pub_conn_s, data, (pr))
 /** converts from a subscribing protocol to an `redis_engine_s`. */
 #define sub2redis(pr) FIO_LS_EMBD_OBJ(redis_engine_s, sub_data, (pr))
 
@@ -86,13 +128,16 @@ static inline void redis_free(redis_engine_s *r) {
   if (fio_atomic_sub(&r->ref, 1))
     return;
   FIO_LOG_DEBUG("freeing redis engine for %s:%s", r->address, r->port);
-  redis_internal_reset(&r->pub_data);
   redis_internal_reset(&r->sub_data);
-  fiobj_free(r->last_ch);
-  while (fio_ls_embd_any(&r->queue)) {
-    fio_free(
-        FIO_LS_EMBD_OBJ(redis_commands_s, node, fio_ls_embd_pop(&r->queue)));
+  for (size_t i = 0; i < r->pool; ++i) {
+    redis_pub_conn_s *c = r->pub + i;
+    redis_internal_reset(&c->data);
+    while (fio_ls_embd_any(&c->queue)) {
+      fio_free(
+          FIO_LS_EMBD_OBJ(redis_commands_s, node, fio_ls_embd_pop(&c->queue)));
+    }
   }
+  fiobj_free(r->last_ch);
   fio_unsubscribe(r->publication_forwarder);
   r->publication_forwarder = NULL;
   fio_unsubscribe(r->cmd_forwarder);
@@ -141,6 +186,7 @@ inline static void fiobj2resp___internal(FIOBJ dest, FIOBJ obj) {
   case FIOBJ_T_FLOAT:   /* overflow */
   case FIOBJ_T_UNKNOWN: /* overflow */
   case FIOBJ_T_STRING:  /* overflow */
+  case FIOBJ_T_JSON:    /* overflow */
   case FIOBJ_T_DATA:
     s = fiobj_obj2cstr(obj);
     fiobj_str_write(dest, "$", 1);
@@ -176,6 +222,80 @@ static inline FIOBJ fiobj2resp_tmp(FIOBJ obj) {
   return fiobj2resp(fiobj_str_tmp(), obj);
 }
 
+static int fiobj2resp_reply_task(FIOBJ o, void *dest_) {
+  FIOBJ dest = (FIOBJ)dest_;
+  switch (FIOBJ_TYPE(o)) {
+  case FIOBJ_T_NUMBER:
+    fiobj_str_write(dest, ":", 1);
+    fiobj_str_write_i(dest, fiobj_obj2num(o));
+    fiobj_str_write(dest, "\r\n", 2);
+    break;
+  case FIOBJ_T_TRUE:
+    fiobj_str_write(dest, "+OK\r\n", 5);
+    break;
+  default:
+    fiobj2resp___internal(dest, o);
+  }
+  return 0;
+}
+
+/**
+ * Converts a parsed reply back into a RESP string (server mode), for replies
+ * that couldn't be handled in place (replies larger than the read buffer).
+ *
+ * Don't call `fiobj_free`, object will self-destruct.
+ */
+static inline FIOBJ fiobj2resp_reply_tmp(FIOBJ obj) {
+  FIOBJ dest = fiobj_str_tmp();
+  fiobj_each2(obj, fiobj2resp_reply_task, (void *)dest);
+  return dest;
+}
+
+/* *****************************************************************************
+Zero-copy reply views
+***************************************************************************** */
+
+/**
+ * Reads the next item from a RESP reply view, advancing the view past the
+ * item (Array members follow their Array).
+ */
+int redis_reply_next(fio_str_info_s *view, redis_reply_item_s *item) {
+  if (!view || !item || !view->data || !view->len)
+    return -1;
+  uint8_t *pos = (uint8_t *)view->data;
+  uint8_t *stop = pos + view->len;
+  uint8_t *eol = memchr(pos, '\n', view->len);
+  if (!eol || eol == pos || eol[-1] != '\r')
+    return -1;
+  *item = (redis_reply_item_s){.type = (char)pos[0]};
+  switch (pos[0]) {
+  case '+': /* fallthrough */
+  case '-':
+    item->str = (fio_str_info_s){.data = (char *)pos + 1,
+                                 .len = (size_t)(eol - pos) - 2};
+    break;
+  case ':': /* fallthrough */
+  case '$': /* fallthrough */
+  case '*': {
+    char *tmp = (char *)pos + 1;
+    item->num = fio_atol(&tmp);
+    if (pos[0] == '$' && item->num >= 0) {
+      if ((size_t)(stop - (eol + 1)) < (size_t)item->num + 2)
+        return -1;
+      item->str = (fio_str_info_s){.data = (char *)eol + 1,
+                                   .len = (size_t)item->num};
+      eol += item->num + 2;
+    }
+  } break;
+  default:
+    return -1;
+  }
+  ++eol;
+  view->len -= (size_t)(eol - pos);
+  view->data = (char *)eol;
+  return 0;
+}
+
 /* *****************************************************************************
 RESP parser callbacks
 ***************************************************************************** */
@@ -197,7 +317,8 @@ static int resp_on_message(resp_parser_s *parser) {
   fiobj_free(msg);
   i->ary = FIOBJ_INVALID;
   i->str = FIOBJ_INVALID;
-  return 0;
+  /* stop, so following (complete) replies are handled in place */
+  return 1;
 }
 
 /** a local helper to add parsed objects to the data store. */
@@ -312,30 +433,101 @@ static void redis_perform_callback(void *e, void *cmd_) {
   fio_free(cmd);
 }
 
-/* send command within lock, to ensure flag integrity */
-static void redis_send_next_command_unsafe(redis_engine_s *r) {
-  if (!r->pub_sent && fio_ls_embd_any(&r->queue)) {
-    r->pub_sent = 1;
-    redis_commands_s *cmd =
-        FIO_LS_EMBD_OBJ(redis_commands_s, node, r->queue.next);
-    fio_write2(r->pub_data.uuid, .data.buffer = cmd->cmd,
-               .length = cmd->cmd_len, .after.dealloc = FIO_DEALLOC_NOOP);
-    FIO_LOG_DEBUG("(redis %d) Sending (%zu bytes):\n%s\n", (int)getpid(),
-                  cmd->cmd_len, cmd->cmd);
+/*
+ * Writes queued commands within the lock, until `pipeline` commands are in
+ * flight. Consecutive commands are coalesced into a single write.
+ */
+static void redis_send_next_command_unsafe(redis_pub_conn_s *c) {
+  const uint16_t limit = c->data.r->pipeline;
+  if (!c->ready)
+    return;
+  while (c->pending < limit && c->sent->next != &c->queue) {
+    fio_ls_embd_s *first = c->sent->next;
+    fio_ls_embd_s *last = first;
+    redis_commands_s *cmd = FIO_LS_EMBD_OBJ(redis_commands_s, node, first);
+    size_t count = 1;
+    size_t len = cmd->cmd_len;
+    while (c->pending + count < limit && last->next != &c->queue) {
+      cmd = FIO_LS_EMBD_OBJ(redis_commands_s, node, last->next);
+      if (len + cmd->cmd_len > REDIS_WRITE_BATCH)
+        break;
+      len += cmd->cmd_len;
+      last = last->next;
+      ++count;
+    }
+    if (count == 1) {
+      cmd = FIO_LS_EMBD_OBJ(redis_commands_s, node, first);
+      fio_write2(c->data.uuid, .data.buffer = cmd->cmd, .length = cmd->cmd_len,
+                 .after.dealloc = FIO_DEALLOC_NOOP);
+    } else {
+      char *batch = fio_malloc(len);
+      FIO_ASSERT_ALLOC(batch);
+      char *pos = batch;
+      for (fio_ls_embd_s *n = first;; n = n->next) {
+        cmd = FIO_LS_EMBD_OBJ(redis_commands_s, node, n);
+        memcpy(pos, cmd->cmd, cmd->cmd_len);
+        pos += cmd->cmd_len;
+        if (n == last)
+          break;
+      }
+      fio_write2(c->data.uuid, .data.buffer = batch, .length = len,
+                 .after.dealloc = fio_free);
+    }
+    c->pending += count;
+    c->sent = last;
+    FIO_LOG_DEBUG("(redis %d) Sending %zu commands (%zu bytes)", (int)getpid(),
+                  count, len);
   }
 }
 
-/* attach a command to the queue */
-static void redis_attach_cmd(redis_engine_s *r, redis_commands_s *cmd) {
-  fio_lock(&r->lock);
-  fio_ls_embd_push(&r->queue, &cmd->node);
-  redis_send_next_command_unsafe(r);
-  fio_unlock(&r->lock);
+/* the deferred (coalescing) write task */
+static void redis_send_task(void *c_, void *ignr) {
+  redis_pub_conn_s *c = c_;
+  fio_lock(&c->lock);
+  c->scheduled = 0;
+  redis_send_next_command_unsafe(c);
+  fio_unlock(&c->lock);
+  redis_free(c->data.r);
+  (void)ignr;
+}
+
+/* attach a command to the queue, the write is deferred so bursts coalesce */
+static void redis_attach_cmd(redis_pub_conn_s *c, redis_commands_s *cmd) {
+  uint8_t schedule;
+  fio_lock(&c->lock);
+  fio_ls_embd_push(&c->queue, &cmd->node);
+  schedule = !c->scheduled;
+  c->scheduled = 1;
+  fio_unlock(&c->lock);
+  if (schedule) {
+    fio_atomic_add(&c->data.r->ref, 1);
+    fio_defer(redis_send_task, c, NULL);
+  }
+}
+
+/* selects the publishing connection for a channel, preserving message order */
+static inline redis_pub_conn_s *redis_pub4channel(redis_engine_s *r,
+                                                  fio_str_info_s channel) {
+  if (r->pool == 1)
+    return r->pub;
+  return r->pub +
+         (fio_risky_hash(channel.data, channel.len, (uintptr_t)r) % r->pool);
+}
+
+/* removes the oldest command in flight (call within the lock) */
+static inline redis_commands_s *redis_pub_shift_unsafe(redis_pub_conn_s *c) {
+  if (!c->pending)
+    return NULL;
+  fio_ls_embd_s *node = fio_ls_embd_shift(&c->queue);
+  if (node == c->sent)
+    c->sent = &c->queue;
+  --c->pending;
+  return FIO_LS_EMBD_OBJ(redis_commands_s, node, node);
 }
 
 /** a local static callback, called when the RESP message is complete. */
 static void resp_on_pub_message(struct redis_engine_internal_s *i, FIOBJ msg) {
-  redis_engine_s *r = pub2redis(i);
+  redis_pub_conn_s *c = pub2conn(i);
   // #if DEBUG
   if (FIO_LOG_LEVEL >= FIO_LOG_LEVEL_DEBUG) {
     FIOBJ json = fiobj_obj2json(msg, 1);
@@ -344,26 +536,73 @@ static void resp_on_pub_message(struct redis_engine_internal_s *i, FIOBJ msg) {
   }
   // #endif
   /* publishing / command parser */
-  fio_lock(&r->lock);
-  fio_ls_embd_s *node = fio_ls_embd_shift(&r->queue);
-  r->pub_sent = 0;
-  redis_send_next_command_unsafe(r);
-  fio_unlock(&r->lock);
-  if (!node) {
+  /* the next command is written once the whole buffer was parsed */
+  fio_lock(&c->lock);
+  redis_commands_s *cmd = redis_pub_shift_unsafe(c);
+  fio_unlock(&c->lock);
+  if (!cmd) {
     /* TODO: possible ping? from server?! not likely... */
     FIO_LOG_WARNING("(redis %d) received a reply when no command was sent.",
                     (int)getpid());
     return;
   }
-  node->next = (void *)fiobj_dup(msg);
-  fio_defer(redis_perform_callback, &r->en,
-            FIO_LS_EMBD_OBJ(redis_commands_s, node, node));
+  if (cmd->on_view) {
+    /* the reply was too big to be handled in place */
+    cmd->on_view(&i->r->en, fiobj_obj2cstr(fiobj2resp_reply_tmp(msg)),
+                 cmd->udata);
+    fio_free(cmd);
+    return;
+  }
+  cmd->node.next = (void *)fiobj_dup(msg);
+  fio_defer(redis_perform_callback, &i->r->en, cmd);
+}
+
+/** handles a complete command reply in place, if the command allows it. */
+static void redis_on_pub_frame(struct redis_engine_internal_s *i,
+                               fio_str_info_s frame) {
+  redis_pub_conn_s *c = pub2conn(i);
+  redis_commands_s *cmd = NULL;
+  fio_lock(&c->lock);
+  if (c->pending) {
+    cmd = FIO_LS_EMBD_OBJ(redis_commands_s, node, c->queue.next);
+    if (cmd->on_view || !cmd->callback)
+      redis_pub_shift_unsafe(c);
+    else
+      cmd = NULL;
+  }
+  fio_unlock(&c->lock);
+  if (!cmd) {
+    /* the reply object is required (or unexpected) */
+    resp_parse(&i->parser, frame.data, frame.len);
+    return;
+  }
+  if (cmd->on_view)
+    cmd->on_view(&i->r->en, frame, cmd->udata);
+  fio_free(cmd);
 }
 
 /* *****************************************************************************
 Subscription Message Handling
 ***************************************************************************** */
 
+/* publishes a "message" / "pmessage" push, avoiding pattern duplicates */
+static void redis_on_sub_push(redis_engine_s *r, uint8_t is_pattern,
+                              fio_str_info_s channel, fio_str_info_s msg) {
+  if (!is_pattern) {
+    /* the channel's buffer is reused, avoiding an allocation per message */
+    if (!r->last_ch)
+      r->last_ch = fiobj_str_buf(channel.len);
+    fiobj_str_resize(r->last_ch, 0);
+    fiobj_str_write(r->last_ch, channel.data, channel.len);
+  } else if (r->last_ch) {
+    fio_str_info_s last = fiobj_obj2cstr(r->last_ch);
+    if (last.len == channel.len && !memcmp(last.data, channel.data, last.len))
+      return;
+  }
+  fio_publish(.channel = channel, .message = msg,
+              .engine = FIO_PUBSUB_CLUSTER);
+}
+
 /** a local static callback, called when the RESP message is complete. */
 static void resp_on_sub_message(struct redis_engine_internal_s *i, FIOBJ msg) {
   redis_engine_s *r = sub2redis(i);
@@ -383,20 +622,41 @@ static void resp_on_sub_message(struct redis_engine_internal_s *i, FIOBJ msg) {
     // }
     fio_str_info_s tmp = fiobj_obj2cstr(fiobj_ary_index(msg, 0));
     if (tmp.len == 7) { /* "message"  */
-      fiobj_free(r->last_ch);
-      r->last_ch = fiobj_dup(fiobj_ary_index(msg, 1));
-      fio_publish(.channel = fiobj_obj2cstr(r->last_ch),
-                  .message = fiobj_obj2cstr(fiobj_ary_index(msg, 2)),
-                  .engine = FIO_PUBSUB_CLUSTER);
+      redis_on_sub_push(r, 0, fiobj_obj2cstr(fiobj_ary_index(msg, 1)),
+                        fiobj_obj2cstr(fiobj_ary_index(msg, 2)));
     } else if (tmp.len == 8) { /* "pmessage" */
-      if (!fiobj_iseq(r->last_ch, fiobj_ary_index(msg, 2)))
-        fio_publish(.channel = fiobj_obj2cstr(fiobj_ary_index(msg, 2)),
-                    .message = fiobj_obj2cstr(fiobj_ary_index(msg, 3)),
-                    .engine = FIO_PUBSUB_CLUSTER);
+      redis_on_sub_push(r, 1, fiobj_obj2cstr(fiobj_ary_index(msg, 2)),
+                        fiobj_obj2cstr(fiobj_ary_index(msg, 3)));
     }
   }
 }
 
+/** handles "message" / "pmessage" pushes in place (no FIOBJ tree). */
+static void redis_on_sub_frame(struct redis_engine_internal_s *i,
+                               fio_str_info_s frame) {
+  redis_reply_item_s item[5];
+  fio_str_info_s view = frame;
+  if (!redis_reply_next(&view, item) && item[0].type == '*' &&
+      (item[0].num == 3 || item[0].num == 4)) {
+    size_t n = 1;
+    while (n <= (size_t)item[0].num && !redis_reply_next(&view, item + n) &&
+           item[n].type == '$' && item[n].num >= 0)
+      ++n;
+    if (n == 4 && item[1].str.len == 7 &&
+        !memcmp(item[1].str.data, "message", 7)) {
+      redis_on_sub_push(sub2redis(i), 0, item[2].str, item[3].str);
+      return;
+    }
+    if (n == 5 && item[1].str.len == 8 &&
+        !memcmp(item[1].str.data, "pmessage", 8)) {
+      redis_on_sub_push(sub2redis(i), 1, item[3].str, item[4].str);
+      return;
+    }
+  }
+  /* anything else (subscription replies, PONG...) uses the parser */
+  resp_parse(&i->parser, frame.data, frame.len);
+}
+
 /* *****************************************************************************
 Connection Callbacks (fio_protocol_s) and Engine
 ***************************************************************************** */
@@ -410,27 +670,60 @@ static void redis_connect(void *r, void *i);
     fio_defer(redis_connect, (r), (i));                                        \
   } while (0);
 
+/* tests if the parser is between replies (no partial FIOBJ tree) */
+static inline int redis_parser_is_idle(struct redis_engine_internal_s *i) {
+  return !i->parser.expecting && i->parser.obj_countdown <= 1 &&
+         i->ary == FIOBJ_INVALID && i->str == FIOBJ_INVALID;
+}
+
 /** Called when a data is available, but will not run concurrently */
 static void redis_on_data(intptr_t uuid, fio_protocol_s *pr) {
   struct redis_engine_internal_s *internal =
       (struct redis_engine_internal_s *)pr;
-  uint8_t *buf;
-  if (internal->on_message == resp_on_sub_message) {
-    buf = sub2redis(pr)->buf + REDIS_READ_BUFFER;
-  } else {
-    buf = pub2redis(pr)->buf;
-  }
+  uint8_t *buf = internal->buf;
   ssize_t i = fio_read(uuid, buf + internal->buf_pos,
                        REDIS_READ_BUFFER - internal->buf_pos);
   if (i <= 0)
     return;
 
   internal->buf_pos += i;
-  i = resp_parse(&internal->parser, buf, internal->buf_pos);
-  if (i) {
-    memmove(buf, buf + internal->buf_pos - i, i);
+  size_t pos = 0;
+  while (pos < internal->buf_pos) {
+    if (redis_parser_is_idle(internal)) {
+      /* complete replies are handled in place */
+      intptr_t len =
+          resp_frame_length(buf + pos, (size_t)(internal->buf_pos - pos));
+      if (len > 0) {
+        fio_str_info_s frame = {.data = (char *)buf + pos, .len = (size_t)len};
+        if (internal->on_message == resp_on_sub_message)
+          redis_on_sub_frame(internal, frame);
+        else
+          redis_on_pub_frame(internal, frame);
+        pos += len;
+        continue;
+      }
+      /* wait for the rest of the reply, unless it's bigger than the buffer */
+      if (!len && (pos || internal->buf_pos < REDIS_READ_BUFFER))
+        break;
+    }
+    /* stream the reply using the parser (big or invalid replies) */
+    size_t consumed = (internal->buf_pos - pos) -
+                      resp_parse(&internal->parser, buf + pos,
+                                 (size_t)(internal->buf_pos - pos));
+    if (!consumed)
+      break;
+    pos += consumed;
+  }
+  if (pos && pos < internal->buf_pos)
+    memmove(buf, buf + pos, internal->buf_pos - pos);
+  internal->buf_pos -= pos;
+  if (internal->on_message == resp_on_pub_message) {
+    /* write as many queued commands as replies were received */
+    redis_pub_conn_s *c = pub2conn(internal);
+    fio_lock(&c->lock);
+    redis_send_next_command_unsafe(c);
+    fio_unlock(&c->lock);
   }
-  internal->buf_pos = i;
 }
 
 /** Called when the connection was closed, but will not run concurrently */
@@ -456,13 +749,19 @@ static void redis_on_close(intptr_t uuid, fio_protocol_s *pr) {
       redis_free(r);
     }
   } else {
-    r = pub2redis(pr);
+    redis_pub_conn_s *c = pub2conn(pr);
+    r = internal->r;
     if (r->flag && uuid != -1) {
       FIO_LOG_WARNING("(redis %d) publication connection lost. "
                       "Reconnecting...",
                       (int)getpid());
     }
-    r->pub_sent = 0;
+    /* commands in flight will be resent once reconnected */
+    fio_lock(&c->lock);
+    c->pending = 0;
+    c->sent = &c->queue;
+    c->ready = 0;
+    fio_unlock(&c->lock);
     fio_close(r->sub_data.uuid);
     redis_free(r);
   }
@@ -486,8 +785,8 @@ static void redis_sub_ping(intptr_t uuid, fio_protocol_s *pr) {
 
 /** Called on connection timeout. */
 static void redis_pub_ping(intptr_t uuid, fio_protocol_s *pr) {
-  redis_engine_s *r = pub2redis(pr);
-  if (fio_ls_embd_any(&r->queue)) {
+  redis_pub_conn_s *c = pub2conn(pr);
+  if (fio_ls_embd_any(&c->queue)) {
     FIO_LOG_WARNING("(redis) Redis server unresponsive, disconnecting.");
     fio_close(uuid);
     return;
@@ -495,7 +794,7 @@ static void redis_pub_ping(intptr_t uuid, fio_protocol_s *pr) {
   redis_commands_s *cmd = fio_malloc(sizeof(*cmd) + 15);
   *cmd = (redis_commands_s){.cmd_len = 14};
   memcpy(cmd->cmd, "*1\r\n$4\r\nPING\r\n\0", 15);
-  redis_attach_cmd(r, cmd);
+  redis_attach_cmd(c, cmd);
 }
 
 /* *****************************************************************************
@@ -525,28 +824,35 @@ static void redis_on_connect(intptr_t uuid, void *i_) {
                  .after.dealloc = FIO_DEALLOC_NOOP);
     }
     fio_pubsub_reattach(&r->en);
-    if (r->pub_data.uuid == -1) {
-      defer_redis_connect(r, &r->pub_data);
+    for (size_t n = 0; n < r->pool; ++n) {
+      if (r->pub[n].data.uuid == -1) {
+        defer_redis_connect(r, &r->pub[n].data);
+      }
     }
     FIO_LOG_INFO("(redis %d) subscription connection established.",
                  (int)getpid());
   } else {
-    r = pub2redis(i);
+    redis_pub_conn_s *c = pub2conn(i);
+    r = i->r;
     if (r->auth_len) {
       redis_commands_s *cmd = fio_malloc(sizeof(*cmd) + r->auth_len);
       *cmd =
           (redis_commands_s){.cmd_len = r->auth_len, .callback = redis_on_auth};
       memcpy(cmd->cmd, r->auth, r->auth_len);
-      fio_lock(&r->lock);
-      r->pub_sent = 0;
-      fio_ls_embd_unshift(&r->queue, &cmd->node);
-      redis_send_next_command_unsafe(r);
-      fio_unlock(&r->lock);
+      fio_lock(&c->lock);
+      c->pending = 0;
+      c->sent = &c->queue;
+      c->ready = 1;
+      fio_ls_embd_unshift(&c->queue, &cmd->node);
+      redis_send_next_command_unsafe(c);
+      fio_unlock(&c->lock);
     } else {
-      fio_lock(&r->lock);
-      r->pub_sent = 0;
-      redis_send_next_command_unsafe(r);
-      fio_unlock(&r->lock);
+      fio_lock(&c->lock);
+      c->pending = 0;
+      c->sent = &c->queue;
+      c->ready = 1;
+      redis_send_next_command_unsafe(c);
+      fio_unlock(&c->lock);
     }
     FIO_LOG_INFO("(redis %d) publication connection established.",
                  (int)getpid());
@@ -659,7 +965,7 @@ static void redis_on_publish_root(const fio_pubsub_engine_s *eng,
   *buf = 0;
   FIO_LOG_DEBUG("(%d) Publishing:\n%s", (int)getpid(), cmd->cmd);
   cmd->cmd_len = (uintptr_t)buf - (uintptr_t)(cmd + 1);
-  redis_attach_cmd(r, cmd);
+  redis_attach_cmd(redis_pub4channel(r, channel), cmd);
   return;
   (void)is_json;
 }
@@ -717,6 +1023,12 @@ static void redis_on_internal_publish(fio_msg_s *msg) {
 Sending commands using the Root connection
 ***************************************************************************** */
 
+/*
+ * Forwarded commands carry 29 bytes of metadata: the engine (8 bytes), the
+ * callback (8 bytes), the udata (8 bytes), the process ID (4 bytes) and a
+ * "view" flag (1 byte), set by `redis_engine_send_view`.
+ */
+
 /* callback from the Redis reply */
 static void redis_forward_reply(fio_pubsub_engine_s *e, FIOBJ reply,
                                 void *udata) {
@@ -730,29 +1042,54 @@ static void redis_forward_reply(fio_pubsub_engine_s *e, FIOBJ reply,
   int32_t pid = (int32_t)fio_str2u32(data + 24);
   FIOBJ rp = fiobj_obj2json(reply, 0);
   fio_publish(.filter = (-10 - (int32_t)pid), .channel.data = (char *)data,
-              .channel.len = 28, .message = fiobj_obj2cstr(rp), .is_json = 1);
+              .channel.len = 29, .message = fiobj_obj2cstr(rp), .is_json = 1);
   fiobj_free(rp);
 }
 
+/* callback from the Redis reply, forwards the raw reply (no FIOBJ / JSON) */
+static void redis_forward_reply_view(fio_pubsub_engine_s *e,
+                                     fio_str_info_s reply, void *udata) {
+  uint8_t *data = udata;
+  fio_pubsub_engine_s *engine = (fio_pubsub_engine_s *)fio_str2u64(data + 0);
+  void *callback = (void *)fio_str2u64(data + 8);
+  if (engine != e || !callback) {
+    FIO_LOG_DEBUG("Redis reply not forwarded (callback: %p)", callback);
+    return;
+  }
+  int32_t pid = (int32_t)fio_str2u32(data + 24);
+  fio_publish(.filter = (-10 - (int32_t)pid), .channel.data = (char *)data,
+              .channel.len = 29, .message = reply, .is_json = 0);
+}
+
 /* listens to channel -2 for commands that need to be sent (only ROOT) */
 static void redis_on_internal_cmd(fio_msg_s *msg) {
   // void*(void *)fio_str2u64(msg->msg.data);
   fio_pubsub_engine_s *engine =
       (fio_pubsub_engine_s *)fio_str2u64(msg->channel.data + 0);
-  if (engine != msg->udata1) {
+  if (engine != msg->udata1 || msg->channel.len < 29) {
     return;
   }
-  redis_commands_s *cmd = fio_malloc(sizeof(*cmd) + msg->msg.len + 1 + 28);
+  redis_commands_s *cmd = fio_malloc(sizeof(*cmd) + msg->msg.len + 1 + 29);
   FIO_ASSERT_ALLOC(cmd);
-  *cmd = (redis_commands_s){.callback = redis_forward_reply,
-                            .udata = (cmd->cmd + msg->msg.len + 1),
+  *cmd = (redis_commands_s){.udata = (cmd->cmd + msg->msg.len + 1),
                             .cmd_len = msg->msg.len};
+  if (msg->channel.data[28])
+    cmd->on_view = redis_forward_reply_view;
+  else
+    cmd->callback = redis_forward_reply;
   memcpy(cmd->cmd, msg->msg.data, msg->msg.len);
-  memcpy(cmd->cmd + msg->msg.len + 1, msg->channel.data, 28);
-  redis_attach_cmd((redis_engine_s *)engine, cmd);
+  memcpy(cmd->cmd + msg->msg.len + 1, msg->channel.data, 29);
+  /* commands keep their order, so they always use the first connection */
+  redis_attach_cmd(((redis_engine_s *)engine)->pub, cmd);
   // fprintf(stderr, " *** Attached CMD (%d) ***\n%s\n", getpid(), cmd->cmd);
 }
 
+/* the reply callback forwarded to Root (`is_view` selects the member) */
+typedef union {
+  void (*callback)(fio_pubsub_engine_s *e, FIOBJ reply, void *udata);
+  void (*on_view)(fio_pubsub_engine_s *e, fio_str_info_s reply, void *udata);
+} redis_reply_cb_u;
+
 /* Listens on filter `-10 -getpid()` for incoming reply data */
 static void redis_on_internal_reply(fio_msg_s *msg) {
   fio_pubsub_engine_s *engine =
@@ -762,20 +1099,28 @@ static void redis_on_internal_reply(fio_msg_s *msg) {
                   (void *)engine, msg->udata1);
     return;
   }
+  void *udata = (void *)fio_str2u64(msg->channel.data + 16);
+  uintptr_t cb_addr = (uintptr_t)fio_str2u64(msg->channel.data + 8);
+  if (!msg->is_json) {
+    /* a reply view, pointing at the message's data */
+    redis_reply_cb_u cb = {
+        .on_view = (void (*)(fio_pubsub_engine_s *, fio_str_info_s,
+                             void *))cb_addr};
+    cb.on_view(engine, msg->msg, udata);
+    return;
+  }
   FIOBJ reply;
   fiobj_json2obj(&reply, msg->msg.data, msg->msg.len);
-  void (*callback)(fio_pubsub_engine_s *, FIOBJ, void *) = (void (*)(
-      fio_pubsub_engine_s *, FIOBJ, void *))fio_str2u64(msg->channel.data + 8);
-  void *udata = (void *)fio_str2u64(msg->channel.data + 16);
-  callback(engine, reply, udata);
+  redis_reply_cb_u cb = {
+      .callback = (void (*)(fio_pubsub_engine_s *, FIOBJ, void *))cb_addr};
+  cb.callback(engine, reply, udata);
   fiobj_free(reply);
 }
 
 /* publishes a Redis command to Root's filter -2 */
-intptr_t redis_engine_send(fio_pubsub_engine_s *engine, FIOBJ command,
-                           void (*callback)(fio_pubsub_engine_s *e, FIOBJ reply,
-                                            void *udata),
-                           void *udata) {
+static intptr_t redis_engine_send_internal(fio_pubsub_engine_s *engine,
+                                           FIOBJ command, redis_reply_cb_u cb,
+                                           void *udata, uint8_t is_view) {
   if ((uintptr_t)engine < 4) {
     FIO_LOG_WARNING("(redis send) trying to use one of the core engines");
     return -1;
@@ -786,12 +1131,14 @@ intptr_t redis_engine_send(fio_pubsub_engine_s *engine, FIOBJ command,
   // } else {
   /* forward publication request to Root */
   fio_str_s tmp = FIO_STR_INIT;
-  fio_str_info_s ti = fio_str_resize(&tmp, 28);
+  fio_str_info_s ti = fio_str_resize(&tmp, 29);
   /* combine metadata */
   fio_u2str64(ti.data + 0, (uint64_t)engine);
-  fio_u2str64(ti.data + 8, (uint64_t)callback);
+  fio_u2str64(ti.data + 8, is_view ? (uint64_t)(uintptr_t)cb.on_view
+                                    : (uint64_t)(uintptr_t)cb.callback);
   fio_u2str64(ti.data + 16, (uint64_t)udata);
   fio_u2str32(ti.data + 24, (uint32_t)getpid());
+  ti.data[28] = (char)is_view;
   FIOBJ cmd = fiobj2resp_tmp(command);
   fio_publish(.filter = -2, .channel = ti, .message = fiobj_obj2cstr(cmd),
               .engine = FIO_PUBSUB_ROOT, .is_json = 0);
@@ -800,6 +1147,25 @@ intptr_t redis_engine_send(fio_pubsub_engine_s *engine, FIOBJ command,
   return 0;
 }
 
+/* publishes a Redis command to Root's filter -2 */
+intptr_t redis_engine_send(fio_pubsub_engine_s *engine, FIOBJ command,
+                           void (*callback)(fio_pubsub_engine_s *e, FIOBJ reply,
+                                            void *udata),
+                           void *udata) {
+  return redis_engine_send_internal(
+      engine, command, (redis_reply_cb_u){.callback = callback}, udata, 0);
+}
+
+/* publishes a Redis command to Root's filter -2, the reply isn't parsed */
+intptr_t redis_engine_send_view(fio_pubsub_engine_s *engine, FIOBJ command,
+                                void (*on_reply)(fio_pubsub_engine_s *e,
+                                                 fio_str_info_s reply,
+                                                 void *udata),
+                                void *udata) {
+  return redis_engine_send_internal(
+      engine, command, (redis_reply_cb_u){.on_view = on_reply}, udata, 1);
+}
+
 /* *****************************************************************************
 Redis Engine Creation
 ***************************************************************************** */
@@ -819,15 +1185,22 @@ static void redis_on_facil_shutdown(void *r_) {
 static void redis_on_engine_fork(void *r_) {
   redis_engine_s *r = r_;
   r->flag = 0;
-  r->lock = FIO_LOCK_INIT;
   fio_force_close(r->sub_data.uuid);
   r->sub_data.uuid = -1;
-  fio_force_close(r->pub_data.uuid);
-  r->pub_data.uuid = -1;
-  while (fio_ls_embd_any(&r->queue)) {
-    redis_commands_s *cmd =
-        FIO_LS_EMBD_OBJ(redis_commands_s, node, fio_ls_embd_pop(&r->queue));
-    fio_free(cmd);
+  for (size_t i = 0; i < r->pool; ++i) {
+    redis_pub_conn_s *c = r->pub + i;
+    c->lock = FIO_LOCK_INIT;
+    fio_force_close(c->data.uuid);
+    c->data.uuid = -1;
+    while (fio_ls_embd_any(&c->queue)) {
+      redis_commands_s *cmd =
+          FIO_LS_EMBD_OBJ(redis_commands_s, node, fio_ls_embd_pop(&c->queue));
+      fio_free(cmd);
+    }
+    c->sent = &c->queue;
+    c->pending = 0;
+    c->scheduled = 0;
+    c->ready = 0;
   }
   r->en = (fio_pubsub_engine_s){
       .subscribe = redis_on_mock_subscribe_child,
@@ -867,9 +1240,18 @@ FIO_IGNORE_MACRO(struct redis_engine_create_args args) {
   if (!args.port.data || !args.port.len) {
     args.port = (fio_str_info_s){.len = 4, .data = (char *)"6379"};
   }
+  if (!args.pool_size)
+    args.pool_size = 1;
+  if (args.pool_size > REDIS_POOL_LIMIT)
+    args.pool_size = REDIS_POOL_LIMIT;
+  if (!args.pipeline)
+    args.pipeline = REDIS_PIPELINE_LIMIT;
+  /* memory layout: engine, connections, read buffers and strings */
+  const size_t buffers = sizeof(redis_pub_conn_s) * args.pool_size +
+                         (REDIS_READ_BUFFER * (args.pool_size + 1));
   redis_engine_s *r =
       fio_malloc(sizeof(*r) + args.port.len + 1 + args.address.len + 1 +
-                 args.auth.len + 1 + (REDIS_READ_BUFFER * 2));
+                 args.auth.len + 1 + buffers);
   FIO_ASSERT_ALLOC(r);
   *r = (redis_engine_s){
       .en =
@@ -878,18 +1260,6 @@ FIO_IGNORE_MACRO(struct redis_engine_create_args args) {
               .unsubscribe = redis_on_unsubscribe_root,
               .publish = redis_on_publish_root,
           },
-      .pub_data =
-          {
-              .protocol =
-                  {
-                      .on_data = redis_on_data,
-                      .on_close = redis_on_close,
-                      .on_shutdown = redis_on_shutdown,
-                      .ping = redis_pub_ping,
-                  },
-              .uuid = -1,
-              .on_message = resp_on_pub_message,
-          },
       .sub_data =
           {
               .protocol =
@@ -901,7 +1271,11 @@ FIO_IGNORE_MACRO(struct redis_engine_create_args args) {
                   },
               .on_message = resp_on_sub_message,
               .uuid = -1,
+              .r = r,
+              .buf = ((uint8_t *)(r + 1) +
+                      sizeof(redis_pub_conn_s) * args.pool_size),
           },
+      .pub = (redis_pub_conn_s *)(r + 1),
       .publication_forwarder =
           fio_subscribe(.filter = -1, .udata1 = r,
                         .on_message = redis_on_internal_publish),
@@ -910,19 +1284,40 @@ FIO_IGNORE_MACRO(struct redis_engine_create_args args) {
       .cmd_reply =
           fio_subscribe(.filter = -10 - (uint32_t)getpid(), .udata1 = r,
                         .on_message = redis_on_internal_reply),
-      .address = ((char *)(r + 1) + (REDIS_READ_BUFFER * 2)),
-      .port =
-          ((char *)(r + 1) + (REDIS_READ_BUFFER * 2) + args.address.len + 1),
-      .auth = ((char *)(r + 1) + (REDIS_READ_BUFFER * 2) + args.address.len +
-               args.port.len + 2),
+      .address = ((char *)(r + 1) + buffers),
+      .port = ((char *)(r + 1) + buffers + args.address.len + 1),
+      .auth = ((char *)(r + 1) + buffers + args.address.len + args.port.len +
+               2),
       .auth_len = args.auth.len,
       .ref = 1,
-      .queue = FIO_LS_INIT(r->queue),
-      .lock = FIO_LOCK_INIT,
       .lock_connection = FIO_LOCK_INIT,
+      .pipeline = args.pipeline,
+      .pool = args.pool_size,
       .ping_int = args.ping_interval,
       .flag = 1,
   };
+  for (size_t i = 0; i < r->pool; ++i) {
+    redis_pub_conn_s *c = r->pub + i;
+    *c = (redis_pub_conn_s){
+        .data =
+            {
+                .protocol =
+                    {
+                        .on_data = redis_on_data,
+                        .on_close = redis_on_close,
+                        .on_shutdown = redis_on_shutdown,
+                        .ping = redis_pub_ping,
+                    },
+                .uuid = -1,
+                .on_message = resp_on_pub_message,
+                .r = r,
+                .buf = r->sub_data.buf + (REDIS_READ_BUFFER * (i + 1)),
+            },
+        .queue = FIO_LS_INIT(c->queue),
+        .sent = &c->queue,
+        .lock = FIO_LOCK_INIT,
+    };
+  }
   memcpy(r->address, args.address.data, args.address.len);
   memcpy(r->port, args.port.data, args.port.len);
   if (args.auth.len)
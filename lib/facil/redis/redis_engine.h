@@ -25,6 +25,22 @@ struct redis_engine_create_args {
   fio_str_info_s auth;
   /** A `ping` will be sent every `ping_interval` interval or inactivity. */
   uint8_t ping_interval;
+  /**
+   * The number of publishing connections (defaults to 1, limited by
+   * `REDIS_POOL_LIMIT`).
+   *
+   * Publications are divided between the connections by channel name, so
+   * messages to the same channel keep their order. Commands sent using
+   * `redis_engine_send` always use the first connection.
+   */
+  uint8_t pool_size;
+  /**
+   * The maximum number of commands sent without waiting for a reply, per
+   * publishing connection (defaults to `REDIS_PIPELINE_LIMIT`).
+   *
+   * A value of 1 waits for each reply before sending the next command.
+   */
+  uint16_t pipeline;
 };
 
 /**
@@ -64,6 +80,50 @@ intptr_t redis_engine_send(fio_pubsub_engine_s *engine, FIOBJ command,
                                             void *udata),
                            void *udata);
 
+/** A RESP reply item, see `redis_reply_next`. */
+typedef struct {
+  /** The RESP type marker: '+', '-', ':', '$' or '*'. */
+  char type;
+  /**
+   * The String's data (types '+', '-' and '$'), pointing into the reply view.
+   *
+   * Note: the data isn't NUL terminated.
+   */
+  fio_str_info_s str;
+  /** A Number (':'), String length ('$') or Array length ('*'), -1 for NULL. */
+  int64_t num;
+} redis_reply_item_s;
+
+/**
+ * Sends a Redis command through the engine's connection, without parsing the
+ * reply into a FIOBJ object.
+ *
+ * The `on_reply` callback receives a (zero-copy) view of the RESP encoded
+ * reply, which is only valid during the callback. Use `redis_reply_next` to
+ * read the reply.
+ *
+ * Replies larger than the engine's read buffer (8Kb) are re-encoded from the
+ * parsed reply, in which case errors are reported as Strings.
+ *
+ * See `redis_engine_send` for details and limitations.
+ */
+intptr_t redis_engine_send_view(fio_pubsub_engine_s *engine, FIOBJ command,
+                                void (*on_reply)(fio_pubsub_engine_s *e,
+                                                 fio_str_info_s reply,
+                                                 void *udata),
+                                void *udata);
+
+/**
+ * Reads the next item from a RESP reply view (see `redis_engine_send_view`),
+ * advancing the view past the item.
+ *
+ * Arrays are flattened - the Array's item (`type == '*'`) is followed by the
+ * Array's members.
+ *
+ * Returns 0 on success or -1 if the view is empty (or the data is invalid).
+ */
+int redis_reply_next(fio_str_info_s *view, redis_reply_item_s *item);
+
 /**
  * See the {pubsub.h} file for documentation about engines.
  *
@@ -49,7 +49,12 @@ static size_t resp_parse(resp_parser_s *parser, const void *buffer,
 Required Parser Callbacks (to be defined by the including file)
 ***************************************************************************** */
 
-/** a local static callback, called when the RESP message is complete. */
+/**
+ * a local static callback, called when the RESP message is complete.
+ *
+ * If this function returns any value besides 0, parsing is stopped (the rest of
+ * the buffer is reported as unparsed).
+ */
 static int resp_on_message(resp_parser_s *parser);
 
 /** a local static callback, called when a Number object is parsed. */
@@ -171,6 +176,67 @@ inline static uint8_t seek2ch(uint8_t **pos, const uint8_t *limit, uint8_t ch) {
 
 #endif
 
+/* *****************************************************************************
+Measuring complete RESP messages (no callbacks)
+***************************************************************************** */
+
+/**
+ * Returns the length of the complete RESP message at the head of the buffer,
+ * allowing the message to be handled in place (without copying).
+ *
+ * Returns 0 if the message is incomplete and -1 if the data isn't valid RESP
+ * (in which case the parser should be used to report the error).
+ */
+static inline intptr_t resp_frame_length(const void *buffer, size_t length) {
+  const uint8_t *pos = (const uint8_t *)buffer;
+  const uint8_t *stop = pos + length;
+  intptr_t countdown = 1;
+  while (countdown) {
+    const uint8_t *eol;
+    if (pos >= stop ||
+        !(eol = (const uint8_t *)memchr(pos, '\n', (size_t)(stop - pos))))
+      return 0;
+    switch (*pos) {
+    case '+': /* fallthrough */
+    case '-': /* fallthrough */
+    case ':':
+      break;
+    case '$': /* fallthrough */
+    case '*': {
+      const uint8_t *tmp = pos + 1;
+      uint8_t inv = (*tmp == '-');
+      int64_t i = 0;
+      tmp += inv;
+      while ((size_t)(*tmp - (uint8_t)'0') <= 9) {
+        const int64_t digit = *tmp - (uint8_t)'0';
+        /* a length this long can't be valid (and would overflow) */
+        if (i > (INT64_MAX - digit) / 10)
+          return -1;
+        i = (i * 10) + digit;
+        ++tmp;
+      }
+      if (inv)
+        break; /* NULL */
+      if (*pos == '*') {
+        /* every element takes at least 2 bytes ("+\n") */
+        if ((uint64_t)(stop - (eol + 1)) < (uint64_t)i * 2)
+          return 0;
+        countdown += i;
+        break;
+      }
+      if ((uint64_t)(stop - (eol + 1)) < (uint64_t)i + 2)
+        return 0;
+      eol += i + 2;
+    } break;
+    default:
+      return -1;
+    }
+    pos = eol + 1;
+    --countdown;
+  }
+  return (intptr_t)(pos - (const uint8_t *)buffer);
+}
+
 /* *****************************************************************************
 Parsing RESP requests
 ***************************************************************************** */
@@ -307,7 +373,8 @@ static size_t resp_parse(resp_parser_s *parser, const void *buffer,
     pos = eol + 1;
     if (parser->obj_countdown <= 0 && !parser->expecting) {
       parser->obj_countdown = 1;
-      resp_on_message(parser);
+      if (resp_on_message(parser))
+        goto finish;
     }
   }
 finish:
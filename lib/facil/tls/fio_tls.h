@@ -18,6 +18,60 @@ Feel free to copy, use and enjoy according to the license provided.
 #define FIO_TLS_PRINT_SECRET 0
 #endif
 
+#ifndef FIO_TLS_TICKET_ROTATION
+/*
+ * Session ticket keys are rotated every this many seconds (0 leaves ticket keys
+ * to the TLS library, per context and per process).
+ */
+#define FIO_TLS_TICKET_ROTATION 3600
+#endif
+
+#ifndef FIO_TLS_SESSION_CACHE
+/* slots in the (shared memory) session ID cache, 0 == no shared cache */
+#define FIO_TLS_SESSION_CACHE 0
+#endif
+
+#ifndef FIO_TLS_KTLS
+/*
+ * If true, kernel TLS (Linux) is enabled after the handshake (when supported),
+ * allowing `fio_sendfile` to use the zero-copy `sendfile` path over TLS.
+ */
+#define FIO_TLS_KTLS 0
+#endif
+
+#ifndef FIO_TLS_RECORD_START
+/*
+ * Dynamic record sizing: new (or idle) connections send small TLS records (a
+ * single TCP segment each) for a faster time to first byte, switching to full
+ * size (16Kb) records once the connection is warm. 0 == always 16Kb records.
+ */
+#define FIO_TLS_RECORD_START 1369
+#endif
+
+#ifndef FIO_TLS_RECORD_BOOST
+/* small records sent before switching to full size records */
+#define FIO_TLS_RECORD_BOOST 40
+#endif
+
+#ifndef FIO_TLS_RECORD_IDLE
+/* milliseconds of idle time after which records start small again */
+#define FIO_TLS_RECORD_IDLE 1000
+#endif
+
+#ifndef FIO_TLS_HANDSHAKE_THREADS
+/*
+ * Server handshakes (the private key operations) are started by this many
+ * dedicated threads per worker process, so established connections keep being
+ * served during a handshake storm. 0 == handshakes run on the I/O threads.
+ */
+#define FIO_TLS_HANDSHAKE_THREADS 1
+#endif
+
+#ifndef FIO_TLS_HANDSHAKE_LIMIT
+/* queued handshakes per worker process, excess connections are closed */
+#define FIO_TLS_HANDSHAKE_LIMIT 4096
+#endif
+
 /** An opaque type used for the SSL/TLS functions. */
 typedef struct fio_tls_s fio_tls_s;
 
@@ -126,4 +180,23 @@ void fio_tls_dup(fio_tls_s *tls);
  */
 void fio_tls_destroy(fio_tls_s *tls);
 
+/** Handshake thread statistics, see `fio_tls_handshake_stats`. */
+typedef struct {
+  /** Handshakes waiting for a handshake thread (the queue depth). */
+  size_t queued;
+  /** Handshakes being performed by the handshake threads. */
+  size_t active;
+  /** Handshakes (steps) completed by the handshake threads. */
+  size_t completed;
+  /** Handshakes refused because `FIO_TLS_HANDSHAKE_LIMIT` was reached. */
+  size_t rejected;
+} fio_tls_handshake_stats_s;
+
+/**
+ * Returns the handshake thread statistics for the calling (worker) process.
+ *
+ * See `FIO_TLS_HANDSHAKE_THREADS`.
+ */
+fio_tls_handshake_stats_s fio_tls_handshake_stats(void);
+
 #endif
@@ -632,4 +632,11 @@ void FIO_TLS_WEAK fio_tls_destroy(fio_tls_s *tls) {
   free(tls);
 }
 
+/**
+ * Returns the handshake thread statistics for the calling (worker) process.
+ */
+fio_tls_handshake_stats_s FIO_TLS_WEAK fio_tls_handshake_stats(void) {
+  return (fio_tls_handshake_stats_s){.queued = 0};
+}
+
 #endif /* Library compiler flags */
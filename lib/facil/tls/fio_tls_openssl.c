@@ -22,10 +22,17 @@ Feel free to copy, use and enjoy according to the license provided.
 #define REQUIRE_LIBRARY()
 #define FIO_TLS_WEAK
 
+/* kernel TLS requires OpenSSL 3.0 (`SSL_sendfile`) built with kTLS support */
+#if FIO_TLS_KTLS && (!defined(SSL_OP_ENABLE_KTLS) || defined(OPENSSL_NO_KTLS))
+#undef FIO_TLS_KTLS
+#define FIO_TLS_KTLS 0
+#endif
+
 /* *****************************************************************************
 The SSL/TLS helper data types (can be left as is)
 ***************************************************************************** */
 #define FIO_INCLUDE_STR 1
+#define FIO_INCLUDE_LINKED_LIST 1
 #define FIO_FORCE_MALLOC_TMP 1
 #include <fio.h>
 
@@ -289,6 +296,293 @@ static X509 *fio_tls_create_self_signed(char *server_name) {
   return cert;
 }
 
+/* *****************************************************************************
+Session Resumption - shared ticket keys and a shared session cache
+
+The ticket keys and the (optional) session ID cache are placed in shared memory,
+mapped when the first TLS object is created (usually by the root process,
+before `fio_start` forks), so every worker process can decrypt the session
+tickets issued by its siblings.
+
+The process that mapped the memory generates a random key for each rotation
+epoch. Keys aren't derived from a long lived secret, so a retired key can't be
+recovered (forward secrecy).
+***************************************************************************** */
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+typedef EVP_MAC_CTX fio_tls_hmac_ctx_s;
+#define fio_tls_ticket_cb_set SSL_CTX_set_tlsext_ticket_key_evp_cb
+#else
+#include <openssl/hmac.h>
+typedef HMAC_CTX fio_tls_hmac_ctx_s;
+#define fio_tls_ticket_cb_set SSL_CTX_set_tlsext_ticket_key_cb
+#endif
+#include <openssl/rand.h>
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  unsigned char name[16];
+  unsigned char aes[32];
+  unsigned char hmac[32];
+} fio_tls_ticket_key_s;
+
+/* sessions serialized to a larger size aren't cached */
+#define FIO_TLS_SESSION_DATA_LIMIT 1984
+
+typedef struct {
+  fio_lock_i lock;
+  uint8_t id_len;
+  uint16_t len;
+  time_t expires;
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char data[FIO_TLS_SESSION_DATA_LIMIT];
+} fio_tls_session_slot_s;
+
+/* the shared memory mapping */
+typedef struct {
+  fio_lock_i lock;              /* protects the ticket keys */
+  uint64_t epoch;               /* the rotation epoch of the current key */
+  fio_tls_ticket_key_s keys[2]; /* the previous and the current keys */
+  fio_tls_session_slot_s cache[];
+} fio_tls_shared_s;
+
+static struct {
+  fio_lock_i lock;
+  uint8_t initialized;
+  pid_t owner; /* the process that generates the ticket keys */
+  fio_tls_shared_s *shared;
+  fio_tls_session_slot_s *cache;
+} fio_tls_session = {.lock = FIO_LOCK_INIT};
+
+#define FIO_TLS_SHARED_SIZE                                                    \
+  (sizeof(fio_tls_shared_s) +                                                  \
+   (sizeof(fio_tls_session_slot_s) * FIO_TLS_SESSION_CACHE))
+
+#if FIO_TLS_TICKET_ROTATION
+/* creates a random key */
+static void fio_tls_ticket_key_new(fio_tls_ticket_key_s *k) {
+  FIO_ASSERT(RAND_bytes((unsigned char *)k, sizeof(*k)) == 1,
+             "OpenSSL failed to create a session ticket key.");
+}
+
+/* rotates the ticket keys (a timer, only the owner process generates keys) */
+static void fio_tls_ticket_keys_rotate(void *ignr_) {
+  fio_tls_shared_s *shared = fio_tls_session.shared;
+  uint64_t epoch = (uint64_t)time(NULL) / FIO_TLS_TICKET_ROTATION;
+  fio_tls_ticket_key_s key;
+  if (!shared || fio_tls_session.owner != getpid() || shared->epoch == epoch)
+    return;
+  fio_tls_ticket_key_new(&key);
+  fio_lock(&shared->lock);
+  if (shared->epoch + 1 == epoch)
+    shared->keys[0] = shared->keys[1];
+  else
+    fio_tls_ticket_key_new(shared->keys); /* no previous key (or too old) */
+  shared->keys[1] = key;
+  shared->epoch = epoch;
+  fio_unlock(&shared->lock);
+  OPENSSL_cleanse(&key, sizeof(key));
+  (void)ignr_;
+}
+
+/**
+ * Copies the current key (`name == NULL`) or the key named `name`.
+ *
+ * Returns the key's index (0 == previous key) or -1 if the key is unknown.
+ */
+static int fio_tls_ticket_key_find(fio_tls_ticket_key_s *dest,
+                                   const unsigned char *name) {
+  fio_tls_shared_s *shared = fio_tls_session.shared;
+  int ret = -1;
+  fio_lock(&shared->lock);
+  for (int i = 0; i < 2; ++i) {
+    if (name ? memcmp(shared->keys[i].name, name, 16) : (i != 1))
+      continue;
+    *dest = shared->keys[i];
+    ret = i;
+    break;
+  }
+  fio_unlock(&shared->lock);
+  return ret;
+}
+
+static int fio_tls_ticket_hmac_init(fio_tls_hmac_ctx_s *hctx,
+                                    unsigned char *key) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  OSSL_PARAM params[3];
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, 32);
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                               (char *)"sha256", 0);
+  params[2] = OSSL_PARAM_construct_end();
+  return EVP_MAC_CTX_set_params(hctx, params) == 1;
+#else
+  return HMAC_Init_ex(hctx, key, 32, EVP_sha256(), NULL) == 1;
+#endif
+}
+
+static int fio_tls_ticket_key_cb(SSL *ssl, unsigned char *key_name,
+                                 unsigned char *iv, EVP_CIPHER_CTX *cctx,
+                                 fio_tls_hmac_ctx_s *hctx, int enc) {
+  fio_tls_ticket_key_s k;
+  int ret = -1;
+  int i = fio_tls_ticket_key_find(&k, enc ? NULL : key_name);
+  if (i == -1)
+    return 0; /* unknown (or expired) key, perform a full handshake */
+  if (enc) {
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+      goto finish;
+    memcpy(key_name, k.name, sizeof(k.name));
+    if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes, iv) != 1)
+      goto finish;
+  } else if (EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes, iv) !=
+             1) {
+    goto finish;
+  }
+  if (!fio_tls_ticket_hmac_init(hctx, k.hmac))
+    goto finish;
+  /* tickets encrypted using the previous key are renewed */
+  ret = (!enc && i == 0) ? 2 : 1;
+finish:
+  OPENSSL_cleanse(&k, sizeof(k));
+  return ret;
+  (void)ssl;
+}
+#endif /* FIO_TLS_TICKET_ROTATION */
+
+#if FIO_TLS_SESSION_CACHE
+FIO_FUNC inline fio_tls_session_slot_s *
+fio_tls_session_slot(const unsigned char *id, size_t len) {
+  return fio_tls_session.cache +
+         (fio_risky_hash(id, len, 0) % FIO_TLS_SESSION_CACHE);
+}
+
+static int fio_tls_session_new_cb(SSL *ssl, SSL_SESSION *session) {
+  unsigned int id_len = 0;
+  const unsigned char *id = SSL_SESSION_get_id(session, &id_len);
+  int len = i2d_SSL_SESSION(session, NULL);
+  if (!id_len || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH || len <= 0 ||
+      len > FIO_TLS_SESSION_DATA_LIMIT)
+    return 0;
+  fio_tls_session_slot_s *slot = fio_tls_session_slot(id, id_len);
+  fio_lock(&slot->lock);
+  unsigned char *pos = slot->data;
+  slot->len = (uint16_t)i2d_SSL_SESSION(session, &pos);
+  slot->id_len = (uint8_t)id_len;
+  memcpy(slot->id, id, id_len);
+  slot->expires =
+      SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+  fio_unlock(&slot->lock);
+  return 0; /* we didn't keep a reference to the session object */
+  (void)ssl;
+}
+
+static SSL_SESSION *fio_tls_session_get_cb(SSL *ssl, const unsigned char *id,
+                                           int id_len, int *copy) {
+  SSL_SESSION *session = NULL;
+  *copy = 0;
+  if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+    return NULL;
+  fio_tls_session_slot_s *slot = fio_tls_session_slot(id, id_len);
+  fio_lock(&slot->lock);
+  if (slot->id_len == id_len && !memcmp(slot->id, id, id_len) &&
+      slot->expires > time(NULL)) {
+    const unsigned char *pos = slot->data;
+    session = d2i_SSL_SESSION(NULL, &pos, slot->len);
+  }
+  fio_unlock(&slot->lock);
+  return session;
+  (void)ssl;
+}
+
+static void fio_tls_session_remove_cb(SSL_CTX *ctx, SSL_SESSION *session) {
+  unsigned int id_len = 0;
+  const unsigned char *id = SSL_SESSION_get_id(session, &id_len);
+  if (!id_len || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+    return;
+  fio_tls_session_slot_s *slot = fio_tls_session_slot(id, id_len);
+  fio_lock(&slot->lock);
+  if (slot->id_len == id_len && !memcmp(slot->id, id, id_len))
+    slot->id_len = 0;
+  fio_unlock(&slot->lock);
+  (void)ctx;
+}
+#endif /* FIO_TLS_SESSION_CACHE */
+
+static void fio_tls_session_cleanup(void *ignr_) {
+  fio_lock(&fio_tls_session.lock);
+  if (fio_tls_session.shared) {
+    /* other processes might still use the keys */
+    if (fio_tls_session.owner == getpid())
+      OPENSSL_cleanse(fio_tls_session.shared->keys,
+                      sizeof(fio_tls_session.shared->keys));
+    munmap(fio_tls_session.shared, FIO_TLS_SHARED_SIZE);
+  }
+  fio_tls_session.shared = NULL;
+  fio_tls_session.cache = NULL;
+  fio_tls_session.initialized = 0;
+  fio_unlock(&fio_tls_session.lock);
+  (void)ignr_;
+}
+
+/* maps the shared ticket keys and session cache (once) */
+static void fio_tls_session_init(void) {
+  fio_lock(&fio_tls_session.lock);
+  if (fio_tls_session.initialized) {
+    fio_unlock(&fio_tls_session.lock);
+    return;
+  }
+  fio_tls_session.initialized = 1;
+#if FIO_TLS_TICKET_ROTATION || FIO_TLS_SESSION_CACHE
+  fio_tls_session.shared =
+      mmap(NULL, FIO_TLS_SHARED_SIZE, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (fio_tls_session.shared == MAP_FAILED) {
+    FIO_LOG_ERROR("couldn't allocate the shared TLS session data.");
+    fio_tls_session.shared = NULL;
+  } else {
+    fio_tls_session.shared->lock = FIO_LOCK_INIT;
+    fio_tls_session.owner = getpid();
+#if FIO_TLS_SESSION_CACHE
+    fio_tls_session.cache = fio_tls_session.shared->cache;
+#endif
+  }
+#endif
+  fio_unlock(&fio_tls_session.lock);
+  if (!fio_is_master())
+    FIO_LOG_DEBUG("TLS session resumption initialized by a worker process, "
+                  "sessions aren't shared with other workers.");
+#if FIO_TLS_TICKET_ROTATION
+  fio_tls_ticket_keys_rotate(NULL);
+  /* the timer is inherited by the workers, where it does nothing */
+  fio_run_every(((FIO_TLS_TICKET_ROTATION * 1000) >> 3) + 1, 0,
+                fio_tls_ticket_keys_rotate, NULL, NULL);
+#endif
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio_tls_session_cleanup, NULL);
+}
+
+/* attaches the shared session resumption settings to the SSL_CTX */
+static void fio_tls_session_attach(SSL_CTX *ctx) {
+  fio_tls_session_init();
+  SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"facil.io", 8);
+#if FIO_TLS_TICKET_ROTATION
+  if (fio_tls_session.shared)
+    fio_tls_ticket_cb_set(ctx, fio_tls_ticket_key_cb);
+#endif
+#if FIO_TLS_SESSION_CACHE
+  if (fio_tls_session.cache) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+                                            SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx, fio_tls_session_new_cb);
+    SSL_CTX_sess_set_get_cb(ctx, fio_tls_session_get_cb);
+    SSL_CTX_sess_set_remove_cb(ctx, fio_tls_session_remove_cb);
+  }
+#endif
+}
+
 /* *****************************************************************************
 SSL/TLS Context (re)-building
 ***************************************************************************** */
@@ -299,10 +593,43 @@ typedef struct {
   fio_tls_s *tls;
   void *alpn_arg;
   intptr_t uuid;
+  /* outgoing data, coalesced into full records (TLS_BUFFER_LENGTH bytes) */
+  char *out;
+  size_t out_start;
+  size_t out_len;
+  /* dynamic record sizing */
+  struct timespec last_write;
+  uint16_t record_size;
+  uint16_t record_count;
+  uint8_t pending; /* an `SSL_write` must be retried with the same length */
+  uint8_t closing; /* 1 == `SSL_shutdown` once the buffer drains, 2 == done */
   uint8_t is_server;
   volatile uint8_t alpn_ok;
+  /* handshake threads (see FIO_TLS_HANDSHAKE_THREADS) */
+  volatile uint8_t hs;
+  uint8_t hs_orphan;
+  int hs_fd; /* the handshake thread's copy of the socket (see `dup`) */
+  fio_ls_embd_s hs_node;
 } fio_tls_connection_s;
 
+/* the handshake is performed by the I/O threads */
+#define FIO_TLS_HS_INLINE 0
+/* waiting for the ClientHello, before handing the handshake to a thread */
+#define FIO_TLS_HS_WAIT 1
+/* refused (FIO_TLS_HANDSHAKE_LIMIT), the connection is being closed */
+#define FIO_TLS_HS_REFUSED 2
+/* waiting for a handshake thread */
+#define FIO_TLS_HS_QUEUED 3
+/* a handshake thread owns the SSL object */
+#define FIO_TLS_HS_RUNNING 4
+
+#if FIO_TLS_HANDSHAKE_THREADS
+static int fio_tls_hs_release(fio_tls_connection_s *c);
+#else
+#define fio_tls_hs_schedule(uuid, c) 0
+#define fio_tls_hs_release(c) 0
+#endif
+
 static void fio_tls_alpn_fallback(fio_tls_connection_s *c) {
   alpn_s *alpn = alpn_default(c->tls);
   if (!alpn || !alpn->on_selected)
@@ -384,10 +711,17 @@ static void fio_tls_build_context(fio_tls_s *tls) {
 
   /* create new context */
   tls->ctx = SSL_CTX_new(TLS_method());
-  SSL_CTX_set_mode(tls->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
+  /* the write buffer might move (compaction) while a write is pending */
+  SSL_CTX_set_mode(tls->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                 SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
   /* see: https://caniuse.com/#search=tls */
   SSL_CTX_set_min_proto_version(tls->ctx, TLS1_2_VERSION);
   SSL_CTX_set_options(tls->ctx, SSL_OP_NO_COMPRESSION);
+#if FIO_TLS_KTLS
+  SSL_CTX_set_options(tls->ctx, SSL_OP_ENABLE_KTLS);
+#endif
+  /* shared session ticket keys and session cache (cross-worker resumption) */
+  fio_tls_session_attach(tls->ctx);
 
   /* attach certificates */
   FIO_ARY_FOR(&tls->sni, pos) {
@@ -509,6 +843,8 @@ static void fio_tls_build_context(fio_tls_s *tls) {
     }
   }
 
+  /* don't leave errors (i.e., failed lookups) to the next TLS operation */
+  ERR_clear_error();
   FIO_LOG_DEBUG("(re)built TLS context for OpenSSL %p", (void *)tls);
 }
 
@@ -533,6 +869,8 @@ static void fio_tls_delayed_close(void *uuid, void *ignr_) {
 static ssize_t fio_tls_read(intptr_t uuid, void *udata, void *buf,
                             size_t count) {
   fio_tls_connection_s *c = udata;
+  /* the error queue is per thread, other connections' errors fail `SSL_read` */
+  ERR_clear_error();
   ssize_t ret = SSL_read(c->ssl, buf, count);
   if (ret > 0)
     return ret;
@@ -558,6 +896,84 @@ static ssize_t fio_tls_read(intptr_t uuid, void *udata, void *buf,
   (void)uuid;
 }
 
+/* *****************************************************************************
+Record Writing (coalescing, dynamic record sizing)
+***************************************************************************** */
+
+#define FIO_TLS_RECORD_MAX 16384
+
+/** Returns the current record size, starting small after idle time. */
+static size_t fio_tls_record_size(fio_tls_connection_s *c) {
+#if FIO_TLS_RECORD_START
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  /* the length of a pending write can't change, so neither can the size */
+  int64_t idle = (now.tv_sec - c->last_write.tv_sec) * 1000 +
+                 (now.tv_nsec - c->last_write.tv_nsec) / 1000000;
+  if (!c->pending && idle >= FIO_TLS_RECORD_IDLE) {
+    c->record_size = FIO_TLS_RECORD_START;
+    c->record_count = 0;
+  }
+  c->last_write = now;
+  return c->record_size;
+#else
+  return FIO_TLS_RECORD_MAX;
+  (void)c;
+#endif
+}
+
+/** Writes a single record (`len` <= the record size), as `SSL_write`. */
+static int fio_tls_record_write(fio_tls_connection_s *c, const void *buf,
+                                size_t len) {
+  ERR_clear_error();
+  int ret = SSL_write(c->ssl, buf, (int)len);
+  if (ret <= 0)
+    return ret;
+  c->pending = 0;
+#if FIO_TLS_RECORD_START
+  if (c->record_size < FIO_TLS_RECORD_MAX &&
+      ++c->record_count >= FIO_TLS_RECORD_BOOST)
+    c->record_size = FIO_TLS_RECORD_MAX;
+#endif
+  return ret;
+}
+
+/** Sets `errno` according to a failed `SSL_write` (or similar), returns -1. */
+static ssize_t fio_tls_write_error(fio_tls_connection_s *c, int ret) {
+  switch (SSL_get_error(c->ssl, ret)) {
+  case SSL_ERROR_SSL: /* overflow */
+  case SSL_ERROR_ZERO_RETURN:
+    errno = EPIPE;
+    return -1;
+  case SSL_ERROR_SYSCALL:
+    if (errno && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      return -1;
+    break;
+  default:
+    break;
+  }
+  c->pending = 1;
+  errno = EWOULDBLOCK;
+  return -1;
+}
+
+/** Encrypts buffered data: full records, or everything if `all` is set. */
+static ssize_t fio_tls_drain(fio_tls_connection_s *c, uint8_t all) {
+  size_t record = fio_tls_record_size(c);
+  while (c->out_len && (all || c->out_len >= record)) {
+    int ret = fio_tls_record_write(
+        c, c->out + c->out_start, (c->out_len < record ? c->out_len : record));
+    if (ret <= 0)
+      return fio_tls_write_error(c, ret);
+    c->out_start += ret;
+    c->out_len -= ret;
+    record = c->record_size;
+  }
+  if (!c->out_len)
+    c->out_start = 0;
+  return 0;
+}
+
 /**
  * When implemented, this function will be called to flush any data remaining
  * in the internal buffer.
@@ -569,9 +985,27 @@ static ssize_t fio_tls_read(intptr_t uuid, void *udata, void *buf,
  * deadlock might occur.
  */
 static ssize_t fio_tls_flush(intptr_t uuid, void *udata) {
-  (void)uuid;
-  (void)udata;
+  fio_tls_connection_s *c = udata;
+  if (c->out_len) {
+    /* the packet queue drained, a partial record is all there is to send */
+    if (fio_tls_drain(c, 1) && errno != EWOULDBLOCK)
+      return -1;
+    if (c->out_len)
+      return c->out_len;
+  }
+  if (c->out) {
+    /* idle connections shouldn't hold on to the buffer */
+    free(c->out);
+    c->out = NULL;
+  }
+  if (c->closing == 1) {
+    c->closing = 2;
+    ERR_clear_error();
+    SSL_shutdown(c->ssl);
+    ERR_clear_error(); /* a reset connection isn't an error worth reporting */
+  }
   return 0;
+  (void)uuid;
 }
 
 /**
@@ -581,34 +1015,52 @@ static ssize_t fio_tls_flush(intptr_t uuid, void *udata) {
  * If an internal buffer is implemented and it is full, errno should be set to
  * EWOULDBLOCK and the function should return -1.
  *
+ * Small writes are buffered and coalesced into full records (the buffer is
+ * drained by `fio_tls_flush` once the packet queue is empty), full records are
+ * encrypted directly from the packet's data.
+ *
  * Note: facil.io library functions MUST NEVER be called by any r/w hook, or a
  * deadlock might occur.
  */
 static ssize_t fio_tls_write(intptr_t uuid, void *udata, const void *buf,
                              size_t count) {
   fio_tls_connection_s *c = udata;
-  ssize_t ret = SSL_write(c->ssl, buf, count);
-  if (ret > 0)
-    return ret;
-  ret = SSL_get_error(c->ssl, ret);
-  switch (ret) {
-  case SSL_ERROR_SSL: /* overflow */
-  case SSL_ERROR_ZERO_RETURN:
-    return 0;                      /* EOF */
-  case SSL_ERROR_NONE:             /* overflow */
-  case SSL_ERROR_WANT_CONNECT:     /* overflow */
-  case SSL_ERROR_WANT_ACCEPT:      /* overflow */
-  case SSL_ERROR_WANT_X509_LOOKUP: /* overflow */
-#ifdef SSL_ERROR_WANT_ASYNC
-  case SSL_ERROR_WANT_ASYNC: /* overflow */
-#endif
-  case SSL_ERROR_WANT_WRITE: /* overflow */
-  case SSL_ERROR_WANT_READ:
-  default:
-    break;
+  size_t written = 0;
+  if (!c->out_len) {
+    size_t record = fio_tls_record_size(c);
+    while (count - written >= record) {
+      int ret = fio_tls_record_write(c, (char *)buf + written, record);
+      if (ret <= 0) {
+        fio_tls_write_error(c, ret);
+        return (written ? (ssize_t)written : -1);
+      }
+      written += ret;
+      record = c->record_size;
+    }
+    if (written == count)
+      return written;
   }
-  errno = EWOULDBLOCK;
-  return -1;
+  if (!c->out) {
+    c->out = malloc(TLS_BUFFER_LENGTH);
+    FIO_ASSERT_ALLOC(c->out);
+  }
+  if (c->out_start + c->out_len + (count - written) > TLS_BUFFER_LENGTH) {
+    memmove(c->out, c->out + c->out_start, c->out_len);
+    c->out_start = 0;
+  }
+  size_t len = TLS_BUFFER_LENGTH - (c->out_start + c->out_len);
+  if (len > count - written)
+    len = count - written;
+  memcpy(c->out + c->out_start + c->out_len, (char *)buf + written, len);
+  c->out_len += len;
+  written += len;
+  if (fio_tls_drain(c, 0) && errno != EWOULDBLOCK)
+    return -1;
+  if (!written) {
+    errno = EWOULDBLOCK;
+    return -1;
+  }
+  return written;
   (void)uuid;
 }
 
@@ -623,19 +1075,27 @@ static ssize_t fio_tls_write(intptr_t uuid, void *udata, const void *buf,
  * */
 static ssize_t fio_tls_before_close(intptr_t uuid, void *udata) {
   fio_tls_connection_s *c = udata;
-  SSL_shutdown(c->ssl);
+  /* buffered data is sent before the close_notify alert */
+  if (!c->closing)
+    c->closing = 1;
+  fio_tls_flush(uuid, udata);
   return 1;
-  (void)uuid;
 }
 /**
  * Called to perform cleanup after the socket was closed.
  * */
 static void fio_tls_cleanup(void *udata) {
   fio_tls_connection_s *c = udata;
+  if (fio_tls_hs_release(c))
+    return; /* the handshake thread will call `fio_tls_cleanup` */
   if (!c->alpn_ok) {
     alpn_select(alpn_default(c->tls), -1, c->alpn_arg);
   }
+  /* a disconnection shouldn't invalidate the session (as per RFC 8446) */
+  if (SSL_is_init_finished(c->ssl))
+    SSL_set_shutdown(c->ssl, SSL_get_shutdown(c->ssl) | SSL_SENT_SHUTDOWN);
   SSL_free(c->ssl);
+  free(c->out);
   FIO_LOG_DEBUG("TLS cleanup for %p", (void *)c->uuid);
   fio_tls_destroy(c->tls); /* manage reference count */
   free(udata);
@@ -649,9 +1109,49 @@ static fio_rw_hook_s FIO_TLS_HOOKS = {
     .cleanup = fio_tls_cleanup,
 };
 
+#if FIO_TLS_KTLS
+/**
+ * Sends file data using kernel TLS (the kernel encrypts the data), behaves like
+ * the `sendfile` system call.
+ *
+ * Note: facil.io library functions MUST NEVER be called by any r/w hook, or a
+ * deadlock might occur.
+ */
+static ssize_t fio_tls_sendfile(intptr_t uuid, void *udata, int fd,
+                                off_t *offset, size_t count) {
+  fio_tls_connection_s *c = udata;
+  /* buffered data must be sent first */
+  ssize_t pending = fio_tls_flush(uuid, udata);
+  if (pending) {
+    if (pending > 0)
+      errno = EWOULDBLOCK;
+    return -1;
+  }
+  ossl_ssize_t ret = SSL_sendfile(c->ssl, fd, *offset, count, 0);
+  if (ret > 0) {
+    *offset += ret;
+    return ret;
+  }
+  return fio_tls_write_error(c, (int)ret);
+}
+
+/* the same hooks, with kernel TLS file transmission */
+static fio_rw_hook_s FIO_TLS_KTLS_HOOKS = {
+    .read = fio_tls_read,
+    .write = fio_tls_write,
+    .before_close = fio_tls_before_close,
+    .flush = fio_tls_flush,
+    .cleanup = fio_tls_cleanup,
+    .sendfile = fio_tls_sendfile,
+};
+#endif
+
 static size_t fio_tls_handshake(intptr_t uuid, void *udata) {
   fio_tls_connection_s *c = udata;
   int ri;
+  /* a completed handshake (i.e., by a handshake thread) won't clear the error
+   * queue, stale errors would fail the connection's first `SSL_read` */
+  ERR_clear_error();
   if (c->is_server) {
     ri = SSL_accept(c->ssl);
   } else {
@@ -744,7 +1244,15 @@ static size_t fio_tls_handshake(intptr_t uuid, void *udata) {
       alpn_select(alpn, c->uuid, c->alpn_arg);
     }
   }
-  if (fio_rw_hook_replace_unsafe(uuid, &FIO_TLS_HOOKS, udata) == 0) {
+  fio_rw_hook_s *hooks = &FIO_TLS_HOOKS;
+#if FIO_TLS_KTLS
+  /* the TLS library enabled kernel TLS (transmission) for this connection */
+  if (BIO_get_ktls_send(SSL_get_wbio(c->ssl))) {
+    hooks = &FIO_TLS_KTLS_HOOKS;
+    FIO_LOG_DEBUG("kernel TLS enabled for %p", (void *)uuid);
+  }
+#endif
+  if (fio_rw_hook_replace_unsafe(uuid, hooks, udata) == 0) {
     FIO_LOG_DEBUG("Completed TLS handshake for %p", (void *)uuid);
   } else {
     FIO_LOG_DEBUG("Something went wrong during TLS handshake for %p",
@@ -775,9 +1283,304 @@ static size_t fio_tls_handshake(intptr_t uuid, void *udata) {
   return 1;
 }
 
+/* *****************************************************************************
+Handshake Threads
+
+Server handshakes are started by a dedicated thread group (per worker process),
+which reads the ClientHello and sends the server's reply - performing the
+expensive private key operations. The rest of the handshake (if any) is
+performed by the read/write hooks, on the I/O threads.
+***************************************************************************** */
+
+#if FIO_TLS_HANDSHAKE_THREADS
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static struct {
+  fio_lock_i lock;
+  pid_t pid; /* threads don't survive `fork`, every worker starts it's own */
+  volatile uint8_t stop;
+  int pipe[2]; /* wakes up the handshake threads */
+  int bell[2]; /* wakes up the reactor (handshake threads => I/O threads) */
+  fio_ls_embd_s queue;
+  fio_tls_handshake_stats_s stats;
+  void *threads[FIO_TLS_HANDSHAKE_THREADS];
+} fio_tls_hs = {.lock = FIO_LOCK_INIT, .pipe = {-1, -1}, .bell = {-1, -1}};
+
+/* the doorbell only wakes the reactor, forced events are already scheduled */
+static void fio_tls_hs_bell_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  char tmp[64];
+  while (fio_read(uuid, tmp, sizeof(tmp)) > 0)
+    ;
+  (void)pr;
+}
+
+static void fio_tls_hs_bell_ping(intptr_t uuid, fio_protocol_s *pr) {
+  fio_touch(uuid);
+  (void)pr;
+}
+
+static void fio_tls_hs_bell_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  free(pr);
+  (void)uuid;
+}
+
+/* attaches a copy of the doorbell's read end, so closing it is safe */
+static int fio_tls_hs_bell_attach(void) {
+  int fd = dup(fio_tls_hs.bell[0]);
+  if (fd == -1)
+    return -1;
+  fio_protocol_s *pr = malloc(sizeof(*pr));
+  FIO_ASSERT_ALLOC(pr);
+  *pr = (fio_protocol_s){
+      .on_data = fio_tls_hs_bell_on_data,
+      .on_close = fio_tls_hs_bell_on_close,
+      .ping = fio_tls_hs_bell_ping,
+  };
+  fio_attach_fd(fd, pr);
+  return 0;
+}
+
+/* completes the cleanup of a connection closed during it's handshake */
+static void fio_tls_hs_orphan_cleanup(void *c, void *ignr_) {
+  fio_tls_cleanup(c);
+  (void)ignr_;
+}
+
+static void *fio_tls_hs_thread(void *ignr_) {
+  while (!fio_tls_hs.stop) {
+    fio_lock(&fio_tls_hs.lock);
+    fio_ls_embd_s *node = fio_ls_embd_shift(&fio_tls_hs.queue);
+    if (node) {
+      FIO_LS_EMBD_OBJ(fio_tls_connection_s, hs_node, node)->hs =
+          FIO_TLS_HS_RUNNING;
+      --fio_tls_hs.stats.queued;
+      ++fio_tls_hs.stats.active;
+    }
+    fio_unlock(&fio_tls_hs.lock);
+    if (!node) {
+      struct pollfd wait = {.fd = fio_tls_hs.pipe[0], .events = POLLIN};
+      if (poll(&wait, 1, 1000) > 0) {
+        char tmp[64];
+        ssize_t r = read(fio_tls_hs.pipe[0], tmp, sizeof(tmp));
+        (void)r;
+      }
+      continue;
+    }
+    fio_tls_connection_s *c =
+        FIO_LS_EMBD_OBJ(fio_tls_connection_s, hs_node, node);
+    int ret = SSL_accept(c->ssl);
+    /* a partial ClientHello is completed by another handshake thread */
+    uint8_t state = (ret != 1 && SSL_in_before(c->ssl) &&
+                     SSL_get_error(c->ssl, ret) == SSL_ERROR_WANT_READ)
+                        ? FIO_TLS_HS_WAIT
+                        : FIO_TLS_HS_INLINE;
+    ERR_clear_error(); /* errors are reported by the I/O thread */
+    intptr_t uuid = c->uuid;
+    fio_lock(&fio_tls_hs.lock);
+    --fio_tls_hs.stats.active;
+    ++fio_tls_hs.stats.completed;
+    uint8_t orphan = c->hs_orphan;
+    /* the I/O threads use the connection's file descriptor */
+    int fd = c->hs_fd;
+    c->hs_fd = -1;
+    if (!orphan)
+      BIO_set_fd(SSL_get_rbio(c->ssl), fio_uuid2fd(uuid), BIO_NOCLOSE);
+    c->hs = state;
+    fio_unlock(&fio_tls_hs.lock);
+    close(fd);
+    if (orphan) {
+      /* the connection was closed while the handshake was performed */
+      fio_defer(fio_tls_hs_orphan_cleanup, c, NULL);
+      continue;
+    }
+    /* the I/O threads pick up where the handshake thread left off */
+    fio_force_event(uuid, FIO_EVENT_ON_DATA);
+    fio_force_event(uuid, FIO_EVENT_ON_READY);
+    if (write(fio_tls_hs.bell[1], "", 1) < 0) {
+      /* a full pipe is a pending wakeup */
+    }
+  }
+  return NULL;
+  (void)ignr_;
+}
+
+static void fio_tls_hs_stop(void *ignr_) {
+  if (fio_tls_hs.pid != getpid() || fio_tls_hs.stop)
+    return;
+  fio_tls_hs.stop = 1;
+  for (size_t i = 0; i < FIO_TLS_HANDSHAKE_THREADS; ++i) {
+    if (write(fio_tls_hs.pipe[1], "", 1) < 0)
+      break;
+  }
+  for (size_t i = 0; i < FIO_TLS_HANDSHAKE_THREADS; ++i) {
+    if (!fio_tls_hs.threads[i])
+      continue;
+    fio_thread_join(fio_tls_hs.threads[i]);
+    fio_tls_hs.threads[i] = NULL;
+  }
+  (void)ignr_;
+}
+
+/* starts the calling process's handshake threads (call within the lock) */
+static int fio_tls_hs_start(void) {
+  if (fio_tls_hs.pid == getpid())
+    return !fio_tls_hs.stop;
+  /* a forked process inherits the parent's state, but not it's threads */
+  for (size_t i = 0; i < 2; ++i) {
+    if (fio_tls_hs.pipe[i] != -1)
+      close(fio_tls_hs.pipe[i]);
+    if (fio_tls_hs.bell[i] != -1)
+      close(fio_tls_hs.bell[i]);
+    fio_tls_hs.pipe[i] = fio_tls_hs.bell[i] = -1;
+  }
+  fio_tls_hs.pid = getpid();
+  fio_tls_hs.stop = 0;
+  fio_tls_hs.queue = (fio_ls_embd_s)FIO_LS_INIT(fio_tls_hs.queue);
+  fio_tls_hs.stats = (fio_tls_handshake_stats_s){.queued = 0};
+  if (pipe(fio_tls_hs.pipe) || pipe(fio_tls_hs.bell))
+    goto failed;
+  for (size_t i = 0; i < 2; ++i) {
+    fcntl(fio_tls_hs.pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(fio_tls_hs.bell[i], F_SETFL, O_NONBLOCK);
+  }
+  if (fio_tls_hs_bell_attach())
+    goto failed;
+  for (size_t i = 0; i < FIO_TLS_HANDSHAKE_THREADS; ++i) {
+    fio_tls_hs.threads[i] = fio_thread_new(fio_tls_hs_thread, NULL);
+    if (!fio_tls_hs.threads[i]) {
+      FIO_LOG_ERROR("(TLS) couldn't start a handshake thread.");
+      fio_tls_hs.stop = !i;
+      break;
+    }
+  }
+  fio_state_callback_add(FIO_CALL_ON_FINISH, fio_tls_hs_stop, NULL);
+  return !fio_tls_hs.stop;
+failed:
+  FIO_LOG_ERROR("(TLS) couldn't create the handshake threads' pipes, "
+                "handshakes will be performed by the I/O threads.");
+  fio_tls_hs.stop = 1;
+  return 0;
+}
+
+/**
+ * Hands a server handshake to the handshake threads once the ClientHello
+ * arrives.
+ *
+ * Returns 0 if the handshake is performed by the I/O threads, 1 while waiting
+ * for data and 2 while the handshake is owned by the handshake threads (or
+ * refused, in which case the connection is being closed).
+ */
+static int fio_tls_hs_schedule(intptr_t uuid, fio_tls_connection_s *c) {
+  if (c->hs == FIO_TLS_HS_INLINE)
+    return 0;
+  if (c->hs != FIO_TLS_HS_WAIT)
+    return 2;
+  /* the handshake threads shouldn't wait for the ClientHello */
+  char tmp;
+  ssize_t peek = recv(fio_uuid2fd(uuid), &tmp, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (peek < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 1;
+  uint8_t refused = 0;
+  fio_lock(&fio_tls_hs.lock);
+  if (c->hs == FIO_TLS_HS_WAIT) {
+    /*
+     * The handshake thread reads and writes using a copy of the file
+     * descriptor, so the connection's file descriptor can be closed (and
+     * reused) while the handshake is performed.
+     */
+    if (peek > 0 && fio_tls_hs_start())
+      c->hs_fd = dup(fio_uuid2fd(uuid));
+    if (c->hs_fd == -1) {
+      /* errors (and EOF) are reported by the I/O thread */
+      c->hs = FIO_TLS_HS_INLINE;
+    } else if (fio_tls_hs.stats.queued + fio_tls_hs.stats.active >=
+               FIO_TLS_HANDSHAKE_LIMIT) {
+      /* the private key operations are skipped, not postponed */
+      ++fio_tls_hs.stats.rejected;
+      c->hs = FIO_TLS_HS_REFUSED;
+      refused = 1;
+      close(c->hs_fd);
+      c->hs_fd = -1;
+    } else {
+      BIO_set_fd(SSL_get_rbio(c->ssl), c->hs_fd, BIO_NOCLOSE);
+      c->hs = FIO_TLS_HS_QUEUED;
+      fio_ls_embd_push(&fio_tls_hs.queue, &c->hs_node);
+      ++fio_tls_hs.stats.queued;
+      ssize_t r = write(fio_tls_hs.pipe[1], "", 1);
+      (void)r; /* a full pipe is a pending wakeup */
+    }
+  }
+  int ret = (c->hs != FIO_TLS_HS_INLINE) << 1;
+  fio_unlock(&fio_tls_hs.lock);
+  if (refused) {
+    FIO_LOG_DEBUG("TLS handshake refused for %p (FIO_TLS_HANDSHAKE_LIMIT)",
+                  (void *)uuid);
+    fio_defer(fio_tls_delayed_close, (void *)uuid, NULL);
+  }
+  return ret;
+}
+
+/* returns 1 if a handshake thread owns the connection (and will free it) */
+static int fio_tls_hs_release(fio_tls_connection_s *c) {
+  if (c->hs < FIO_TLS_HS_QUEUED)
+    return 0;
+  int ret = 0;
+  fio_lock(&fio_tls_hs.lock);
+  if (c->hs == FIO_TLS_HS_QUEUED) {
+    fio_ls_embd_remove(&c->hs_node);
+    --fio_tls_hs.stats.queued;
+    c->hs = FIO_TLS_HS_INLINE;
+    close(c->hs_fd);
+    c->hs_fd = -1;
+  } else if (c->hs == FIO_TLS_HS_RUNNING) {
+    /* the handshake thread's copy keeps the socket open, end the handshake */
+    shutdown(c->hs_fd, SHUT_RDWR);
+    c->hs_orphan = 1;
+    ret = 1;
+  }
+  fio_unlock(&fio_tls_hs.lock);
+  return ret;
+}
+
+/**
+ * Returns the handshake thread statistics for the calling (worker) process.
+ */
+fio_tls_handshake_stats_s FIO_TLS_WEAK fio_tls_handshake_stats(void) {
+  fio_tls_handshake_stats_s ret = {.queued = 0};
+  fio_lock(&fio_tls_hs.lock);
+  if (fio_tls_hs.pid == getpid())
+    ret = fio_tls_hs.stats;
+  fio_unlock(&fio_tls_hs.lock);
+  return ret;
+}
+
+#else
+
+/**
+ * Returns the handshake thread statistics for the calling (worker) process.
+ */
+fio_tls_handshake_stats_s FIO_TLS_WEAK fio_tls_handshake_stats(void) {
+  return (fio_tls_handshake_stats_s){.queued = 0};
+}
+
+#endif
+
 static ssize_t fio_tls_read4handshake(intptr_t uuid, void *udata, void *buf,
                                       size_t count) {
   // FIO_LOG_DEBUG("TLS handshake from read %p", (void *)uuid);
+  switch (fio_tls_hs_schedule(uuid, udata)) {
+  case 2:
+    /* don't poll the socket, the handshake thread will force an event */
+    fio_suspend(uuid);
+    /* fallthrough */
+  case 1:
+    errno = EWOULDBLOCK;
+    return -1;
+  }
   if (fio_tls_handshake(uuid, udata))
     return fio_tls_read(uuid, udata, buf, count);
   errno = EWOULDBLOCK;
@@ -787,7 +1590,7 @@ static ssize_t fio_tls_read4handshake(intptr_t uuid, void *udata, void *buf,
 static ssize_t fio_tls_write4handshake(intptr_t uuid, void *udata,
                                        const void *buf, size_t count) {
   // FIO_LOG_DEBUG("TLS handshake from write %p", (void *)uuid);
-  if (fio_tls_handshake(uuid, udata))
+  if (!fio_tls_hs_schedule(uuid, udata) && fio_tls_handshake(uuid, udata))
     return fio_tls_write(uuid, udata, buf, count);
   errno = EWOULDBLOCK;
   return -1;
@@ -795,6 +1598,13 @@ static ssize_t fio_tls_write4handshake(intptr_t uuid, void *udata,
 
 static ssize_t fio_tls_flush4handshake(intptr_t uuid, void *udata) {
   // FIO_LOG_DEBUG("TLS handshake from flush %p", (void *)uuid);
+  switch (fio_tls_hs_schedule(uuid, udata)) {
+  case 2:
+    return 0; /* the handshake thread will force an event (or refused) */
+  case 1:
+    errno = 0;
+    return 1;
+  }
   if (fio_tls_handshake(uuid, udata)) {
     return fio_tls_flush(uuid, udata);
   }
@@ -821,6 +1631,9 @@ static inline void fio_tls_attach2uuid(intptr_t uuid, fio_tls_s *tls,
       .ssl = SSL_new(tls->ctx),
       .is_server = is_server,
       .alpn_ok = 0,
+      .hs_fd = -1,
+      .hs = (FIO_TLS_HANDSHAKE_THREADS && is_server) ? FIO_TLS_HS_WAIT
+                                                     : FIO_TLS_HS_INLINE,
   };
   FIO_ASSERT_ALLOC(c->ssl);
   /* set facil.io data in the SSL object */
@@ -0,0 +1,200 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A connection rate benchmark over loopback, measuring the sustained number of
+ * accepted connections per second.
+ *
+ * The server listens on two ports, sending a single byte to every new
+ * connection before closing it. Forked clients flood the first port (connect,
+ * read, close) while a probe measures the latency of connections to the second
+ * port, showing whether a flood on one listening socket starves the other.
+ *
+ * Use `-spread` to spread the `on_open` callbacks across the worker threads
+ * (see `fio_listen`'s `spread_accept`).
+ *
+ * Run with:
+ *
+ *       make test/lib/accept_rate
+ *       ./tmp/demo -t 4 -c 4 -s 3
+ */
+#include <fio.h>
+#include <fio_cli.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int port = 9445;
+static size_t clients = 4;
+static size_t seconds = 3;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The server (sends a single byte and closes the connection)
+***************************************************************************** */
+
+static void server_on_open(intptr_t uuid, void *udata) {
+  fio_write(uuid, "k", 1);
+  fio_close(uuid);
+  (void)udata;
+}
+
+/* *****************************************************************************
+The clients
+***************************************************************************** */
+
+/* connects, waits for the server's byte and closes. Returns 0 on success. */
+static int client_connection(int port_) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port_),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  char c;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  /* reset instead of TIME_WAIT, so the client doesn't run out of ports */
+  struct linger l = {.l_onoff = 1, .l_linger = 0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+  int ret = -1;
+  if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)) &&
+      read(fd, &c, 1) == 1)
+    ret = 0;
+  close(fd);
+  return ret;
+}
+
+/* floods the first port until the deadline, returns the connection count */
+static size_t client_flood(uint64_t deadline) {
+  size_t count = 0;
+  while (bench_now_ns() < deadline) {
+    if (!client_connection(port))
+      ++count;
+  }
+  return count;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t a_ = *(const uint64_t *)a, b_ = *(const uint64_t *)b;
+  return (a_ > b_) - (a_ < b_);
+}
+
+static void client_main(void) {
+  /* wait for the server */
+  for (size_t i = 0; i < 500 && client_connection(port + 1); ++i)
+    usleep(10000);
+  int counts[2];
+  FIO_ASSERT(!pipe(counts), "couldn't create the clients' pipe");
+  uint64_t start = bench_now_ns();
+  uint64_t deadline = start + (seconds * 1000000000ULL);
+  pid_t *flood = calloc(clients, sizeof(*flood));
+  FIO_ASSERT_ALLOC(flood);
+  for (size_t i = 0; i < clients; ++i) {
+    flood[i] = fork();
+    FIO_ASSERT(flood[i] != -1, "couldn't fork a client");
+    if (!flood[i]) {
+      size_t count = client_flood(deadline);
+      if (write(counts[1], &count, sizeof(count)) != sizeof(count))
+        _exit(1);
+      _exit(0);
+    }
+  }
+  /* probe the second listening socket (once per millisecond) */
+  size_t probes = 0, failed = 0, capa = seconds * 1000;
+  uint64_t *latency = malloc(sizeof(*latency) * capa);
+  FIO_ASSERT_ALLOC(latency);
+  while (bench_now_ns() < deadline && probes < capa) {
+    uint64_t t = bench_now_ns();
+    if (client_connection(port + 1))
+      ++failed;
+    else
+      latency[probes++] = bench_now_ns() - t;
+    usleep(1000);
+  }
+  size_t total = 0;
+  for (size_t i = 0; i < clients; ++i) {
+    size_t count = 0;
+    waitpid(flood[i], NULL, 0);
+    if (read(counts[0], &count, sizeof(count)) == sizeof(count))
+      total += count;
+  }
+  double elapsed = (double)(bench_now_ns() - start) / 1000000000.0;
+  fprintf(stderr, "* %zu clients flooding a listening socket for %zu seconds:\n"
+                  "    %8.0f connections/sec (%zu connections)\n",
+          clients, seconds, total / elapsed, total);
+  if (probes) {
+    qsort(latency, probes, sizeof(*latency), cmp_u64);
+    fprintf(stderr,
+            "* %zu connections to the second listening socket (%zu failed):\n"
+            "    p50 %8.1f us    p99 %8.1f us    max %8.1f us\n",
+            probes, failed, latency[probes >> 1] / 1000.0,
+            latency[(probes * 99) / 100] / 1000.0,
+            latency[probes - 1] / 1000.0);
+  }
+  free(latency);
+  free(flood);
+  close(counts[0]);
+  close(counts[1]);
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "A connection rate benchmark (loopback). Arguments:",
+      FIO_CLI_INT("-port -p the first of two ports to listen to (9445)."),
+      FIO_CLI_INT("-threads -t the number of server threads (1)."),
+      FIO_CLI_INT("-workers -w the number of server worker processes (1)."),
+      FIO_CLI_INT("-clients -c the number of flooding clients (4)."),
+      FIO_CLI_INT("-seconds -s the benchmark's duration (3)."),
+      FIO_CLI_BOOL("-spread spread new connections across the threads."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    clients = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get_i("-s") > 0)
+    seconds = (size_t)fio_cli_get_i("-s");
+  int threads = fio_cli_get("-t") ? fio_cli_get_i("-t") : 1;
+  int workers = fio_cli_get("-w") ? fio_cli_get_i("-w") : 1;
+  uint8_t spread = (uint8_t)fio_cli_get_bool("-spread");
+
+  for (int i = 0; i < 2; ++i) {
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port + i);
+    FIO_ASSERT(fio_listen(.port = port_str, .address = "127.0.0.1",
+                          .on_open = server_on_open,
+                          .spread_accept = spread) != -1,
+               "couldn't listen on port %s", port_str);
+  }
+
+  pid_t client = fork();
+  FIO_ASSERT(client != -1, "couldn't fork the client process");
+  if (!client) {
+    client_main();
+    kill(getppid(), SIGINT);
+    fflush(stderr);
+    _exit(0);
+  }
+  fio_start(.threads = threads, .workers = workers);
+  waitpid(client, NULL, 0);
+  fio_cli_end();
+  return 0;
+}
@@ -0,0 +1,218 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Tests the shared memory cluster transport (`FIO_CLUSTER_SHM`).
+ *
+ * Each worker publishes `-n` numbered messages to the root process, after which
+ * the root process publishes `-n` numbered messages to the workers. Messages
+ * are published in bursts of `-b` messages (every millisecond). Messages are
+ * up to 768 bytes long, but every `-l` message is larger than a quarter of the
+ * ring (sent using the Unix socket).
+ *
+ * Messages must arrive in the order they were published, even when the socket
+ * is used as a fallback.
+ *
+ * The library must be compiled with the flag, so run with:
+ *
+ *       make clean
+ *       make test/lib/cluster_shm FIO_CLUSTER_SHM=1
+ *
+ * Test full rings (most bursts don't fit) using the smallest ring size:
+ *
+ *       make clean
+ *       make test/lib/cluster_shm FIO_CLUSTER_SHM=1 FIO_CLUSTER_SHM_RING_SIZE=4096
+ */
+#include <fio.h>
+#include <fio_cli.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#if !FIO_CLUSTER_SHM
+#error "run with: make test/lib/cluster_shm FIO_CLUSTER_SHM=1"
+#endif
+
+#ifndef FIO_CLUSTER_SHM_RING_SIZE
+#define FIO_CLUSTER_SHM_RING_SIZE (1UL << 20)
+#endif
+
+/* messages over a quarter of the ring are sent using the Unix socket */
+#define LARGE_MESSAGE ((FIO_CLUSTER_SHM_RING_SIZE >> 2) + 1)
+
+static size_t messages = 100000;
+static size_t large_every = 1000;
+static size_t burst = 32;
+static uint16_t workers = 4;
+
+static char *payload;
+static uint64_t start;
+
+/* root: the next sequence number expected from each worker */
+static struct {
+  uint32_t pid;
+  uint64_t next;
+} senders[256];
+static size_t received = 0;
+static size_t finished = 0;
+
+/* worker: the next sequence number expected from the root */
+static uint64_t down_next = 0;
+
+/* the number of messages published (by the root or the worker) */
+static size_t published = 0;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000) + (uint64_t)t.tv_nsec;
+}
+
+static double bench_rate(size_t count) {
+  return (double)count * 1000000000.0 / (double)(bench_now_ns() - start + 1);
+}
+
+static size_t message_length(uint64_t seq) {
+  if ((seq % large_every) == large_every - 1)
+    return LARGE_MESSAGE;
+  return 12 + (size_t)(seq & 63) * 12;
+}
+
+/* publishes a burst of numbered messages (pid and sequence number) */
+static void publish_burst(void *is_root) {
+  fio_str_info_s channel = {.data = "up", .len = 2};
+  fio_pubsub_engine_s *engine = FIO_PUBSUB_ROOT;
+  if (is_root) {
+    channel = (fio_str_info_s){.data = "down", .len = 4};
+    engine = FIO_PUBSUB_CLUSTER;
+  }
+  for (size_t i = 0; i < burst && published < messages; ++i) {
+    fio_u2str32(payload, (uint32_t)getpid());
+    fio_u2str64(payload + 4, (uint64_t)published);
+    fio_publish(.engine = engine, .channel = channel,
+                .message = {.data = payload,
+                            .len = message_length(published)});
+    ++published;
+  }
+}
+
+static void publish_all(void *is_root) {
+  fio_run_every(1, (messages + burst - 1) / burst, publish_burst, is_root,
+                NULL);
+}
+
+static void check_message(fio_msg_s *msg, uint64_t expected) {
+  uint64_t seq = fio_str2u64(msg->msg.data + 4);
+  size_t len = message_length(seq);
+  FIO_ASSERT(seq == expected,
+             "(%d) message out of order (got %llu, expected %llu)",
+             (int)getpid(), (unsigned long long)seq,
+             (unsigned long long)expected);
+  FIO_ASSERT(msg->msg.len == len, "(%d) message length error (%zu != %zu)",
+             (int)getpid(), msg->msg.len, len);
+}
+
+/* *****************************************************************************
+The root process
+***************************************************************************** */
+
+static void root_on_done(fio_msg_s *msg) {
+  if (++finished < workers)
+    return;
+  fprintf(stderr, "* root => workers: %.0f messages / sec (per worker)\n",
+          bench_rate(messages));
+  fprintf(stderr, "* passed.\n");
+  fio_stop();
+  (void)msg;
+}
+
+static void root_on_message(fio_msg_s *msg) {
+  uint32_t pid = fio_str2u32(msg->msg.data);
+  size_t i = 0;
+  while (i < 255 && senders[i].pid && senders[i].pid != pid)
+    ++i;
+  FIO_ASSERT(i < 255, "too many publishing workers (respawned?)");
+  senders[i].pid = pid;
+  check_message(msg, senders[i].next++);
+  if (++received < messages * workers)
+    return;
+  fprintf(stderr, "* workers => root: %.0f messages / sec (%u workers)\n",
+          bench_rate(messages * workers), (unsigned int)workers);
+  start = bench_now_ns();
+  publish_all((void *)1);
+}
+
+static void root_on_timeout(void *ignr_) {
+  FIO_ASSERT(0, "test timed out (%zu messages received, %zu workers done)",
+             received, finished);
+  (void)ignr_;
+}
+
+static void root_start(void *ignr_) {
+  if (!fio_is_master())
+    return;
+  fio_subscribe(.channel = {.data = "up", .len = 2},
+                .on_message = root_on_message);
+  fio_subscribe(.channel = {.data = "done", .len = 4},
+                .on_message = root_on_done);
+  fio_run_every(60000, 1, root_on_timeout, NULL, NULL);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+The worker processes
+***************************************************************************** */
+
+static void worker_on_message(fio_msg_s *msg) {
+  check_message(msg, down_next++);
+  if (down_next == messages)
+    fio_publish(.engine = FIO_PUBSUB_ROOT,
+                .channel = {.data = "done", .len = 4});
+}
+
+static void worker_start(void *ignr_) {
+  if (fio_is_master())
+    return;
+  /* the subscription is sent to the root before the messages */
+  fio_subscribe(.channel = {.data = "down", .len = 4},
+                .on_message = worker_on_message);
+  publish_all(NULL);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "A shared memory cluster transport test. Arguments:",
+      FIO_CLI_INT("-workers -w the number of worker processes (4)."),
+      FIO_CLI_INT("-messages -n the number of messages in each direction "
+                  "(100000)."),
+      FIO_CLI_INT("-large -l every how many messages one is large (1000)."),
+      FIO_CLI_INT("-burst -b messages published every millisecond (32)."));
+  if (fio_cli_get_i("-w") > 1)
+    workers = (uint16_t)fio_cli_get_i("-w");
+  if (fio_cli_get_i("-n") > 0)
+    messages = (size_t)fio_cli_get_i("-n");
+  if (fio_cli_get_i("-l") > 0)
+    large_every = (size_t)fio_cli_get_i("-l");
+  if (fio_cli_get_i("-b") > 0)
+    burst = (size_t)fio_cli_get_i("-b");
+  fio_cli_end();
+  FIO_ASSERT(workers < 128, "too many workers (127 at most)");
+
+  payload = calloc(LARGE_MESSAGE, 1);
+  FIO_ASSERT_ALLOC(payload);
+  start = bench_now_ns();
+  fio_state_callback_add(FIO_CALL_PRE_START, root_start, NULL);
+  fio_state_callback_add(FIO_CALL_ON_START, worker_start, NULL);
+  fio_start(.threads = 1, .workers = workers);
+  free(payload);
+  return 0;
+}
@@ -43,6 +43,25 @@ typedef uintptr_t (*hashing_func_fn)(char *, size_t);
 #define FIO_SET_OBJ_TYPE hashing_func_fn
 #include <fio.h>
 
+/* Set backends compared by the benchmark (`-b`) */
+#define FIO_SET_NAME bench_map
+#define FIO_SET_OBJ_TYPE fio_str_s *
+#define FIO_SET_OBJ_COMPARE(a, b) fio_str_iseq((a), (b))
+#include <fio.h>
+
+#define FIO_SET_NAME bench_swiss
+#define FIO_SET_OBJ_TYPE fio_str_s *
+#define FIO_SET_OBJ_COMPARE(a, b) fio_str_iseq((a), (b))
+#define FIO_SET_SWISS 1
+#include <fio.h>
+
+#define FIO_SET_NAME bench_swiss_ordered
+#define FIO_SET_OBJ_TYPE fio_str_s *
+#define FIO_SET_OBJ_COMPARE(a, b) fio_str_iseq((a), (b))
+#define FIO_SET_SWISS 1
+#define FIO_SET_ORDERED 1
+#include <fio.h>
+
 #define FIO_ARY_NAME words
 #define FIO_ARY_TYPE fio_str_s
 #define FIO_ARY_COMPARE(a, b) fio_str_iseq(&(a), &(b))
@@ -67,10 +86,16 @@ static void initialize_hash_names(void);
 static void print_hash_names(void);
 static char *hash_name(hashing_func_fn fn);
 static void cleanup(void);
+static void benchmark_sets(void);
 
 int main(int argc, char const *argv[]) {
   // FIO_LOG_LEVEL = FIO_LOG_LEVEL_DEBUG;
   initialize_cli(argc, argv);
+  if (fio_cli_get_bool("-b")) {
+    benchmark_sets();
+    fio_cli_end();
+    return 0;
+  }
   load_words();
   initialize_hash_names();
   if (fio_cli_get("-t")) {
@@ -109,6 +134,8 @@ static void initialize_cli(int argc, char const *argv[]) {
       FIO_CLI_STRING(
           "-dictionary -d a text file containing words separated by an "
           "EOL marker."),
+      FIO_CLI_BOOL("-bench -b benchmark the Set backends (no collision test)."),
+      FIO_CLI_INT("-keys -k the number of keys used by the benchmark."),
       FIO_CLI_BOOL("-v make output more verbouse (debug mode)"));
   if (fio_cli_get_bool("-v"))
     FIO_LOG_LEVEL = FIO_LOG_LEVEL_DEBUG;
@@ -384,6 +411,116 @@ static void test_hash_function(hashing_func_fn h) {
   collisions_free(&c);
 }
 
+/* *****************************************************************************
+Set backend benchmark (lookup-hit, lookup-miss and churn)
+
+Compares the default Set backend (`map` + `ordered` arrays) with the Swiss
+table backend (FIO_SET_SWISS), with and without insertion order, using
+`fio_str_hash` (Risky Hash) for "key-#" Strings. Run with:
+
+    ./collisions -b -k 1000000
+***************************************************************************** */
+
+static size_t bench_keys = 262144;
+static fio_str_s *bench_hit;    /* keys in the Set */
+static fio_str_s *bench_miss;   /* keys that aren't in the Set */
+static uint64_t *bench_hash;    /* hash values for `bench_hit` */
+static uint64_t *bench_hash_mx; /* hash values for `bench_miss` */
+static size_t *bench_order;     /* a shuffled lookup order */
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+static void bench_report(const char *set, const char *workload, size_t ops,
+                         uint64_t ns) {
+  fprintf(stderr, "    %-22s %-12s %8.2f ns/op\n", set, workload,
+          (double)ns / ops);
+}
+
+/* runs all workloads for a Set type (the Set's API is the same) */
+#define BENCHMARK_SET(name)                                                    \
+  static void benchmark_##name(void) {                                         \
+    name##_s s = FIO_SET_INIT;                                                 \
+    size_t found = 0;                                                          \
+    uint64_t start = bench_now_ns();                                           \
+    for (size_t i = 0; i < bench_keys; ++i)                                    \
+      name##_insert(&s, bench_hash[i], bench_hit + i);                         \
+    bench_report(#name, "insert", bench_keys, bench_now_ns() - start);         \
+    start = bench_now_ns();                                                    \
+    for (size_t i = 0; i < bench_keys; ++i) {                                  \
+      const size_t k = bench_order[i];                                         \
+      found += (name##_find(&s, bench_hash[k], bench_hit + k) != NULL);        \
+    }                                                                          \
+    bench_report(#name, "lookup-hit", bench_keys, bench_now_ns() - start);     \
+    start = bench_now_ns();                                                    \
+    for (size_t i = 0; i < bench_keys; ++i) {                                  \
+      const size_t k = bench_order[i];                                         \
+      found += (name##_find(&s, bench_hash_mx[k], bench_miss + k) != NULL);    \
+    }                                                                          \
+    bench_report(#name, "lookup-miss", bench_keys, bench_now_ns() - start);    \
+    start = bench_now_ns();                                                    \
+    for (size_t i = 0; i < bench_keys; ++i) {                                  \
+      const size_t k = bench_order[i];                                         \
+      name##_remove(&s, bench_hash[k], bench_hit + k, NULL);                   \
+      name##_insert(&s, bench_hash_mx[k], bench_miss + k);                     \
+    }                                                                          \
+    for (size_t i = 0; i < bench_keys; ++i) {                                  \
+      const size_t k = bench_order[i];                                         \
+      name##_remove(&s, bench_hash_mx[k], bench_miss + k, NULL);               \
+      name##_insert(&s, bench_hash[k], bench_hit + k);                         \
+    }                                                                          \
+    bench_report(#name, "churn", bench_keys << 2, bench_now_ns() - start);     \
+    FIO_ASSERT(found == bench_keys && name##_count(&s) == bench_keys,          \
+               #name " benchmark sanity test failed (%zu, %zu)", found,        \
+               name##_count(&s));                                              \
+    name##_free(&s);                                                           \
+  }
+
+BENCHMARK_SET(bench_map)
+BENCHMARK_SET(bench_swiss)
+BENCHMARK_SET(bench_swiss_ordered)
+
+static void benchmark_sets(void) {
+  if (fio_cli_get_i("-k") > 0)
+    bench_keys = (size_t)fio_cli_get_i("-k");
+  bench_hit = calloc(sizeof(*bench_hit), bench_keys);
+  bench_miss = calloc(sizeof(*bench_miss), bench_keys);
+  bench_hash = calloc(sizeof(*bench_hash), bench_keys);
+  bench_hash_mx = calloc(sizeof(*bench_hash_mx), bench_keys);
+  bench_order = calloc(sizeof(*bench_order), bench_keys);
+  FIO_ASSERT_ALLOC(bench_hit && bench_miss && bench_hash && bench_hash_mx &&
+                   bench_order);
+  for (size_t i = 0; i < bench_keys; ++i) {
+    fio_str_printf(bench_hit + i, "key-%zu", i);
+    fio_str_printf(bench_miss + i, "missing-key-%zu", i);
+    bench_hash[i] = fio_str_hash(bench_hit + i);
+    bench_hash_mx[i] = fio_str_hash(bench_miss + i);
+    bench_order[i] = i;
+  }
+  for (size_t i = bench_keys - 1; i; --i) {
+    const size_t j = (size_t)(fio_rand64() % (i + 1));
+    const size_t tmp = bench_order[i];
+    bench_order[i] = bench_order[j];
+    bench_order[j] = tmp;
+  }
+  fprintf(stderr, "* Set benchmark, %zu keys:\n", bench_keys);
+  benchmark_bench_map();
+  benchmark_bench_swiss();
+  benchmark_bench_swiss_ordered();
+  for (size_t i = 0; i < bench_keys; ++i) {
+    fio_str_free(bench_hit + i);
+    fio_str_free(bench_miss + i);
+  }
+  free(bench_hit);
+  free(bench_miss);
+  free(bench_hash);
+  free(bench_hash_mx);
+  free(bench_order);
+}
+
 /* *****************************************************************************
 Finsing a mod64 inverse
 See: https://lemire.me/blog/2017/09/18/computing-the-inverse-of-odd-integers/
@@ -27,6 +27,19 @@ void resp_test(void) {
   FIO_ASSERT(!resp_parse(&parser, array_x3_i, sizeof(array_x3_i) - 1),
              "RESP parser didn't parse the whole of the Array response data "
              "(or parsed more).");
+  FIO_ASSERT(resp_frame_length(OK, sizeof(OK) - 1) == sizeof(OK) - 1,
+             "RESP frame length error for the OK response.");
+  FIO_ASSERT(resp_frame_length(array_x3_i, sizeof(array_x3_i) - 1) ==
+                 sizeof(array_x3_i) - 1 - 6,
+             "RESP frame length error for the Array response.");
+  FIO_ASSERT(!resp_frame_length(array_x3_i, sizeof(array_x3_i) - 10),
+             "RESP frame length should be zero for incomplete data.");
+  FIO_ASSERT(resp_frame_length("x\r\n", 3) == -1,
+             "RESP frame length should be -1 for invalid data.");
+  FIO_ASSERT(resp_frame_length("$99999999999999999999\r\n", 23) == -1,
+             "RESP frame length should be -1 for overflowing lengths.");
+  FIO_ASSERT(!resp_frame_length("*9223372036854775807\r\n:1\r\n", 26),
+             "RESP frame length should be zero for impossibly long arrays.");
 }
 
 static int resp_on_number(resp_parser_s *parser, int64_t num) {
@@ -0,0 +1,279 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Tests the non-blocking DNS resolver used by `fio_connect`, using a local UDP
+ * DNS stand-in (a thread) that knows the following names:
+ *
+ * * `delay.test` - the A answer (127.0.0.1) is delayed (`-delay`, 300ms).
+ *
+ * * `dual.test` - an unreachable IPv6 address (100::1) and 127.0.0.1, so the
+ *   connection attempts are raced (Happy Eyeballs).
+ *
+ * * any other name isn't found (NXDOMAIN).
+ *
+ * HTTP clients connect to a local server using these names. A timer measures
+ * how late the reactor is (it would stall for the whole delay if the resolver
+ * blocked). The second round of requests should be answered from the cache.
+ *
+ * Run with:
+ *
+ *       make test/lib/dns
+ *       ./tmp/demo -c 16 -delay 300
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <http.h>
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+
+static int port = 9450;
+static size_t concurrency = 16;
+static size_t delay_ms = 300;
+
+static volatile size_t dns_queries = 0;
+static volatile size_t responses = 0;
+static volatile size_t finished = 0;
+static size_t expected = 0;
+static size_t round_num = 0;
+static uint64_t round_start;
+static uint64_t last_tick;
+static uint64_t max_lag;
+static char host_port[16];
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The DNS stand-in
+***************************************************************************** */
+
+static size_t dns_record(uint8_t *pos, uint16_t type, uint32_t ttl,
+                         const void *data, uint16_t len) {
+  /* the record's name is a pointer to the question's name */
+  const uint8_t head[] = {
+      0xC0,      12,        type >> 8, type & 0xFF, 0,        1,
+      ttl >> 24, ttl >> 16, ttl >> 8,  ttl & 0xFF,  len >> 8, len & 0xFF,
+  };
+  memcpy(pos, head, sizeof(head));
+  memcpy(pos + sizeof(head), data, len);
+  return sizeof(head) + len;
+}
+
+static size_t dns_answer(uint8_t *msg, size_t len, const char *name,
+                         uint16_t type) {
+  static const uint8_t soa[] = {
+      2, 'n', 's', 0,           /* mname */
+      4, 'r', 'o', 'o', 't', 0, /* rname */
+      0, 0,   0,   1,           /* serial */
+      0, 0,   14,  16,          /* refresh */
+      0, 0,   3,   132,         /* retry */
+      0, 9,   58,  128,         /* expire */
+      0, 0,   0,   30,          /* minimum */
+  };
+  uint8_t *pos = msg + len;
+  uint16_t answers = 0, authority = 0;
+  uint8_t rcode = 0;
+  if (!strcmp(name, "delay.test")) {
+    if (type == 1) {
+      fio_throttle_thread(delay_ms * 1000000UL);
+      pos += dns_record(pos, 1, 2, "\x7F\x00\x00\x01", 4);
+      answers = 1;
+    }
+  } else if (!strcmp(name, "dual.test")) {
+    if (type == 1) {
+      pos += dns_record(pos, 1, 60, "\x7F\x00\x00\x01", 4);
+      answers = 1;
+    } else if (type == 28) {
+      pos += dns_record(pos, 28, 60,
+                        "\x01\x00\x00\x00\x00\x00\x00\x00"
+                        "\x00\x00\x00\x00\x00\x00\x00\x01",
+                        16);
+      answers = 1;
+    }
+  } else {
+    rcode = 3;
+  }
+  if (!answers) {
+    pos += dns_record(pos, 6, 60, soa, sizeof(soa));
+    authority = 1;
+  }
+  msg[2] = 0x81; /* QR, RD */
+  msg[3] = 0x80 | rcode;
+  msg[6] = 0;
+  msg[7] = answers;
+  msg[8] = 0;
+  msg[9] = authority;
+  msg[10] = msg[11] = 0; /* the OPT record isn't echoed */
+  return pos - msg;
+}
+
+static void *dns_server(void *fd_) {
+  int fd = (int)(intptr_t)fd_;
+  uint8_t msg[1500];
+  for (;;) {
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    ssize_t len = recvfrom(fd, msg, 512, 0, (struct sockaddr *)&from,
+                           &from_len);
+    if (len < 17)
+      continue;
+    fio_atomic_add(&dns_queries, 1);
+    /* read the question's name */
+    char name[256];
+    size_t pos = 12, n = 0;
+    while (pos < (size_t)len && msg[pos] && n + msg[pos] < 250) {
+      if (n)
+        name[n++] = '.';
+      memcpy(name + n, msg + pos + 1, msg[pos]);
+      n += msg[pos];
+      pos += msg[pos] + 1;
+    }
+    name[n] = 0;
+    pos += 5; /* the root label, type and class */
+    if (pos > (size_t)len)
+      continue;
+    uint16_t type = (msg[pos - 4] << 8) | msg[pos - 3];
+    len = dns_answer(msg, pos, name, type);
+    sendto(fd, msg, len, 0, (struct sockaddr *)&from, from_len);
+  }
+  return NULL;
+}
+
+static void dns_server_start(void) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port + 1),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  FIO_ASSERT(fd != -1 && !bind(fd, (struct sockaddr *)&addr, sizeof(addr)),
+             "couldn't bind the DNS stand-in to UDP port %d", port + 1);
+  pthread_t thread;
+  FIO_ASSERT(!pthread_create(&thread, NULL, dns_server, (void *)(intptr_t)fd),
+             "couldn't start the DNS stand-in");
+  pthread_detach(thread);
+  char dns_port[16];
+  snprintf(dns_port, sizeof(dns_port), "%d", port + 1);
+  FIO_ASSERT(!fio_dns_server_add("127.0.0.1", dns_port),
+             "couldn't set the name server");
+}
+
+/* *****************************************************************************
+The HTTP server and clients
+***************************************************************************** */
+
+static void server_on_request(http_s *h) {
+  http_send_body(h, "Hello World!", 12);
+}
+
+static void client_on_response(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    http_set_header(h, HTTP_HEADER_CONNECTION, fiobj_str_new("close", 5));
+    http_finish(h);
+    return;
+  }
+  if (h->status == 200)
+    fio_atomic_add(&responses, 1);
+}
+
+static void next_round(void *ignr1_, void *ignr2_);
+
+static void client_on_finish(http_settings_s *settings) {
+  if (fio_atomic_add(&finished, 1) == expected)
+    fio_defer(next_round, NULL, NULL);
+  (void)settings;
+}
+
+static void client_request(const char *name) {
+  char url[128];
+  snprintf(url, sizeof(url), "http://%s:%s/", name, host_port);
+  http_connect(url, NULL, .on_response = client_on_response,
+               .on_finish = client_on_finish, .timeout = 5);
+}
+
+static void next_round(void *ignr1_, void *ignr2_) {
+  static const char *names[] = {"delay.test", "delay.test", "dual.test",
+                                "missing.test"};
+  static const char *titles[] = {"delayed answer", "cached answer",
+                                 "Happy Eyeballs (IPv6 unreachable)",
+                                 "missing name"};
+  uint64_t now = bench_now_ns();
+  if (round_num) {
+    fprintf(stderr,
+            "* %-34s %zu/%zu responses, %6.1f ms, %zu DNS queries total\n",
+            titles[round_num - 1], (size_t)responses, concurrency,
+            (double)(now - round_start) / 1000000.0, (size_t)dns_queries);
+  }
+  if (round_num == sizeof(names) / sizeof(names[0])) {
+    fprintf(stderr, "* the reactor was at most %.1f ms late (10 ms timer)\n",
+            (double)max_lag / 1000000.0);
+    fio_stop();
+    return;
+  }
+  responses = 0;
+  finished = 0;
+  expected = concurrency;
+  round_start = now;
+  for (size_t i = 0; i < concurrency; ++i)
+    client_request(names[round_num]);
+  ++round_num;
+  (void)ignr1_;
+  (void)ignr2_;
+}
+
+/* measures how late the reactor runs a 10ms timer */
+static void lag_timer(void *ignr_) {
+  uint64_t now = bench_now_ns();
+  if (last_tick && now - last_tick > 10000000ULL &&
+      now - last_tick - 10000000ULL > max_lag)
+    max_lag = now - last_tick - 10000000ULL;
+  last_tick = now;
+  (void)ignr_;
+}
+
+static void on_start(void *ignr_) {
+  fio_run_every(10, 0, lag_timer, NULL, NULL);
+  next_round(NULL, NULL);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "A non-blocking DNS resolver test. Arguments:",
+      FIO_CLI_INT("-port -p the HTTP port, the DNS stand-in uses the next port "
+                  "(9450)."),
+      FIO_CLI_INT("-concurrency -c the number of concurrent requests (16)."),
+      FIO_CLI_INT("-delay the DNS stand-in's delay in milliseconds (300)."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    concurrency = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get("-delay"))
+    delay_ms = (size_t)fio_cli_get_i("-delay");
+
+  snprintf(host_port, sizeof(host_port), "%d", port);
+  FIO_ASSERT(http_listen(host_port, "127.0.0.1",
+                         .on_request = server_on_request) != -1,
+             "couldn't listen on port %s", host_port);
+  dns_server_start();
+  fio_state_callback_add(FIO_CALL_ON_START, on_start, NULL);
+  fio_start(.threads = 1, .workers = 1);
+  fio_cli_end();
+  return 0;
+}
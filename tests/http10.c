@@ -0,0 +1,210 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * An HTTP/1.0 short connection benchmark over loopback (a new connection per
+ * request), testing the listening socket options.
+ *
+ * Forked clients connect, send a single HTTP/1.0 request and read the response
+ * until the server closes the connection. The server reports the voluntary
+ * context switches (wakeups) and the system (syscall) time per request.
+ *
+ * Compare the default settings with `-defer` (TCP_DEFER_ACCEPT, saving the
+ * wakeup between the accept and the request's arrival) and `-fastopen` (TCP
+ * Fast Open, requires the `net.ipv4.tcp_fastopen` sysctl to be set to 3).
+ *
+ * Run with:
+ *
+ *       make test/lib/http10
+ *       ./tmp/demo -c 4 -s 3 -defer
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <http.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int port = 9446;
+static size_t clients = 4;
+static size_t seconds = 3;
+static uint8_t fastopen = 0;
+static volatile size_t requests = 0;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The server
+***************************************************************************** */
+
+static void server_on_request(http_s *h) {
+  fio_atomic_add(&requests, 1);
+  http_send_body(h, "Hello World!", 12);
+}
+
+static void server_on_finish(void *ignr_) {
+  struct rusage u;
+  if (!requests || getrusage(RUSAGE_SELF, &u))
+    return;
+  double sys_us = (u.ru_stime.tv_sec * 1000000.0) + u.ru_stime.tv_usec;
+  fprintf(stderr,
+          "* server: %zu requests\n"
+          "    %6.2f context switches per request (%ld voluntary)\n"
+          "    %6.2f us system time per request\n",
+          (size_t)requests, (double)(u.ru_nvcsw + u.ru_nivcsw) / requests,
+          u.ru_nvcsw, sys_us / requests);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+The clients
+***************************************************************************** */
+
+static const char request[] = "GET / HTTP/1.0\r\nHost: localhost\r\n\r\n";
+
+/* performs a single request, returns -1 on error or 1 if TFO was used */
+static int client_request(void) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  char buf[512];
+  int ret = -1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+#ifdef MSG_FASTOPEN
+  if (fastopen) {
+    /* connects and sends the request (along with the SYN, given a cookie) */
+    if (sendto(fd, request, sizeof(request) - 1, MSG_FASTOPEN,
+               (struct sockaddr *)&addr,
+               sizeof(addr)) != (ssize_t)(sizeof(request) - 1))
+      goto finish;
+  } else
+#endif
+      if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+          write(fd, request, sizeof(request) - 1) !=
+              (ssize_t)(sizeof(request) - 1)) {
+    goto finish;
+  }
+  ssize_t r;
+  size_t total = 0;
+  while ((r = read(fd, buf, sizeof(buf))) > 0)
+    total += r;
+  if (r || !total)
+    goto finish;
+  ret = 0;
+#ifdef TCPI_OPT_SYN_DATA
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+  if (!getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) &&
+      (info.tcpi_options & TCPI_OPT_SYN_DATA))
+    ret = 1;
+#endif
+finish:
+  close(fd);
+  return ret;
+}
+
+static void client_main(void) {
+  /* wait for the server */
+  for (size_t i = 0; i < 500 && client_request() == -1; ++i)
+    usleep(10000);
+  int counts[2];
+  FIO_ASSERT(!pipe(counts), "couldn't create the clients' pipe");
+  uint64_t start = bench_now_ns();
+  uint64_t deadline = start + (seconds * 1000000000ULL);
+  for (size_t i = 0; i < clients; ++i) {
+    pid_t pid = fork();
+    FIO_ASSERT(pid != -1, "couldn't fork a client");
+    if (!pid) {
+      size_t result[3] = {0}; /* completed, fast open, failed */
+      while (bench_now_ns() < deadline) {
+        int r = client_request();
+        ++result[(r == -1) ? 2 : r];
+      }
+      result[0] += result[1];
+      if (write(counts[1], result, sizeof(result)) != sizeof(result))
+        _exit(1);
+      _exit(0);
+    }
+  }
+  size_t total[3] = {0};
+  for (size_t i = 0; i < clients; ++i) {
+    size_t result[3];
+    wait(NULL);
+    if (read(counts[0], result, sizeof(result)) != sizeof(result))
+      continue;
+    for (size_t j = 0; j < 3; ++j)
+      total[j] += result[j];
+  }
+  double elapsed = (double)(bench_now_ns() - start) / 1000000000.0;
+  fprintf(stderr,
+          "* %zu clients, a connection per request, %zu seconds:\n"
+          "    %8.0f requests/sec (%zu requests, %zu fast open, %zu failed)\n",
+          clients, seconds, total[0] / elapsed, total[0], total[1], total[2]);
+  close(counts[0]);
+  close(counts[1]);
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "An HTTP/1.0 short connection benchmark. Arguments:",
+      FIO_CLI_INT("-port -p the port to listen to (9446)."),
+      FIO_CLI_INT("-threads -t the number of server threads (1)."),
+      FIO_CLI_INT("-clients -c the number of clients (4)."),
+      FIO_CLI_INT("-seconds -s the benchmark's duration (3)."),
+      FIO_CLI_BOOL("-defer use TCP_DEFER_ACCEPT."),
+      FIO_CLI_BOOL("-fastopen use TCP Fast Open."),
+      FIO_CLI_INT("-busy SO_BUSY_POLL microseconds (0)."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    clients = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get_i("-s") > 0)
+    seconds = (size_t)fio_cli_get_i("-s");
+  int threads = fio_cli_get("-t") ? fio_cli_get_i("-t") : 1;
+  fastopen = (uint8_t)fio_cli_get_bool("-fastopen");
+
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  FIO_ASSERT(http_listen(port_str, "127.0.0.1",
+                         .on_request = server_on_request,
+                         .defer_accept = (fio_cli_get_bool("-defer") ? 5 : 0),
+                         .busy_poll = (uint16_t)fio_cli_get_i("-busy")) != -1,
+             "couldn't listen on port %s", port_str);
+  fio_state_callback_add(FIO_CALL_ON_FINISH, server_on_finish, NULL);
+
+  pid_t client = fork();
+  FIO_ASSERT(client != -1, "couldn't fork the client process");
+  if (!client) {
+    client_main();
+    kill(getppid(), SIGINT);
+    fflush(stderr);
+    _exit(0);
+  }
+  fio_start(.threads = threads, .workers = 1);
+  waitpid(client, NULL, 0);
+  fio_cli_end();
+  return 0;
+}
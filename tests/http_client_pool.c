@@ -0,0 +1,144 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * An HTTP client benchmark over loopback, measuring the number of requests per
+ * second with and without the client's connection pool.
+ *
+ * The server and the client share the same process. The client keeps `-c`
+ * requests in flight, each completed request (`on_finish`) starting the next.
+ *
+ * Without `-pool`, every request uses a new connection (the request asks the
+ * server to close the connection). With `-pool N`, up to N connections are
+ * kept alive and reused and `-pipeline N` allows requests to be pipelined.
+ *
+ * Run with:
+ *
+ *       make test/lib/http_client_pool
+ *       ./tmp/demo -c 16 -n 20000 -pool 8
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <http.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static int port = 9447;
+static size_t concurrency = 16;
+static size_t total = 20000;
+static uint16_t pool_limit = 0;
+static uint8_t pipeline = 1;
+static char url[64];
+
+static volatile size_t issued = 0;
+static volatile size_t finished = 0;
+static volatile size_t responses = 0;
+static volatile size_t server_requests = 0;
+static uint64_t start;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The server
+***************************************************************************** */
+
+static void server_on_request(http_s *h) {
+  fio_atomic_add(&server_requests, 1);
+  http_send_body(h, "Hello World!", 12);
+}
+
+/* *****************************************************************************
+The client
+***************************************************************************** */
+
+static void client_request(void);
+
+static void client_on_response(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    /* the first call, send the request */
+    if (!pool_limit)
+      http_set_header(h, HTTP_HEADER_CONNECTION, fiobj_str_new("close", 5));
+    http_finish(h);
+    return;
+  }
+  if (h->status == 200)
+    fio_atomic_add(&responses, 1);
+}
+
+static void client_on_finish(http_settings_s *settings) {
+  if (fio_atomic_add(&finished, 1) == total) {
+    double elapsed = (double)(bench_now_ns() - start) / 1000000000.0;
+    fprintf(stderr,
+            "* %zu requests, %zu concurrent, pool %u, pipeline %u:\n"
+            "    %8.0f requests/sec (%zu responses, %zu failed)\n",
+            total, concurrency, (unsigned)pool_limit, (unsigned)pipeline,
+            total / elapsed, (size_t)responses, total - responses);
+    fio_stop();
+    return;
+  }
+  client_request();
+  (void)settings;
+}
+
+static void client_request(void) {
+  if (fio_atomic_add(&issued, 1) > total)
+    return;
+  http_connect(url, NULL, .on_response = client_on_response,
+               .on_finish = client_on_finish, .pool_limit = pool_limit,
+               .pool_pipeline = pipeline);
+}
+
+static void client_start(void *ignr_) {
+  start = bench_now_ns();
+  for (size_t i = 0; i < concurrency; ++i)
+    client_request();
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "An HTTP client benchmark (loopback). Arguments:",
+      FIO_CLI_INT("-port -p the port to listen to (9447)."),
+      FIO_CLI_INT("-threads -t the number of threads (1)."),
+      FIO_CLI_INT("-concurrency -c the number of concurrent requests (16)."),
+      FIO_CLI_INT("-requests -n the number of requests (20000)."),
+      FIO_CLI_INT("-pool the number of pooled connections (0, no pool)."),
+      FIO_CLI_INT("-pipeline the number of requests per connection (1)."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    concurrency = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get_i("-n") > 0)
+    total = (size_t)fio_cli_get_i("-n");
+  if (fio_cli_get_i("-pool") > 0)
+    pool_limit = (uint16_t)fio_cli_get_i("-pool");
+  if (fio_cli_get_i("-pipeline") > 0)
+    pipeline = (uint8_t)fio_cli_get_i("-pipeline");
+  int threads = fio_cli_get("-t") ? fio_cli_get_i("-t") : 1;
+
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/", port);
+  FIO_ASSERT(http_listen(port_str, "127.0.0.1",
+                         .on_request = server_on_request) != -1,
+             "couldn't listen on port %s", port_str);
+  fio_state_callback_add(FIO_CALL_ON_START, client_start, NULL);
+  fio_start(.threads = threads, .workers = 1);
+  fprintf(stderr, "* the server handled %zu requests\n",
+          (size_t)server_requests);
+  fio_cli_end();
+  return 0;
+}
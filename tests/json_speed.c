@@ -0,0 +1,302 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A JSON parsing benchmark, comparing the structural index (vectorized) parser
+ * with the byte by byte parser and measuring `fiobj_json2obj`,
+ * `fiobj_json2view` and `fiobj_obj2json`.
+ *
+ * The benchmark accepts JSON files (i.e., the standard twitter.json,
+ * citm_catalog.json and canada.json corpus files). When no files are provided,
+ * similarly shaped documents are generated.
+ *
+ * Run with:
+ *
+ *       make test/lib/json_speed
+ *       ./tmp/demo twitter.json citm_catalog.json canada.json
+ *
+ * To measure `fiobj_json2obj` without the structural index, compile the
+ * library with `-DJSON_USE_INDEX=0`.
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <fiobj.h>
+
+#include <fio_json_parser.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static size_t rounds = 20;
+
+#define bench_write(dest, str) fiobj_str_write((dest), (str), sizeof(str) - 1)
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+Parser callbacks (counting events, without creating objects)
+***************************************************************************** */
+
+static size_t events;
+
+static void fio_json_on_null(json_parser_s *p) {
+  ++events;
+  (void)p;
+}
+static void fio_json_on_true(json_parser_s *p) {
+  ++events;
+  (void)p;
+}
+static void fio_json_on_false(json_parser_s *p) {
+  ++events;
+  (void)p;
+}
+static void fio_json_on_number(json_parser_s *p, long long i) {
+  ++events;
+  (void)p;
+  (void)i;
+}
+static void fio_json_on_float(json_parser_s *p, double f) {
+  ++events;
+  (void)p;
+  (void)f;
+}
+static void fio_json_on_string(json_parser_s *p, void *start, size_t length) {
+  ++events;
+  (void)p;
+  (void)start;
+  (void)length;
+}
+static int fio_json_on_start_object(json_parser_s *p) {
+  ++events;
+  return 0;
+  (void)p;
+}
+static void fio_json_on_end_object(json_parser_s *p) { (void)p; }
+static int fio_json_on_start_array(json_parser_s *p) {
+  ++events;
+  return 0;
+  (void)p;
+}
+static void fio_json_on_end_array(json_parser_s *p) { (void)p; }
+static void fio_json_on_json(json_parser_s *p) { (void)p; }
+static void fio_json_on_error(json_parser_s *p) {
+  FIO_LOG_ERROR("JSON parsing error.");
+  (void)p;
+}
+
+/* *****************************************************************************
+Generated documents (shaped after the standard corpus)
+***************************************************************************** */
+
+/* tweets: pretty printed objects with plenty of Strings and escapes */
+static FIOBJ bench_twitter(void) {
+  FIOBJ s = fiobj_str_buf(1 << 20);
+  bench_write(s, "{\n  \"statuses\": [\n");
+  for (size_t i = 0; i < 400; ++i) {
+    fiobj_str_printf(
+        s,
+        "%s    {\n      \"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\",\n"
+        "      \"id\": %lu,\n      \"id_str\": \"%lu\",\n"
+        "      \"text\": \"@aym0566x \\n\\n\\u540d\\u524d:\\u524d\\u7530\\u3042"
+        "\\u3086\\u307f\\n\\u7b2c\\u4e00\\u5370\\u8c61:\\u306a\\u3093\\u304b "
+        "\\\"quoted\\\" http:\\/\\/t.co\\/%lu\",\n"
+        "      \"source\": \"<a href=\\\"http://twitter.com/download/iphone\\\""
+        " rel=\\\"nofollow\\\">Twitter for iPhone</a>\",\n"
+        "      \"truncated\": false,\n"
+        "      \"in_reply_to_status_id\": null,\n"
+        "      \"user\": {\n        \"id\": %lu,\n"
+        "        \"name\": \"\\u3089\\u3044\\u3061\\u3083\\u3093\",\n"
+        "        \"screen_name\": \"yuttari1998\",\n"
+        "        \"description\": \"\\u7121\\u8a00\\u30d5\\u30a9\\u30ed\\u30fc"
+        "\\u306f\\u3042\\u307e\\u308a\\u597d\\u307f\\u307e\\u305b\\u3093\",\n"
+        "        \"followers_count\": %lu,\n        \"verified\": false,\n"
+        "        \"profile_background_color\": \"C0DEED\"\n      },\n"
+        "      \"entities\": {\n        \"hashtags\": [],\n"
+        "        \"user_mentions\": [\n          {\n"
+        "            \"screen_name\": \"aym0566x\",\n"
+        "            \"indices\": [\n              0,\n              9\n"
+        "            ]\n          }\n        ]\n      },\n"
+        "      \"retweet_count\": %lu,\n      \"favorited\": false,\n"
+        "      \"lang\": \"ja\"\n    }",
+        (i ? ",\n" : ""), (unsigned long)(505874924095815681ULL + i),
+        (unsigned long)(505874924095815681ULL + i), (unsigned long)i,
+        (unsigned long)(1186275104 + i), (unsigned long)(i * 7),
+        (unsigned long)(i & 31));
+  }
+  bench_write(s, "\n  ],\n  \"search_metadata\": {\"count\": 400}\n}\n");
+  return s;
+}
+
+/* a catalog: nested objects and many integers */
+static FIOBJ bench_citm(void) {
+  FIOBJ s = fiobj_str_buf(1 << 21);
+  bench_write(s, "{\n    \"events\": {\n");
+  for (size_t i = 0; i < 800; ++i) {
+    fiobj_str_printf(
+        s,
+        "%s        \"%lu\": {\n            \"description\": null,\n"
+        "            \"id\": %lu,\n            \"logo\": null,\n"
+        "            \"name\": \"30th Anniversary Tour\",\n"
+        "            \"subTopicIds\": [\n                337184269,\n"
+        "                337184283\n            ],\n"
+        "            \"subjectCode\": null,\n            \"topicIds\": [\n"
+        "                324846099,\n                107888604\n"
+        "            ]\n        }",
+        (i ? ",\n" : ""), (unsigned long)(138586341 + i),
+        (unsigned long)(138586341 + i));
+  }
+  bench_write(s, "\n    },\n    \"performances\": [\n");
+  for (size_t i = 0; i < 2400; ++i) {
+    fiobj_str_printf(
+        s,
+        "%s        {\n            \"eventId\": %lu,\n"
+        "            \"id\": %lu,\n            \"logo\": null,\n"
+        "            \"prices\": [\n                {\n"
+        "                    \"amount\": 90250,\n"
+        "                    \"audienceSubCategoryId\": 337100890,\n"
+        "                    \"seatCategoryId\": 338937295\n"
+        "                }\n            ],\n"
+        "            \"start\": %lu,\n"
+        "            \"venueCode\": \"PLEYEL_PLEYEL\"\n        }",
+        (i ? ",\n" : ""), (unsigned long)(138586341 + (i % 800)),
+        (unsigned long)(339887544 + i),
+        (unsigned long)(1372701600000ULL + i * 3600000));
+  }
+  bench_write(s, "\n    ]\n}\n");
+  return s;
+}
+
+/* geographical data: deeply nested arrays of long floating point numbers */
+static FIOBJ bench_canada(void) {
+  FIOBJ s = fiobj_str_buf(1 << 21);
+  bench_write(s, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":"
+                 "\"Feature\",\"properties\":{\"name\":\"Canada\"},"
+                 "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+  for (size_t ring = 0; ring < 40; ++ring) {
+    fiobj_str_write(s, (ring ? ",[" : "["), (ring ? 2 : 1));
+    for (size_t i = 0; i < 1400; ++i) {
+      fiobj_str_printf(s, "%s[%.15f,%.15f]", (i ? "," : ""),
+                       -65.613616999999977 + (double)(ring * 1400 + i) * 1e-4,
+                       43.420273000000009 + (double)i * 1e-5);
+    }
+    bench_write(s, "]\n");
+  }
+  bench_write(s, "]}}]}\n");
+  return s;
+}
+
+/* *****************************************************************************
+Benchmarks
+***************************************************************************** */
+
+static const char *bench_isa_name(int isa) {
+  switch (isa) {
+  case JSON_ISA_SSE42:
+    return "SSE4.2";
+  case JSON_ISA_AVX2:
+    return "AVX2";
+  case JSON_ISA_NEON:
+    return "NEON";
+  }
+  return "byte by byte";
+}
+
+static void bench_report(const char *name, size_t len, uint64_t ns) {
+  double seconds = (double)ns / 1000000000.0;
+  fprintf(stderr, "    %-24s %8.1f MB/s\n", name,
+          ((double)len * rounds) / (seconds * 1024 * 1024));
+}
+
+static void bench_document(const char *name, fio_str_info_s data) {
+  fprintf(stderr, "* %s (%zu bytes):\n", name, data.len);
+  for (int isa = JSON_ISA_SCALAR; isa <= JSON_ISA_NEON; ++isa) {
+    if (fio_json_set_isa(isa) != isa)
+      continue;
+    size_t consumed = 0;
+    events = 0;
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < rounds; ++i) {
+      json_parser_s p = {.dict = 0};
+      consumed = fio_json_parse(&p, data.data, data.len);
+    }
+    uint64_t end = bench_now_ns();
+    if (!consumed) {
+      FIO_LOG_ERROR("%s couldn't be parsed", name);
+      return;
+    }
+    bench_report(bench_isa_name(isa), data.len, end - start);
+  }
+  FIOBJ o = FIOBJ_INVALID;
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < rounds; ++i) {
+    fiobj_json2obj(&o, data.data, data.len);
+    fiobj_free(o);
+  }
+  bench_report("fiobj_json2obj", data.len, bench_now_ns() - start);
+  start = bench_now_ns();
+  for (size_t i = 0; i < rounds; ++i) {
+    fiobj_json2view(&o, data.data, data.len);
+    fiobj_free(o);
+  }
+  bench_report("fiobj_json2view", data.len, bench_now_ns() - start);
+  /* formatting (measured against the length of the formatted JSON) */
+  fiobj_json2obj(&o, data.data, data.len);
+  size_t formatted = 0;
+  start = bench_now_ns();
+  for (size_t i = 0; i < rounds; ++i) {
+    FIOBJ json = fiobj_obj2json(o, 0);
+    formatted = fiobj_obj2cstr(json).len;
+    fiobj_free(json);
+  }
+  bench_report("fiobj_obj2json", formatted, bench_now_ns() - start);
+  fiobj_free(o);
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(argc, argv, 0, -1,
+                "A JSON parsing benchmark. Accepts JSON files as unnamed "
+                "arguments (similar documents are generated otherwise). "
+                "Arguments:",
+                FIO_CLI_INT("-rounds -r times each document is parsed (20)."));
+  if (fio_cli_get("-r") && fio_cli_get_i("-r") > 0)
+    rounds = (size_t)fio_cli_get_i("-r");
+
+  if (fio_cli_unnamed_count()) {
+    for (unsigned int i = 0; i < fio_cli_unnamed_count(); ++i) {
+      FIOBJ s = fiobj_str_buf(1);
+      if (!fiobj_str_readfile(s, fio_cli_unnamed(i), 0, 0)) {
+        FIO_LOG_ERROR("couldn't read %s", fio_cli_unnamed(i));
+      } else {
+        bench_document(fio_cli_unnamed(i), fiobj_obj2cstr(s));
+      }
+      fiobj_free(s);
+    }
+  } else {
+    struct {
+      const char *name;
+      FIOBJ (*generate)(void);
+    } docs[] = {{"twitter (generated)", bench_twitter},
+                {"citm_catalog (generated)", bench_citm},
+                {"canada (generated)", bench_canada}};
+    for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+      FIOBJ s = docs[i].generate();
+      bench_document(docs[i].name, fiobj_obj2cstr(s));
+      fiobj_free(s);
+    }
+  }
+  fio_cli_end();
+  return 0;
+}
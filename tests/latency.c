@@ -0,0 +1,165 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Tests the HTTP request latency histograms, the slow request tracing and the
+ * asynchronous request log.
+ *
+ * An HTTP server (with logging enabled) answers `/` right away, `/missing`
+ * with a 404 error and `/slow` after `-delay` milliseconds (over the slow
+ * request threshold). HTTP clients send `-n` requests (every 16th request is
+ * slow, every 8th is missing) with `-c` requests in flight.
+ *
+ * Once all the requests were answered, the latency percentiles are printed per
+ * status class, followed by the `http_send_metrics` output.
+ *
+ * Run with:
+ *
+ *       make test/lib/latency
+ *       ./tmp/demo -c 16 -n 2000 -delay 20 2>/dev/null
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <http.h>
+
+#include <stdio.h>
+
+static int port = 9454;
+static size_t concurrency = 16;
+static size_t total = 2000;
+static size_t delay_ms = 20;
+static char url[64];
+
+static volatile size_t issued = 0;
+static volatile size_t finished = 0;
+
+/* *****************************************************************************
+The server
+***************************************************************************** */
+
+static void server_on_request(http_s *h) {
+  fio_str_info_s path = fiobj_obj2cstr(h->path);
+  if (path.len == 8 && !memcmp(path.data, "/metrics", 8)) {
+    http_send_metrics(h);
+    return;
+  }
+  if (path.len == 8 && !memcmp(path.data, "/missing", 8)) {
+    http_send_error(h, 404);
+    return;
+  }
+  if (path.len == 5 && !memcmp(path.data, "/slow", 5))
+    fio_throttle_thread(delay_ms * 1000000UL);
+  http_send_body(h, "Hello World!", 12);
+}
+
+/* *****************************************************************************
+The client
+***************************************************************************** */
+
+static void client_on_metrics(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    http_set_header(h, HTTP_HEADER_CONNECTION, fiobj_str_new("close", 5));
+    http_finish(h);
+    return;
+  }
+  if (h->body) {
+    fio_str_info_s body = fiobj_data_read(h->body, 0);
+    fprintf(stdout, "%.*s", (int)body.len, body.data);
+  }
+  fio_stop();
+}
+
+static void print_percentiles(void) {
+  static const char *names[] = {"all", "1xx", "2xx", "3xx", "4xx", "5xx"};
+  for (uint8_t c = 0; c < 6; ++c) {
+    http_latency_s l = {0};
+    http_latency_collect(&l, c);
+    if (!l.count)
+      continue;
+    fprintf(stdout,
+            "* %s: %llu requests, avg %.3fms, p50 %.3fms, p99 %.3fms, "
+            "max %.3fms\n",
+            names[c], (unsigned long long)l.count,
+            (double)l.sum_us / l.count / 1000.0,
+            (double)http_latency_percentile(&l, 0.5) / 1000.0,
+            (double)http_latency_percentile(&l, 0.99) / 1000.0,
+            (double)l.max_us / 1000.0);
+  }
+}
+
+static void client_request(void);
+
+static void client_on_response(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    http_set_header(h, HTTP_HEADER_CONNECTION, fiobj_str_new("close", 5));
+    http_finish(h);
+    return;
+  }
+}
+
+static void client_on_finish(http_settings_s *settings) {
+  if (fio_atomic_add(&finished, 1) == total) {
+    print_percentiles();
+    char metrics_url[80];
+    snprintf(metrics_url, sizeof(metrics_url), "%smetrics", url);
+    http_connect(metrics_url, NULL, .on_response = client_on_metrics);
+    return;
+  }
+  client_request();
+  (void)settings;
+}
+
+static void client_request(void) {
+  size_t i = fio_atomic_add(&issued, 1);
+  if (i > total)
+    return;
+  char request_url[80];
+  snprintf(request_url, sizeof(request_url), "%s%s", url,
+           (i & 15) == 0 ? "slow" : ((i & 7) == 0 ? "missing" : ""));
+  http_connect(request_url, NULL, .on_response = client_on_response,
+               .on_finish = client_on_finish);
+}
+
+static void client_start(void *ignr_) {
+  for (size_t i = 0; i < concurrency; ++i)
+    client_request();
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "An HTTP request latency test. Arguments:",
+      FIO_CLI_INT("-port -p the port to listen to (9454)."),
+      FIO_CLI_INT("-concurrency -c the number of concurrent requests (16)."),
+      FIO_CLI_INT("-requests -n the number of requests (2000)."),
+      FIO_CLI_INT("-delay the slow requests' delay in milliseconds (20)."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    concurrency = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get_i("-n") > 0)
+    total = (size_t)fio_cli_get_i("-n");
+  if (fio_cli_get("-delay"))
+    delay_ms = (size_t)fio_cli_get_i("-delay");
+
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/", port);
+  /* the slow request threshold is half the delay */
+  FIO_ASSERT(http_listen(port_str, "127.0.0.1",
+                         .on_request = server_on_request, .log = 1,
+                         .slow_request = (uint32_t)(delay_ms / 2)) != -1,
+             "couldn't listen on port %s", port_str);
+  fio_state_callback_add(FIO_CALL_ON_START, client_start, NULL);
+  fio_start(.threads = 2, .workers = 1);
+  fio_cli_end();
+  return 0;
+}
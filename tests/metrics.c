@@ -0,0 +1,174 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * Tests the reactor metrics and their aggregation across worker processes.
+ *
+ * The worker processes run an HTTP server that serves the cluster's metrics
+ * (`http_send_metrics`) at `/metrics`. The root process acts as an HTTP client,
+ * sending `-n` requests (with `-c` requests in flight) and publishing a pub/sub
+ * message per request.
+ *
+ * Once all the requests were answered, the root process waits for the workers
+ * to report their counters, requests `/metrics` and prints the response.
+ *
+ * Run with:
+ *
+ *       make test/lib/metrics
+ *       ./tmp/demo -w 2 -c 16 -n 20000
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <http.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static int port = 9452;
+static size_t concurrency = 16;
+static size_t total = 20000;
+static char url[64];
+static char metrics_url[64];
+
+static volatile size_t issued = 0;
+static volatile size_t finished = 0;
+static volatile size_t responses = 0;
+static uint64_t start;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The server (workers)
+***************************************************************************** */
+
+static void on_message(fio_msg_s *msg) { (void)msg; }
+
+static void server_subscribe(void *ignr_) {
+  fio_subscribe(.channel = {.data = "metrics", .len = 7},
+                .on_message = on_message);
+  (void)ignr_;
+}
+
+static void server_on_request(http_s *h) {
+  fio_str_info_s path = fiobj_obj2cstr(h->path);
+  if (path.len == 8 && !memcmp(path.data, "/metrics", 8)) {
+    http_send_metrics(h);
+    return;
+  }
+  fio_publish(.channel = {.data = "metrics", .len = 7},
+              .message = {.data = "request", .len = 7});
+  http_send_body(h, "Hello World!", 12);
+}
+
+/* *****************************************************************************
+The client (root)
+***************************************************************************** */
+
+static void client_on_metrics(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    http_finish(h);
+    return;
+  }
+  if (h->body) {
+    fio_str_info_s body = fiobj_data_read(h->body, 0);
+    fprintf(stderr, "%.*s", (int)body.len, body.data);
+  }
+  fio_stop();
+}
+
+static void client_metrics(void *ignr_) {
+  http_connect(metrics_url, NULL, .on_response = client_on_metrics);
+  (void)ignr_;
+}
+
+static void client_request(void);
+
+static void client_on_response(http_s *h) {
+  if (h->status_str == FIOBJ_INVALID) {
+    http_finish(h);
+    return;
+  }
+  if (h->status == 200)
+    fio_atomic_add(&responses, 1);
+}
+
+static void client_on_finish(http_settings_s *settings) {
+  if (fio_atomic_add(&finished, 1) == total) {
+    double elapsed = (double)(bench_now_ns() - start) / 1000000000.0;
+    fprintf(stderr,
+            "* %zu requests, %zu concurrent: %.0f requests/sec "
+            "(%zu responses)\n",
+            total, concurrency, total / elapsed, (size_t)responses);
+    /* wait for the workers' reports to reach the root and return */
+    fio_run_every(2500, 1, client_metrics, NULL, NULL);
+    return;
+  }
+  client_request();
+  (void)settings;
+}
+
+static void client_request(void) {
+  if (fio_atomic_add(&issued, 1) > total)
+    return;
+  http_connect(url, NULL, .on_response = client_on_response,
+               .on_finish = client_on_finish, .pool_limit = 8);
+}
+
+static void client_start(void *ignr_) {
+  if (!fio_is_master())
+    return;
+  start = bench_now_ns();
+  for (size_t i = 0; i < concurrency; ++i)
+    client_request();
+  (void)ignr_;
+}
+
+/* the timer is inherited by the workers, but only the root acts on it */
+static void client_schedule(void *ignr_) {
+  fio_run_every(100, 1, client_start, NULL, NULL);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "A reactor metrics test. Arguments:",
+      FIO_CLI_INT("-port -p the port to listen to (9452)."),
+      FIO_CLI_INT("-workers -w the number of worker processes (2)."),
+      FIO_CLI_INT("-threads -t the number of threads per worker (1)."),
+      FIO_CLI_INT("-concurrency -c the number of concurrent requests (16)."),
+      FIO_CLI_INT("-requests -n the number of requests (20000)."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-c") > 0)
+    concurrency = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get_i("-n") > 0)
+    total = (size_t)fio_cli_get_i("-n");
+  int workers = fio_cli_get("-w") ? fio_cli_get_i("-w") : 2;
+  int threads = fio_cli_get("-t") ? fio_cli_get_i("-t") : 1;
+
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/", port);
+  snprintf(metrics_url, sizeof(metrics_url), "http://127.0.0.1:%d/metrics",
+           port);
+  FIO_ASSERT(http_listen(port_str, "127.0.0.1",
+                         .on_request = server_on_request) != -1,
+             "couldn't listen on port %s", port_str);
+  fio_state_callback_add(FIO_CALL_ON_START, server_subscribe, NULL);
+  fio_state_callback_add(FIO_CALL_PRE_START, client_schedule, NULL);
+  fio_start(.threads = threads, .workers = workers);
+  fio_cli_end();
+  return 0;
+}
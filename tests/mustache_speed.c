@@ -0,0 +1,259 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A Mustache rendering benchmark, rendering a 10K row table using
+ * `fiobj_mustache_build` (compiled templates with pre-hashed names) and a
+ * reference renderer that resolves every name the way `fiobj_mustache_build`
+ * did before templates were compiled (an uncompiled template, a temporary key
+ * String and a `fiobj_hash_get` for every path segment, for every row).
+ *
+ * Run with:
+ *
+ *       make test/lib/mustache_speed
+ *       ./tmp/demo -r 40
+ */
+
+/* the reference renderer uses an uncompiled template and it's own callbacks */
+#define MUSTACHE_COMPILE_TEMPLATES 0
+#define INCLUDE_MUSTACHE_IMPLEMENTATION 1
+#include <mustache_parser.h>
+
+#include <fio.h>
+#include <fio_cli.h>
+#include <fiobj.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static size_t rounds = 20;
+static size_t rows = 10000;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+Reference renderer (name lookup for every row, as before compilation)
+***************************************************************************** */
+
+static FIOBJ ref_find_absolute(FIOBJ parent, FIOBJ key) {
+  if (!FIOBJ_TYPE_IS(parent, FIOBJ_T_HASH))
+    return FIOBJ_INVALID;
+  return fiobj_hash_get(parent, key);
+}
+
+static FIOBJ ref_find_tree(mustache_section_s *section, const char *name,
+                           uint32_t name_len) {
+  FIOBJ key = fiobj_str_tmp();
+  fiobj_str_write(key, name, name_len);
+  do {
+    FIOBJ tmp = ref_find_absolute((FIOBJ)section->udata2, key);
+    if (tmp != FIOBJ_INVALID)
+      return tmp;
+  } while ((section = mustache_section_parent(section)));
+  return FIOBJ_INVALID;
+}
+
+static FIOBJ ref_find(mustache_section_s *section, const char *name,
+                      uint32_t name_len) {
+  FIOBJ tmp = ref_find_tree(section, name, name_len);
+  if (tmp != FIOBJ_INVALID)
+    return tmp;
+  uint32_t dot = 0;
+  while (dot < name_len && name[dot] != '.')
+    ++dot;
+  if (dot == name_len)
+    return FIOBJ_INVALID;
+  tmp = ref_find_tree(section, name, dot);
+  if (!tmp)
+    return FIOBJ_INVALID;
+  ++dot;
+  for (;;) {
+    FIOBJ key = fiobj_str_tmp();
+    fiobj_str_write(key, name + dot, name_len - dot);
+    FIOBJ obj = ref_find_absolute(tmp, key);
+    if (obj != FIOBJ_INVALID)
+      return obj;
+    name += dot;
+    name_len -= dot;
+    dot = 0;
+    while (dot < name_len && name[dot] != '.')
+      ++dot;
+    if (dot == name_len)
+      return FIOBJ_INVALID;
+    key = fiobj_str_tmp();
+    fiobj_str_write(key, name, dot);
+    tmp = ref_find_absolute(tmp, key);
+    if (tmp == FIOBJ_INVALID)
+      return FIOBJ_INVALID;
+    ++dot;
+  }
+}
+
+static int mustache_on_arg(mustache_section_s *section, const char *name,
+                           uint32_t name_len, unsigned char escape) {
+  FIOBJ o = ref_find(section, name, name_len);
+  if (!o)
+    return 0;
+  fio_str_info_s i = fiobj_obj2cstr(o);
+  if (!i.len)
+    return 0;
+  return mustache_write_text(section, i.data, i.len, escape);
+}
+
+static int mustache_on_text(mustache_section_s *section, const char *data,
+                            uint32_t data_len) {
+  fiobj_str_write((FIOBJ)section->udata1, data, data_len);
+  return 0;
+}
+
+static int32_t mustache_on_section_test(mustache_section_s *section,
+                                        const char *name, uint32_t name_len,
+                                        uint8_t callable) {
+  FIOBJ o = ref_find(section, name, name_len);
+  if (!o || FIOBJ_TYPE_IS(o, FIOBJ_T_FALSE))
+    return 0;
+  if (FIOBJ_TYPE_IS(o, FIOBJ_T_ARRAY))
+    return fiobj_ary_count(o);
+  return 1;
+  (void)callable;
+}
+
+static int mustache_on_section_start(mustache_section_s *section,
+                                     char const *name, uint32_t name_len,
+                                     uint32_t index) {
+  FIOBJ o = ref_find(section, name, name_len);
+  if (!o)
+    return -1;
+  if (FIOBJ_TYPE_IS(o, FIOBJ_T_ARRAY))
+    section->udata2 = (void *)fiobj_ary_index(o, index);
+  else
+    section->udata2 = (void *)o;
+  return 0;
+}
+
+static void mustache_on_formatting_error(void *udata1, void *udata2) {
+  (void)udata1;
+  (void)udata2;
+}
+
+static FIOBJ ref_build(mustache_s *m, FIOBJ data) {
+  FIOBJ dest = fiobj_str_buf(m->u.read_only.data_length);
+  mustache_build(m, .udata1 = (void *)dest, .udata2 = (void *)data);
+  return dest;
+}
+
+/* *****************************************************************************
+Template and data
+***************************************************************************** */
+
+static const char template[] =
+    "<!DOCTYPE html>\n<html>\n<head>\n  <title>{{title}}</title>\n"
+    "</head>\n<body>\n{{! the report's header }}\n"
+    "  <h1>{{title}}</h1>\n  <p>{{site.owner.name}} ({{site.owner.email}})</p>\n"
+    "  <table>\n    <tr>\n      <th>ID</th>\n      <th>Name</th>\n"
+    "      <th>Email</th>\n      <th>Score</th>\n    </tr>\n"
+    "{{#rows}}\n    <tr class=\"{{#active}}active{{/active}}"
+    "{{^active}}inactive{{/active}}\">\n"
+    "      <td>{{id}}</td>\n      <td>{{name}}</td>\n"
+    "      <td>{{user.email}}</td>{{! a comment between text }}\n"
+    "      <td>{{{score}}}</td>\n      <td>{{site.owner.name}}</td>\n"
+    "    </tr>\n{{/rows}}\n  </table>\n</body>\n</html>\n";
+
+#define bench_set(hash, name, value)                                           \
+  do {                                                                         \
+    FIOBJ key__ = fiobj_str_new((name), sizeof(name) - 1);                     \
+    fiobj_hash_set((hash), key__, (value));                                    \
+    fiobj_free(key__);                                                         \
+  } while (0)
+
+static FIOBJ bench_data(void) {
+  FIOBJ data = fiobj_hash_new();
+  bench_set(data, "title", fiobj_str_new("A <10K> row report", 18));
+  FIOBJ site = fiobj_hash_new();
+  FIOBJ owner = fiobj_hash_new();
+  bench_set(owner, "name", fiobj_str_new("Boaz & Co.", 10));
+  bench_set(owner, "email", fiobj_str_new("owner@example.com", 17));
+  bench_set(site, "owner", owner);
+  bench_set(data, "site", site);
+  FIOBJ ary = fiobj_ary_new2(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    FIOBJ row = fiobj_hash_new2(5);
+    FIOBJ user = fiobj_hash_new2(1);
+    bench_set(row, "id", fiobj_num_new(i));
+    FIOBJ name = fiobj_str_buf(24);
+    fiobj_str_printf(name, "User \"%zu\" <%zu>", i, i * 7);
+    bench_set(row, "name", name);
+    FIOBJ email = fiobj_str_buf(24);
+    fiobj_str_printf(email, "user%zu@example.com", i);
+    bench_set(user, "email", email);
+    bench_set(row, "user", user);
+    bench_set(row, "score", fiobj_float_new((double)i / 3));
+    bench_set(row, "active", ((i & 3) ? fiobj_true() : fiobj_false()));
+    fiobj_ary_push(ary, row);
+  }
+  bench_set(data, "rows", ary);
+  return data;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+static void bench_report(const char *name, size_t len, uint64_t ns) {
+  double seconds = (double)ns / 1000000000.0;
+  fprintf(stderr, "    %-28s %8.2f ms/render %8.1f MB/s\n", name,
+          (seconds * 1000) / rounds,
+          ((double)len * rounds) / (seconds * 1024 * 1024));
+}
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(argc, argv, 0, 0, "A Mustache rendering benchmark. Arguments:",
+                FIO_CLI_INT("-rounds -r times the template is rendered (20)."),
+                FIO_CLI_INT("-rows rows in the rendered table (10000)."));
+  if (fio_cli_get("-r") && fio_cli_get_i("-r") > 0)
+    rounds = (size_t)fio_cli_get_i("-r");
+  if (fio_cli_get("-rows") && fio_cli_get_i("-rows") > 0)
+    rows = (size_t)fio_cli_get_i("-rows");
+
+  FIOBJ data = bench_data();
+  mustache_error_en err = MUSTACHE_OK;
+  mustache_s *ref = mustache_load(.data = template,
+                                  .data_len = sizeof(template) - 1, .err = &err);
+  mustache_s *compiled = fiobj_mustache_new(
+      .data = template, .data_len = sizeof(template) - 1, .err = &err);
+  FIO_ASSERT(ref && compiled, "couldn't load template (%d)", (int)err);
+
+  /* make sure both renderers agree */
+  FIOBJ expected = ref_build(ref, data);
+  FIOBJ result = fiobj_mustache_build(compiled, data);
+  FIO_ASSERT(fiobj_iseq(expected, result),
+             "rendering mismatch between fiobj_mustache_build and the "
+             "reference renderer");
+  const size_t len = fiobj_obj2cstr(result).len;
+  fiobj_free(expected);
+  fiobj_free(result);
+
+  fprintf(stderr, "* %zu rows, %zu bytes per render:\n", rows, len);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < rounds; ++i)
+    fiobj_free(ref_build(ref, data));
+  bench_report("reference (per row lookup)", len, bench_now_ns() - start);
+  start = bench_now_ns();
+  for (size_t i = 0; i < rounds; ++i)
+    fiobj_free(fiobj_mustache_build(compiled, data));
+  bench_report("fiobj_mustache_build", len, bench_now_ns() - start);
+
+  mustache_free(ref);
+  fiobj_mustache_free(compiled);
+  fiobj_free(data);
+  fio_cli_end();
+  return 0;
+}
@@ -0,0 +1,166 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A mixed publish / subscribe stress test for the process local pub/sub layer.
+ *
+ * Publishing threads publish to a set of "hot" channels while churning threads
+ * subscribe and unsubscribe from other channels (i.e., users joining and
+ * leaving rooms), measuring the publishing throughput under contention.
+ *
+ * Run with:
+ *
+ *       make test/lib/pubsub_speed
+ */
+#include <fio.h>
+#include <fio_cli.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static size_t publishers = 4;
+static size_t churners = 4;
+static size_t messages = 1 << 19;
+static size_t hot_channels = 64;
+
+static volatile uint8_t churn_active = 1;
+static volatile uintptr_t delivered = 0;
+static volatile uintptr_t churn_count = 0;
+
+/* *****************************************************************************
+Helpers
+***************************************************************************** */
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+static void bench_on_message(fio_msg_s *msg) {
+  fio_atomic_add(&delivered, 1);
+  (void)msg;
+}
+
+static fio_str_info_s bench_channel_name(char *buf, const char *prefix,
+                                         size_t id) {
+  size_t len = strlen(prefix);
+  memcpy(buf, prefix, len);
+  len += fio_ltoa(buf + len, (int64_t)id, 10);
+  buf[len] = 0;
+  return (fio_str_info_s){.data = buf, .len = len};
+}
+
+/* *****************************************************************************
+Threads
+***************************************************************************** */
+
+static void *bench_publisher(void *id_) {
+  char buf[64];
+  uint64_t id = (uintptr_t)id_;
+  for (size_t i = 0; i < messages; ++i) {
+    fio_publish(.engine = FIO_PUBSUB_PROCESS,
+                .channel = bench_channel_name(
+                    buf, "hot-", (size_t)((id + i) % hot_channels)),
+                .message = {.data = "payload", .len = 7});
+    if (!(i & 1023))
+      fio_defer_perform();
+  }
+  fio_defer_perform();
+  return NULL;
+}
+
+static void *bench_churner(void *id_) {
+  char buf[64];
+  uint64_t id = (uintptr_t)id_;
+  size_t i = 0;
+  while (churn_active) {
+    subscription_s *s = fio_subscribe(
+        .channel = bench_channel_name(buf, "room-",
+                                      (size_t)((id << 20) | (i & 1023))),
+        .on_message = bench_on_message);
+    fio_unsubscribe(s);
+    ++i;
+    if (!(i & 255))
+      fio_defer_perform();
+  }
+  fio_atomic_add(&churn_count, i);
+  return NULL;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0,
+      "A mixed publish / subscribe stress test for the pub/sub channel "
+      "registry. Arguments:",
+      FIO_CLI_INT("-publishers -p publishing threads (4)."),
+      FIO_CLI_INT("-churners -c subscribe / unsubscribe threads (4)."),
+      FIO_CLI_INT("-messages -m messages per publishing thread (524288)."),
+      FIO_CLI_INT("-hot -n number of subscribed (hot) channels (64)."));
+  if (fio_cli_get("-p"))
+    publishers = (size_t)fio_cli_get_i("-p");
+  if (fio_cli_get("-c"))
+    churners = (size_t)fio_cli_get_i("-c");
+  if (fio_cli_get("-m"))
+    messages = (size_t)fio_cli_get_i("-m");
+  if (fio_cli_get("-n") && fio_cli_get_i("-n") > 0)
+    hot_channels = (size_t)fio_cli_get_i("-n");
+  fio_cli_end();
+
+  subscription_s **subs = malloc(sizeof(*subs) * hot_channels);
+  pthread_t *threads = malloc(sizeof(*threads) * (publishers + churners));
+  FIO_ASSERT_ALLOC(subs && threads);
+  char buf[64];
+  for (size_t i = 0; i < hot_channels; ++i) {
+    subs[i] = fio_subscribe(.channel = bench_channel_name(buf, "hot-", i),
+                            .on_message = bench_on_message);
+  }
+
+  fprintf(stderr,
+          "* %zu publishers x %zu messages, %zu churning threads, %zu hot "
+          "channels.\n",
+          publishers, messages, churners, hot_channels);
+  for (size_t i = 0; i < churners; ++i) {
+    pthread_create(threads + publishers + i, NULL, bench_churner,
+                   (void *)(uintptr_t)i);
+  }
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < publishers; ++i) {
+    pthread_create(threads + i, NULL, bench_publisher, (void *)(uintptr_t)i);
+  }
+  for (size_t i = 0; i < publishers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  uint64_t end = bench_now_ns();
+  churn_active = 0;
+  for (size_t i = 0; i < churners; ++i) {
+    pthread_join(threads[publishers + i], NULL);
+  }
+  fio_defer_perform();
+
+  double seconds = (double)(end - start) / 1000000000.0;
+  fprintf(stderr,
+          "* published %zu messages in %.3f seconds (%.0f msg/sec).\n"
+          "* delivered %zu messages, %zu subscribe / unsubscribe cycles.\n",
+          publishers * messages, seconds,
+          (double)(publishers * messages) / seconds, (size_t)delivered,
+          (size_t)churn_count);
+
+  for (size_t i = 0; i < hot_channels; ++i) {
+    fio_unsubscribe(subs[i]);
+  }
+  fio_defer_perform();
+  free(subs);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,239 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A Redis engine publishing benchmark.
+ *
+ * The benchmark runs an in-process RESP "stand-in" (answering PUBLISH, PING,
+ * SUBSCRIBE and AUTH the way Redis would), so no Redis server is required.
+ *
+ * Compare pipelined publishing to the request / response behavior using:
+ *
+ *       make test/lib/redis_pipeline
+ *       ./tmp/demo -P 1
+ */
+#define FIO_INCLUDE_LINKED_LIST
+#include <fio.h>
+#include <fio_cli.h>
+#include <fiobj.h>
+#include <redis_engine.h>
+#include <resp_parser.h>
+
+#include <stdio.h>
+#include <time.h>
+
+static size_t messages = 200000;
+static size_t burst = 1024;
+static size_t published = 0;
+static volatile size_t received = 0;
+static volatile size_t connections = 0;
+static size_t pool_size = 1;
+static uint64_t start = 0;
+static fio_pubsub_engine_s *engine;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The RESP stand-in (server side)
+***************************************************************************** */
+
+typedef struct {
+  fio_protocol_s pr;
+  resp_parser_s parser;
+  FIOBJ reply;
+  uint8_t is_name;
+  uint8_t name_len;
+  char name[16];
+  size_t buf_pos;
+  uint8_t buf[8192];
+} standin_s;
+
+#define parser2standin(p) FIO_LS_EMBD_OBJ(standin_s, parser, (p))
+
+static int resp_on_message(resp_parser_s *parser) {
+  standin_s *s = parser2standin(parser);
+  if (s->name_len == 7 && !memcmp(s->name, "PUBLISH", 7)) {
+    fiobj_str_write(s->reply, ":0\r\n", 4);
+    ++received;
+  } else if (s->name_len == 4 && !memcmp(s->name, "PING", 4)) {
+    fiobj_str_write(s->reply, "+PONG\r\n", 7);
+  } else if (s->name_len > 8 && !memcmp(s->name + s->name_len - 9,
+                                        "SUBSCRIBE", 9)) {
+    fiobj_str_write(s->reply, "*3\r\n$9\r\nsubscribe\r\n$0\r\n\r\n:1\r\n", 29);
+  } else {
+    fiobj_str_write(s->reply, "+OK\r\n", 5);
+  }
+  s->name_len = 0;
+  return 0;
+}
+static int resp_on_number(resp_parser_s *parser, int64_t num) {
+  return 0;
+  (void)parser;
+  (void)num;
+}
+static int resp_on_okay(resp_parser_s *parser) {
+  return 0;
+  (void)parser;
+}
+static int resp_on_null(resp_parser_s *parser) {
+  return 0;
+  (void)parser;
+}
+static int resp_on_start_string(resp_parser_s *parser, size_t str_len) {
+  standin_s *s = parser2standin(parser);
+  s->is_name = (s->name_len == 0);
+  return 0;
+  (void)str_len;
+}
+static int resp_on_string_chunk(resp_parser_s *parser, void *data, size_t len) {
+  standin_s *s = parser2standin(parser);
+  if (!s->is_name)
+    return 0;
+  if (len > sizeof(s->name) - s->name_len)
+    len = sizeof(s->name) - s->name_len;
+  memcpy(s->name + s->name_len, data, len);
+  s->name_len += len;
+  return 0;
+}
+static int resp_on_end_string(resp_parser_s *parser) {
+  parser2standin(parser)->is_name = 0;
+  return 0;
+}
+static int resp_on_err_msg(resp_parser_s *parser, void *data, size_t len) {
+  return 0;
+  (void)parser;
+  (void)data;
+  (void)len;
+}
+static int resp_on_start_array(resp_parser_s *parser, size_t array_len) {
+  parser2standin(parser)->name_len = 0;
+  return 0;
+  (void)array_len;
+}
+static int resp_on_parser_error(resp_parser_s *parser) {
+  FIO_LOG_ERROR("(stand-in) RESP parser error.");
+  return -1;
+  (void)parser;
+}
+
+static void standin_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  standin_s *s = (standin_s *)pr;
+  ssize_t i;
+  while ((i = fio_read(uuid, s->buf + s->buf_pos,
+                       sizeof(s->buf) - s->buf_pos)) > 0) {
+    s->buf_pos += i;
+    s->reply = fiobj_str_buf(256);
+    i = resp_parse(&s->parser, s->buf, s->buf_pos);
+    if (i)
+      memmove(s->buf, s->buf + s->buf_pos - i, i);
+    s->buf_pos = i;
+    /* replies are coalesced, the same way Redis would */
+    if (fiobj_obj2cstr(s->reply).len)
+      fiobj_send_free(uuid, s->reply);
+    else
+      fiobj_free(s->reply);
+  }
+  if (received >= messages && start) {
+    uint64_t end = bench_now_ns();
+    double seconds = (double)(end - start) / 1000000000.0;
+    fprintf(stderr,
+            "* published %zu messages in %.3f seconds (%.0f msg/sec).\n",
+            messages, seconds, (double)messages / seconds);
+    start = 0;
+    fio_stop();
+  }
+}
+
+static void standin_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  fio_free(pr);
+  (void)uuid;
+}
+
+static void standin_on_open(intptr_t uuid, void *udata) {
+  standin_s *s = fio_malloc(sizeof(*s));
+  FIO_ASSERT_ALLOC(s);
+  *s = (standin_s){
+      .pr = {.on_data = standin_on_data, .on_close = standin_on_close}};
+  fio_attach(uuid, &s->pr);
+  ++connections;
+  (void)udata;
+}
+
+/* *****************************************************************************
+The publisher (the engine under test)
+***************************************************************************** */
+
+static void bench_publish_burst(void *ignr1, void *ignr2) {
+  char buf[32];
+  memcpy(buf, "bench-", 6);
+  for (size_t i = 0; i < burst && published < messages; ++i, ++published) {
+    size_t len = 6 + fio_ltoa(buf + 6, (int64_t)(published & 15), 10);
+    fio_publish(.engine = engine, .channel = {.data = buf, .len = len},
+                .message = {.data = "payload", .len = 7});
+  }
+  if (published < messages)
+    fio_defer(bench_publish_burst, NULL, NULL);
+  (void)ignr1;
+  (void)ignr2;
+}
+
+static void bench_wait_for_connections(void *arg) {
+  static uint8_t done = 0;
+  if (done || connections < pool_size + 1)
+    return;
+  done = 1;
+  start = bench_now_ns();
+  fio_defer(bench_publish_burst, NULL, NULL);
+  (void)arg;
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0,
+      "A Redis engine publishing benchmark, using an in-process RESP stand-in. "
+      "Arguments:",
+      FIO_CLI_INT("-messages -m number of PUBLISH commands (200000)."),
+      FIO_CLI_INT("-burst -b publications per reactor cycle (1024)."),
+      FIO_CLI_INT("-pipeline -P commands in flight per connection (engine "
+                  "default)."),
+      FIO_CLI_INT("-pool -c publishing connections (1)."),
+      FIO_CLI_STRING("-port -p the stand-in's port (6399)."));
+  if (fio_cli_get("-m") && fio_cli_get_i("-m") > 0)
+    messages = (size_t)fio_cli_get_i("-m");
+  if (fio_cli_get("-b") && fio_cli_get_i("-b") > 0)
+    burst = (size_t)fio_cli_get_i("-b");
+  if (fio_cli_get("-c") && fio_cli_get_i("-c") > 0)
+    pool_size = (size_t)fio_cli_get_i("-c");
+  fio_cli_set_default("-p", "6399");
+
+  const char *port = fio_cli_get("-p");
+  if (fio_listen(.port = port, .address = "127.0.0.1",
+                 .on_open = standin_on_open) == -1) {
+    FIO_LOG_FATAL("couldn't open the RESP stand-in on port %s", port);
+    exit(-1);
+  }
+  engine = redis_engine_create(.address = {.data = (char *)"127.0.0.1"},
+                               .port = {.data = (char *)port},
+                               .pool_size = (uint8_t)pool_size,
+                               .pipeline = (uint16_t)fio_cli_get_i("-P"));
+  fprintf(stderr, "* %zu messages, %zu connection(s), pipeline %s.\n",
+          messages, pool_size,
+          fio_cli_get("-P") ? fio_cli_get("-P") : "(default)");
+  fio_cli_end();
+  fio_run_every(1, 0, bench_wait_for_connections, NULL, NULL);
+  fio_start(.threads = 1, .workers = 1);
+  redis_engine_destroy(engine);
+  return 0;
+}
@@ -0,0 +1,332 @@
+/*
+Copyright: Boaz Segev, 2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+
+/*
+ * A TLS handshake benchmark over loopback, measuring full handshakes versus
+ * resumed handshakes per second.
+ *
+ * The server is a facil.io TLS listener (self-signed certificate) running on
+ * multiple worker processes, so resumed sessions often land on a different
+ * worker than the one that issued the session. A forked OpenSSL client performs
+ * blocking handshakes (each followed by a single byte sent by the server).
+ *
+ * Use `-id` to test session ID resumption (TLS 1.2, no tickets), which is
+ * shared between workers only when compiling with `FIO_TLS_SESSION_CACHE`.
+ *
+ * Use `-storm <clients>` to measure the latency of an established connection
+ * (1 byte echo round trips) while other clients perform full handshakes.
+ * Compare with the handshake threads disabled, using:
+ *
+ *       -DFIO_TLS_HANDSHAKE_THREADS=0
+ *
+ * Add `-abort` to have the storm clients close their connections right after
+ * sending the ClientHello, closing connections while their handshake is
+ * performed (the established connection's echo is validated).
+ *
+ * Run with:
+ *
+ *       make test/lib/tls_handshake
+ *       ./tmp/demo -w 4 -n 2000
+ */
+#include <fio.h>
+#include <fio_cli.h>
+#include <fio_tls.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+static size_t handshakes = 1000;
+static size_t storm = 0;
+static uint8_t storm_abort = 0;
+static int port = 9443;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ULL) + (uint64_t)t.tv_nsec;
+}
+
+/* *****************************************************************************
+The server (sends a single byte once the handshake is complete, then echoes)
+***************************************************************************** */
+
+static void server_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  char buf[64];
+  ssize_t len;
+  while ((len = fio_read(uuid, buf, 64)) > 0)
+    fio_write(uuid, buf, (size_t)len);
+  (void)pr;
+}
+
+static void server_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  free(pr);
+  (void)uuid;
+}
+
+static void server_on_finish(void *ignr_) {
+  fio_tls_handshake_stats_s s = fio_tls_handshake_stats();
+  if (s.completed || s.rejected)
+    fprintf(stderr, "    (%d) handshake threads: %zu completed, %zu rejected\n",
+            (int)getpid(), s.completed, s.rejected);
+  (void)ignr_;
+}
+
+static void server_on_open(intptr_t uuid, void *udata) {
+  fio_protocol_s *pr = malloc(sizeof(*pr));
+  FIO_ASSERT_ALLOC(pr);
+  *pr = (fio_protocol_s){
+      .on_data = server_on_data,
+      .on_close = server_on_close,
+  };
+  fio_attach(uuid, pr);
+  fio_write(uuid, "k", 1);
+  (void)udata;
+}
+
+/* *****************************************************************************
+The client (blocking OpenSSL handshakes)
+***************************************************************************** */
+
+static int client_socket(void) {
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  for (size_t i = 0; i < 500; ++i) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+      return -1;
+    if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      return fd;
+    }
+    close(fd);
+    usleep(10000); /* the server might still be starting up */
+  }
+  return -1;
+}
+
+static void client_close(SSL *ssl) {
+  int fd = SSL_get_fd(ssl);
+  /* send close_notify, truncated connections don't leave resumable sessions */
+  SSL_shutdown(ssl);
+  SSL_free(ssl);
+  close(fd);
+}
+
+/* connects and performs a handshake (waiting for the server's byte) */
+static SSL *client_try_connect(SSL_CTX *ctx, SSL_SESSION *session) {
+  char c;
+  int fd = client_socket();
+  FIO_ASSERT(fd != -1, "couldn't connect to the server");
+  SSL *ssl = SSL_new(ctx);
+  FIO_ASSERT_ALLOC(ssl);
+  SSL_set_fd(ssl, fd);
+  if (session)
+    SSL_set_session(ssl, session);
+  if (SSL_connect(ssl) == 1 && SSL_read(ssl, &c, 1) == 1)
+    return ssl;
+  SSL_free(ssl);
+  close(fd);
+  return NULL;
+}
+
+/* sends a ClientHello and closes the connection without waiting */
+static void client_abort(SSL_CTX *ctx) {
+  int fd = client_socket();
+  FIO_ASSERT(fd != -1, "couldn't connect to the server");
+  SSL *ssl = SSL_new(ctx);
+  FIO_ASSERT_ALLOC(ssl);
+  SSL_set_fd(ssl, fd);
+  /* a zero timeout: the ClientHello is sent, the ServerHello isn't awaited */
+  struct timeval tv = {.tv_usec = 1};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  SSL_connect(ssl);
+  SSL_free(ssl);
+  close(fd);
+}
+
+static SSL *client_connect(SSL_CTX *ctx, SSL_SESSION *session) {
+  SSL *ssl = client_try_connect(ctx, session);
+  FIO_ASSERT(ssl, "TLS handshake failed");
+  return ssl;
+}
+
+/* performs `handshakes` handshakes, returns the number of resumed sessions */
+static size_t client_run(SSL_CTX *ctx, uint8_t resume, uint64_t *ns) {
+  SSL_SESSION *session = NULL;
+  size_t resumed = 0;
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < handshakes; ++i) {
+    SSL *ssl = client_connect(ctx, session);
+    resumed += SSL_session_reused(ssl);
+    if (resume) {
+      /* the latest session (TLS 1.3 tickets arrive after the handshake) */
+      SSL_SESSION_free(session);
+      session = SSL_get1_session(ssl);
+    }
+    client_close(ssl);
+  }
+  *ns = bench_now_ns() - start;
+  SSL_SESSION_free(session);
+  return resumed;
+}
+
+static void client_report(const char *name, size_t resumed, uint64_t ns) {
+  double seconds = (double)ns / 1000000000.0;
+  fprintf(stderr, "    %-10s %8.0f handshakes/sec %8.1f us/handshake "
+                  "(%zu/%zu resumed)\n",
+          name, handshakes / seconds, (seconds * 1000000) / handshakes,
+          resumed, handshakes);
+}
+
+static void client_main(uint8_t session_ids) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  FIO_ASSERT_ALLOC(ctx);
+  if (session_ids) {
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+  uint64_t ns;
+  size_t resumed;
+  fprintf(stderr, "* %zu handshakes per round (%s):\n", handshakes,
+          (session_ids ? "TLS 1.2 session IDs" : "session tickets"));
+  resumed = client_run(ctx, 0, &ns);
+  client_report("full", resumed, ns);
+  resumed = client_run(ctx, 1, &ns);
+  client_report("resumed", resumed, ns);
+  SSL_CTX_free(ctx);
+}
+
+/* *****************************************************************************
+The storm (established connection latency during full handshakes)
+***************************************************************************** */
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t a_ = *(const uint64_t *)a, b_ = *(const uint64_t *)b;
+  return (a_ > b_) - (a_ < b_);
+}
+
+static void storm_main(void) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  FIO_ASSERT_ALLOC(ctx);
+  SSL *ssl = client_connect(ctx, NULL);
+  pid_t *clients = calloc(storm, sizeof(*clients));
+  uint64_t *rtt = malloc(sizeof(*rtt) * handshakes);
+  FIO_ASSERT_ALLOC(clients && rtt);
+  for (size_t i = 0; i < storm; ++i) {
+    clients[i] = fork();
+    FIO_ASSERT(clients[i] != -1, "couldn't fork a storm client");
+    if (!clients[i]) {
+      /* refused handshakes (FIO_TLS_HANDSHAKE_LIMIT) are retried */
+      for (;;) {
+        if (storm_abort) {
+          client_abort(ctx);
+          continue;
+        }
+        SSL *tmp = client_try_connect(ctx, NULL);
+        if (tmp)
+          client_close(tmp);
+      }
+    }
+  }
+  usleep(100000); /* let the storm start */
+  for (size_t i = 0; i < handshakes; ++i) {
+    char c = 'a' + (i % 26);
+    uint64_t start = bench_now_ns();
+    FIO_ASSERT(SSL_write(ssl, &c, 1) == 1 && SSL_read(ssl, &c, 1) == 1,
+               "established connection failed during the storm");
+    FIO_ASSERT(c == 'a' + (char)(i % 26), "established connection echo error");
+    rtt[i] = bench_now_ns() - start;
+    usleep(1000);
+  }
+  for (size_t i = 0; i < storm; ++i) {
+    kill(clients[i], SIGKILL);
+    waitpid(clients[i], NULL, 0);
+  }
+  qsort(rtt, handshakes, sizeof(*rtt), cmp_u64);
+  fprintf(stderr,
+          "* %zu round trips during a storm of %zu handshaking clients:\n"
+          "    p50 %8.1f us    p99 %8.1f us    max %8.1f us\n",
+          handshakes, storm, rtt[handshakes >> 1] / 1000.0,
+          rtt[(handshakes * 99) / 100] / 1000.0, rtt[handshakes - 1] / 1000.0);
+  client_close(ssl);
+  free(rtt);
+  free(clients);
+  SSL_CTX_free(ctx);
+}
+
+/* *****************************************************************************
+Main
+***************************************************************************** */
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc, argv, 0, 0, "A TLS handshake benchmark (loopback). Arguments:",
+      FIO_CLI_INT("-port -p the port to listen to (9443)."),
+      FIO_CLI_INT("-workers -w the number of server worker processes (4)."),
+      FIO_CLI_INT("-handshakes -n handshakes per round (1000)."),
+      FIO_CLI_BOOL("-id use TLS 1.2 session IDs instead of session tickets."),
+      FIO_CLI_INT("-storm -s measure latency while clients handshake (0)."),
+      FIO_CLI_BOOL("-abort storm clients close connections mid handshake."));
+  if (fio_cli_get_i("-p") > 0)
+    port = fio_cli_get_i("-p");
+  if (fio_cli_get_i("-n") > 0)
+    handshakes = (size_t)fio_cli_get_i("-n");
+  int workers = fio_cli_get("-w") ? fio_cli_get_i("-w") : 4;
+  uint8_t session_ids = (uint8_t)fio_cli_get_bool("-id");
+  if (fio_cli_get_i("-s") > 0)
+    storm = (size_t)fio_cli_get_i("-s");
+  storm_abort = (uint8_t)fio_cli_get_bool("-abort");
+
+  /* the root process creates the TLS context (and ticket keys) */
+  fio_tls_s *tls = fio_tls_new("localhost", NULL, NULL, NULL);
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  FIO_ASSERT(fio_listen(.port = port_str, .address = "127.0.0.1",
+                        .on_open = server_on_open, .tls = tls) != -1,
+             "couldn't listen on port %s", port_str);
+  fio_tls_destroy(tls);
+  fio_state_callback_add(FIO_CALL_ON_FINISH, server_on_finish, NULL);
+
+  pid_t client = fork();
+  FIO_ASSERT(client != -1, "couldn't fork the client process");
+  if (!client) {
+    if (storm)
+      storm_main();
+    else
+      client_main(session_ids);
+    kill(getppid(), SIGINT);
+    fflush(stderr);
+    _exit(0);
+  }
+  fio_start(.threads = 1, .workers = workers);
+  waitpid(client, NULL, 0);
+  fio_cli_end();
+  return 0;
+}
+
+#else
+
+int main(void) {
+  fprintf(stderr, "The TLS handshake benchmark requires OpenSSL.\n");
+  return 0;
+}
+
+#endif